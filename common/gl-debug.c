@@ -0,0 +1,204 @@
+/*
+ * GL error checking
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <assert.h>
+#include "gl-debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The state of the context current on each thread, as set by
+ * gl_debug_make_current(), or of the thread itself if there is none.
+ * Errors are counted by the callback in the state of the context it was
+ * installed for, which is the current one as output is synchronous.
+ */
+static __thread struct gl_debug *current_debug = NULL;
+static __thread struct gl_debug thread_debug = {
+   .file = "(start)",
+};
+
+static struct gl_debug *
+get_current (void)
+{
+   return current_debug != NULL ? current_debug : &thread_debug;
+}
+
+#ifndef NDEBUG
+
+static const char *
+source_to_string (GLenum source)
+{
+   switch (source) {
+   case GL_DEBUG_SOURCE_API_KHR: return "API";
+   case GL_DEBUG_SOURCE_WINDOW_SYSTEM_KHR: return "window system";
+   case GL_DEBUG_SOURCE_SHADER_COMPILER_KHR: return "shader compiler";
+   case GL_DEBUG_SOURCE_THIRD_PARTY_KHR: return "third party";
+   case GL_DEBUG_SOURCE_APPLICATION_KHR: return "application";
+   default: return "other";
+   }
+}
+
+static const char *
+type_to_string (GLenum type)
+{
+   switch (type) {
+   case GL_DEBUG_TYPE_ERROR_KHR: return "error";
+   case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR_KHR: return "deprecated behavior";
+   case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR_KHR: return "undefined behavior";
+   case GL_DEBUG_TYPE_PORTABILITY_KHR: return "portability";
+   case GL_DEBUG_TYPE_PERFORMANCE_KHR: return "performance";
+   default: return "other";
+   }
+}
+
+static void GL_APIENTRY
+debug_callback (GLenum source,
+                GLenum type,
+                GLuint id,
+                GLenum severity,
+                GLsizei length,
+                const GLchar *message,
+                const void *user_data)
+{
+   if (severity == GL_DEBUG_SEVERITY_NOTIFICATION_KHR)
+      return;
+
+   struct gl_debug *debug = (struct gl_debug *) user_data;
+
+   if (type == GL_DEBUG_TYPE_ERROR_KHR)
+      debug->errors++;
+
+   /* Output is synchronous, so a breakpoint here shows the faulting call. */
+   printf ("GL %s (%s, id %u): %s [after %s:%d %s]\n",
+           type_to_string (type),
+           source_to_string (source),
+           id,
+           message,
+           debug->file,
+           debug->line,
+           debug->func != NULL ? debug->func : "");
+}
+
+#endif /* NDEBUG */
+
+/* public API */
+
+bool
+gl_debug_init (struct gl_debug *debug, GlGetProcAddress get_proc_address)
+{
+   assert (debug != NULL);
+
+   memset (debug, 0x00, sizeof (struct gl_debug));
+   debug->file = "(init)";
+
+   gl_debug_make_current (debug);
+
+#ifdef NDEBUG
+   return false;
+#else
+   if (get_proc_address == NULL || ! gl_has_extension ("GL_KHR_debug"))
+      return false;
+
+   PFNGLDEBUGMESSAGECALLBACKKHRPROC DebugMessageCallback =
+      (PFNGLDEBUGMESSAGECALLBACKKHRPROC)
+      get_proc_address ("glDebugMessageCallbackKHR");
+   if (DebugMessageCallback == NULL)
+      return false;
+
+   glEnable (GL_DEBUG_OUTPUT_KHR);
+   glEnable (GL_DEBUG_OUTPUT_SYNCHRONOUS_KHR);
+   DebugMessageCallback (debug_callback, debug);
+
+   /* the only glGetError() of debug builds with KHR_debug */
+   debug->callback = glGetError () == GL_NO_ERROR;
+
+   return debug->callback;
+#endif
+}
+
+void
+gl_debug_make_current (struct gl_debug *debug)
+{
+   current_debug = debug;
+}
+
+GLenum
+gl_debug_take_error (void)
+{
+   GLenum error = glGetError ();
+
+   /* the flags of other kinds of errors may be set too */
+   while (error != GL_NO_ERROR && glGetError () != GL_NO_ERROR)
+      ;
+
+   /* already counted if the KHR_debug callback reported it */
+   get_current ()->errors = 0;
+
+   return error;
+}
+
+void
+gl_debug_check (const char *file, int32_t line, const char *func)
+{
+   struct gl_debug *debug = get_current ();
+
+   if (! debug->callback) {
+      GLenum error;
+      while ((error = glGetError ()) != GL_NO_ERROR) {
+         printf ("GL error 0x%04x\n", error);
+         debug->errors++;
+      }
+   }
+
+   if (debug->errors > 0) {
+      printf ("%u GL error(s) between %s:%d (%s) and %s:%d (%s)\n",
+              debug->errors,
+              debug->file,
+              debug->line,
+              debug->func != NULL ? debug->func : "",
+              file,
+              line,
+              func);
+      fflush (stdout);
+      abort ();
+   }
+
+   debug->file = file;
+   debug->line = line;
+   debug->func = func;
+}
+
+void
+gl_debug_frame_check (const char *file, int32_t line)
+{
+#ifndef NDEBUG
+   gl_debug_check (file, line, "frame");
+#else
+   struct gl_debug *debug = get_current ();
+
+   debug->frames++;
+   if (debug->frames % GL_DEBUG_FRAME_CHECK_INTERVAL != 0)
+      return;
+
+   /* Errors are sticky until read, so one check covers all the frames
+    * since the previous one, though without telling where.
+    */
+   GLenum error;
+   while ((error = glGetError ()) != GL_NO_ERROR) {
+      printf ("GL error 0x%04x in the last %u frames (checked at %s:%d)\n",
+              error,
+              GL_DEBUG_FRAME_CHECK_INTERVAL,
+              file,
+              line);
+   }
+#endif
+}
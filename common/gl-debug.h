@@ -0,0 +1,88 @@
+/*
+ * GL error checking
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+/* GLES3 headers also declare the GLES2 API, don't include both */
+#ifndef GL_ES_VERSION_2_0
+#include <GLES2/gl2.h>
+#endif
+#include <GLES2/gl2ext.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gl-proc.h"
+
+/* glGetError() is a synchronous round trip to the driver on many
+ * implementations, so it is kept out of the command stream:
+ *
+ * - In debug builds, errors are reported through a synchronous KHR_debug
+ *   message callback, as they happen. GL_CHECK() costs no GL call then; it
+ *   only records the call site, and aborts if an error was reported since
+ *   the previous check, naming both sites. Without KHR_debug, GL_CHECK()
+ *   falls back to glGetError().
+ *
+ * - In release builds (NDEBUG), GL_CHECK() compiles to nothing, and
+ *   GL_FRAME_CHECK() calls glGetError() once every
+ *   GL_DEBUG_FRAME_CHECK_INTERVAL frames, reporting errors without
+ *   aborting.
+ */
+
+#define GL_DEBUG_FRAME_CHECK_INTERVAL 120
+
+#ifdef NDEBUG
+#define GL_CHECK() ((void) 0)
+#else
+#define GL_CHECK() gl_debug_check (__FILE__, __LINE__, __func__)
+#endif
+
+#define GL_FRAME_CHECK() gl_debug_frame_check (__FILE__, __LINE__)
+
+/* The checking state of a context, which must live as long as it. */
+struct gl_debug {
+   bool callback;
+
+   /* the last GL_CHECK(), i.e. where errors reported since happened after */
+   const char *file;
+   int32_t line;
+   const char *func;
+
+   uint32_t errors;
+   uint64_t frames;
+};
+
+/* Must be called with the GL context current, before any GL_CHECK(). Debug
+ * contexts (see GLFW_OPENGL_DEBUG_CONTEXT or EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR)
+ * get the most detailed messages. Also makes 'debug' current on the calling
+ * thread. Returns true if the KHR_debug callback was installed.
+ */
+bool     gl_debug_init         (struct gl_debug *debug,
+                                GlGetProcAddress get_proc_address);
+
+/* GL_CHECK() uses the state made current on the calling thread, which must
+ * be that of its current GL context: call this whenever another context is
+ * made current, with NULL when none is.
+ */
+void     gl_debug_make_current (struct gl_debug *debug);
+
+/* Returns the GL error raised since the previous check, if any, and
+ * clears it so that the next GL_CHECK() doesn't abort: for calls whose
+ * errors are to be expected and not bugs, like running out of memory. A
+ * GL_CHECK() right before such a call keeps real bugs from being taken.
+ */
+GLenum   gl_debug_take_error   (void);
+
+void     gl_debug_check        (const char *file,
+                                int32_t line,
+                                const char *func);
+
+void     gl_debug_frame_check  (const char *file, int32_t line);
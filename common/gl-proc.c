@@ -0,0 +1,43 @@
+/*
+ * GL entry point loading
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <GLES2/gl2.h>
+#include "gl-proc.h"
+#include <string.h>
+
+/* public API */
+
+bool
+gl_has_extension (const char *name)
+{
+   return gl_has_extension_in ((const char *) glGetString (GL_EXTENSIONS),
+                               name);
+}
+
+bool
+gl_has_extension_in (const char *extensions, const char *name)
+{
+   if (extensions == NULL)
+      return false;
+
+   size_t len = strlen (name);
+   const char *match = extensions;
+   while ((match = strstr (match, name)) != NULL) {
+      if ((match == extensions || match[-1] == ' ')
+          && (match[len] == ' ' || match[len] == '\0')) {
+         return true;
+      }
+      match += len;
+   }
+
+   return false;
+}
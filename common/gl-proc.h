@@ -0,0 +1,29 @@
+/*
+ * GL entry point loading
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+
+/* Matches eglGetProcAddress and glfwGetProcAddress, used to load extension
+ * entry points.
+ */
+typedef void (* GlProc) (void);
+typedef GlProc (* GlGetProcAddress) (const char *name);
+
+/* Whether the current context exposes extension 'name'. */
+bool     gl_has_extension    (const char *name);
+
+/* Whether space-separated extension list 'extensions' (of EGL or GL)
+ * contains 'name'.
+ */
+bool     gl_has_extension_in (const char *extensions, const char *name);
@@ -0,0 +1,488 @@
+/*
+ * GL program binary cache
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <errno.h>
+#include "gl-debug.h"
+#include "gl-program-cache.h"
+#include "now.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* same values for the GLES 3.0 and OES_get_program_binary enums */
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH GL_PROGRAM_BINARY_LENGTH_OES
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS GL_NUM_PROGRAM_BINARY_FORMATS_OES
+#endif
+
+#define CACHE_DIR_NAME "gl-program-cache"
+
+#define CACHE_FILE_MAGIC 0x42504c47 /* "GLPB" */
+#define CACHE_FILE_VERSION 1
+
+/* much more than any sane program binary, to reject corrupt headers */
+#define CACHE_MAX_BINARY_SIZE (64 * 1024 * 1024)
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+struct cache_file_header {
+   uint32_t magic;
+   uint32_t version;
+   uint64_t key;
+   uint32_t format;
+   uint32_t length;
+
+   /* of the binary, drivers don't always notice corrupt ones */
+   uint64_t checksum;
+};
+
+/* FNV-1a, including the terminating NUL so that consecutive strings can't
+ * alias each other.
+ */
+static uint64_t
+hash_string (uint64_t hash, const char *str)
+{
+   if (str == NULL)
+      str = "";
+
+   do {
+      hash ^= (uint8_t) *str;
+      hash *= FNV_PRIME;
+   } while (*str++ != '\0');
+
+   return hash;
+}
+
+static uint64_t
+hash_u32 (uint64_t hash, uint32_t value)
+{
+   for (uint32_t i = 0; i < 4; i++) {
+      hash ^= (value >> (i * 8)) & 0xff;
+      hash *= FNV_PRIME;
+   }
+
+   return hash;
+}
+
+static uint64_t
+hash_data (const void *data, size_t size)
+{
+   const uint8_t *bytes = data;
+   uint64_t hash = FNV_OFFSET_BASIS;
+
+   for (size_t i = 0; i < size; i++) {
+      hash ^= bytes[i];
+      hash *= FNV_PRIME;
+   }
+
+   return hash;
+}
+
+/* Like 'mkdir -p'. */
+static bool
+make_dirs (const char *path)
+{
+   char *tmp = strdup (path);
+   assert (tmp != NULL);
+
+   bool ok = true;
+   for (char *p = tmp + 1; ok; p++) {
+      if (*p != '/' && *p != '\0')
+         continue;
+
+      bool last = *p == '\0';
+      *p = '\0';
+      if (mkdir (tmp, 0755) != 0 && errno != EEXIST)
+         ok = false;
+
+      if (last)
+         break;
+      *p = '/';
+   }
+
+   free (tmp);
+
+   return ok;
+}
+
+static char *
+default_dir (void)
+{
+   const char *base = getenv ("XDG_CACHE_HOME");
+   const char *suffix = "";
+
+   if (base == NULL || base[0] == '\0') {
+      base = getenv ("HOME");
+      suffix = "/.cache";
+   }
+   if (base == NULL || base[0] == '\0')
+      return NULL;
+
+   size_t len = strlen (base) + strlen (suffix) + strlen (CACHE_DIR_NAME) + 2;
+   char *dir = malloc (len);
+   assert (dir != NULL);
+   snprintf (dir, len, "%s%s/%s", base, suffix, CACHE_DIR_NAME);
+
+   return dir;
+}
+
+static char *
+cache_filename (struct gl_program_cache *cache, uint64_t key)
+{
+   size_t len = strlen (cache->dir) + 1 + 16 + 4 + 1;
+   char *filename = malloc (len);
+   assert (filename != NULL);
+
+   snprintf (filename, len, "%s/%016llx.bin",
+             cache->dir, (unsigned long long) key);
+
+   return filename;
+}
+
+static bool
+print_shader_log (GLuint shader)
+{
+   GLint length;
+   char buffer[4096] = {0};
+   GLint success;
+
+   glGetShaderiv (shader, GL_INFO_LOG_LENGTH, &length);
+   if (length > 0) {
+      glGetShaderInfoLog (shader, sizeof (buffer), NULL, buffer);
+      if (strlen (buffer) > 0)
+         printf ("Shader compilation log: %s\n", buffer);
+   }
+
+   glGetShaderiv (shader, GL_COMPILE_STATUS, &success);
+
+   return success == GL_TRUE;
+}
+
+static bool
+print_program_log (GLuint program)
+{
+   GLint length;
+   char buffer[4096] = {0};
+   GLint success;
+
+   glGetProgramiv (program, GL_INFO_LOG_LENGTH, &length);
+   if (length > 0) {
+      glGetProgramInfoLog (program, sizeof (buffer), NULL, buffer);
+      if (strlen (buffer) > 0)
+         printf ("Program link log: %s\n", buffer);
+   }
+
+   glGetProgramiv (program, GL_LINK_STATUS, &success);
+
+   return success == GL_TRUE;
+}
+
+static GLuint
+build_program (const char *const *sources,
+               const GLenum *types,
+               uint32_t num_shaders,
+               const char *const *attribs,
+               uint32_t num_attribs)
+{
+   GLuint program = glCreateProgram ();
+   bool ok = true;
+
+   for (uint32_t i = 0; i < num_shaders; i++) {
+      GLuint shader = glCreateShader (types[i]);
+
+      glShaderSource (shader, 1, &sources[i], NULL);
+      glCompileShader (shader);
+      if (! print_shader_log (shader))
+         ok = false;
+
+      glAttachShader (program, shader);
+
+      /* only actually deleted when the program is */
+      glDeleteShader (shader);
+   }
+
+   for (uint32_t i = 0; i < num_attribs; i++) {
+      if (attribs[i] != NULL)
+         glBindAttribLocation (program, i, attribs[i]);
+   }
+
+   if (ok) {
+      glLinkProgram (program);
+      ok = print_program_log (program);
+   }
+
+   if (! ok) {
+      glDeleteProgram (program);
+      return 0;
+   }
+
+   return program;
+}
+
+/* Returns a program created from the binary stored under 'key', or 0. */
+static GLuint
+load_program (struct gl_program_cache *cache, uint64_t key)
+{
+   char *filename = cache_filename (cache, key);
+   FILE *file_obj = fopen (filename, "rb");
+   free (filename);
+
+   if (file_obj == NULL)
+      return 0;
+
+   GLuint program = 0;
+   void *binary = NULL;
+   struct cache_file_header header;
+
+   if (fread (&header, sizeof (header), 1, file_obj) != 1
+       || header.magic != CACHE_FILE_MAGIC
+       || header.version != CACHE_FILE_VERSION
+       || header.key != key
+       || header.length == 0
+       || header.length > CACHE_MAX_BINARY_SIZE) {
+      goto out;
+   }
+
+   /* the file must hold the binary the header describes, and nothing else */
+   struct stat st;
+   if (fstat (fileno (file_obj), &st) != 0
+       || (uint64_t) st.st_size != sizeof (header) + (uint64_t) header.length) {
+      goto out;
+   }
+
+   binary = malloc (header.length);
+   assert (binary != NULL);
+   if (fread (binary, header.length, 1, file_obj) != 1
+       || hash_data (binary, header.length) != header.checksum) {
+      goto out;
+   }
+
+   program = glCreateProgram ();
+   GL_CHECK ();
+   cache->ProgramBinary (program, header.format, binary, header.length);
+
+   /* Drivers reject binaries they can't use anymore, e.g. after an update
+    * that didn't change the version string.
+    */
+   GLint success;
+   glGetProgramiv (program, GL_LINK_STATUS, &success);
+   if (gl_debug_take_error () != GL_NO_ERROR || success != GL_TRUE) {
+      glDeleteProgram (program);
+      program = 0;
+   }
+
+ out:
+   free (binary);
+   fclose (file_obj);
+
+   return program;
+}
+
+static void
+store_program (struct gl_program_cache *cache, uint64_t key, GLuint program)
+{
+   GLint length = 0;
+   glGetProgramiv (program, GL_PROGRAM_BINARY_LENGTH, &length);
+   if (length <= 0 || length > CACHE_MAX_BINARY_SIZE)
+      return;
+
+   void *binary = malloc (length);
+   assert (binary != NULL);
+
+   GLenum format;
+   GLsizei written = 0;
+   GL_CHECK ();
+   cache->GetProgramBinary (program, length, &written, &format, binary);
+   if (gl_debug_take_error () != GL_NO_ERROR || written <= 0) {
+      free (binary);
+      return;
+   }
+
+   struct cache_file_header header = {
+      .magic = CACHE_FILE_MAGIC,
+      .version = CACHE_FILE_VERSION,
+      .key = key,
+      .format = format,
+      .length = written,
+      .checksum = hash_data (binary, written),
+   };
+
+   /* Write to a temporary file first, so that concurrent runs never see a
+    * partial binary. Caches of contexts on other threads of this process
+    * may store the same program at the same time, hence the cache's address.
+    */
+   char *filename = cache_filename (cache, key);
+   size_t tmp_len = strlen (filename) + 48;
+   char *tmp_filename = malloc (tmp_len);
+   assert (tmp_filename != NULL);
+   snprintf (tmp_filename, tmp_len, "%s.%d.%p",
+             filename, (int) getpid (), (void *) cache);
+
+   FILE *file_obj = fopen (tmp_filename, "wb");
+   if (file_obj != NULL) {
+      bool ok = fwrite (&header, sizeof (header), 1, file_obj) == 1
+         && fwrite (binary, written, 1, file_obj) == 1;
+      ok = fclose (file_obj) == 0 && ok;
+
+      if (! ok || rename (tmp_filename, filename) != 0) {
+         printf ("Failed to store program binary in %s\n", filename);
+         unlink (tmp_filename);
+      }
+   }
+
+   free (tmp_filename);
+   free (filename);
+   free (binary);
+}
+
+/* public API */
+
+bool
+gl_program_cache_init (struct gl_program_cache *cache,
+                       const char *dir,
+                       GlGetProcAddress get_proc_address)
+{
+   assert (cache != NULL);
+
+   memset (cache, 0x00, sizeof (struct gl_program_cache));
+
+   uint64_t hash = FNV_OFFSET_BASIS;
+   hash = hash_string (hash, (const char *) glGetString (GL_VENDOR));
+   hash = hash_string (hash, (const char *) glGetString (GL_RENDERER));
+   hash = hash_string (hash, (const char *) glGetString (GL_VERSION));
+   cache->driver_hash = hash;
+
+   GLint num_formats = 0;
+   GL_CHECK ();
+   glGetIntegerv (GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+   if (gl_debug_take_error () != GL_NO_ERROR || num_formats <= 0)
+      return false;
+
+   /* Core since GLES 3.0, "OpenGL ES 3.x ..." in the version string. */
+   const char *version = (const char *) glGetString (GL_VERSION);
+   int32_t major = 0;
+   if (version != NULL)
+      sscanf (version, "OpenGL ES %d", &major);
+
+   if (major >= 3) {
+      cache->GetProgramBinary = (PFNGLGETPROGRAMBINARYOESPROC)
+         get_proc_address ("glGetProgramBinary");
+      cache->ProgramBinary = (PFNGLPROGRAMBINARYOESPROC)
+         get_proc_address ("glProgramBinary");
+   } else if (gl_has_extension ("GL_OES_get_program_binary")) {
+      cache->GetProgramBinary = (PFNGLGETPROGRAMBINARYOESPROC)
+         get_proc_address ("glGetProgramBinaryOES");
+      cache->ProgramBinary = (PFNGLPROGRAMBINARYOESPROC)
+         get_proc_address ("glProgramBinaryOES");
+   }
+
+   if (cache->GetProgramBinary == NULL || cache->ProgramBinary == NULL) {
+      cache->GetProgramBinary = NULL;
+      cache->ProgramBinary = NULL;
+      return false;
+   }
+
+   cache->dir = dir != NULL ? strdup (dir) : default_dir ();
+   if (cache->dir == NULL || ! make_dirs (cache->dir)) {
+      printf ("Program cache directory not usable, caching disabled\n");
+      free (cache->dir);
+      cache->dir = NULL;
+      return false;
+   }
+
+   return true;
+}
+
+void
+gl_program_cache_finish (struct gl_program_cache *cache)
+{
+   assert (cache != NULL);
+
+   free (cache->dir);
+   cache->dir = NULL;
+}
+
+GLuint
+gl_program_cache_get_program (struct gl_program_cache *cache,
+                              const char *const *sources,
+                              const GLenum *types,
+                              uint32_t num_shaders,
+                              const char *const *attribs,
+                              uint32_t num_attribs)
+{
+   assert (cache != NULL);
+   assert (sources != NULL && types != NULL && num_shaders > 0);
+   assert (attribs != NULL || num_attribs == 0);
+
+   double start = now_ms ();
+   bool enabled = cache->dir != NULL;
+
+   uint64_t key = cache->driver_hash;
+   for (uint32_t i = 0; i < num_shaders; i++) {
+      key = hash_u32 (key, types[i]);
+      key = hash_string (key, sources[i]);
+   }
+   for (uint32_t i = 0; i < num_attribs; i++)
+      key = hash_string (key, attribs[i]);
+
+   if (enabled) {
+      GLuint program = load_program (cache, key);
+      if (program != 0) {
+         cache->hits++;
+         cache->load_ms += now_ms () - start;
+         return program;
+      }
+   }
+
+   GLuint program = build_program (sources,
+                                   types,
+                                   num_shaders,
+                                   attribs,
+                                   num_attribs);
+
+   if (enabled && program != 0) {
+      cache->misses++;
+      store_program (cache, key, program);
+   }
+
+   cache->build_ms += now_ms () - start;
+
+   return program;
+}
+
+void
+gl_program_cache_print_stats (struct gl_program_cache *cache)
+{
+   assert (cache != NULL);
+
+   if (cache->dir == NULL) {
+      printf ("Program cache: disabled, %.2f ms building from source\n",
+              cache->build_ms);
+      return;
+   }
+
+   printf ("Program cache (%s): %u hits in %.2f ms, "
+           "%u misses in %.2f ms\n",
+           cache->dir,
+           cache->hits,
+           cache->load_ms,
+           cache->misses,
+           cache->build_ms);
+}
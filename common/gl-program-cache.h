@@ -0,0 +1,71 @@
+/*
+ * GL program binary cache
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+/* GLES3 headers also declare the GLES2 API, don't include both */
+#ifndef GL_ES_VERSION_2_0
+#include <GLES2/gl2.h>
+#endif
+#include <GLES2/gl2ext.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gl-proc.h"
+
+/* Keeps linked GL programs on disk, as returned by glGetProgramBinary()
+ * (GLES 3.0, or GL_OES_get_program_binary on GLES 2.0), so that later runs
+ * can skip compiling and linking GLSL. Binaries are keyed by a hash of the
+ * shader sources, the attribute bindings, and the GL vendor, renderer and
+ * version strings, so a driver update or a GPU change is a cache miss. Any
+ * failure to load a binary falls back to building from source.
+ */
+
+struct gl_program_cache {
+   char *dir;
+   uint64_t driver_hash;
+
+   /* NULL if program binaries are not supported */
+   PFNGLGETPROGRAMBINARYOESPROC GetProgramBinary;
+   PFNGLPROGRAMBINARYOESPROC ProgramBinary;
+
+   /* statistics */
+   uint32_t hits;
+   uint32_t misses;
+   double load_ms;
+   double build_ms;
+};
+
+/* Must be called with the GL context current. 'dir' of NULL uses
+ * $XDG_CACHE_HOME/gl-program-cache, or ~/.cache/gl-program-cache. Returns
+ * false if binaries can't be cached, in which case
+ * gl_program_cache_get_program() still works but always builds from source.
+ */
+bool     gl_program_cache_init        (struct gl_program_cache *cache,
+                                       const char *dir,
+                                       GlGetProcAddress get_proc_address);
+
+void     gl_program_cache_finish      (struct gl_program_cache *cache);
+
+/* Returns a linked program made of 'num_shaders' shaders, each of type
+ * types[i] with GLSL source sources[i], and with attribute i bound to
+ * attribs[i] for each of the 'num_attribs' attributes. Returns 0 if the
+ * program fails to build.
+ */
+GLuint   gl_program_cache_get_program (struct gl_program_cache *cache,
+                                       const char *const *sources,
+                                       const GLenum *types,
+                                       uint32_t num_shaders,
+                                       const char *const *attribs,
+                                       uint32_t num_attribs);
+
+void     gl_program_cache_print_stats (struct gl_program_cache *cache);
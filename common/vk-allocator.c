@@ -0,0 +1,480 @@
+/*
+ * Vulkan host allocator with per-scope statistics
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vk-allocator.h"
+
+#define DEFAULT_ARENA_SIZE (256 * 1024)
+
+/* Pool slots and chunks are aligned to the smallest slot, and start with
+ * the header, so that the memory after it is aligned to HEADER_SIZE.
+ */
+#define MIN_SLOT_SIZE 64
+#define CHUNK_SIZE (64 * 1024)
+
+/* The minimum alignment of all allocations, as malloc()'s. */
+#define MIN_ALIGNMENT 16
+
+/* Right before each allocation, as pfnFree() doesn't tell its size or
+ * scope.
+ */
+#define HEADER_SIZE 32
+
+enum block_kind {
+   BLOCK_HEAP,
+   BLOCK_POOL,
+   BLOCK_ARENA,
+};
+
+struct block_header {
+   size_t size;
+   /* what malloc() returned, for heap blocks */
+   void *base;
+   uint8_t scope;
+   uint8_t kind;
+   uint8_t pool_class;
+};
+
+static const char *SCOPE_NAMES[VK_ALLOCATOR_SCOPE_COUNT] = {
+   "command",
+   "object",
+   "cache",
+   "device",
+   "instance",
+};
+
+static size_t
+align_up (size_t value, size_t alignment)
+{
+   return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static struct block_header *
+block_header (void *memory)
+{
+   return (struct block_header *) ((uint8_t *) memory - HEADER_SIZE);
+}
+
+static void *
+heap_alloc (struct vk_allocator *allocator, size_t size, size_t alignment)
+{
+   uint8_t *base = malloc (HEADER_SIZE + size + alignment - 1);
+   if (base == NULL)
+      return NULL;
+
+   uint8_t *memory =
+      (uint8_t *) align_up ((uintptr_t) base + HEADER_SIZE, alignment);
+   struct block_header *header = block_header (memory);
+   header->kind = BLOCK_HEAP;
+   header->base = base;
+
+   allocator->heap_allocations++;
+
+   return memory;
+}
+
+static void *
+pool_alloc (struct vk_allocator *allocator, size_t size, size_t alignment)
+{
+   if (alignment > HEADER_SIZE)
+      return NULL;
+
+   uint32_t class = 0;
+   while (class < VK_ALLOCATOR_POOL_CLASSES
+          && allocator->pools[class].slot_size < HEADER_SIZE + size) {
+      class++;
+   }
+   if (class == VK_ALLOCATOR_POOL_CLASSES)
+      return NULL;
+
+   struct vk_allocator_pool *pool = &allocator->pools[class];
+
+   /* carve a new chunk into slots, its first one keeping the chunk list */
+   if (pool->free_slots == NULL) {
+      void *chunk;
+      if (posix_memalign (&chunk, MIN_SLOT_SIZE, CHUNK_SIZE) != 0)
+         return NULL;
+
+      * (void **) chunk = pool->chunks;
+      pool->chunks = chunk;
+
+      for (size_t offset = CHUNK_SIZE - pool->slot_size;
+           offset >= pool->slot_size;
+           offset -= pool->slot_size) {
+         void *slot = (uint8_t *) chunk + offset;
+         * (void **) slot = pool->free_slots;
+         pool->free_slots = slot;
+      }
+   }
+
+   void *slot = pool->free_slots;
+   pool->free_slots = * (void **) slot;
+   pool->allocations++;
+
+   uint8_t *memory = (uint8_t *) slot + HEADER_SIZE;
+   struct block_header *header = block_header (memory);
+   header->kind = BLOCK_POOL;
+   header->pool_class = class;
+
+   return memory;
+}
+
+static void *
+arena_alloc (struct vk_allocator *allocator, size_t size, size_t alignment)
+{
+   uintptr_t start = (uintptr_t) allocator->arena + allocator->arena_offset;
+   size_t offset = align_up (start + HEADER_SIZE, alignment)
+      - (uintptr_t) allocator->arena;
+   if (offset + size > allocator->arena_size)
+      return NULL;
+
+   allocator->arena_offset = offset + size;
+   if (allocator->arena_offset > allocator->arena_peak)
+      allocator->arena_peak = allocator->arena_offset;
+   allocator->arena_count++;
+   allocator->arena_allocations++;
+
+   uint8_t *memory = allocator->arena + offset;
+   block_header (memory)->kind = BLOCK_ARENA;
+
+   return memory;
+}
+
+static void
+block_free (struct vk_allocator *allocator, void *memory)
+{
+   struct block_header *header = block_header (memory);
+   struct vk_allocator_stats *stats = &allocator->stats[header->scope];
+
+   stats->frees++;
+   stats->count--;
+   stats->bytes -= header->size;
+
+   switch (header->kind) {
+   case BLOCK_POOL: {
+      struct vk_allocator_pool *pool = &allocator->pools[header->pool_class];
+      void *slot = (uint8_t *) memory - HEADER_SIZE;
+      * (void **) slot = pool->free_slots;
+      pool->free_slots = slot;
+      break;
+   }
+
+   case BLOCK_ARENA:
+      /* its blocks are freed in any order, so only all at once */
+      assert (allocator->arena_count > 0);
+      if (--allocator->arena_count == 0)
+         allocator->arena_offset = 0;
+      break;
+
+   case BLOCK_HEAP:
+   default:
+      free (header->base);
+      break;
+   }
+}
+
+static void *
+block_alloc (struct vk_allocator *allocator,
+             size_t size,
+             size_t alignment,
+             VkSystemAllocationScope scope)
+{
+   assert (scope < VK_ALLOCATOR_SCOPE_COUNT);
+
+   if (alignment < MIN_ALIGNMENT)
+      alignment = MIN_ALIGNMENT;
+
+   void *memory = NULL;
+   switch (scope) {
+   case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND:
+      memory = arena_alloc (allocator, size, alignment);
+      if (memory == NULL)
+         memory = pool_alloc (allocator, size, alignment);
+      break;
+
+   case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT:
+      memory = pool_alloc (allocator, size, alignment);
+      break;
+
+   default:
+      break;
+   }
+   if (memory == NULL)
+      memory = heap_alloc (allocator, size, alignment);
+   if (memory == NULL)
+      return NULL;
+
+   struct block_header *header = block_header (memory);
+   header->size = size;
+   header->scope = scope;
+
+   struct vk_allocator_stats *stats = &allocator->stats[scope];
+   stats->allocations++;
+   if (allocator->frames > 0)
+      allocator->pending_frame_allocations[scope]++;
+   stats->count++;
+   stats->bytes += size;
+   if (stats->count > stats->peak_count)
+      stats->peak_count = stats->count;
+   if (stats->bytes > stats->peak_bytes)
+      stats->peak_bytes = stats->bytes;
+
+   return memory;
+}
+
+/* callbacks */
+
+static void *
+allocation_cb (void *user_data,
+               size_t size,
+               size_t alignment,
+               VkSystemAllocationScope scope)
+{
+   struct vk_allocator *allocator = user_data;
+
+   if (size == 0)
+      return NULL;
+
+   pthread_mutex_lock (&allocator->mutex);
+   void *memory = block_alloc (allocator, size, alignment, scope);
+   pthread_mutex_unlock (&allocator->mutex);
+
+   return memory;
+}
+
+static void *
+reallocation_cb (void *user_data,
+                 void *original,
+                 size_t size,
+                 size_t alignment,
+                 VkSystemAllocationScope scope)
+{
+   struct vk_allocator *allocator = user_data;
+   void *memory = NULL;
+
+   pthread_mutex_lock (&allocator->mutex);
+
+   if (original == NULL) {
+      if (size > 0)
+         memory = block_alloc (allocator, size, alignment, scope);
+   } else if (size == 0) {
+      block_free (allocator, original);
+   } else {
+      /* on failure, the original must stay valid */
+      memory = block_alloc (allocator, size, alignment, scope);
+      if (memory != NULL) {
+         size_t old_size = block_header (original)->size;
+         memcpy (memory, original, old_size < size ? old_size : size);
+         block_free (allocator, original);
+      }
+   }
+
+   pthread_mutex_unlock (&allocator->mutex);
+
+   return memory;
+}
+
+static void
+free_cb (void *user_data, void *memory)
+{
+   struct vk_allocator *allocator = user_data;
+
+   if (memory == NULL)
+      return;
+
+   pthread_mutex_lock (&allocator->mutex);
+   block_free (allocator, memory);
+   pthread_mutex_unlock (&allocator->mutex);
+}
+
+static void
+internal_allocation_cb (void *user_data,
+                        size_t size,
+                        VkInternalAllocationType type,
+                        VkSystemAllocationScope scope)
+{
+   struct vk_allocator *allocator = user_data;
+   assert (scope < VK_ALLOCATOR_SCOPE_COUNT);
+
+   pthread_mutex_lock (&allocator->mutex);
+   struct vk_allocator_stats *stats = &allocator->stats[scope];
+   stats->internal_bytes += size;
+   if (stats->internal_bytes > stats->peak_internal_bytes)
+      stats->peak_internal_bytes = stats->internal_bytes;
+   pthread_mutex_unlock (&allocator->mutex);
+}
+
+static void
+internal_free_cb (void *user_data,
+                  size_t size,
+                  VkInternalAllocationType type,
+                  VkSystemAllocationScope scope)
+{
+   struct vk_allocator *allocator = user_data;
+   assert (scope < VK_ALLOCATOR_SCOPE_COUNT);
+
+   pthread_mutex_lock (&allocator->mutex);
+   allocator->stats[scope].internal_bytes -= size;
+   pthread_mutex_unlock (&allocator->mutex);
+}
+
+/* public API */
+
+bool
+vk_allocator_init (struct vk_allocator *allocator, size_t arena_size)
+{
+   assert (allocator != NULL);
+   assert (sizeof (struct block_header) <= HEADER_SIZE);
+
+   memset (allocator, 0x00, sizeof (struct vk_allocator));
+
+   allocator->arena_size = arena_size > 0 ? arena_size : DEFAULT_ARENA_SIZE;
+   allocator->arena = malloc (allocator->arena_size);
+   if (allocator->arena == NULL) {
+      printf ("Error: Failed to allocate a %zu bytes arena\n",
+              allocator->arena_size);
+      return false;
+   }
+
+   for (uint32_t i = 0; i < VK_ALLOCATOR_POOL_CLASSES; i++)
+      allocator->pools[i].slot_size = (size_t) MIN_SLOT_SIZE << i;
+
+   pthread_mutex_init (&allocator->mutex, NULL);
+
+   allocator->callbacks = (VkAllocationCallbacks) {
+      .pUserData = allocator,
+      .pfnAllocation = allocation_cb,
+      .pfnReallocation = reallocation_cb,
+      .pfnFree = free_cb,
+      .pfnInternalAllocation = internal_allocation_cb,
+      .pfnInternalFree = internal_free_cb,
+   };
+
+   return true;
+}
+
+void
+vk_allocator_finish (struct vk_allocator *allocator)
+{
+   assert (allocator != NULL);
+
+   for (uint32_t i = 0; i < VK_ALLOCATOR_SCOPE_COUNT; i++) {
+      if (allocator->stats[i].count > 0) {
+         printf ("Warning: %llu %s scope allocation(s) not freed\n",
+                 (unsigned long long) allocator->stats[i].count,
+                 SCOPE_NAMES[i]);
+      }
+   }
+
+   for (uint32_t i = 0; i < VK_ALLOCATOR_POOL_CLASSES; i++) {
+      void *chunk = allocator->pools[i].chunks;
+      while (chunk != NULL) {
+         void *next = * (void **) chunk;
+         free (chunk);
+         chunk = next;
+      }
+   }
+
+   free (allocator->arena);
+   pthread_mutex_destroy (&allocator->mutex);
+   memset (allocator, 0x00, sizeof (struct vk_allocator));
+}
+
+void
+vk_allocator_end_frame (struct vk_allocator *allocator)
+{
+   assert (allocator != NULL);
+
+   pthread_mutex_lock (&allocator->mutex);
+
+   /* only now that the frame is complete, so that teardown after the last
+    * one is left out
+    */
+   for (uint32_t i = 0; i < VK_ALLOCATOR_SCOPE_COUNT; i++) {
+      allocator->stats[i].frame_allocations +=
+         allocator->pending_frame_allocations[i];
+      allocator->pending_frame_allocations[i] = 0;
+   }
+   allocator->frames++;
+
+   pthread_mutex_unlock (&allocator->mutex);
+}
+
+void
+vk_allocator_get_stats (struct vk_allocator *allocator,
+                        VkSystemAllocationScope scope,
+                        struct vk_allocator_stats *stats)
+{
+   assert (allocator != NULL);
+   assert (scope < VK_ALLOCATOR_SCOPE_COUNT);
+   assert (stats != NULL);
+
+   pthread_mutex_lock (&allocator->mutex);
+   *stats = allocator->stats[scope];
+   pthread_mutex_unlock (&allocator->mutex);
+}
+
+void
+vk_allocator_print_stats (struct vk_allocator *allocator)
+{
+   assert (allocator != NULL);
+
+   pthread_mutex_lock (&allocator->mutex);
+
+   /* the allocations per frame are those between the first and the last
+    * vk_allocator_end_frame()
+    */
+   uint64_t frames = allocator->frames > 1 ? allocator->frames - 1 : 0;
+
+   printf ("Host allocations per scope:\n");
+   printf ("   %-9s %9s %7s %11s %7s %11s %9s %11s\n",
+           "scope", "allocs", "live", "live bytes", "peak", "peak bytes",
+           "per frame", "internal");
+   for (uint32_t i = 0; i < VK_ALLOCATOR_SCOPE_COUNT; i++) {
+      const struct vk_allocator_stats *stats = &allocator->stats[i];
+      char per_frame[16] = "-";
+
+      if (frames > 0) {
+         snprintf (per_frame, sizeof (per_frame), "%.1f",
+                   (double) stats->frame_allocations / frames);
+      }
+
+      printf ("   %-9s %9llu %7llu %11llu %7llu %11llu %9s %11llu\n",
+              SCOPE_NAMES[i],
+              (unsigned long long) stats->allocations,
+              (unsigned long long) stats->count,
+              (unsigned long long) stats->bytes,
+              (unsigned long long) stats->peak_count,
+              (unsigned long long) stats->peak_bytes,
+              per_frame,
+              (unsigned long long) stats->peak_internal_bytes);
+   }
+
+   uint64_t pool_allocations = 0;
+   for (uint32_t i = 0; i < VK_ALLOCATOR_POOL_CLASSES; i++)
+      pool_allocations += allocator->pools[i].allocations;
+
+   printf ("   from the arena: %llu (peak %zu of %zu bytes), "
+           "the pools: %llu, the heap: %llu\n",
+           (unsigned long long) allocator->arena_allocations,
+           allocator->arena_peak,
+           allocator->arena_size,
+           (unsigned long long) pool_allocations,
+           (unsigned long long) allocator->heap_allocations);
+
+   pthread_mutex_unlock (&allocator->mutex);
+}
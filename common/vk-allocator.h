@@ -0,0 +1,116 @@
+/*
+ * Vulkan host allocator with per-scope statistics
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+/* VkAllocationCallbacks that serve the driver's host allocations according
+ * to their VkSystemAllocationScope:
+ *
+ *  - COMMAND: allocations freed before the Vulkan command returns, from a
+ *    linear arena that is rewound whenever it's empty, which is at least
+ *    once per frame;
+ *  - OBJECT: allocations as long-lived as a Vulkan object, from pools of a
+ *    few sizes with free lists;
+ *  - CACHE, DEVICE and INSTANCE: from the heap.
+ *
+ * Whatever doesn't fit its arena or pool, or needs a larger alignment,
+ * falls back to the heap. Callbacks may be called from the driver's
+ * threads, so all of it is under a mutex.
+ */
+
+#define VK_ALLOCATOR_SCOPE_COUNT (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+
+/* slots of 64, 128... 2048 bytes, headers included */
+#define VK_ALLOCATOR_POOL_CLASSES 6
+
+struct vk_allocator_stats {
+   /* reallocations count as an allocation and a free */
+   uint64_t allocations;
+   uint64_t frees;
+
+   /* live, and the most ever live */
+   uint64_t count;
+   uint64_t bytes;
+   uint64_t peak_count;
+   uint64_t peak_bytes;
+
+   /* made between the first and the last vk_allocator_end_frame() */
+   uint64_t frame_allocations;
+
+   /* the driver's own, notified through pfnInternalAllocation */
+   uint64_t internal_bytes;
+   uint64_t peak_internal_bytes;
+};
+
+struct vk_allocator_pool {
+   size_t slot_size;
+   /* free slots, linked through their first bytes */
+   void *free_slots;
+   /* chunks the slots are carved from, linked the same way */
+   void *chunks;
+
+   uint64_t allocations;
+};
+
+struct vk_allocator {
+   /* what to pass to Vulkan */
+   VkAllocationCallbacks callbacks;
+
+   pthread_mutex_t mutex;
+
+   struct vk_allocator_stats stats[VK_ALLOCATOR_SCOPE_COUNT];
+
+   struct vk_allocator_pool pools[VK_ALLOCATOR_POOL_CLASSES];
+
+   uint8_t *arena;
+   size_t arena_size;
+   size_t arena_offset;
+   uint32_t arena_count;
+   size_t arena_peak;
+   uint64_t arena_allocations;
+
+   uint64_t heap_allocations;
+
+   uint64_t frames;
+   /* of the frame in progress, added to the stats when it ends */
+   uint64_t pending_frame_allocations[VK_ALLOCATOR_SCOPE_COUNT];
+};
+
+/* 'arena_size' of 0 uses a default of 256 KiB. */
+bool     vk_allocator_init        (struct vk_allocator *allocator,
+                                   size_t arena_size);
+
+/* Frees the pools and the arena: everything allocated through 'allocator'
+ * must have been freed, as when the instance was destroyed.
+ */
+void     vk_allocator_finish      (struct vk_allocator *allocator);
+
+/* Marks the end of a frame, for the allocations per frame; allocations
+ * made before the first call, at startup, or after the last one, at
+ * teardown, are not counted.
+ */
+void     vk_allocator_end_frame   (struct vk_allocator *allocator);
+
+/* Copies the statistics of 'scope', consistent even while the driver is
+ * allocating from other threads.
+ */
+void     vk_allocator_get_stats   (struct vk_allocator *allocator,
+                                   VkSystemAllocationScope scope,
+                                   struct vk_allocator_stats *stats);
+
+void     vk_allocator_print_stats (struct vk_allocator *allocator);
@@ -44,6 +44,7 @@ vk_api_load_from_instance (struct vk_api* vk, VkInstance* instance)
    GET_INSTANCE_PROC_ADDR (*vk, *instance, CreateDevice);
    GET_INSTANCE_PROC_ADDR (*vk, *instance, EnumerateDeviceExtensionProperties);
    GET_INSTANCE_PROC_ADDR (*vk, *instance, GetPhysicalDeviceProperties);
+   GET_INSTANCE_PROC_ADDR (*vk, *instance, GetPhysicalDeviceMemoryProperties);
 
    GET_INSTANCE_PROC_ADDR (*vk, *instance, DestroySurfaceKHR);
    GET_INSTANCE_PROC_ADDR (*vk, *instance, GetPhysicalDeviceSurfaceSupportKHR);
@@ -78,6 +79,9 @@ vk_api_load_from_device (struct vk_api* vk, VkDevice* device)
    GET_DEVICE_PROC_ADDR (*vk, *device, DestroyDevice);
    GET_DEVICE_PROC_ADDR (*vk, *device, CreateGraphicsPipelines);
    GET_DEVICE_PROC_ADDR (*vk, *device, DestroyPipeline);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreatePipelineCache);
+   GET_DEVICE_PROC_ADDR (*vk, *device, DestroyPipelineCache);
+   GET_DEVICE_PROC_ADDR (*vk, *device, GetPipelineCacheData);
    GET_DEVICE_PROC_ADDR (*vk, *device, CreateShaderModule);
    GET_DEVICE_PROC_ADDR (*vk, *device, DestroyShaderModule);
    GET_DEVICE_PROC_ADDR (*vk, *device, CreatePipelineLayout);
@@ -94,6 +98,39 @@ vk_api_load_from_device (struct vk_api* vk, VkDevice* device)
    GET_DEVICE_PROC_ADDR (*vk, *device, QueueSubmit);
    GET_DEVICE_PROC_ADDR (*vk, *device, DeviceWaitIdle);
 
+   GET_DEVICE_PROC_ADDR (*vk, *device, QueueWaitIdle);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateFence);
+   GET_DEVICE_PROC_ADDR (*vk, *device, DestroyFence);
+   GET_DEVICE_PROC_ADDR (*vk, *device, WaitForFences);
+   GET_DEVICE_PROC_ADDR (*vk, *device, ResetFences);
+   GET_DEVICE_PROC_ADDR (*vk, *device, GetFenceStatus);
+   GET_DEVICE_PROC_ADDR (*vk, *device, ResetCommandBuffer);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateBuffer);
+   GET_DEVICE_PROC_ADDR (*vk, *device, DestroyBuffer);
+   GET_DEVICE_PROC_ADDR (*vk, *device, GetBufferMemoryRequirements);
+   GET_DEVICE_PROC_ADDR (*vk, *device, AllocateMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, FreeMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, BindBufferMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, GetImageMemoryRequirements);
+   GET_DEVICE_PROC_ADDR (*vk, *device, BindImageMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, MapMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, UnmapMemory);
+   GET_DEVICE_PROC_ADDR (*vk, *device, FlushMappedMemoryRanges);
+   GET_DEVICE_PROC_ADDR (*vk, *device, InvalidateMappedMemoryRanges);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateDescriptorSetLayout);
+   GET_DEVICE_PROC_ADDR (*vk, *device, DestroyDescriptorSetLayout);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateDescriptorPool);
+   GET_DEVICE_PROC_ADDR (*vk, *device, DestroyDescriptorPool);
+   GET_DEVICE_PROC_ADDR (*vk, *device, AllocateDescriptorSets);
+   GET_DEVICE_PROC_ADDR (*vk, *device, UpdateDescriptorSets);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CreateComputePipelines);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdBindDescriptorSets);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdPushConstants);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdDispatch);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdPipelineBarrier);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdSetViewport);
+   GET_DEVICE_PROC_ADDR (*vk, *device, CmdSetScissor);
+
    GET_DEVICE_PROC_ADDR (*vk, *device, CreateSwapchainKHR);
    GET_DEVICE_PROC_ADDR (*vk, *device, DestroySwapchainKHR);
    GET_DEVICE_PROC_ADDR (*vk, *device, GetSwapchainImagesKHR);
@@ -54,6 +54,9 @@ struct vk_api {
    PFN_vkDestroyInstance                         DestroyInstance;
    PFN_vkCreateGraphicsPipelines                 CreateGraphicsPipelines;
    PFN_vkDestroyPipeline                         DestroyPipeline;
+   PFN_vkCreatePipelineCache                     CreatePipelineCache;
+   PFN_vkDestroyPipelineCache                    DestroyPipelineCache;
+   PFN_vkGetPipelineCacheData                    GetPipelineCacheData;
    PFN_vkCreateShaderModule                      CreateShaderModule;
    PFN_vkDestroyShaderModule                     DestroyShaderModule;
    PFN_vkCreatePipelineLayout                    CreatePipelineLayout;
@@ -72,6 +75,39 @@ struct vk_api {
    PFN_vkDestroySemaphore                        DestroySemaphore;
    PFN_vkQueueSubmit                             QueueSubmit;
    PFN_vkDeviceWaitIdle                          DeviceWaitIdle;
+   PFN_vkGetPhysicalDeviceMemoryProperties       GetPhysicalDeviceMemoryProperties;
+   PFN_vkQueueWaitIdle                           QueueWaitIdle;
+   PFN_vkCreateFence                             CreateFence;
+   PFN_vkDestroyFence                            DestroyFence;
+   PFN_vkWaitForFences                           WaitForFences;
+   PFN_vkResetFences                             ResetFences;
+   PFN_vkGetFenceStatus                          GetFenceStatus;
+   PFN_vkResetCommandBuffer                      ResetCommandBuffer;
+   PFN_vkCreateBuffer                            CreateBuffer;
+   PFN_vkDestroyBuffer                           DestroyBuffer;
+   PFN_vkGetBufferMemoryRequirements             GetBufferMemoryRequirements;
+   PFN_vkAllocateMemory                          AllocateMemory;
+   PFN_vkFreeMemory                              FreeMemory;
+   PFN_vkBindBufferMemory                        BindBufferMemory;
+   PFN_vkGetImageMemoryRequirements              GetImageMemoryRequirements;
+   PFN_vkBindImageMemory                         BindImageMemory;
+   PFN_vkMapMemory                               MapMemory;
+   PFN_vkUnmapMemory                             UnmapMemory;
+   PFN_vkFlushMappedMemoryRanges                 FlushMappedMemoryRanges;
+   PFN_vkInvalidateMappedMemoryRanges            InvalidateMappedMemoryRanges;
+   PFN_vkCreateDescriptorSetLayout               CreateDescriptorSetLayout;
+   PFN_vkDestroyDescriptorSetLayout              DestroyDescriptorSetLayout;
+   PFN_vkCreateDescriptorPool                    CreateDescriptorPool;
+   PFN_vkDestroyDescriptorPool                   DestroyDescriptorPool;
+   PFN_vkAllocateDescriptorSets                  AllocateDescriptorSets;
+   PFN_vkUpdateDescriptorSets                    UpdateDescriptorSets;
+   PFN_vkCreateComputePipelines                  CreateComputePipelines;
+   PFN_vkCmdBindDescriptorSets                   CmdBindDescriptorSets;
+   PFN_vkCmdPushConstants                        CmdPushConstants;
+   PFN_vkCmdDispatch                             CmdDispatch;
+   PFN_vkCmdPipelineBarrier                      CmdPipelineBarrier;
+   PFN_vkCmdSetViewport                          CmdSetViewport;
+   PFN_vkCmdSetScissor                           CmdSetScissor;
 
    PFN_vkDestroySurfaceKHR                       DestroySurfaceKHR;
    PFN_vkGetPhysicalDeviceSurfaceSupportKHR      GetPhysicalDeviceSurfaceSupportKHR;
@@ -0,0 +1,772 @@
+/*
+ * Vulkan device memory sub-allocator
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vk-memory.h"
+
+#define DEFAULT_BLOCK_SIZE (64 * 1024 * 1024)
+#define MIN_BLOCK_SIZE (VK_MEMORY_MIN_NODE << 10)
+#define MAX_BLOCK_SIZE ((VkDeviceSize) VK_MEMORY_MIN_NODE \
+                        << (VK_MEMORY_MAX_ORDERS - 1))
+
+#define KIB(bytes) ((unsigned long long) ((bytes) / 1024))
+
+static VkDeviceSize
+node_size (uint32_t order)
+{
+   return (VkDeviceSize) VK_MEMORY_MIN_NODE << order;
+}
+
+/* the smallest order whose nodes hold 'size' bytes */
+static uint32_t
+node_order (VkDeviceSize size)
+{
+   uint32_t order = 0;
+
+   while (node_size (order) < size)
+      order++;
+
+   return order;
+}
+
+static VkDeviceSize
+align_up (VkDeviceSize value, VkDeviceSize alignment)
+{
+   return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool
+bit_get (const struct vk_memory_block *block, uint32_t order, uint32_t node)
+{
+   const uint64_t *bits = block->free_bits + block->free_words[order];
+
+   return (bits[node / 64] >> (node % 64)) & 1;
+}
+
+static void
+bit_set (struct vk_memory_block *block, uint32_t order, uint32_t node)
+{
+   block->free_bits[block->free_words[order] + node / 64] |=
+      (uint64_t) 1 << (node % 64);
+   block->free_counts[order]++;
+}
+
+static void
+bit_clear (struct vk_memory_block *block, uint32_t order, uint32_t node)
+{
+   block->free_bits[block->free_words[order] + node / 64] &=
+      ~((uint64_t) 1 << (node % 64));
+   block->free_counts[order]--;
+}
+
+/* a free node of 'order', which must have some */
+static uint32_t
+find_free_node (const struct vk_memory_block *block, uint32_t order)
+{
+   const uint64_t *bits = block->free_bits + block->free_words[order];
+
+   for (uint32_t word = 0; ; word++) {
+      if (bits[word] == 0)
+         continue;
+
+      uint32_t bit = 0;
+      while (((bits[word] >> bit) & 1) == 0)
+         bit++;
+
+      return word * 64 + bit;
+   }
+}
+
+static bool
+buddy_alloc (struct vk_memory_block *block,
+             uint32_t order,
+             VkDeviceSize *offset)
+{
+   uint32_t from = order;
+   while (from < block->num_orders && block->free_counts[from] == 0)
+      from++;
+   if (from >= block->num_orders)
+      return false;
+
+   uint32_t node = find_free_node (block, from);
+   bit_clear (block, from, node);
+
+   /* split it down, freeing the upper halves */
+   while (from > order) {
+      from--;
+      node *= 2;
+      bit_set (block, from, node + 1);
+   }
+
+   *offset = node * node_size (order);
+
+   return true;
+}
+
+static void
+buddy_free (struct vk_memory_block *block,
+            uint32_t order,
+            VkDeviceSize offset)
+{
+   uint32_t node = offset / node_size (order);
+
+   /* merge with the buddies that are free too */
+   while (order + 1 < block->num_orders && bit_get (block, order, node ^ 1)) {
+      bit_clear (block, order, node ^ 1);
+      node /= 2;
+      order++;
+   }
+
+   bit_set (block, order, node);
+}
+
+static VkDeviceSize
+block_size_for_type (struct vk_memory *mem, uint32_t type_index)
+{
+   uint32_t heap_index = mem->props.memoryTypes[type_index].heapIndex;
+   VkDeviceSize heap_size = mem->props.memoryHeaps[heap_index].size;
+   VkDeviceSize size = mem->block_size;
+
+   while (size > MIN_BLOCK_SIZE && size > heap_size / 8)
+      size /= 2;
+
+   return size;
+}
+
+static struct vk_memory_block *
+block_create (struct vk_memory *mem,
+              uint32_t type_index,
+              uint32_t list,
+              VkDeviceSize size)
+{
+   const struct vk_api *vk = mem->vk;
+
+   if (mem->device_allocations >= mem->max_allocations) {
+      printf ("Error: maxMemoryAllocationCount (%u) reached\n",
+              mem->max_allocations);
+      return NULL;
+   }
+
+   struct vk_memory_block *block = calloc (1, sizeof (struct vk_memory_block));
+   assert (block != NULL);
+   block->size = size;
+   block->type_index = type_index;
+   block->list = list;
+
+   VkMemoryAllocateInfo alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+      .allocationSize = size,
+      .memoryTypeIndex = type_index,
+   };
+   if (vk->AllocateMemory (mem->device,
+                           &alloc_info,
+                           mem->allocator,
+                           &block->memory) != VK_SUCCESS) {
+      printf ("Error: Failed to allocate %llu KiB of memory type %u\n",
+              KIB (size),
+              type_index);
+      free (block);
+      return NULL;
+   }
+
+   mem->device_allocations++;
+   if (mem->device_allocations > mem->peak_device_allocations)
+      mem->peak_device_allocations = mem->device_allocations;
+
+   VkMemoryPropertyFlags flags =
+      mem->props.memoryTypes[type_index].propertyFlags;
+   void *mapped = NULL;
+   if ((flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+       && vk->MapMemory (mem->device,
+                         block->memory,
+                         0,
+                         VK_WHOLE_SIZE,
+                         0,
+                         &mapped) != VK_SUCCESS) {
+      printf ("Warning: Failed to map memory of type %u\n", type_index);
+      mapped = NULL;
+   }
+   block->mapped = mapped;
+
+   if (list != VK_MEMORY_LIST_DEDICATED) {
+      /* a single free node of the top order, to begin with */
+      block->num_orders = node_order (size) + 1;
+
+      uint32_t words = 0;
+      for (uint32_t order = 0; order < block->num_orders; order++) {
+         uint32_t nodes = size / node_size (order);
+         block->free_words[order] = words;
+         words += (nodes + 63) / 64;
+      }
+      block->free_bits = calloc (words, sizeof (uint64_t));
+      assert (block->free_bits != NULL);
+
+      bit_set (block, block->num_orders - 1, 0);
+   }
+
+   block->next = mem->blocks[type_index][list];
+   mem->blocks[type_index][list] = block;
+
+   return block;
+}
+
+static void
+block_destroy (struct vk_memory *mem, struct vk_memory_block *block)
+{
+   struct vk_memory_block **link = &mem->blocks[block->type_index][block->list];
+   while (*link != block)
+      link = &(*link)->next;
+   *link = block->next;
+
+   if (block->mapped != NULL)
+      mem->vk->UnmapMemory (mem->device, block->memory);
+   mem->vk->FreeMemory (mem->device, block->memory, mem->allocator);
+   mem->device_allocations--;
+
+   free (block->free_bits);
+   free (block);
+}
+
+static void
+flush_or_invalidate (struct vk_memory *mem,
+                     const struct vk_memory_allocation *alloc,
+                     VkDeviceSize offset,
+                     VkDeviceSize size,
+                     bool flush)
+{
+   if (alloc->block == NULL
+       || alloc->mapped == NULL
+       || vk_memory_is_coherent (mem, alloc)) {
+      return;
+   }
+
+   /* ranges are in whole atoms, or up to the end of the memory */
+   VkDeviceSize start = (alloc->offset + offset) / mem->atom_size
+      * mem->atom_size;
+   VkDeviceSize end = align_up (alloc->offset + offset + size, mem->atom_size);
+
+   VkMappedMemoryRange range = {
+      .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+      .memory = alloc->memory,
+      .offset = start,
+      .size = end <= alloc->block->size ? end - start : VK_WHOLE_SIZE,
+   };
+
+   if (flush)
+      mem->vk->FlushMappedMemoryRanges (mem->device, 1, &range);
+   else
+      mem->vk->InvalidateMappedMemoryRanges (mem->device, 1, &range);
+}
+
+/* public API */
+
+bool
+vk_memory_init (struct vk_memory *mem,
+                const struct vk_api *vk,
+                VkPhysicalDevice physical_device,
+                VkDevice device,
+                const VkAllocationCallbacks *allocator,
+                VkDeviceSize block_size)
+{
+   assert (mem != NULL);
+   assert (vk != NULL && vk->AllocateMemory != NULL);
+   assert (physical_device != VK_NULL_HANDLE);
+   assert (device != VK_NULL_HANDLE);
+
+   memset (mem, 0x00, sizeof (struct vk_memory));
+   mem->vk = vk;
+   mem->device = device;
+   mem->allocator = allocator;
+
+   VkPhysicalDeviceProperties props;
+   vk->GetPhysicalDeviceProperties (physical_device, &props);
+   vk->GetPhysicalDeviceMemoryProperties (physical_device, &mem->props);
+
+   mem->granularity = props.limits.bufferImageGranularity;
+   mem->atom_size = props.limits.nonCoherentAtomSize > 0 ?
+      props.limits.nonCoherentAtomSize : 1;
+   mem->max_allocations = props.limits.maxMemoryAllocationCount;
+
+   if (block_size == 0)
+      block_size = DEFAULT_BLOCK_SIZE;
+   if (block_size > MAX_BLOCK_SIZE)
+      block_size = MAX_BLOCK_SIZE;
+   mem->block_size = MIN_BLOCK_SIZE;
+   while (mem->block_size * 2 <= block_size)
+      mem->block_size *= 2;
+
+   return true;
+}
+
+void
+vk_memory_finish (struct vk_memory *mem)
+{
+   assert (mem != NULL);
+
+   for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++) {
+      for (uint32_t list = 0; list < VK_MEMORY_LIST_COUNT; list++) {
+         while (mem->blocks[i][list] != NULL) {
+            struct vk_memory_block *block = mem->blocks[i][list];
+            if (block->allocations > 0) {
+               printf ("Warning: %u allocation(s) of memory type %u "
+                       "not freed\n",
+                       block->allocations,
+                       i);
+            }
+            block_destroy (mem, block);
+         }
+      }
+   }
+}
+
+int32_t
+vk_memory_find_type (struct vk_memory *mem,
+                     uint32_t type_bits,
+                     VkMemoryPropertyFlags required,
+                     VkMemoryPropertyFlags preferred)
+{
+   assert (mem != NULL);
+
+   int32_t best = -1;
+   uint32_t best_score = 0;
+
+   for (uint32_t i = 0; i < mem->props.memoryTypeCount; i++) {
+      VkMemoryPropertyFlags flags = mem->props.memoryTypes[i].propertyFlags;
+
+      if ((type_bits & (1u << i)) == 0 || (flags & required) != required)
+         continue;
+
+      /* the number of preferred properties it has */
+      uint32_t score = 0;
+      VkMemoryPropertyFlags bits = flags & preferred;
+      for (; bits != 0; bits &= bits - 1)
+         score++;
+
+      if (best < 0 || score > best_score) {
+         best = i;
+         best_score = score;
+      }
+   }
+
+   return best;
+}
+
+bool
+vk_memory_alloc (struct vk_memory *mem,
+                 const VkMemoryRequirements *reqs,
+                 VkMemoryPropertyFlags required,
+                 VkMemoryPropertyFlags preferred,
+                 bool optimal_image,
+                 struct vk_memory_allocation *alloc)
+{
+   assert (mem != NULL);
+   assert (reqs != NULL && reqs->size > 0);
+   assert (alloc != NULL);
+
+   memset (alloc, 0x00, sizeof (struct vk_memory_allocation));
+
+   int32_t type_index = vk_memory_find_type (mem,
+                                             reqs->memoryTypeBits,
+                                             required,
+                                             preferred);
+   if (type_index < 0) {
+      printf ("Error: No memory type with properties 0x%x\n", required);
+      return false;
+   }
+
+   VkDeviceSize alignment = reqs->alignment > 0 ? reqs->alignment : 1;
+   uint32_t order = node_order (reqs->size > alignment ?
+                                reqs->size : alignment);
+   VkDeviceSize block_size = block_size_for_type (mem, type_index);
+
+   struct vk_memory_block *block = NULL;
+   VkDeviceSize offset = 0;
+
+   if (node_size (order) > block_size / 2) {
+      block = block_create (mem,
+                            type_index,
+                            VK_MEMORY_LIST_DEDICATED,
+                            reqs->size);
+      if (block == NULL)
+         return false;
+   } else {
+      uint32_t list = optimal_image && mem->granularity > 1 ?
+         VK_MEMORY_LIST_OPTIMAL : VK_MEMORY_LIST_LINEAR;
+
+      for (block = mem->blocks[type_index][list];
+           block != NULL;
+           block = block->next) {
+         if (buddy_alloc (block, order, &offset))
+            break;
+      }
+
+      if (block == NULL) {
+         block = block_create (mem, type_index, list, block_size);
+         if (block == NULL)
+            return false;
+
+         bool ok = buddy_alloc (block, order, &offset);
+         assert (ok);
+         (void) ok;
+      }
+   }
+
+   block->allocations++;
+   block->used += reqs->size;
+   block->allocated += block->list == VK_MEMORY_LIST_DEDICATED ?
+      reqs->size : node_size (order);
+
+   alloc->memory = block->memory;
+   alloc->offset = offset;
+   alloc->size = reqs->size;
+   alloc->mapped = block->mapped != NULL ? block->mapped + offset : NULL;
+   alloc->type_index = type_index;
+   alloc->block = block;
+   alloc->order = order;
+
+   return true;
+}
+
+void
+vk_memory_free (struct vk_memory *mem, struct vk_memory_allocation *alloc)
+{
+   assert (mem != NULL);
+   assert (alloc != NULL);
+
+   struct vk_memory_block *block = alloc->block;
+   if (block == NULL)
+      return;
+
+   assert (block->allocations > 0);
+   block->allocations--;
+   block->used -= alloc->size;
+
+   if (block->list == VK_MEMORY_LIST_DEDICATED) {
+      block_destroy (mem, block);
+   } else {
+      block->allocated -= node_size (alloc->order);
+      buddy_free (block, alloc->order, alloc->offset);
+
+      /* an empty block is kept only if it's the last of its list */
+      if (block->allocations == 0
+          && (mem->blocks[block->type_index][block->list] != block
+              || block->next != NULL)) {
+         block_destroy (mem, block);
+      }
+   }
+
+   memset (alloc, 0x00, sizeof (struct vk_memory_allocation));
+}
+
+bool
+vk_memory_alloc_buffer (struct vk_memory *mem,
+                        VkBuffer buffer,
+                        VkMemoryPropertyFlags required,
+                        VkMemoryPropertyFlags preferred,
+                        struct vk_memory_allocation *alloc)
+{
+   assert (mem != NULL);
+   assert (buffer != VK_NULL_HANDLE);
+
+   VkMemoryRequirements reqs;
+   mem->vk->GetBufferMemoryRequirements (mem->device, buffer, &reqs);
+
+   if (! vk_memory_alloc (mem, &reqs, required, preferred, false, alloc))
+      return false;
+
+   if (mem->vk->BindBufferMemory (mem->device,
+                                  buffer,
+                                  alloc->memory,
+                                  alloc->offset) != VK_SUCCESS) {
+      printf ("Error: Failed to bind the memory of a buffer\n");
+      vk_memory_free (mem, alloc);
+      return false;
+   }
+
+   return true;
+}
+
+bool
+vk_memory_alloc_image (struct vk_memory *mem,
+                       VkImage image,
+                       VkImageTiling tiling,
+                       VkMemoryPropertyFlags required,
+                       VkMemoryPropertyFlags preferred,
+                       struct vk_memory_allocation *alloc)
+{
+   assert (mem != NULL);
+   assert (image != VK_NULL_HANDLE);
+
+   VkMemoryRequirements reqs;
+   mem->vk->GetImageMemoryRequirements (mem->device, image, &reqs);
+
+   if (! vk_memory_alloc (mem,
+                          &reqs,
+                          required,
+                          preferred,
+                          tiling == VK_IMAGE_TILING_OPTIMAL,
+                          alloc)) {
+      return false;
+   }
+
+   if (mem->vk->BindImageMemory (mem->device,
+                                 image,
+                                 alloc->memory,
+                                 alloc->offset) != VK_SUCCESS) {
+      printf ("Error: Failed to bind the memory of an image\n");
+      vk_memory_free (mem, alloc);
+      return false;
+   }
+
+   return true;
+}
+
+void
+vk_memory_flush (struct vk_memory *mem,
+                 const struct vk_memory_allocation *alloc)
+{
+   assert (mem != NULL && alloc != NULL);
+
+   flush_or_invalidate (mem, alloc, 0, alloc->size, true);
+}
+
+void
+vk_memory_invalidate (struct vk_memory *mem,
+                      const struct vk_memory_allocation *alloc)
+{
+   assert (mem != NULL && alloc != NULL);
+
+   flush_or_invalidate (mem, alloc, 0, alloc->size, false);
+}
+
+bool
+vk_memory_is_coherent (struct vk_memory *mem,
+                       const struct vk_memory_allocation *alloc)
+{
+   assert (mem != NULL && alloc != NULL);
+
+   VkMemoryPropertyFlags flags =
+      mem->props.memoryTypes[alloc->type_index].propertyFlags;
+
+   return (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+void
+vk_memory_print_stats (struct vk_memory *mem)
+{
+   assert (mem != NULL);
+
+   printf ("Device memory: %u allocation(s), %u at most, of %u allowed; "
+           "blocks of %llu KiB, granularity %llu\n",
+           mem->device_allocations,
+           mem->peak_device_allocations,
+           mem->max_allocations,
+           KIB (mem->block_size),
+           (unsigned long long) mem->granularity);
+
+   for (uint32_t i = 0; i < mem->props.memoryTypeCount; i++) {
+      uint32_t blocks = 0;
+      uint32_t dedicated = 0;
+      uint32_t allocations = 0;
+      VkDeviceSize size = 0;
+      VkDeviceSize used = 0;
+      VkDeviceSize allocated = 0;
+      VkDeviceSize free_size = 0;
+      VkDeviceSize largest_free = 0;
+      VkDeviceSize fragmented = 0;
+
+      for (uint32_t list = 0; list < VK_MEMORY_LIST_COUNT; list++) {
+         for (struct vk_memory_block *block = mem->blocks[i][list];
+              block != NULL;
+              block = block->next) {
+            if (list == VK_MEMORY_LIST_DEDICATED)
+               dedicated++;
+            else
+               blocks++;
+            allocations += block->allocations;
+            size += block->size;
+            used += block->used;
+            allocated += block->allocated;
+
+            VkDeviceSize block_free = 0;
+            VkDeviceSize block_largest = 0;
+            for (uint32_t order = 0; order < block->num_orders; order++) {
+               VkDeviceSize node = node_size (order);
+               block_free += block->free_counts[order] * node;
+               if (block->free_counts[order] > 0)
+                  block_largest = node;
+            }
+
+            free_size += block_free;
+            fragmented += block_free - block_largest;
+            if (block_largest > largest_free)
+               largest_free = block_largest;
+         }
+      }
+
+      if (blocks + dedicated == 0)
+         continue;
+
+      double fragmentation = free_size > 0 ?
+         100.0 * fragmented / free_size : 0.0;
+
+      printf ("   type %u (flags 0x%x, heap %u): %u block(s), "
+              "%u dedicated, %u allocation(s)\n",
+              i,
+              mem->props.memoryTypes[i].propertyFlags,
+              mem->props.memoryTypes[i].heapIndex,
+              blocks,
+              dedicated,
+              allocations);
+      printf ("      %llu KiB used of %llu KiB (%llu KiB with padding), "
+              "%llu KiB free, largest %llu KiB, %.1f%% fragmented\n",
+              KIB (used),
+              KIB (size),
+              KIB (allocated),
+              KIB (free_size),
+              KIB (largest_free),
+              fragmentation);
+   }
+}
+
+bool
+vk_memory_linear_init (struct vk_memory_linear *linear,
+                       struct vk_memory *mem,
+                       VkBufferUsageFlags usage,
+                       VkDeviceSize frame_size,
+                       uint32_t num_frames)
+{
+   assert (linear != NULL && mem != NULL);
+   assert (frame_size > 0 && num_frames > 0);
+
+   memset (linear, 0x00, sizeof (struct vk_memory_linear));
+   linear->mem = mem;
+   linear->num_frames = num_frames;
+
+   /* regions start at offsets any use of a buffer is aligned to, and
+    * flush whole atoms
+    */
+   VkDeviceSize alignment = mem->atom_size > VK_MEMORY_MIN_NODE ?
+      mem->atom_size : VK_MEMORY_MIN_NODE;
+   linear->frame_size = align_up (frame_size, alignment);
+
+   VkBufferCreateInfo buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size = linear->frame_size * num_frames,
+      .usage = usage,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+   };
+   if (mem->vk->CreateBuffer (mem->device,
+                              &buffer_info,
+                              mem->allocator,
+                              &linear->buffer) != VK_SUCCESS) {
+      printf ("Error: Failed to create a buffer for per-frame data\n");
+      return false;
+   }
+
+   if (! vk_memory_alloc_buffer (mem,
+                                 linear->buffer,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+                                 | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                 &linear->alloc)
+       || linear->alloc.mapped == NULL) {
+      vk_memory_linear_finish (linear);
+      return false;
+   }
+
+   return true;
+}
+
+void
+vk_memory_linear_finish (struct vk_memory_linear *linear)
+{
+   assert (linear != NULL);
+
+   if (linear->mem == NULL)
+      return;
+
+   vk_memory_free (linear->mem, &linear->alloc);
+   linear->mem->vk->DestroyBuffer (linear->mem->device,
+                                   linear->buffer,
+                                   linear->mem->allocator);
+   memset (linear, 0x00, sizeof (struct vk_memory_linear));
+}
+
+void
+vk_memory_linear_begin_frame (struct vk_memory_linear *linear,
+                              uint32_t frame)
+{
+   assert (linear != NULL);
+   assert (frame < linear->num_frames);
+
+   linear->frame = frame;
+   linear->offset = 0;
+}
+
+bool
+vk_memory_linear_alloc (struct vk_memory_linear *linear,
+                        VkDeviceSize size,
+                        VkDeviceSize alignment,
+                        VkDeviceSize *offset,
+                        void **mapped)
+{
+   assert (linear != NULL && linear->buffer != VK_NULL_HANDLE);
+   assert (offset != NULL);
+
+   VkDeviceSize start = align_up (linear->offset,
+                                  alignment > 0 ? alignment : 1);
+   if (start + size > linear->frame_size) {
+      linear->failures++;
+      return false;
+   }
+   linear->offset = start + size;
+   if (linear->offset > linear->peak)
+      linear->peak = linear->offset;
+
+   *offset = linear->frame * linear->frame_size + start;
+   if (mapped != NULL)
+      *mapped = (uint8_t *) linear->alloc.mapped + *offset;
+
+   return true;
+}
+
+void
+vk_memory_linear_flush (struct vk_memory_linear *linear)
+{
+   assert (linear != NULL);
+
+   if (linear->offset == 0)
+      return;
+
+   flush_or_invalidate (linear->mem,
+                        &linear->alloc,
+                        linear->frame * linear->frame_size,
+                        linear->offset,
+                        true);
+}
+
+void
+vk_memory_linear_print_stats (struct vk_memory_linear *linear)
+{
+   assert (linear != NULL);
+
+   printf ("Per-frame memory: %u frame(s) of %llu KiB, at most %llu KiB "
+           "used in a frame, %llu failed allocation(s)\n",
+           linear->num_frames,
+           KIB (linear->frame_size),
+           KIB (linear->peak),
+           (unsigned long long) linear->failures);
+}
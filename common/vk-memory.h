@@ -0,0 +1,206 @@
+/*
+ * Vulkan device memory sub-allocator
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include "vk-api.h"
+
+/* Buffers and images share a few large VkDeviceMemory blocks per memory
+ * type, instead of a vkAllocateMemory() each, which is slow and limited to
+ * maxMemoryAllocationCount allocations. Blocks are split with a buddy
+ * allocator: a node of 2^n times VK_MEMORY_MIN_NODE bytes lies at a
+ * multiple of its size, so any alignment up to the size comes for free.
+ *
+ * Linear resources (buffers, linearly tiled images) and optimally tiled
+ * images must not share a page of bufferImageGranularity bytes, so they
+ * get blocks of their own when the granularity is larger than a byte.
+ * Resources larger than half a block get a dedicated allocation.
+ *
+ * Host-visible blocks are mapped for their whole life. None of this is
+ * thread-safe.
+ */
+
+#define VK_MEMORY_MIN_NODE 256
+#define VK_MEMORY_MAX_ORDERS 24
+
+/* block lists of each memory type */
+#define VK_MEMORY_LIST_LINEAR 0
+#define VK_MEMORY_LIST_OPTIMAL 1
+#define VK_MEMORY_LIST_DEDICATED 2
+#define VK_MEMORY_LIST_COUNT 3
+
+struct vk_memory_block {
+   VkDeviceMemory memory;
+   VkDeviceSize size;
+   uint8_t *mapped;
+   uint32_t type_index;
+   uint32_t list;
+
+   /* one bitset per order, of its nodes that are free; none when
+    * dedicated
+    */
+   uint32_t num_orders;
+   uint64_t *free_bits;
+   uint32_t free_words[VK_MEMORY_MAX_ORDERS];
+   uint32_t free_counts[VK_MEMORY_MAX_ORDERS];
+
+   /* statistics */
+   uint32_t allocations;
+   VkDeviceSize used;
+   VkDeviceSize allocated;
+
+   struct vk_memory_block *next;
+};
+
+struct vk_memory {
+   const struct vk_api *vk;
+   VkDevice device;
+   const VkAllocationCallbacks *allocator;
+
+   VkPhysicalDeviceMemoryProperties props;
+   VkDeviceSize granularity;
+   VkDeviceSize atom_size;
+   uint32_t max_allocations;
+
+   VkDeviceSize block_size;
+   struct vk_memory_block *blocks[VK_MAX_MEMORY_TYPES][VK_MEMORY_LIST_COUNT];
+
+   /* live vkAllocateMemory() allocations, and the most ever live */
+   uint32_t device_allocations;
+   uint32_t peak_device_allocations;
+};
+
+struct vk_memory_allocation {
+   VkDeviceMemory memory;
+   VkDeviceSize offset;
+   VkDeviceSize size;
+   /* NULL if not host-visible */
+   void *mapped;
+   uint32_t type_index;
+
+   /* private */
+   struct vk_memory_block *block;
+   uint32_t order;
+};
+
+/* A ring of 'num_frames' regions of a host-visible buffer, one per frame
+ * in flight, each filled linearly by a frame's transient data (uniforms,
+ * streamed vertices...) and reset when the frame starts again, once the
+ * GPU is done with it.
+ */
+struct vk_memory_linear {
+   struct vk_memory *mem;
+   VkBuffer buffer;
+   struct vk_memory_allocation alloc;
+
+   VkDeviceSize frame_size;
+   uint32_t num_frames;
+   uint32_t frame;
+   VkDeviceSize offset;
+
+   /* statistics */
+   VkDeviceSize peak;
+   uint64_t failures;
+};
+
+/* 'block_size' of 0 uses a default of 64 MiB; it is rounded down to a
+ * power of two, and smaller for heaps of less than 8 blocks.
+ */
+bool     vk_memory_init                (struct vk_memory *mem,
+                                        const struct vk_api *vk,
+                                        VkPhysicalDevice physical_device,
+                                        VkDevice device,
+                                        const VkAllocationCallbacks *allocator,
+                                        VkDeviceSize block_size);
+
+void     vk_memory_finish              (struct vk_memory *mem);
+
+/* Returns the memory type allowed by 'type_bits' with all the 'required'
+ * properties and most of the 'preferred' ones, or -1.
+ */
+int32_t  vk_memory_find_type           (struct vk_memory *mem,
+                                        uint32_t type_bits,
+                                        VkMemoryPropertyFlags required,
+                                        VkMemoryPropertyFlags preferred);
+
+bool     vk_memory_alloc               (struct vk_memory *mem,
+                                        const VkMemoryRequirements *reqs,
+                                        VkMemoryPropertyFlags required,
+                                        VkMemoryPropertyFlags preferred,
+                                        bool optimal_image,
+                                        struct vk_memory_allocation *alloc);
+
+void     vk_memory_free                (struct vk_memory *mem,
+                                        struct vk_memory_allocation *alloc);
+
+/* Allocate the memory of a buffer or an image and bind it. */
+bool     vk_memory_alloc_buffer        (struct vk_memory *mem,
+                                        VkBuffer buffer,
+                                        VkMemoryPropertyFlags required,
+                                        VkMemoryPropertyFlags preferred,
+                                        struct vk_memory_allocation *alloc);
+
+bool     vk_memory_alloc_image         (struct vk_memory *mem,
+                                        VkImage image,
+                                        VkImageTiling tiling,
+                                        VkMemoryPropertyFlags required,
+                                        VkMemoryPropertyFlags preferred,
+                                        struct vk_memory_allocation *alloc);
+
+/* Make what the host wrote visible to the device, and the other way
+ * around; nothing to do for coherent memory.
+ */
+void     vk_memory_flush               (struct vk_memory *mem,
+                                        const struct vk_memory_allocation *alloc);
+
+void     vk_memory_invalidate          (struct vk_memory *mem,
+                                        const struct vk_memory_allocation *alloc);
+
+bool     vk_memory_is_coherent         (struct vk_memory *mem,
+                                        const struct vk_memory_allocation *alloc);
+
+/* Usage of each memory type, and how fragmented its blocks are: the share
+ * of their free memory not in the largest free node of its block.
+ */
+void     vk_memory_print_stats         (struct vk_memory *mem);
+
+bool     vk_memory_linear_init         (struct vk_memory_linear *linear,
+                                        struct vk_memory *mem,
+                                        VkBufferUsageFlags usage,
+                                        VkDeviceSize frame_size,
+                                        uint32_t num_frames);
+
+void     vk_memory_linear_finish       (struct vk_memory_linear *linear);
+
+/* Starts filling the region of 'frame' again: the GPU must be done with
+ * what was allocated in it before.
+ */
+void     vk_memory_linear_begin_frame  (struct vk_memory_linear *linear,
+                                        uint32_t frame);
+
+/* Returns the offset in linear->buffer, and where it is mapped; fails if
+ * the region of the frame is full.
+ */
+bool     vk_memory_linear_alloc        (struct vk_memory_linear *linear,
+                                        VkDeviceSize size,
+                                        VkDeviceSize alignment,
+                                        VkDeviceSize *offset,
+                                        void **mapped);
+
+/* Flushes what was allocated in the current frame. */
+void     vk_memory_linear_flush        (struct vk_memory_linear *linear);
+
+void     vk_memory_linear_print_stats  (struct vk_memory_linear *linear);
@@ -0,0 +1,443 @@
+/*
+ * Vulkan pipeline cache stored on disk
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "now.h"
+#include "vk-pipeline-cache.h"
+
+#define CACHE_DIR_NAME "vk-pipeline-cache"
+
+#define CACHE_FILE_MAGIC 0x4350504b /* "KPPC" */
+#define CACHE_FILE_VERSION 1
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/* Followed by 'size' bytes of vkGetPipelineCacheData(). The identity of the
+ * device is repeated here, as the file name alone can't be trusted.
+ */
+struct cache_file_header {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t vendor_id;
+   uint32_t device_id;
+   uint32_t driver_version;
+   uint8_t uuid[VK_UUID_SIZE];
+   uint32_t size;
+
+   /* of the data, drivers don't always notice corrupt ones */
+   uint64_t checksum;
+};
+
+/* The header the Vulkan spec mandates at the start of the cache data,
+ * version VK_PIPELINE_CACHE_HEADER_VERSION_ONE.
+ */
+struct vk_cache_data_header {
+   uint32_t length;
+   uint32_t version;
+   uint32_t vendor_id;
+   uint32_t device_id;
+   uint8_t uuid[VK_UUID_SIZE];
+};
+
+/* FNV-1a */
+static uint64_t
+hash_data (const void *data, size_t size)
+{
+   const uint8_t *bytes = data;
+   uint64_t hash = FNV_OFFSET_BASIS;
+
+   for (size_t i = 0; i < size; i++) {
+      hash ^= bytes[i];
+      hash *= FNV_PRIME;
+   }
+
+   return hash;
+}
+
+/* Like 'mkdir -p'. */
+static bool
+make_dirs (const char *path)
+{
+   char *tmp = strdup (path);
+   assert (tmp != NULL);
+
+   bool ok = true;
+   for (char *p = tmp + 1; ok; p++) {
+      if (*p != '/' && *p != '\0')
+         continue;
+
+      bool last = *p == '\0';
+      *p = '\0';
+      if (mkdir (tmp, 0755) != 0 && errno != EEXIST)
+         ok = false;
+
+      if (last)
+         break;
+      *p = '/';
+   }
+
+   free (tmp);
+
+   return ok;
+}
+
+static char *
+default_dir (void)
+{
+   const char *base = getenv ("XDG_CACHE_HOME");
+   const char *suffix = "";
+
+   if (base == NULL || base[0] == '\0') {
+      base = getenv ("HOME");
+      suffix = "/.cache";
+   }
+   if (base == NULL || base[0] == '\0')
+      return NULL;
+
+   size_t len = strlen (base) + strlen (suffix) + strlen (CACHE_DIR_NAME) + 2;
+   char *dir = malloc (len);
+   assert (dir != NULL);
+   snprintf (dir, len, "%s%s/%s", base, suffix, CACHE_DIR_NAME);
+
+   return dir;
+}
+
+/* <vendor>-<device>-<driver version>-<pipelineCacheUUID>.bin */
+static char *
+cache_filename (const char *dir, const VkPhysicalDeviceProperties *props)
+{
+   char uuid[VK_UUID_SIZE * 2 + 1];
+   for (uint32_t i = 0; i < VK_UUID_SIZE; i++)
+      snprintf (uuid + i * 2, 3, "%02x", props->pipelineCacheUUID[i]);
+
+   size_t len = strlen (dir) + 1 + 3 * 9 + sizeof (uuid) + 4;
+   char *filename = malloc (len);
+   assert (filename != NULL);
+
+   snprintf (filename, len, "%s/%08x-%08x-%08x-%s.bin",
+             dir,
+             props->vendorID,
+             props->deviceID,
+             props->driverVersion,
+             uuid);
+
+   return filename;
+}
+
+/* Whether 'data' is cache data the device can take, as far as its header
+ * tells.
+ */
+static bool
+check_cache_data (const void *data,
+                  size_t size,
+                  const VkPhysicalDeviceProperties *props)
+{
+   struct vk_cache_data_header header;
+
+   if (size < sizeof (header))
+      return false;
+   memcpy (&header, data, sizeof (header));
+
+   return header.length >= sizeof (header)
+      && header.length <= size
+      && header.version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+      && header.vendor_id == props->vendorID
+      && header.device_id == props->deviceID
+      && memcmp (header.uuid, props->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+/* Returns the cache data stored in 'filename' for the device of 'props',
+ * or NULL if there's none or it's not usable.
+ */
+static void *
+load_data (const char *filename,
+           const VkPhysicalDeviceProperties *props,
+           size_t *size,
+           uint64_t *checksum)
+{
+   FILE *file_obj = fopen (filename, "rb");
+   if (file_obj == NULL)
+      return NULL;
+
+   void *data = NULL;
+   struct cache_file_header header;
+
+   if (fread (&header, sizeof (header), 1, file_obj) != 1
+       || header.magic != CACHE_FILE_MAGIC
+       || header.version != CACHE_FILE_VERSION
+       || header.vendor_id != props->vendorID
+       || header.device_id != props->deviceID
+       || header.driver_version != props->driverVersion
+       || memcmp (header.uuid, props->pipelineCacheUUID, VK_UUID_SIZE) != 0
+       || header.size == 0) {
+      printf ("Pipeline cache file %s is for another device, ignored\n",
+              filename);
+      goto out;
+   }
+
+   /* a truncated or padded file, or a corrupt size, must not make us
+    * allocate what the header claims
+    */
+   struct stat st;
+   if (fstat (fileno (file_obj), &st) != 0
+       || (uint64_t) st.st_size != sizeof (header) + (uint64_t) header.size) {
+      printf ("Pipeline cache file %s is corrupt, ignored\n", filename);
+      goto out;
+   }
+
+   data = malloc (header.size);
+   assert (data != NULL);
+   if (fread (data, header.size, 1, file_obj) != 1
+       || hash_data (data, header.size) != header.checksum
+       || ! check_cache_data (data, header.size, props)) {
+      printf ("Pipeline cache file %s is corrupt, ignored\n", filename);
+      free (data);
+      data = NULL;
+      goto out;
+   }
+
+   *size = header.size;
+   *checksum = header.checksum;
+
+ out:
+   fclose (file_obj);
+
+   return data;
+}
+
+static void
+store_data (const char *filename,
+            const VkPhysicalDeviceProperties *props,
+            const void *data,
+            size_t size,
+            uint64_t checksum)
+{
+   struct cache_file_header header = {
+      .magic = CACHE_FILE_MAGIC,
+      .version = CACHE_FILE_VERSION,
+      .vendor_id = props->vendorID,
+      .device_id = props->deviceID,
+      .driver_version = props->driverVersion,
+      .size = size,
+      .checksum = checksum,
+   };
+   memcpy (header.uuid, props->pipelineCacheUUID, VK_UUID_SIZE);
+
+   /* Write to a temporary file first, so that concurrent runs never see a
+    * partial cache.
+    */
+   size_t tmp_len = strlen (filename) + 16;
+   char *tmp_filename = malloc (tmp_len);
+   assert (tmp_filename != NULL);
+   snprintf (tmp_filename, tmp_len, "%s.%d", filename, (int) getpid ());
+
+   FILE *file_obj = fopen (tmp_filename, "wb");
+   bool ok = file_obj != NULL;
+   if (ok) {
+      ok = fwrite (&header, sizeof (header), 1, file_obj) == 1
+         && fwrite (data, size, 1, file_obj) == 1;
+      ok = fclose (file_obj) == 0 && ok;
+   }
+
+   if (! ok || rename (tmp_filename, filename) != 0) {
+      printf ("Failed to store pipeline cache in %s\n", filename);
+      unlink (tmp_filename);
+   }
+
+   free (tmp_filename);
+}
+
+/* public API */
+
+bool
+vk_pipeline_cache_init (struct vk_pipeline_cache *cache,
+                        const struct vk_api *vk,
+                        VkPhysicalDevice physical_device,
+                        VkDevice device,
+                        const VkAllocationCallbacks *allocator,
+                        const char *dir)
+{
+   assert (cache != NULL);
+   assert (vk != NULL && vk->CreatePipelineCache != NULL);
+   assert (physical_device != VK_NULL_HANDLE);
+   assert (device != VK_NULL_HANDLE);
+
+   memset (cache, 0x00, sizeof (struct vk_pipeline_cache));
+   cache->vk = vk;
+   cache->device = device;
+   cache->allocator = allocator;
+   vk->GetPhysicalDeviceProperties (physical_device, &cache->props);
+
+   char *cache_dir = dir != NULL ? strdup (dir) : default_dir ();
+   if (cache_dir != NULL && make_dirs (cache_dir))
+      cache->filename = cache_filename (cache_dir, &cache->props);
+   else
+      printf ("Pipeline cache directory not usable, cache not stored\n");
+   free (cache_dir);
+
+   size_t size = 0;
+   void *data = NULL;
+   if (cache->filename != NULL) {
+      data = load_data (cache->filename,
+                        &cache->props,
+                        &size,
+                        &cache->loaded_checksum);
+   }
+
+   VkPipelineCacheCreateInfo cache_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+      .initialDataSize = size,
+      .pInitialData = data,
+   };
+   VkResult result = vk->CreatePipelineCache (device,
+                                              &cache_info,
+                                              allocator,
+                                              &cache->cache);
+
+   /* the driver may still refuse data that looked right */
+   if (result != VK_SUCCESS && data != NULL) {
+      printf ("Pipeline cache data refused by the driver, ignored\n");
+      cache_info.initialDataSize = 0;
+      cache_info.pInitialData = NULL;
+      result = vk->CreatePipelineCache (device,
+                                        &cache_info,
+                                        allocator,
+                                        &cache->cache);
+      free (data);
+      data = NULL;
+   }
+   cache->warm = data != NULL;
+   free (data);
+
+   if (result != VK_SUCCESS) {
+      printf ("Error: Failed to create a pipeline cache\n");
+      free (cache->filename);
+      cache->filename = NULL;
+      cache->cache = VK_NULL_HANDLE;
+      return false;
+   }
+
+   return true;
+}
+
+void
+vk_pipeline_cache_finish (struct vk_pipeline_cache *cache)
+{
+   assert (cache != NULL);
+
+   if (cache->cache == VK_NULL_HANDLE)
+      return;
+
+   const struct vk_api *vk = cache->vk;
+   size_t size = 0;
+   void *data = NULL;
+
+   if (cache->filename != NULL
+       && vk->GetPipelineCacheData (cache->device,
+                                    cache->cache,
+                                    &size,
+                                    NULL) == VK_SUCCESS
+       && size > 0) {
+      data = malloc (size);
+      assert (data != NULL);
+      if (vk->GetPipelineCacheData (cache->device,
+                                    cache->cache,
+                                    &size,
+                                    data) != VK_SUCCESS) {
+         size = 0;
+      }
+   }
+
+   if (size > 0 && check_cache_data (data, size, &cache->props)) {
+      uint64_t checksum = hash_data (data, size);
+
+      /* nothing new, as when all pipelines came from the file */
+      if (! cache->warm || checksum != cache->loaded_checksum)
+         store_data (cache->filename, &cache->props, data, size, checksum);
+   }
+
+   free (data);
+   free (cache->filename);
+   cache->filename = NULL;
+
+   vk->DestroyPipelineCache (cache->device, cache->cache, cache->allocator);
+   cache->cache = VK_NULL_HANDLE;
+}
+
+VkResult
+vk_pipeline_cache_create_graphics (struct vk_pipeline_cache *cache,
+                                   uint32_t count,
+                                   const VkGraphicsPipelineCreateInfo *infos,
+                                   VkPipeline *pipelines)
+{
+   assert (cache != NULL);
+   assert (infos != NULL && pipelines != NULL);
+
+   double start = now_ms ();
+
+   VkResult result = cache->vk->CreateGraphicsPipelines (cache->device,
+                                                         cache->cache,
+                                                         count,
+                                                         infos,
+                                                         cache->allocator,
+                                                         pipelines);
+
+   cache->create_ms += now_ms () - start;
+   cache->pipelines += count;
+
+   return result;
+}
+
+VkResult
+vk_pipeline_cache_create_compute (struct vk_pipeline_cache *cache,
+                                  uint32_t count,
+                                  const VkComputePipelineCreateInfo *infos,
+                                  VkPipeline *pipelines)
+{
+   assert (cache != NULL);
+   assert (infos != NULL && pipelines != NULL);
+
+   double start = now_ms ();
+
+   VkResult result = cache->vk->CreateComputePipelines (cache->device,
+                                                        cache->cache,
+                                                        count,
+                                                        infos,
+                                                        cache->allocator,
+                                                        pipelines);
+
+   cache->create_ms += now_ms () - start;
+   cache->pipelines += count;
+
+   return result;
+}
+
+void
+vk_pipeline_cache_print_stats (struct vk_pipeline_cache *cache)
+{
+   assert (cache != NULL);
+
+   printf ("Pipeline cache (%s): %s, %u pipelines created in %.2f ms\n",
+           cache->filename != NULL ? cache->filename : "not stored",
+           cache->warm ? "warm" : "cold",
+           cache->pipelines,
+           cache->create_ms);
+}
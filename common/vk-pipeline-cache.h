@@ -0,0 +1,79 @@
+/*
+ * Vulkan pipeline cache stored on disk
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+#include "vk-api.h"
+
+/* A VkPipelineCache loaded from a file at startup and written back when
+ * finished, so that later runs skip compiling shaders in the driver. Files
+ * are named after the device's vendor, device and driver version and its
+ * pipelineCacheUUID, so a driver update or a GPU change starts from an
+ * empty (cold) cache. Files that are truncated, corrupt or made for another
+ * device are ignored, never handed to the driver.
+ */
+
+struct vk_pipeline_cache {
+   const struct vk_api *vk;
+   VkDevice device;
+   const VkAllocationCallbacks *allocator;
+
+   VkPipelineCache cache;
+   VkPhysicalDeviceProperties props;
+
+   /* NULL if the cache is not stored */
+   char *filename;
+
+   /* the cache started from the file's data */
+   bool warm;
+   uint64_t loaded_checksum;
+
+   /* statistics */
+   uint32_t pipelines;
+   double create_ms;
+};
+
+/* 'dir' of NULL uses $XDG_CACHE_HOME/vk-pipeline-cache, or
+ * ~/.cache/vk-pipeline-cache. Returns false only if no VkPipelineCache can
+ * be created at all; if the directory is not usable, the cache works but
+ * is not stored.
+ */
+bool     vk_pipeline_cache_init             (struct vk_pipeline_cache *cache,
+                                             const struct vk_api *vk,
+                                             VkPhysicalDevice physical_device,
+                                             VkDevice device,
+                                             const VkAllocationCallbacks *allocator,
+                                             const char *dir);
+
+/* Writes the cache back to its file, replacing it atomically, unless its
+ * data did not change, and destroys it.
+ */
+void     vk_pipeline_cache_finish           (struct vk_pipeline_cache *cache);
+
+/* vkCreateGraphicsPipelines() and vkCreateComputePipelines() through the
+ * cache, timed for the statistics.
+ */
+VkResult vk_pipeline_cache_create_graphics  (struct vk_pipeline_cache *cache,
+                                             uint32_t count,
+                                             const VkGraphicsPipelineCreateInfo *infos,
+                                             VkPipeline *pipelines);
+
+VkResult vk_pipeline_cache_create_compute   (struct vk_pipeline_cache *cache,
+                                             uint32_t count,
+                                             const VkComputePipelineCreateInfo *infos,
+                                             VkPipeline *pipelines);
+
+void     vk_pipeline_cache_print_stats      (struct vk_pipeline_cache *cache);
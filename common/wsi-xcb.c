@@ -10,6 +10,7 @@ static struct {
    xcb_window_t win;
    xcb_intern_atom_reply_t* atom_wm_delete_window;
    WsiExposeEvent expose_event;
+   WsiInputEvent input_event;
 } xcb_data = { 0, };
 
 static bool
@@ -31,6 +32,12 @@ wsi_handle_event_xcb (xcb_generic_event_t* event)
          }
          break;
 
+      case XCB_KEY_PRESS:
+         /* latency is measured from the press, not the release */
+         if (xcb_data.input_event != NULL)
+            xcb_data.input_event ();
+         break;
+
       case XCB_KEY_RELEASE: {
          const xcb_key_release_event_t* key =
             (const xcb_key_release_event_t*) event;
@@ -125,8 +132,8 @@ wsi_init (const char* win_title,
    uint32_t value_mask, value_list[32];
    value_mask = XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK;
    value_list[0] = xcb_data.screen->black_pixel;
-   value_list[1] = XCB_EVENT_MASK_KEY_RELEASE | XCB_EVENT_MASK_EXPOSURE |
-      XCB_EVENT_MASK_STRUCTURE_NOTIFY;
+   value_list[1] = XCB_EVENT_MASK_KEY_PRESS | XCB_EVENT_MASK_KEY_RELEASE |
+      XCB_EVENT_MASK_EXPOSURE | XCB_EVENT_MASK_STRUCTURE_NOTIFY;
 
    xcb_create_window (xcb_data.conn,                 /* Connection          */
                       XCB_COPY_FROM_PARENT,          /* depth (same as root)*/
@@ -189,6 +196,24 @@ wsi_wait_for_events (void)
    return wsi_handle_event_xcb (event);
 }
 
+bool
+wsi_poll_for_events (void)
+{
+   xcb_generic_event_t* event;
+
+   event = xcb_poll_for_event (xcb_data.conn);
+   if (event == NULL && xcb_connection_has_error (xcb_data.conn))
+      return false;
+
+   return wsi_handle_event_xcb (event);
+}
+
+void
+wsi_set_input_event (WsiInputEvent input_event)
+{
+   xcb_data.input_event = input_event;
+}
+
 void
 wsi_window_show (void)
 {
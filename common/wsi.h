@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 typedef void (* WsiExposeEvent) (void);
+typedef void (* WsiInputEvent) (void);
 
 bool wsi_init                      (const char* win_title,
                                     uint32_t width,
@@ -13,10 +14,16 @@ bool wsi_init                      (const char* win_title,
 void wsi_get_connection_and_window (const void** conn,
                                     const void** win);
 
+/* called on key presses, before they are handled */
+void wsi_set_input_event           (WsiInputEvent input_event);
+
 void wsi_toggle_fullscreen         (void);
 
 bool wsi_wait_for_events           (void);
 
+/* like wsi_wait_for_events(), but returns at once if there are none */
+bool wsi_poll_for_events           (void);
+
 void wsi_window_show               (void);
 
 void wsi_finish                    (void);
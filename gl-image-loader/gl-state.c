@@ -0,0 +1,298 @@
+#include <assert.h>
+#include "common/gl-proc.h"
+#include "gl-state.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Shadowed value for state that is not known. */
+#define UNKNOWN ((GLuint) -1)
+
+/* Accounts for a call that is about to be issued (true) or skipped. */
+static bool
+issue (struct o_gl_state *self, bool needed)
+{
+   if (needed) {
+      self->calls++;
+      self->frame_calls++;
+   } else {
+      self->skipped++;
+   }
+
+   return needed;
+}
+
+/* public API */
+
+void
+o_gl_state_init (struct o_gl_state *self,
+                 GlGetProcAddress get_proc_address)
+{
+   assert (self != NULL);
+
+   memset (self, 0x00, sizeof (struct o_gl_state));
+
+   if (get_proc_address != NULL
+       && gl_has_extension ("GL_OES_vertex_array_object")) {
+      self->gen_vertex_arrays = (PFNGLGENVERTEXARRAYSOESPROC)
+         get_proc_address ("glGenVertexArraysOES");
+      self->bind_vertex_array = (PFNGLBINDVERTEXARRAYOESPROC)
+         get_proc_address ("glBindVertexArrayOES");
+      self->delete_vertex_arrays = (PFNGLDELETEVERTEXARRAYSOESPROC)
+         get_proc_address ("glDeleteVertexArraysOES");
+
+      if (self->gen_vertex_arrays == NULL
+          || self->bind_vertex_array == NULL
+          || self->delete_vertex_arrays == NULL) {
+         self->gen_vertex_arrays = NULL;
+         self->bind_vertex_array = NULL;
+         self->delete_vertex_arrays = NULL;
+      }
+   }
+
+   o_gl_state_invalidate (self);
+}
+
+void
+o_gl_state_invalidate (struct o_gl_state *self)
+{
+   assert (self != NULL);
+
+   self->program = UNKNOWN;
+   self->active_texture = UNKNOWN;
+   for (uint32_t i = 0; i < O_GL_STATE_MAX_TEXTURE_UNITS; i++)
+      self->textures[i] = UNKNOWN;
+   self->array_buffer = UNKNOWN;
+   self->vertex_array = UNKNOWN;
+   self->enabled_attribs_known = false;
+   self->blend = UNKNOWN;
+   self->blend_src = UNKNOWN;
+   self->blend_dst = UNKNOWN;
+   self->clear_color_known = false;
+}
+
+void
+o_gl_state_use_program (struct o_gl_state *self, GLuint program)
+{
+   assert (self != NULL);
+
+   if (issue (self, self->program != program)) {
+      glUseProgram (program);
+      self->program = program;
+   }
+}
+
+void
+o_gl_state_bind_texture (struct o_gl_state *self, uint32_t unit, GLuint tex)
+{
+   assert (self != NULL);
+   assert (unit < O_GL_STATE_MAX_TEXTURE_UNITS);
+
+   if (self->textures[unit] == tex) {
+      issue (self, false);
+      return;
+   }
+
+   if (issue (self, self->active_texture != GL_TEXTURE0 + unit)) {
+      glActiveTexture (GL_TEXTURE0 + unit);
+      self->active_texture = GL_TEXTURE0 + unit;
+   }
+
+   issue (self, true);
+   glBindTexture (GL_TEXTURE_2D, tex);
+   self->textures[unit] = tex;
+}
+
+void
+o_gl_state_delete_texture (struct o_gl_state *self, GLuint tex)
+{
+   assert (self != NULL);
+
+   issue (self, true);
+   glDeleteTextures (1, &tex);
+
+   /* GL reverts the bindings of a deleted texture to 0 */
+   for (uint32_t i = 0; i < O_GL_STATE_MAX_TEXTURE_UNITS; i++) {
+      if (self->textures[i] == tex)
+         self->textures[i] = 0;
+   }
+}
+
+void
+o_gl_state_bind_array_buffer (struct o_gl_state *self, GLuint buffer)
+{
+   assert (self != NULL);
+
+   if (issue (self, self->array_buffer != buffer)) {
+      glBindBuffer (GL_ARRAY_BUFFER, buffer);
+      self->array_buffer = buffer;
+   }
+}
+
+bool
+o_gl_state_has_vertex_arrays (struct o_gl_state *self)
+{
+   assert (self != NULL);
+
+   return self->gen_vertex_arrays != NULL;
+}
+
+GLuint
+o_gl_state_gen_vertex_array (struct o_gl_state *self)
+{
+   assert (self != NULL);
+   assert (o_gl_state_has_vertex_arrays (self));
+
+   GLuint vertex_array = 0;
+
+   issue (self, true);
+   self->gen_vertex_arrays (1, &vertex_array);
+
+   return vertex_array;
+}
+
+void
+o_gl_state_bind_vertex_array (struct o_gl_state *self, GLuint vertex_array)
+{
+   assert (self != NULL);
+   assert (o_gl_state_has_vertex_arrays (self));
+
+   if (issue (self, self->vertex_array != vertex_array)) {
+      self->bind_vertex_array (vertex_array);
+      self->vertex_array = vertex_array;
+
+      /* enabled arrays are per vertex array object */
+      self->enabled_attribs_known = false;
+   }
+}
+
+void
+o_gl_state_delete_vertex_array (struct o_gl_state *self,
+                                GLuint vertex_array)
+{
+   assert (self != NULL);
+   assert (o_gl_state_has_vertex_arrays (self));
+
+   issue (self, true);
+   self->delete_vertex_arrays (1, &vertex_array);
+
+   if (self->vertex_array == vertex_array) {
+      self->vertex_array = 0;
+      self->enabled_attribs_known = false;
+   }
+}
+
+void
+o_gl_state_set_attribs (struct o_gl_state *self, uint32_t mask)
+{
+   assert (self != NULL);
+
+   /* Only the attributes enabled before or after count, so that the ones
+    * never used don't show as avoided calls. GLES2 guarantees at least 8
+    * vertex attributes, and we use fewer: if which are enabled is not
+    * known, all of them are set.
+    */
+   uint32_t used, changed;
+   if (self->enabled_attribs_known) {
+      used = self->enabled_attribs | mask;
+      changed = self->enabled_attribs ^ mask;
+   } else {
+      used = 0xff;
+      changed = 0xff;
+   }
+
+   for (uint32_t i = 0; i < 8; i++) {
+      if ((used & (1u << i)) == 0)
+         continue;
+
+      if (! issue (self, (changed & (1u << i)) != 0))
+         continue;
+
+      if (mask & (1u << i))
+         glEnableVertexAttribArray (i);
+      else
+         glDisableVertexAttribArray (i);
+   }
+
+   self->enabled_attribs = mask;
+   self->enabled_attribs_known = true;
+}
+
+void
+o_gl_state_set_blend (struct o_gl_state *self,
+                      bool enabled,
+                      GLenum src,
+                      GLenum dst)
+{
+   assert (self != NULL);
+
+   GLenum blend = enabled ? GL_TRUE : GL_FALSE;
+   if (issue (self, self->blend != blend)) {
+      if (enabled)
+         glEnable (GL_BLEND);
+      else
+         glDisable (GL_BLEND);
+      self->blend = blend;
+   }
+
+   if (! enabled)
+      return;
+
+   if (issue (self, self->blend_src != src || self->blend_dst != dst)) {
+      glBlendFunc (src, dst);
+      self->blend_src = src;
+      self->blend_dst = dst;
+   }
+}
+
+void
+o_gl_state_set_clear_color (struct o_gl_state *self,
+                            GLfloat r,
+                            GLfloat g,
+                            GLfloat b,
+                            GLfloat a)
+{
+   assert (self != NULL);
+
+   GLfloat color[4] = { r, g, b, a };
+   bool needed = ! self->clear_color_known
+      || memcmp (self->clear_color, color, sizeof (color)) != 0;
+
+   if (issue (self, needed)) {
+      glClearColor (r, g, b, a);
+      memcpy (self->clear_color, color, sizeof (color));
+      self->clear_color_known = true;
+   }
+}
+
+void
+o_gl_state_count_calls (struct o_gl_state *self, uint32_t calls)
+{
+   assert (self != NULL);
+
+   self->calls += calls;
+   self->frame_calls += calls;
+}
+
+void
+o_gl_state_end_frame (struct o_gl_state *self)
+{
+   assert (self != NULL);
+
+   self->frames++;
+   self->last_frame_calls = self->frame_calls;
+   self->frame_calls = 0;
+}
+
+void
+o_gl_state_print_stats (struct o_gl_state *self)
+{
+   assert (self != NULL);
+
+   printf ("GL state: %lu frames, %lu calls issued (%lu in the last frame), "
+           "%lu redundant calls skipped; vertex array objects %s\n",
+           (unsigned long) self->frames,
+           (unsigned long) self->calls,
+           (unsigned long) self->last_frame_calls,
+           (unsigned long) self->skipped,
+           o_gl_state_has_vertex_arrays (self) ? "used" : "not supported");
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "common/gl-proc.h"
+
+/* Shadows the bits of GL state the render loop touches, so that calls that
+ * would set a state to the value it already has are skipped. All changes to
+ * the tracked state must go through this layer; code that changes it behind
+ * its back (e.g. texture uploads) must call o_gl_state_invalidate().
+ *
+ * It also exposes OES_vertex_array_object where the driver supports it.
+ */
+
+#define O_GL_STATE_MAX_TEXTURE_UNITS 8
+
+struct o_gl_state {
+   GLuint program;
+   GLenum active_texture;
+   GLuint textures[O_GL_STATE_MAX_TEXTURE_UNITS];
+   GLuint array_buffer;
+   GLuint vertex_array;
+   uint32_t enabled_attribs;
+   bool enabled_attribs_known;
+
+   GLenum blend;
+   GLenum blend_src;
+   GLenum blend_dst;
+
+   GLfloat clear_color[4];
+   bool clear_color_known;
+
+   /* OES_vertex_array_object entry points, NULL if not supported */
+   PFNGLGENVERTEXARRAYSOESPROC gen_vertex_arrays;
+   PFNGLBINDVERTEXARRAYOESPROC bind_vertex_array;
+   PFNGLDELETEVERTEXARRAYSOESPROC delete_vertex_arrays;
+
+   /* statistics */
+   uint64_t frames;
+   uint64_t calls;
+   uint64_t skipped;
+   uint64_t frame_calls;
+   uint64_t last_frame_calls;
+};
+
+/* Must be called with the GL context current. 'get_proc_address' (e.g.
+ * glfwGetProcAddress or eglGetProcAddress) is used to load extension entry
+ * points.
+ */
+void
+o_gl_state_init (struct o_gl_state *self,
+                 GlGetProcAddress get_proc_address);
+
+/* Forgets all the shadowed state, so the next call of each kind goes to GL. */
+void
+o_gl_state_invalidate (struct o_gl_state *self);
+
+void
+o_gl_state_use_program (struct o_gl_state *self, GLuint program);
+
+/* Binds 'tex' to GL_TEXTURE_2D of texture unit 'unit'. */
+void
+o_gl_state_bind_texture (struct o_gl_state *self, uint32_t unit, GLuint tex);
+
+/* Deletes 'tex', forgetting it wherever it was bound. */
+void
+o_gl_state_delete_texture (struct o_gl_state *self, GLuint tex);
+
+void
+o_gl_state_bind_array_buffer (struct o_gl_state *self, GLuint buffer);
+
+bool
+o_gl_state_has_vertex_arrays (struct o_gl_state *self);
+
+GLuint
+o_gl_state_gen_vertex_array (struct o_gl_state *self);
+
+void
+o_gl_state_bind_vertex_array (struct o_gl_state *self, GLuint vertex_array);
+
+void
+o_gl_state_delete_vertex_array (struct o_gl_state *self,
+                                GLuint vertex_array);
+
+/* Enables the vertex attribute arrays in bit 'mask' and disables the rest,
+ * for the currently bound vertex array.
+ */
+void
+o_gl_state_set_attribs (struct o_gl_state *self, uint32_t mask);
+
+void
+o_gl_state_set_blend (struct o_gl_state *self,
+                      bool enabled,
+                      GLenum src,
+                      GLenum dst);
+
+void
+o_gl_state_set_clear_color (struct o_gl_state *self,
+                            GLfloat r,
+                            GLfloat g,
+                            GLfloat b,
+                            GLfloat a);
+
+/* Counts GL calls made outside of this layer, e.g. draws and clears, so
+ * that the statistics cover the whole frame.
+ */
+void
+o_gl_state_count_calls (struct o_gl_state *self, uint32_t calls);
+
+void
+o_gl_state_end_frame (struct o_gl_state *self);
+
+void
+o_gl_state_print_stats (struct o_gl_state *self);
@@ -0,0 +1,268 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <assert.h>
+#include "common/gl-debug.h"
+#include "common/gl-proc.h"
+#include "common/now.h"
+#include "gpu-timer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void
+add_sample (struct o_gpu_timer_samples *samples, double value)
+{
+   samples->values[samples->next] = value;
+   samples->next = (samples->next + 1) % O_GPU_TIMER_HISTORY;
+   if (samples->count < O_GPU_TIMER_HISTORY)
+      samples->count++;
+}
+
+static int
+compare_doubles (const void *a, const void *b)
+{
+   double da = *(const double *) a;
+   double db = *(const double *) b;
+
+   return (da > db) - (da < db);
+}
+
+static void
+print_samples (const char *label, struct o_gpu_timer_samples *samples)
+{
+   if (samples->count == 0) {
+      printf ("  %s      -\n", label);
+      return;
+   }
+
+   double sorted[O_GPU_TIMER_HISTORY];
+   memcpy (sorted, samples->values, samples->count * sizeof (double));
+   qsort (sorted, samples->count, sizeof (double), compare_doubles);
+
+   double sum = 0;
+   for (uint32_t i = 0; i < samples->count; i++)
+      sum += sorted[i];
+
+   uint32_t p99 = (samples->count * 99 + 99) / 100 - 1;
+
+   printf ("  %s %8.3f %8.3f %8.3f ms\n",
+           label,
+           sorted[0],
+           sum / samples->count,
+           sorted[p99]);
+}
+
+/* Reads the result of the query in ring 'slot' for 'region' if it is
+ * available, or unconditionally if 'wait' is true. Returns false if it is
+ * still pending.
+ */
+static bool
+collect (struct o_gpu_timer *self, uint32_t slot, uint32_t region, bool wait)
+{
+   if (! self->pending[slot][region])
+      return true;
+
+   GLuint query = self->queries[slot][region];
+
+   if (! wait) {
+      GLuint available = GL_FALSE;
+      self->GetQueryObjectuiv (query,
+                               GL_QUERY_RESULT_AVAILABLE_EXT,
+                               &available);
+      if (! available)
+         return false;
+   }
+
+   GLuint64 elapsed_ns = 0;
+   self->GetQueryObjectui64v (query, GL_QUERY_RESULT_EXT, &elapsed_ns);
+   self->pending[slot][region] = false;
+
+   /* Reading GL_GPU_DISJOINT_EXT also resets it. A disjoint event makes
+    * the results of all queries in flight meaningless, but there is no way
+    * to tell which ones; discarding the one read now is a good enough
+    * approximation for statistics.
+    */
+   GLint disjoint = GL_FALSE;
+   glGetIntegerv (GL_GPU_DISJOINT_EXT, &disjoint);
+   if (disjoint) {
+      self->disjoint++;
+      return true;
+   }
+
+   add_sample (&self->gpu[region], elapsed_ns / 1000000.0);
+
+   return true;
+}
+
+/* public API */
+
+void
+o_gpu_timer_init (struct o_gpu_timer *self,
+                  const char *const *names,
+                  uint32_t num_regions,
+                  GlGetProcAddress get_proc_address)
+{
+   assert (self != NULL);
+   assert (names != NULL);
+   assert (num_regions > 0 && num_regions <= O_GPU_TIMER_MAX_REGIONS);
+
+   memset (self, 0x00, sizeof (struct o_gpu_timer));
+
+   self->names = names;
+   self->num_regions = num_regions;
+   self->active_region = -1;
+
+   if (get_proc_address == NULL
+       || ! gl_has_extension ("GL_EXT_disjoint_timer_query")) {
+      return;
+   }
+
+   self->GenQueries = (PFNGLGENQUERIESEXTPROC)
+      get_proc_address ("glGenQueriesEXT");
+   self->DeleteQueries = (PFNGLDELETEQUERIESEXTPROC)
+      get_proc_address ("glDeleteQueriesEXT");
+   self->BeginQuery = (PFNGLBEGINQUERYEXTPROC)
+      get_proc_address ("glBeginQueryEXT");
+   self->EndQuery = (PFNGLENDQUERYEXTPROC)
+      get_proc_address ("glEndQueryEXT");
+   self->GetQueryObjectuiv = (PFNGLGETQUERYOBJECTUIVEXTPROC)
+      get_proc_address ("glGetQueryObjectuivEXT");
+   self->GetQueryObjectui64v = (PFNGLGETQUERYOBJECTUI64VEXTPROC)
+      get_proc_address ("glGetQueryObjectui64vEXT");
+
+   if (self->GenQueries == NULL
+       || self->DeleteQueries == NULL
+       || self->BeginQuery == NULL
+       || self->EndQuery == NULL
+       || self->GetQueryObjectuiv == NULL
+       || self->GetQueryObjectui64v == NULL) {
+      return;
+   }
+
+   GL_CHECK ();
+   for (uint32_t i = 0; i < O_GPU_TIMER_LATENCY; i++)
+      self->GenQueries (num_regions, self->queries[i]);
+
+   /* reset any disjoint event from before we started */
+   GLint disjoint;
+   glGetIntegerv (GL_GPU_DISJOINT_EXT, &disjoint);
+
+   /* drivers may expose the extension without quite supporting it */
+   self->supported = gl_debug_take_error () == GL_NO_ERROR;
+}
+
+void
+o_gpu_timer_clear (struct o_gpu_timer *self)
+{
+   assert (self != NULL);
+
+   if (self->supported) {
+      for (uint32_t i = 0; i < O_GPU_TIMER_LATENCY; i++)
+         self->DeleteQueries (self->num_regions, self->queries[i]);
+   }
+
+   self->supported = false;
+}
+
+void
+o_gpu_timer_begin (struct o_gpu_timer *self, uint32_t region)
+{
+   assert (self != NULL);
+   assert (region < self->num_regions);
+   assert (self->active_region < 0);
+
+   self->active_region = region;
+   self->active_query = false;
+
+   /* The first frame's GPU times include driver warm-up, and some drivers
+    * report bogus results for the very first query of a context.
+    */
+   if (self->supported && self->frames > 0) {
+      /* The GPU is more than O_GPU_TIMER_LATENCY frames behind: skip this
+       * measurement rather than waiting for it.
+       */
+      if (collect (self, self->slot, region, false)) {
+         self->BeginQuery (GL_TIME_ELAPSED_EXT,
+                           self->queries[self->slot][region]);
+         self->active_query = true;
+      } else {
+         self->dropped++;
+      }
+   }
+
+   self->cpu_start = now_ms ();
+}
+
+void
+o_gpu_timer_end (struct o_gpu_timer *self, uint32_t region)
+{
+   assert (self != NULL);
+   assert (self->active_region == (int32_t) region);
+
+   add_sample (&self->cpu[region], now_ms () - self->cpu_start);
+
+   if (self->active_query) {
+      self->EndQuery (GL_TIME_ELAPSED_EXT);
+      self->pending[self->slot][region] = true;
+   }
+
+   self->active_region = -1;
+   self->active_query = false;
+}
+
+void
+o_gpu_timer_end_frame (struct o_gpu_timer *self)
+{
+   assert (self != NULL);
+   assert (self->active_region < 0);
+
+   self->frames++;
+
+   if (! self->supported)
+      return;
+
+   for (uint32_t slot = 0; slot < O_GPU_TIMER_LATENCY; slot++) {
+      for (uint32_t region = 0; region < self->num_regions; region++)
+         collect (self, slot, region, false);
+   }
+
+   self->slot = (self->slot + 1) % O_GPU_TIMER_LATENCY;
+}
+
+void
+o_gpu_timer_flush (struct o_gpu_timer *self)
+{
+   assert (self != NULL);
+   assert (self->active_region < 0);
+
+   if (! self->supported)
+      return;
+
+   for (uint32_t slot = 0; slot < O_GPU_TIMER_LATENCY; slot++) {
+      for (uint32_t region = 0; region < self->num_regions; region++)
+         collect (self, slot, region, true);
+   }
+}
+
+void
+o_gpu_timer_print_stats (struct o_gpu_timer *self)
+{
+   assert (self != NULL);
+
+   printf ("Frame timings (last %u samples)    min      avg      p99\n",
+           O_GPU_TIMER_HISTORY);
+
+   for (uint32_t i = 0; i < self->num_regions; i++) {
+      printf (" %s\n", self->names[i]);
+      print_samples ("CPU", &self->cpu[i]);
+      if (self->supported)
+         print_samples ("GPU", &self->gpu[i]);
+   }
+
+   if (! self->supported)
+      printf (" GPU times not available (no EXT_disjoint_timer_query)\n");
+   else if (self->dropped > 0 || self->disjoint > 0)
+      printf (" %u GPU samples dropped, %u discarded as disjoint\n",
+              self->dropped,
+              self->disjoint);
+}
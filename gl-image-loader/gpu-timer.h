@@ -0,0 +1,93 @@
+#pragma once
+
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gl-state.h"
+
+/* Measures how long the GPU and the CPU spend in named regions of a frame.
+ *
+ * GPU times come from EXT_disjoint_timer_query (GL_TIME_ELAPSED). Queries
+ * are kept in a ring of O_GPU_TIMER_LATENCY frames, and each result is
+ * collected several frames after it was issued, once it is available, so
+ * reading it never stalls the pipeline. Results spanning a disjoint event
+ * (e.g. a GPU frequency change) are discarded.
+ *
+ * Both GPU and CPU times feed rolling statistics over the last
+ * O_GPU_TIMER_HISTORY samples of each region.
+ */
+
+#define O_GPU_TIMER_MAX_REGIONS 8
+#define O_GPU_TIMER_LATENCY 4
+#define O_GPU_TIMER_HISTORY 256
+
+struct o_gpu_timer_samples {
+   double values[O_GPU_TIMER_HISTORY];
+   uint32_t count;
+   uint32_t next;
+};
+
+struct o_gpu_timer {
+   /* false if the driver has no timer queries, only CPU times are kept */
+   bool supported;
+
+   PFNGLGENQUERIESEXTPROC GenQueries;
+   PFNGLDELETEQUERIESEXTPROC DeleteQueries;
+   PFNGLBEGINQUERYEXTPROC BeginQuery;
+   PFNGLENDQUERYEXTPROC EndQuery;
+   PFNGLGETQUERYOBJECTUIVEXTPROC GetQueryObjectuiv;
+   PFNGLGETQUERYOBJECTUI64VEXTPROC GetQueryObjectui64v;
+
+   const char *const *names;
+   uint32_t num_regions;
+
+   GLuint queries[O_GPU_TIMER_LATENCY][O_GPU_TIMER_MAX_REGIONS];
+   bool pending[O_GPU_TIMER_LATENCY][O_GPU_TIMER_MAX_REGIONS];
+   uint32_t slot;
+   uint64_t frames;
+
+   int32_t active_region;
+   bool active_query;
+   double cpu_start;
+
+   struct o_gpu_timer_samples gpu[O_GPU_TIMER_MAX_REGIONS];
+   struct o_gpu_timer_samples cpu[O_GPU_TIMER_MAX_REGIONS];
+
+   /* statistics */
+   uint32_t dropped;
+   uint32_t disjoint;
+};
+
+/* 'names' has one entry per region and must outlive the timer. */
+void
+o_gpu_timer_init (struct o_gpu_timer *self,
+                  const char *const *names,
+                  uint32_t num_regions,
+                  GlGetProcAddress get_proc_address);
+
+void
+o_gpu_timer_clear (struct o_gpu_timer *self);
+
+/* Regions can't nest or overlap. */
+void
+o_gpu_timer_begin (struct o_gpu_timer *self, uint32_t region);
+
+void
+o_gpu_timer_end (struct o_gpu_timer *self, uint32_t region);
+
+/* Collects the results that became available, and moves on to the next
+ * set of queries of the ring.
+ */
+void
+o_gpu_timer_end_frame (struct o_gpu_timer *self);
+
+/* Waits for all results still in flight, e.g. before printing the final
+ * statistics.
+ */
+void
+o_gpu_timer_flush (struct o_gpu_timer *self);
+
+void
+o_gpu_timer_print_stats (struct o_gpu_timer *self);
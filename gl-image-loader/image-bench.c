@@ -0,0 +1,251 @@
+/*
+ * Decodes images with each of the decoder backends, checks that they all
+ * produce the same pixels, and reports decoding throughput.
+ *
+ * With -p, decodes the images once each as a batch instead, reading them
+ * ahead through o_prefetch with the given number of reads in flight, and
+ * reports how long decoding was blocked on I/O. -t forces the pread()
+ * thread pool instead of io_uring. Run it on a cold page cache (e.g. after
+ * 'echo 3 > /proc/sys/vm/drop_caches') to measure disk latency hiding.
+ *
+ * Usage: image-bench [-n <iterations>] <image> [<image> ...]
+ *        image-bench -p <depth> [-t] <image> [<image> ...]
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/now.h"
+#include "image.h"
+#include "prefetch.h"
+
+#define BLOCK_SIZE (64 * 1024)
+
+struct backend {
+   const char *name;
+   uint32_t flags;
+};
+
+static const struct backend backends[] = {
+   { "libpng/libjpeg", O_IMAGE_FLAG_NONE },
+   { "png-fast", O_IMAGE_FLAG_PNG_FAST },
+   { "png-fast (trusted)", O_IMAGE_FLAG_PNG_FAST | O_IMAGE_FLAG_TRUSTED },
+};
+
+#define NUM_BACKENDS (sizeof (backends) / sizeof (backends[0]))
+
+/* Decodes 'image' into a newly allocated buffer, progressively in blocks as
+ * main.c does, returning NULL on failure.
+ */
+static uint8_t *
+decode_image (struct o_image *image, size_t *size, uint8_t *type)
+{
+   size_t row_stride =
+      image->width * (image->format == O_IMAGE_FORMAT_RGB ? 3 : 4);
+   size_t block_rows = BLOCK_SIZE / row_stride;
+   if (block_rows == 0)
+      block_rows = 1;
+
+   uint8_t *pixels = malloc (row_stride * image->height);
+   assert (pixels != NULL);
+
+   ssize_t size_read;
+   size_t first_row;
+   size_t num_rows;
+   size_t offset = 0;
+   do {
+      size_read = o_image_read (image,
+                                pixels + offset,
+                                block_rows * row_stride,
+                                &first_row,
+                                &num_rows);
+      if (size_read < 0) {
+         free (pixels);
+         pixels = NULL;
+         break;
+      }
+      offset += size_read;
+   } while (size_read > 0 && offset < row_stride * image->height);
+
+   *size = row_stride * image->height;
+   *type = image->type;
+   o_image_clear (image);
+
+   return pixels;
+}
+
+static uint8_t *
+decode (const char *filename, uint32_t flags, size_t *size, uint8_t *type)
+{
+   struct o_image image = {0, };
+
+   if (! o_image_init_from_filename_with_flags (&image, filename, flags))
+      return NULL;
+
+   return decode_image (&image, size, type);
+}
+
+/* Decodes all the images once, in order, from memory as o_prefetch reads
+ * them ahead.
+ */
+static int32_t
+decode_batch (const char *const *filenames,
+              uint32_t num_files,
+              uint32_t depth,
+              enum o_prefetch_backend backend)
+{
+   struct o_prefetch prefetch;
+   int32_t result = 0;
+
+   double start = now_ms ();
+
+   if (! o_prefetch_init (&prefetch, filenames, num_files, depth, 0, backend)) {
+      printf ("Failed to set up prefetching: %s\n", strerror (errno));
+      return -1;
+   }
+
+   size_t total_size = 0;
+   for (uint32_t i = 0; i < num_files; i++) {
+      size_t data_size;
+      const uint8_t *data = o_prefetch_get (&prefetch, i, &data_size);
+      if (data == NULL) {
+         printf ("%s: read failed: %s\n", filenames[i], strerror (errno));
+         o_prefetch_release (&prefetch, i);
+         result = -1;
+         continue;
+      }
+
+      struct o_image image = {0, };
+      uint8_t *pixels = NULL;
+      size_t size;
+      uint8_t type;
+      if (o_image_init_from_memory_with_flags (&image,
+                                               data,
+                                               data_size,
+                                               O_IMAGE_FLAG_PNG_FAST)) {
+         pixels = decode_image (&image, &size, &type);
+      }
+
+      o_prefetch_release (&prefetch, i);
+
+      if (pixels == NULL) {
+         printf ("%s: decoding failed\n", filenames[i]);
+         result = -1;
+         continue;
+      }
+
+      total_size += size;
+      free (pixels);
+   }
+
+   double elapsed = now_ms () - start;
+
+   printf ("%u images in %.2f ms, %.1f MB/s of pixels\n",
+           num_files,
+           elapsed,
+           total_size / (elapsed * 1000.0));
+   o_prefetch_print_stats (&prefetch);
+
+   o_prefetch_clear (&prefetch);
+
+   return result;
+}
+
+int32_t
+main (int32_t argc, char *argv[])
+{
+   uint32_t iterations = 10;
+   uint32_t depth = 0;
+   enum o_prefetch_backend backend = O_PREFETCH_BACKEND_AUTO;
+   int32_t first_arg = 1;
+   int32_t result = 0;
+
+   while (first_arg < argc && argv[first_arg][0] == '-') {
+      if (strcmp (argv[first_arg], "-t") == 0) {
+         backend = O_PREFETCH_BACKEND_THREADS;
+         first_arg++;
+      } else if (first_arg + 1 < argc
+                 && strcmp (argv[first_arg], "-n") == 0) {
+         iterations = atoi (argv[first_arg + 1]);
+         first_arg += 2;
+      } else if (first_arg + 1 < argc
+                 && strcmp (argv[first_arg], "-p") == 0) {
+         depth = atoi (argv[first_arg + 1]);
+         first_arg += 2;
+      } else {
+         break;
+      }
+   }
+
+   if (first_arg >= argc || iterations == 0) {
+      printf ("Usage: %s [-n <iterations>] <image> [<image> ...]\n"
+              "       %s -p <depth> [-t] <image> [<image> ...]\n",
+              argv[0],
+              argv[0]);
+      return -1;
+   }
+
+   if (depth > 0) {
+      return decode_batch ((const char *const *) &argv[first_arg],
+                           argc - first_arg,
+                           depth,
+                           backend);
+   }
+
+   for (int32_t i = first_arg; i < argc; i++) {
+      uint8_t *reference = NULL;
+      size_t reference_size = 0;
+
+      printf ("%s\n", argv[i]);
+
+      for (uint32_t b = 0; b < NUM_BACKENDS; b++) {
+         size_t size;
+         uint8_t type;
+         uint8_t *pixels = decode (argv[i], backends[b].flags, &size, &type);
+         if (pixels == NULL) {
+            printf ("   %-20s decoding failed\n", backends[b].name);
+            result = -1;
+            continue;
+         }
+
+         if ((backends[b].flags & O_IMAGE_FLAG_PNG_FAST)
+             && type != O_IMAGE_TYPE_PNG_FAST) {
+            printf ("   %-20s not handled, skipped\n", backends[b].name);
+            free (pixels);
+            continue;
+         }
+
+         bool match = true;
+         if (reference == NULL) {
+            reference = pixels;
+            reference_size = size;
+         } else {
+            match = size == reference_size
+               && memcmp (pixels, reference, size) == 0;
+            free (pixels);
+         }
+
+         double start = now_ms ();
+         for (uint32_t n = 0; n < iterations; n++)
+            free (decode (argv[i], backends[b].flags, &size, &type));
+         double elapsed = (now_ms () - start) / iterations;
+
+         printf ("   %-20s %8.2f ms  %8.1f MB/s  %s\n",
+                 backends[b].name,
+                 elapsed,
+                 size / (elapsed * 1000.0),
+                 match ? "output matches" : "OUTPUT MISMATCH");
+         if (! match)
+            result = -1;
+      }
+
+      free (reference);
+   }
+
+   return result;
+}
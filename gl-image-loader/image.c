@@ -2,35 +2,83 @@
 #include <errno.h>
 #include "image.h"
 
+static bool
+png_format_to_image_format (uint8_t png_format, uint32_t *format)
+{
+   switch (png_format) {
+   case PNG_COLOR_TYPE_RGB:
+      *format = O_IMAGE_FORMAT_RGB;
+      return true;
+   case PNG_COLOR_TYPE_RGB_ALPHA:
+      *format = O_IMAGE_FORMAT_RGBA;
+      return true;
+   default:
+      return false;
+   }
+}
+
 bool
 o_image_init_from_filename (struct o_image *self,
                             const char *filename)
 {
-   assert (self != NULL);
-   assert (filename != NULL);
+   return o_image_init_from_filename_with_flags (self,
+                                                 filename,
+                                                 O_IMAGE_FLAG_NONE);
+}
+
+/* Decodes from 'filename', or from 'data' if 'filename' is NULL. */
+static bool
+init_decoder (struct o_image *self,
+              const char *filename,
+              const void *data,
+              size_t size,
+              uint32_t flags)
+{
+
+   /* Try the whole-buffer PNG backend first, if requested. */
+   if (flags & O_IMAGE_FLAG_PNG_FAST) {
+      bool check_crc = (flags & O_IMAGE_FLAG_TRUSTED) == 0;
+
+      bool ok = filename != NULL ?
+         png_fast_decoder_init_from_filename (&self->png_fast,
+                                              filename,
+                                              check_crc) :
+         png_fast_decoder_init_from_memory (&self->png_fast,
+                                            data,
+                                            size,
+                                            check_crc);
+      if (ok) {
+         if (png_format_to_image_format (self->png_fast.format,
+                                         &self->format)) {
+            self->type = O_IMAGE_TYPE_PNG_FAST;
+            self->width = self->png_fast.width;
+            self->height = self->png_fast.height;
+
+            return true;
+         }
+      }
+
+      png_fast_clear (&self->png_fast);
+   }
 
    /* Try PNG. */
-   bool ok = png_decoder_init_from_filename (&self->png, filename);
+   bool ok = filename != NULL ?
+      png_decoder_init_from_filename (&self->png, filename) :
+      png_decoder_init_from_memory (&self->png, data, size);
    if (ok) {
       self->type = O_IMAGE_TYPE_PNG;
       self->width = self->png.width;
       self->height = self->png.height;
 
-      switch (self->png.format) {
-      case PNG_COLOR_TYPE_RGB:
-         self->format = O_IMAGE_FORMAT_RGB;
-         break;
-      case PNG_COLOR_TYPE_RGB_ALPHA:
-         self->format = O_IMAGE_FORMAT_RGBA;
-         break;
-      default:
+      if (! png_format_to_image_format (self->png.format, &self->format))
          assert (!"PNG image format not handled\n");
-      }
    } else {
       png_clear (&self->png);
 
       /* Try JPEG. */
-      bool ok = jpeg_decoder_init_from_filename (&self->jpeg, filename);
+      bool ok = filename != NULL ?
+         jpeg_decoder_init_from_filename (&self->jpeg, filename) :
+         jpeg_decoder_init_from_memory (&self->jpeg, data, size);
       if (ok) {
          assert (self->jpeg.status == JPEG_STATUS_DECODE_READY);
 
@@ -59,6 +107,86 @@ o_image_init_from_filename (struct o_image *self,
    return true;
 }
 
+bool
+o_image_init_from_filename_with_flags (struct o_image *self,
+                                       const char *filename,
+                                       uint32_t flags)
+{
+   assert (self != NULL);
+   assert (filename != NULL);
+
+   return init_decoder (self, filename, NULL, 0, flags);
+}
+
+bool
+o_image_init_from_memory_with_flags (struct o_image *self,
+                                     const void *data,
+                                     size_t size,
+                                     uint32_t flags)
+{
+   assert (self != NULL);
+   assert (data != NULL);
+
+   return init_decoder (self, NULL, data, size, flags);
+}
+
+bool
+o_image_init_to_filename (struct o_image *self,
+                          const char *filename,
+                          enum o_image_type type,
+                          enum o_image_format format,
+                          uint32_t width,
+                          uint32_t height)
+{
+   assert (self != NULL);
+   assert (filename != NULL);
+   assert (format == O_IMAGE_FORMAT_RGB || format == O_IMAGE_FORMAT_RGBA);
+
+   bool ok;
+
+   switch (type) {
+   case O_IMAGE_TYPE_PNG: {
+      struct png_encode_options options;
+      png_encode_options_init_default (&options);
+
+      ok = png_encoder_init_to_filename (&self->png,
+                                         filename,
+                                         width,
+                                         height,
+                                         format == O_IMAGE_FORMAT_RGB ?
+                                         PNG_COLOR_TYPE_RGB :
+                                         PNG_COLOR_TYPE_RGB_ALPHA,
+                                         &options);
+      break;
+   }
+
+   case O_IMAGE_TYPE_JPEG:
+      ok = jpeg_encoder_init_to_filename (&self->jpeg,
+                                          filename,
+                                          width,
+                                          height,
+                                          format == O_IMAGE_FORMAT_RGB ?
+                                          JPEG_FORMAT_RGB :
+                                          JPEG_FORMAT_EXT_RGBA,
+                                          90);
+      break;
+
+   default:
+      errno = EINVAL;
+      return false;
+   }
+
+   if (! ok)
+      return false;
+
+   self->type = type;
+   self->format = format;
+   self->width = width;
+   self->height = height;
+
+   return true;
+}
+
 void
 o_image_clear (struct o_image *self)
 {
@@ -68,6 +196,8 @@ o_image_clear (struct o_image *self)
       png_clear (&self->png);
    else if (self->type == O_IMAGE_TYPE_JPEG)
       jpeg_clear (&self->jpeg);
+   else if (self->type == O_IMAGE_TYPE_PNG_FAST)
+      png_fast_clear (&self->png_fast);
 }
 
 ssize_t
@@ -94,6 +224,43 @@ o_image_read (struct o_image *self,
                         first_row,
                         num_rows);
 
+   case O_IMAGE_TYPE_PNG_FAST:
+      return png_fast_read (&self->png_fast,
+                            buffer,
+                            size,
+                            first_row,
+                            num_rows);
+
+   default:
+      errno = ENXIO;
+      return -1;
+   }
+}
+
+ssize_t
+o_image_write (struct o_image *self,
+               const void *buffer,
+               size_t size,
+               size_t *first_row,
+               size_t *num_rows)
+{
+   assert (self != NULL);
+
+   switch (self->type) {
+   case O_IMAGE_TYPE_PNG:
+      return png_write (&self->png,
+                        buffer,
+                        size,
+                        first_row,
+                        num_rows);
+
+   case O_IMAGE_TYPE_JPEG:
+      return jpeg_write (&self->jpeg,
+                         buffer,
+                         size,
+                         first_row,
+                         num_rows);
+
    default:
       errno = ENXIO;
       return -1;
@@ -2,6 +2,7 @@
 
 #include "jpeg.h"
 #include "png.h"
+#include "png-fast.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -15,6 +16,19 @@ enum o_image_type {
    O_IMAGE_TYPE_INVALID,
    O_IMAGE_TYPE_PNG,
    O_IMAGE_TYPE_JPEG,
+   O_IMAGE_TYPE_PNG_FAST,
+};
+
+enum o_image_flags {
+   O_IMAGE_FLAG_NONE = 0,
+
+   /* Decode PNGs with the whole-buffer backend (see png-fast.h), falling
+    * back to libpng for the images it doesn't handle.
+    */
+   O_IMAGE_FLAG_PNG_FAST = 1 << 0,
+
+   /* The source is trusted, skip checksum verification where possible. */
+   O_IMAGE_FLAG_TRUSTED = 1 << 1,
 };
 
 struct o_image {
@@ -26,12 +40,39 @@ struct o_image {
 
    struct png_ctx png;
    struct jpeg_ctx jpeg;
+   struct png_fast_ctx png_fast;
 };
 
 bool
 o_image_init_from_filename (struct o_image *self,
                             const char *filename);
 
+bool
+o_image_init_from_filename_with_flags (struct o_image *self,
+                                       const char *filename,
+                                       uint32_t flags);
+
+/* Decodes an image already loaded in memory, e.g. by o_prefetch. The data
+ * is not copied and must stay valid until o_image_clear() is called.
+ */
+bool
+o_image_init_from_memory_with_flags (struct o_image *self,
+                                     const void *data,
+                                     size_t size,
+                                     uint32_t flags);
+
+/* Prepares 'self' for encoding an image of the given type, pixel format and
+ * size into 'filename', using the default settings of each encoder. Pixel
+ * rows are then fed progressively with o_image_write().
+ */
+bool
+o_image_init_to_filename (struct o_image *self,
+                          const char *filename,
+                          enum o_image_type type,
+                          enum o_image_format format,
+                          uint32_t width,
+                          uint32_t height);
+
 void
 o_image_clear (struct o_image *self);
 
@@ -41,3 +82,10 @@ o_image_read (struct o_image *self,
               size_t size,
               size_t *first_row,
               size_t *num_rows);
+
+ssize_t
+o_image_write (struct o_image *self,
+               const void *buffer,
+               size_t size,
+               size_t *first_row,
+               size_t *num_rows);
@@ -17,21 +17,12 @@ handle_error_exit (j_common_ptr cinfo)
    longjmp (err_handler->setjmp_buffer, 1);
 }
 
-/* public API */
-
-bool
-jpeg_decoder_init_from_filename (struct jpeg_ctx *self,
-                                 const char *filename)
+/* Sets up the decompressor, reading from the already opened file or, if
+ * there is none, from 'data'.
+ */
+static bool
+decoder_init (struct jpeg_ctx *self, const void *data, size_t size)
 {
-   assert (self != NULL);
-   assert (filename != NULL);
-
-   memset (self, 0x00, sizeof (struct jpeg_ctx));
-
-   self->file_obj = fopen (filename, "rb");
-   if (self->file_obj == NULL)
-      return false;
-
    /* Set an error manager. */
    self->cinfo.err =
       jpeg_std_error (&self->err_handler.jpeg_error_mgr);
@@ -48,7 +39,10 @@ jpeg_decoder_init_from_filename (struct jpeg_ctx *self,
 
    /* Create and set up the decompression object. */
    jpeg_create_decompress (&self->cinfo);
-   jpeg_stdio_src (&self->cinfo, self->file_obj);
+   if (self->file_obj != NULL)
+      jpeg_stdio_src (&self->cinfo, self->file_obj);
+   else
+      jpeg_mem_src (&self->cinfo, (const unsigned char *) data, size);
 
    /* Read JPEG header. */
    int result = jpeg_read_header (&self->cinfo, true);
@@ -69,6 +63,115 @@ jpeg_decoder_init_from_filename (struct jpeg_ctx *self,
    return true;
 }
 
+/* public API */
+
+bool
+jpeg_decoder_init_from_filename (struct jpeg_ctx *self,
+                                 const char *filename)
+{
+   assert (self != NULL);
+   assert (filename != NULL);
+
+   memset (self, 0x00, sizeof (struct jpeg_ctx));
+
+   self->file_obj = fopen (filename, "rb");
+   if (self->file_obj == NULL)
+      return false;
+
+   return decoder_init (self, NULL, 0);
+}
+
+bool
+jpeg_decoder_init_from_memory (struct jpeg_ctx *self,
+                               const void *data,
+                               size_t size)
+{
+   assert (self != NULL);
+   assert (data != NULL);
+
+   memset (self, 0x00, sizeof (struct jpeg_ctx));
+
+   if (size == 0) {
+      errno = EINVAL;
+      return false;
+   }
+
+   return decoder_init (self, data, size);
+}
+
+bool
+jpeg_encoder_init_to_filename (struct jpeg_ctx *self,
+                               const char *filename,
+                               uint32_t width,
+                               uint32_t height,
+                               enum jpeg_format format,
+                               int32_t quality)
+{
+   assert (self != NULL);
+   assert (filename != NULL);
+   assert (width > 0 && height > 0);
+
+   memset (self, 0x00, sizeof (struct jpeg_ctx));
+
+   uint32_t components;
+   switch (format) {
+   case JPEG_FORMAT_GRAYSCALE:
+      components = 1;
+      break;
+   case JPEG_FORMAT_RGB:
+   case JPEG_FORMAT_EXT_RGB:
+      components = 3;
+      break;
+   case JPEG_FORMAT_EXT_RGBA:
+      components = 4;
+      break;
+   default:
+      errno = EINVAL;
+      return false;
+   }
+
+   self->file_obj = fopen (filename, "wb");
+   if (self->file_obj == NULL)
+      return false;
+
+   self->encoder = true;
+
+   /* Set an error manager. */
+   self->enc_cinfo.err =
+      jpeg_std_error (&self->err_handler.jpeg_error_mgr);
+   self->err_handler.jpeg_error_mgr.error_exit =
+      handle_error_exit;
+
+   self->err_handler.ctx = self;
+
+   if (setjmp (self->err_handler.setjmp_buffer) != 0) {
+      jpeg_clear (self);
+      return false;
+   }
+
+   /* Create and set up the compression object. */
+   jpeg_create_compress (&self->enc_cinfo);
+   self->status = JPEG_STATUS_ENCODE_READY;
+   jpeg_stdio_dest (&self->enc_cinfo, self->file_obj);
+
+   self->enc_cinfo.image_width = width;
+   self->enc_cinfo.image_height = height;
+   self->enc_cinfo.input_components = components;
+   self->enc_cinfo.in_color_space = (J_COLOR_SPACE) format;
+
+   jpeg_set_defaults (&self->enc_cinfo);
+   jpeg_set_quality (&self->enc_cinfo, quality, true);
+
+   jpeg_start_compress (&self->enc_cinfo, true);
+
+   self->row_stride = width * components;
+   self->width = width;
+   self->height = height;
+   self->format = format;
+
+   return true;
+}
+
 void
 jpeg_clear (struct jpeg_ctx *self)
 {
@@ -77,8 +180,12 @@ jpeg_clear (struct jpeg_ctx *self)
       self->file_obj = NULL;
    }
 
-   if (self->status != JPEG_STATUS_NONE)
-      jpeg_destroy_decompress (&self->cinfo);
+   if (self->status != JPEG_STATUS_NONE) {
+      if (self->encoder)
+         jpeg_destroy_compress (&self->enc_cinfo);
+      else
+         jpeg_destroy_decompress (&self->cinfo);
+   }
 
    self->status = JPEG_STATUS_NONE;
 }
@@ -106,6 +213,10 @@ jpeg_read (struct jpeg_ctx *self,
    _first_row = self->cinfo.output_scanline;
 
    uint32_t lines = size / self->row_stride;
+   uint32_t remaining = self->cinfo.output_height - self->cinfo.output_scanline;
+   if (lines > remaining)
+      lines = remaining;
+
    for (int32_t i = 0; i < lines; i++) {
       uint8_t *rowptr[1];
       rowptr[0] = buffer + self->row_stride * i;
@@ -137,3 +248,65 @@ jpeg_read (struct jpeg_ctx *self,
 
    return result;
 }
+
+ssize_t
+jpeg_write (struct jpeg_ctx *self,
+            const void *buffer,
+            size_t size,
+            size_t *first_row,
+            size_t *num_rows)
+{
+   assert (self != NULL);
+   assert (self->encoder);
+   assert (self->status == JPEG_STATUS_ENCODE_READY ||
+           self->status == JPEG_STATUS_DONE);
+   assert (size == 0 || buffer != NULL);
+   assert (self->row_stride > 0 && size >= self->row_stride);
+
+   size_t _num_rows = 0;
+   size_t _first_row = 0;
+   size_t result = 0;
+
+   if (self->status == JPEG_STATUS_DONE)
+      goto out;
+
+   /* libjpeg reports errors by long-jumping, so re-arm the handler for the
+    * duration of this call.
+    */
+   if (setjmp (self->err_handler.setjmp_buffer) != 0) {
+      errno = EIO;
+      return -1;
+   }
+
+   _first_row = self->enc_cinfo.next_scanline;
+
+   uint32_t lines = size / self->row_stride;
+   uint32_t remaining = self->height - self->enc_cinfo.next_scanline;
+   if (lines > remaining)
+      lines = remaining;
+
+   for (uint32_t i = 0; i < lines; i++) {
+      JSAMPROW rowptr[1];
+      rowptr[0] = (JSAMPROW) buffer + self->row_stride * i;
+
+      jpeg_write_scanlines (&self->enc_cinfo, rowptr, 1);
+   }
+
+   _num_rows = self->enc_cinfo.next_scanline - _first_row;
+
+   if (self->enc_cinfo.next_scanline == self->enc_cinfo.image_height) {
+      jpeg_finish_compress (&self->enc_cinfo);
+      self->status = JPEG_STATUS_DONE;
+   }
+
+   result = _num_rows * self->row_stride;
+
+ out:
+   if (first_row != NULL)
+      *first_row = _first_row;
+
+   if (num_rows != NULL)
+      *num_rows = _num_rows;
+
+   return result;
+}
@@ -54,6 +54,8 @@ struct jpeg_error_handler {
 struct jpeg_ctx {
    FILE *file_obj;
    struct jpeg_decompress_struct cinfo;
+   struct jpeg_compress_struct enc_cinfo;
+   bool encoder;
 
    struct jpeg_error_mgr err_manager;
 
@@ -71,6 +73,26 @@ bool
 jpeg_decoder_init_from_filename (struct jpeg_ctx *self,
                                  const char *filename);
 
+/* Decodes from 'data' instead of a file. The data is not copied and must
+ * stay valid until jpeg_clear() is called.
+ */
+bool
+jpeg_decoder_init_from_memory (struct jpeg_ctx *self,
+                               const void *data,
+                               size_t size);
+
+/* 'format' is one of JPEG_FORMAT_GRAYSCALE, JPEG_FORMAT_RGB or
+ * JPEG_FORMAT_EXT_RGBA (the alpha channel is dropped), and 'quality' is in
+ * the 0-100 range used by libjpeg.
+ */
+bool
+jpeg_encoder_init_to_filename (struct jpeg_ctx *self,
+                               const char *filename,
+                               uint32_t width,
+                               uint32_t height,
+                               enum jpeg_format format,
+                               int32_t quality);
+
 void
 jpeg_clear (struct jpeg_ctx *self);
 
@@ -80,3 +102,10 @@ jpeg_read (struct jpeg_ctx *self,
            size_t size,
            size_t *first_row,
            size_t *num_rows);
+
+ssize_t
+jpeg_write (struct jpeg_ctx *self,
+            const void *buffer,
+            size_t size,
+            size_t *first_row,
+            size_t *num_rows);
@@ -6,47 +6,51 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "common/gl-debug.h"
+#include "common/gl-program-cache.h"
+#include "gl-state.h"
+#include "gpu-timer.h"
 #include "image.h"
+#include "texture-manager.h"
 
 #define IMAGE_FILENAME_DEFAULT "./igalia-white-text.png"
 
-static bool
-gl_utils_print_shader_log (GLuint shader)
-{
-   GLint length;
-   char buffer[4096] = {0};
-   GLint success;
-
-   glGetShaderiv (shader, GL_INFO_LOG_LENGTH, &length);
-   if (length == 0)
-      return true;
-
-   glGetShaderInfoLog (shader, 4096, NULL, buffer);
-   if (strlen (buffer) > 0)
-      printf ("Shader compilation log: %s\n", buffer);
-
-   glGetShaderiv (shader, GL_COMPILE_STATUS, &success);
-
-   return success == GL_TRUE;
-}
-
-static GLuint
-gl_utils_load_shader (const char *shader_source, GLenum type)
-{
-   GLuint shader = glCreateShader (type);
-
-   glShaderSource (shader, 1, &shader_source, NULL);
-   assert (glGetError () == GL_NO_ERROR);
-   glCompileShader (shader);
-   assert (glGetError () == GL_NO_ERROR);
-
-   gl_utils_print_shader_log (shader);
-
-   return shader;
-}
+/* Default GPU memory budget for textures, in MiB. */
+#define TEXTURE_BUDGET_DEFAULT 256
+
+/* Vertex attribute locations, bound in create_shader_program(). */
+#define ATTRIB_POS 0
+#define ATTRIB_TEXTURE 1
+
+/* Timed regions of a frame. */
+enum {
+   TIMER_UPLOAD,
+   TIMER_DRAW,
+   TIMER_SWAP,
+   NUM_TIMERS,
+};
+
+static const char *const timer_names[NUM_TIMERS] = {
+   "upload",
+   "draw",
+   "swap",
+};
+
+static struct gl_debug gl_debug;
+static struct o_gl_state gl_state;
+static struct o_gpu_timer gpu_timer;
+
+/* Set when the window contents must be redrawn: resize, expose or a
+ * different image. The loop sleeps in glfwWaitEvents() otherwise.
+ */
+static bool damaged = true;
+static struct o_texture_manager texture_manager;
+static struct o_texture **textures = NULL;
+static uint32_t num_textures = 0;
+static uint32_t current_texture = 0;
 
 static GLuint
-create_shader_program (void)
+create_shader_program (struct gl_program_cache *program_cache)
 {
    const char *VERTEX_SOURCE =
       "attribute vec2 pos;\n"
@@ -65,53 +69,178 @@ create_shader_program (void)
       "  gl_FragColor = texture2D(u_tex, v_texture);\n"
       "}\n";
 
-   GLuint vertex_shader = gl_utils_load_shader (VERTEX_SOURCE,
-                                                GL_VERTEX_SHADER);
-   assert (vertex_shader >= 0);
-   assert (glGetError () == GL_NO_ERROR);
+   const char *sources[] = { VERTEX_SOURCE, FRAGMENT_SOURCE };
+   const GLenum types[] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
 
-   GLuint fragment_shader = gl_utils_load_shader (FRAGMENT_SOURCE,
-                                                  GL_FRAGMENT_SHADER);
-   assert (fragment_shader >= 0);
-   assert (glGetError () == GL_NO_ERROR);
+   const char *attribs[2];
+   attribs[ATTRIB_POS] = "pos";
+   attribs[ATTRIB_TEXTURE] = "texture";
 
-   GLuint program = glCreateProgram ();
-   assert (glGetError () == GL_NO_ERROR);
-   glAttachShader (program, vertex_shader);
-   assert (glGetError () == GL_NO_ERROR);
-   glAttachShader (program, fragment_shader);
-   assert (glGetError () == GL_NO_ERROR);
+   /* Loaded from the program binary cache if built in an earlier run. */
+   GLuint program = gl_program_cache_get_program (program_cache,
+                                                  sources,
+                                                  types,
+                                                  2,
+                                                  attribs,
+                                                  2);
+   assert (program != 0);
+   GL_CHECK ();
 
-   glBindAttribLocation (program, 0, "pos");
-   glBindAttribLocation (program, 1, "texture");
+   return program;
+}
 
-   glLinkProgram (program);
-   assert (glGetError () == GL_NO_ERROR);
+/* Creates a static vertex buffer with a full-screen quad, interleaving the
+ * positions and texture coordinates, and sets up the vertex attributes to
+ * source from it. Where vertex array objects are supported, that setup is
+ * recorded into one, which is returned; it is left bound either way.
+ */
+static GLuint
+create_quad (GLuint *vbo)
+{
+   static const GLfloat s_quad[4][4] = {
+      /* pos          texture */
+      { -1.0,  1.0,   0, 0 },
+      {  1.0,  1.0,   1, 0 },
+      { -1.0, -1.0,   0, 1 },
+      {  1.0, -1.0,   1, 1 },
+   };
+
+   GLuint vao = 0;
+   if (o_gl_state_has_vertex_arrays (&gl_state)) {
+      vao = o_gl_state_gen_vertex_array (&gl_state);
+      o_gl_state_bind_vertex_array (&gl_state, vao);
+   }
 
-   glDeleteShader (vertex_shader);
-   glDeleteShader (fragment_shader);
+   glGenBuffers (1, vbo);
+   o_gl_state_bind_array_buffer (&gl_state, *vbo);
+   glBufferData (GL_ARRAY_BUFFER, sizeof (s_quad), s_quad, GL_STATIC_DRAW);
+   GL_CHECK ();
+
+   glVertexAttribPointer (ATTRIB_POS,
+                          2,
+                          GL_FLOAT,
+                          GL_FALSE,
+                          sizeof (s_quad[0]),
+                          (const void *) 0);
+   glVertexAttribPointer (ATTRIB_TEXTURE,
+                          2,
+                          GL_FLOAT,
+                          GL_FALSE,
+                          sizeof (s_quad[0]),
+                          (const void *) (2 * sizeof (GLfloat)));
+   o_gl_state_set_attribs (&gl_state,
+                           (1 << ATTRIB_POS) | (1 << ATTRIB_TEXTURE));
+   GL_CHECK ();
+
+   return vao;
+}
 
-   return program;
+static void
+framebuffer_size_callback (GLFWwindow *window, int32_t width, int32_t height)
+{
+   glViewport (0, 0, width, height);
+   damaged = true;
+}
+
+static void
+window_refresh_callback (GLFWwindow *window)
+{
+   damaged = true;
+}
+
+static void
+key_callback (GLFWwindow *window,
+              int32_t key,
+              int32_t scancode,
+              int32_t action,
+              int32_t mods)
+{
+   if (action != GLFW_PRESS)
+      return;
+
+   switch (key) {
+   case GLFW_KEY_RIGHT:
+   case GLFW_KEY_SPACE:
+      current_texture = (current_texture + 1) % num_textures;
+      break;
+
+   case GLFW_KEY_LEFT:
+      current_texture = (current_texture + num_textures - 1) % num_textures;
+      break;
+
+   case GLFW_KEY_ESCAPE:
+      glfwSetWindowShouldClose (window, GLFW_TRUE);
+      return;
+
+   default:
+      return;
+   }
+
+   damaged = true;
+
+   printf ("Showing %s\n", textures[current_texture]->filename);
+   o_texture_manager_print_stats (&texture_manager);
 }
 
 int32_t
 main (int32_t argc, char *argv[])
 {
-   printf ("Usage: %s <path-to-PNG-or-JPEG-image>\n", argv[0]);
-
-   /* Load an decode an image. */
-   static struct o_image image;
+   printf ("Usage: %s [-b <texture-budget-MiB>] [-s <swap-interval>] "
+           "[-f <max-fps>] [-t <timings-interval-sec>] "
+           "[<path-to-PNG-or-JPEG-image> ...]\n", argv[0]);
+   printf ("Use left/right arrows or space to switch images\n");
+
+   size_t budget = TEXTURE_BUDGET_DEFAULT;
+   int32_t swap_interval = 1;
+   double max_fps = 0;
+   double timings_interval = 0;
+   int32_t first_image_arg = 1;
+   while (first_image_arg + 1 < argc && argv[first_image_arg][0] == '-') {
+      const char *value = argv[first_image_arg + 1];
+
+      if (strcmp (argv[first_image_arg], "-b") == 0)
+         budget = atoi (value);
+      else if (strcmp (argv[first_image_arg], "-s") == 0)
+         swap_interval = atoi (value);
+      else if (strcmp (argv[first_image_arg], "-f") == 0)
+         max_fps = atof (value);
+      else if (strcmp (argv[first_image_arg], "-t") == 0)
+         timings_interval = atof (value);
+      else
+         break;
+
+      first_image_arg += 2;
+   }
 
-   const char *image_url;
-   if (argc > 1)
-      image_url = argv[1];
-   else
-      image_url = IMAGE_FILENAME_DEFAULT;
+   const char *default_image_url = IMAGE_FILENAME_DEFAULT;
+   const char **image_urls = (const char **) argv + first_image_arg;
+   uint32_t num_image_urls = argc - first_image_arg;
+   if (num_image_urls == 0) {
+      image_urls = &default_image_url;
+      num_image_urls = 1;
+   }
 
-   /* This loads the image header (metadata), but doesn't load any pixel
-    * data or do any decoding.
+   /* The texture manager owns the GL textures of all images. Acquiring a
+    * texture loads the image header (metadata), but doesn't load any pixel
+    * data or do any decoding until it is first drawn.
     */
-   if (! o_image_init_from_filename (&image, image_url))
+   o_texture_manager_init (&texture_manager,
+                           &gl_state,
+                           budget * 1024 * 1024,
+                           O_IMAGE_FLAG_NONE,
+                           false);
+
+   textures = calloc (num_image_urls, sizeof (struct o_texture *));
+   for (uint32_t i = 0; i < num_image_urls; i++) {
+      struct o_texture *texture =
+         o_texture_manager_acquire (&texture_manager, image_urls[i]);
+      if (texture == NULL) {
+         printf ("Failed to load %s\n", image_urls[i]);
+         continue;
+      }
+      textures[num_textures++] = texture;
+   }
+   if (num_textures == 0)
       return -1;
 
    GLFWwindow* window;
@@ -124,10 +253,13 @@ main (int32_t argc, char *argv[])
    glfwWindowHint (GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
    glfwWindowHint (GLFW_CONTEXT_VERSION_MAJOR, 2);
    glfwWindowHint (GLFW_CONTEXT_VERSION_MINOR, 0);
+#ifndef NDEBUG
+   glfwWindowHint (GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+#endif
 
    /* Create a windowed mode window and its OpenGL context */
-   window = glfwCreateWindow (image.width,
-                              image.height,
+   window = glfwCreateWindow (textures[0]->width,
+                              textures[0]->height,
                               "GL Image Loader",
                               NULL,
                               NULL);
@@ -136,122 +268,167 @@ main (int32_t argc, char *argv[])
       return -1;
    }
 
+   glfwSetKeyCallback (window, key_callback);
+   glfwSetFramebufferSizeCallback (window, framebuffer_size_callback);
+   glfwSetWindowRefreshCallback (window, window_refresh_callback);
+
    /* Make the window's context current */
    glfwMakeContextCurrent (window);
+   glfwSwapInterval (swap_interval);
 
    /* Dump some GL capabilities. */
    const GLubyte *gles_version = glGetString (GL_VERSION);
    printf ("%s\n", (char *) gles_version);
 
-   /* Create a texture for the image. */
-   GLuint tex;
-   glGenTextures (1, &tex);
-   assert (glGetError () == GL_NO_ERROR);
-   assert (tex > 0);
-   glBindTexture (GL_TEXTURE_2D, tex);
-   assert (glGetError () == GL_NO_ERROR);
-   glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-   glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-   /* Load the image into the texture, progressively in chunks of max
-    * BLOCK_SIZE bytes. */
-#define BLOCK_SIZE (8192 * 1)
-   uint8_t buf[BLOCK_SIZE] = {0, };
-   size_t first_row;
-   size_t num_rows;
-
-   GLuint format = image.format == O_IMAGE_FORMAT_RGB ?
-      GL_RGB : GL_RGBA;
-
-   /* Allocate the texture size. */
-   glTexImage2D (GL_TEXTURE_2D,
-                 0,
-                 format,
-                 image.width, image.height,
-                 0,
-                 format,
-                 GL_UNSIGNED_BYTE,
-                 NULL);
-   assert (glGetError () == GL_NO_ERROR);
-
-   ssize_t size_read;
-   do {
-      size_read = o_image_read (&image,
-                                buf,
-                                BLOCK_SIZE,
-                                &first_row,
-                                &num_rows);
-      assert (size_read >= 0);
-      if (size_read > 0) {
-         glTexSubImage2D (GL_TEXTURE_2D,
-                          0,
-                          0, first_row,
-                          image.width, num_rows,
-                          format,
-                          GL_UNSIGNED_BYTE,
-                          buf);
-         assert (glGetError () == GL_NO_ERROR);
-      }
-   } while (size_read > 0);
+   /* GL errors are reported through KHR_debug in debug builds, see
+    * common/gl-debug.h.
+    */
+   gl_debug_init (&gl_debug, (GlGetProcAddress) glfwGetProcAddress);
 
-   glBindTexture (GL_TEXTURE_2D, 0);
-#undef BLOCK_SIZE
+   /* All GL state changes from here on go through gl_state, which skips
+    * the redundant ones.
+    */
+   o_gl_state_init (&gl_state, (GlGetProcAddress) glfwGetProcAddress);
 
    /* Create shader program to sample the texture. */
-   GLuint program = create_shader_program ();
-   glUseProgram (program);
-   assert (glGetError () == GL_NO_ERROR);
+   struct gl_program_cache program_cache;
+   gl_program_cache_init (&program_cache,
+                          NULL,
+                          (GlGetProcAddress) glfwGetProcAddress);
+   GLuint program = create_shader_program (&program_cache);
+   gl_program_cache_print_stats (&program_cache);
+   gl_program_cache_finish (&program_cache);
+
+   /* GPU and CPU time spent in each region of a frame, printed every
+    * 'timings_interval' seconds if set, and on exit.
+    */
+   o_gpu_timer_init (&gpu_timer,
+                     timer_names,
+                     NUM_TIMERS,
+                     (GlGetProcAddress) glfwGetProcAddress);
+   double last_timings_time = glfwGetTime ();
+
+   /* Geometry never changes, upload it once. */
+   GLuint vbo;
+   GLuint vao = create_quad (&vbo);
+
+   /* Frames are only drawn when the window is damaged, and at most
+    * 'max_fps' times per second; otherwise the loop sleeps until an event
+    * arrives.
+    */
+   uint64_t frames_drawn = 0;
+   uint64_t frames_skipped = 0;
+   double next_frame_time = 0;
 
    /* Loop until the user closes the window */
    while (! glfwWindowShouldClose (window)) {
+      double now = glfwGetTime ();
+
+      if (! damaged || now < next_frame_time) {
+         if (! damaged)
+            glfwWaitEvents ();
+         else
+            glfwWaitEventsTimeout (next_frame_time - now);
+
+         if (! damaged)
+            frames_skipped++;
+         continue;
+      }
+
+      damaged = false;
+      if (max_fps > 0)
+         next_frame_time = now + 1.0 / max_fps;
+
       /* Render here */
-      glClearColor (0.25, 0.25, 0.25, 0.5);
+      o_gl_state_set_clear_color (&gl_state, 0.25, 0.25, 0.25, 0.5);
       glClear (GL_COLOR_BUFFER_BIT);
 
-      /* Bind the texture. */
-      glActiveTexture (GL_TEXTURE0);
-      glBindTexture (GL_TEXTURE_2D, tex);
-      assert (glGetError () == GL_NO_ERROR);
+      /* Get the texture, uploading it if it is not resident. Uploads bind
+       * textures behind gl_state's back.
+       */
+      bool upload = textures[current_texture]->tex == 0;
+      if (upload)
+         o_gpu_timer_begin (&gpu_timer, TIMER_UPLOAD);
+
+      GLuint tex = o_texture_manager_use (&texture_manager,
+                                          textures[current_texture]);
+
+      if (upload) {
+         o_gpu_timer_end (&gpu_timer, TIMER_UPLOAD);
+         o_gl_state_invalidate (&gl_state);
+      }
+
+      o_gpu_timer_begin (&gpu_timer, TIMER_DRAW);
+
+      o_gl_state_use_program (&gl_state, program);
+      o_gl_state_bind_texture (&gl_state, 0, tex);
 
       /* Enable blending for transparent PNGs. */
-      glEnable (GL_BLEND);
-      glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      o_gl_state_set_blend (&gl_state,
+                            true,
+                            GL_SRC_ALPHA,
+                            GL_ONE_MINUS_SRC_ALPHA);
 
       /* Draw a quad. */
-      static const GLfloat s_vertices[4][2] = {
-         { -1.0,  1.0 },
-         {  1.0,  1.0 },
-         { -1.0, -1.0 },
-         {  1.0, -1.0 },
-      };
-
-      static const GLfloat s_texturePos[4][2] = {
-         { 0, 0 },
-         { 1, 0 },
-         { 0, 1 },
-         { 1, 1 },
-      };
-
-      glVertexAttribPointer (0, 2, GL_FLOAT, GL_FALSE, 0, s_vertices);
-      glVertexAttribPointer (1, 2, GL_FLOAT, GL_FALSE, 0, s_texturePos);
-
-      glEnableVertexAttribArray (0);
-      glEnableVertexAttribArray (1);
+      if (vao != 0) {
+         o_gl_state_bind_vertex_array (&gl_state, vao);
+      } else {
+         o_gl_state_bind_array_buffer (&gl_state, vbo);
+         o_gl_state_set_attribs (&gl_state,
+                                 (1 << ATTRIB_POS) | (1 << ATTRIB_TEXTURE));
+      }
 
       glDrawArrays (GL_TRIANGLE_STRIP, 0, 4);
+      GL_CHECK ();
+
+      o_gpu_timer_end (&gpu_timer, TIMER_DRAW);
 
-      glDisableVertexAttribArray (0);
-      glDisableVertexAttribArray (1);
+      /* the clear and the draw */
+      o_gl_state_count_calls (&gl_state, 2);
 
       /* Swap front and back buffers */
+      o_gpu_timer_begin (&gpu_timer, TIMER_SWAP);
       glfwSwapBuffers (window);
+      o_gpu_timer_end (&gpu_timer, TIMER_SWAP);
+
+      o_texture_manager_end_frame (&texture_manager);
+      o_gl_state_end_frame (&gl_state);
+      o_gpu_timer_end_frame (&gpu_timer);
+      frames_drawn++;
+
+      GL_FRAME_CHECK ();
 
-      /* Poll and process events */
+      if (timings_interval > 0
+          && now - last_timings_time >= timings_interval) {
+         o_gpu_timer_print_stats (&gpu_timer);
+         last_timings_time = now;
+      }
+
+      /* Process the events that arrived while drawing */
       glfwPollEvents ();
    }
 
+   printf ("Frames: %lu drawn, "
+           "%lu skipped (wake-ups with nothing to redraw)\n",
+           (unsigned long) frames_drawn,
+           (unsigned long) frames_skipped);
+
+   o_texture_manager_print_stats (&texture_manager);
+   o_gl_state_print_stats (&gl_state);
+   o_gpu_timer_flush (&gpu_timer);
+   o_gpu_timer_print_stats (&gpu_timer);
+   o_gpu_timer_clear (&gpu_timer);
+
+   for (uint32_t i = 0; i < num_textures; i++)
+      o_texture_manager_release (&texture_manager, textures[i]);
+   o_texture_manager_clear (&texture_manager);
+   free (textures);
+
+   if (vao != 0)
+      o_gl_state_delete_vertex_array (&gl_state, vao);
+   glDeleteBuffers (1, &vbo);
+   glDeleteProgram (program);
+
    glfwTerminate ();
 
    return 0;
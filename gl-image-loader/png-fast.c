@@ -0,0 +1,626 @@
+#include <assert.h>
+#include <errno.h>
+#include "png-fast.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const uint8_t png_signature[8] = {
+   0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+static uint32_t
+read_u32_be (const uint8_t *src)
+{
+   return ((uint32_t) src[0] << 24) | ((uint32_t) src[1] << 16)
+      | ((uint32_t) src[2] << 8) | (uint32_t) src[3];
+}
+
+/* Walks the chunk at 'offset', returning its data size and type, or false if
+ * it is truncated or its CRC doesn't match.
+ */
+static bool
+next_chunk (struct png_fast_ctx *self,
+            size_t offset,
+            uint32_t *length,
+            const uint8_t **type)
+{
+   if (self->data_size - offset < 12)
+      return false;
+
+   *length = read_u32_be (self->data + offset);
+   *type = self->data + offset + 4;
+
+   if (*length > self->data_size - offset - 12)
+      return false;
+
+   if (self->check_crc) {
+      uLong crc = crc32 (0, *type, *length + 4);
+      if (crc != read_u32_be (*type + 4 + *length))
+         return false;
+   }
+
+   return true;
+}
+
+static bool
+parse_header (struct png_fast_ctx *self)
+{
+   uint32_t length;
+   const uint8_t *type;
+
+   if (self->data_size < 8 || memcmp (self->data, png_signature, 8) != 0)
+      return false;
+
+   if (! next_chunk (self, 8, &length, &type)
+       || memcmp (type, "IHDR", 4) != 0
+       || length != 13) {
+      return false;
+   }
+
+   const uint8_t *ihdr = type + 4;
+   uint8_t bit_depth = ihdr[8];
+   uint8_t compression = ihdr[10];
+   uint8_t filter = ihdr[11];
+   uint8_t interlace = ihdr[12];
+
+   self->width = read_u32_be (ihdr);
+   self->height = read_u32_be (ihdr + 4);
+   self->format = ihdr[9];
+
+   if (self->width == 0 || self->height == 0)
+      return false;
+
+   if (bit_depth != 8
+       || compression != PNG_COMPRESSION_TYPE_BASE
+       || filter != PNG_FILTER_TYPE_BASE
+       || interlace != PNG_INTERLACE_NONE) {
+      return false;
+   }
+
+   switch (self->format) {
+   case PNG_COLOR_TYPE_GRAY:
+      self->bpp = 1;
+      break;
+   case PNG_COLOR_TYPE_GRAY_ALPHA:
+      self->bpp = 2;
+      break;
+   case PNG_COLOR_TYPE_RGB:
+      self->bpp = 3;
+      break;
+   case PNG_COLOR_TYPE_RGB_ALPHA:
+      self->bpp = 4;
+      break;
+   default:
+      /* palette images are left to libpng */
+      return false;
+   }
+
+   self->row_stride = (size_t) self->width * self->bpp;
+
+   return true;
+}
+
+/* Gathers all IDAT chunks and inflates them at once into 'self->inflated'. */
+static bool
+inflate_image (struct png_fast_ctx *self)
+{
+   size_t offset = 8;
+   size_t idat_size = 0;
+   uint32_t idat_count = 0;
+   const uint8_t *first_idat = NULL;
+   uint32_t length;
+   const uint8_t *type;
+
+   /* first pass: validate chunks and measure the compressed data */
+   while (next_chunk (self, offset, &length, &type)) {
+      if (memcmp (type, "IDAT", 4) == 0) {
+         if (first_idat == NULL)
+            first_idat = type + 4;
+         idat_size += length;
+         idat_count++;
+      } else if (memcmp (type, "IEND", 4) == 0) {
+         break;
+      }
+      offset += length + 12;
+   }
+
+   if (idat_count == 0 || idat_size < 2)
+      return false;
+
+   /* a single IDAT chunk is inflated in place, otherwise join them */
+   uint8_t *joined = NULL;
+   const uint8_t *idat = first_idat;
+
+   if (idat_count > 1) {
+      joined = malloc (idat_size);
+      if (joined == NULL)
+         return false;
+
+      size_t copied = 0;
+      offset = 8;
+      while (copied < idat_size && next_chunk (self, offset, &length, &type)) {
+         if (memcmp (type, "IDAT", 4) == 0) {
+            memcpy (joined + copied, type + 4, length);
+            copied += length;
+         }
+         offset += length + 12;
+      }
+      idat = joined;
+   }
+
+   size_t inflated_size = (self->row_stride + 1) * self->height;
+   self->inflated = malloc (inflated_size);
+   if (self->inflated == NULL) {
+      free (joined);
+      return false;
+   }
+
+   /* For trusted sources, skip the 2 bytes zlib header and inflate the raw
+    * deflate stream, which spares computing the Adler-32 of the output.
+    */
+   z_stream zs = {0, };
+   int32_t window_bits = self->check_crc ? 15 : -15;
+   size_t skip = self->check_crc ? 0 : 2;
+
+   if (inflateInit2 (&zs, window_bits) != Z_OK) {
+      free (joined);
+      return false;
+   }
+
+   zs.next_in = (uint8_t *) idat + skip;
+   zs.avail_in = idat_size - skip;
+   zs.next_out = self->inflated;
+   zs.avail_out = inflated_size;
+
+   int32_t ret = inflate (&zs, Z_FINISH);
+   bool ok = ret == Z_STREAM_END && zs.avail_out == 0;
+
+   inflateEnd (&zs);
+   free (joined);
+
+   return ok;
+}
+
+/* Row unfiltering. Each kernel reconstructs a row into 'out' from the
+ * filtered bytes in 'src' and the previous reconstructed row in 'prev'.
+ */
+
+static uint8_t
+paeth_predictor (uint8_t a, uint8_t b, uint8_t c)
+{
+   int32_t p = (int32_t) a + b - c;
+   int32_t pa = abs (p - a);
+   int32_t pb = abs (p - b);
+   int32_t pc = abs (p - c);
+
+   if (pa <= pb && pa <= pc)
+      return a;
+   else if (pb <= pc)
+      return b;
+   else
+      return c;
+}
+
+static void
+unfilter_sub (uint8_t *out, const uint8_t *src, size_t stride, uint8_t bpp)
+{
+   memcpy (out, src, bpp);
+   for (size_t i = bpp; i < stride; i++)
+      out[i] = src[i] + out[i - bpp];
+}
+
+static void
+unfilter_up (uint8_t *out,
+             const uint8_t *src,
+             const uint8_t *prev,
+             size_t stride)
+{
+   size_t i = 0;
+
+#if defined(__SSE2__)
+   for (; i + 16 <= stride; i += 16) {
+      __m128i s = _mm_loadu_si128 ((const __m128i *) (src + i));
+      __m128i p = _mm_loadu_si128 ((const __m128i *) (prev + i));
+      _mm_storeu_si128 ((__m128i *) (out + i), _mm_add_epi8 (s, p));
+   }
+#endif
+
+   for (; i < stride; i++)
+      out[i] = src[i] + prev[i];
+}
+
+static void
+unfilter_avg (uint8_t *out,
+              const uint8_t *src,
+              const uint8_t *prev,
+              size_t stride,
+              uint8_t bpp)
+{
+   for (size_t i = 0; i < bpp; i++)
+      out[i] = src[i] + (prev[i] >> 1);
+   for (size_t i = bpp; i < stride; i++)
+      out[i] = src[i] + ((out[i - bpp] + prev[i]) >> 1);
+}
+
+static void
+unfilter_paeth (uint8_t *out,
+                const uint8_t *src,
+                const uint8_t *prev,
+                size_t stride,
+                uint8_t bpp)
+{
+   for (size_t i = 0; i < bpp; i++)
+      out[i] = src[i] + prev[i];
+   for (size_t i = bpp; i < stride; i++)
+      out[i] = src[i] + paeth_predictor (out[i - bpp], prev[i], prev[i - bpp]);
+}
+
+#if defined(__SSE2__)
+/* SSE2 versions of the Sub, Avg and Paeth filters for 3 and 4 bytes per
+ * pixel. These filters carry a dependency on the pixel to the left, so the
+ * parallelism is across the channels of one pixel, one pixel per iteration.
+ * Pixels are moved as 4 bytes whenever the row has room for it; for 3 bytes
+ * per pixel the extra byte written to 'out' is overwritten by the next pixel.
+ */
+
+static inline __m128i
+load_pixel (const uint8_t *src, size_t remaining, uint8_t bpp)
+{
+   uint32_t value = 0;
+
+   if (remaining >= 4)
+      memcpy (&value, src, 4);
+   else
+      memcpy (&value, src, bpp);
+
+   return _mm_cvtsi32_si128 (value);
+}
+
+static inline void
+store_pixel (uint8_t *dest, __m128i pixel, size_t remaining, uint8_t bpp)
+{
+   uint32_t value = _mm_cvtsi128_si32 (pixel);
+
+   if (remaining >= 4)
+      memcpy (dest, &value, 4);
+   else
+      memcpy (dest, &value, bpp);
+}
+
+static inline void
+unfilter_sub_sse2 (uint8_t *out,
+                   const uint8_t *src,
+                   size_t stride,
+                   uint8_t bpp)
+{
+   __m128i a = _mm_setzero_si128 ();
+
+   for (size_t i = 0; i < stride; i += bpp) {
+      __m128i d = _mm_add_epi8 (load_pixel (src + i, stride - i, bpp), a);
+      store_pixel (out + i, d, stride - i, bpp);
+      a = d;
+   }
+}
+
+static inline void
+unfilter_avg_sse2 (uint8_t *out,
+                   const uint8_t *src,
+                   const uint8_t *prev,
+                   size_t stride,
+                   uint8_t bpp)
+{
+   const __m128i one = _mm_set1_epi8 (1);
+   __m128i a = _mm_setzero_si128 ();
+
+   for (size_t i = 0; i < stride; i += bpp) {
+      __m128i b = load_pixel (prev + i, stride - i, bpp);
+      __m128i d = load_pixel (src + i, stride - i, bpp);
+
+      /* _mm_avg_epu8 rounds up, the PNG average rounds down */
+      __m128i avg = _mm_avg_epu8 (a, b);
+      avg = _mm_sub_epi8 (avg, _mm_and_si128 (_mm_xor_si128 (a, b), one));
+
+      d = _mm_add_epi8 (d, avg);
+      store_pixel (out + i, d, stride - i, bpp);
+      a = d;
+   }
+}
+
+static inline __m128i
+abs_epi16 (__m128i x)
+{
+   return _mm_max_epi16 (x, _mm_sub_epi16 (_mm_setzero_si128 (), x));
+}
+
+static inline __m128i
+select_epi16 (__m128i mask, __m128i a, __m128i b)
+{
+   return _mm_or_si128 (_mm_and_si128 (mask, a), _mm_andnot_si128 (mask, b));
+}
+
+static inline void
+unfilter_paeth_sse2 (uint8_t *out,
+                     const uint8_t *src,
+                     const uint8_t *prev,
+                     size_t stride,
+                     uint8_t bpp)
+{
+   const __m128i zero = _mm_setzero_si128 ();
+   __m128i a = zero;
+   __m128i c = zero;
+
+   for (size_t i = 0; i < stride; i += bpp) {
+      __m128i b =
+         _mm_unpacklo_epi8 (load_pixel (prev + i, stride - i, bpp), zero);
+      __m128i d = load_pixel (src + i, stride - i, bpp);
+
+      /* with p = a + b - c: |p - a| = |b - c|, |p - b| = |a - c| and
+       * |p - c| = |(b - c) + (a - c)|
+       */
+      __m128i pa = _mm_sub_epi16 (b, c);
+      __m128i pb = _mm_sub_epi16 (a, c);
+      __m128i pc = _mm_add_epi16 (pa, pb);
+
+      pa = abs_epi16 (pa);
+      pb = abs_epi16 (pb);
+      pc = abs_epi16 (pc);
+
+      __m128i smallest = _mm_min_epi16 (pc, _mm_min_epi16 (pa, pb));
+      __m128i nearest =
+         select_epi16 (_mm_cmpeq_epi16 (smallest, pa),
+                       a,
+                       select_epi16 (_mm_cmpeq_epi16 (smallest, pb), b, c));
+
+      d = _mm_add_epi8 (d, _mm_packus_epi16 (nearest, nearest));
+      store_pixel (out + i, d, stride - i, bpp);
+
+      c = b;
+      a = _mm_unpacklo_epi8 (d, zero);
+   }
+}
+#endif
+
+static bool
+unfilter_row (uint8_t type,
+              uint8_t *out,
+              const uint8_t *src,
+              const uint8_t *prev,
+              size_t stride,
+              uint8_t bpp)
+{
+#if defined(__SSE2__)
+   /* constant 'bpp' arguments let the compiler specialize each kernel */
+   if (bpp == 3 || bpp == 4) {
+      switch (type) {
+      case PNG_FILTER_VALUE_NONE:
+         memcpy (out, src, stride);
+         return true;
+      case PNG_FILTER_VALUE_SUB:
+         if (bpp == 3)
+            unfilter_sub_sse2 (out, src, stride, 3);
+         else
+            unfilter_sub_sse2 (out, src, stride, 4);
+         return true;
+      case PNG_FILTER_VALUE_UP:
+         unfilter_up (out, src, prev, stride);
+         return true;
+      case PNG_FILTER_VALUE_AVG:
+         if (bpp == 3)
+            unfilter_avg_sse2 (out, src, prev, stride, 3);
+         else
+            unfilter_avg_sse2 (out, src, prev, stride, 4);
+         return true;
+      case PNG_FILTER_VALUE_PAETH:
+         if (bpp == 3)
+            unfilter_paeth_sse2 (out, src, prev, stride, 3);
+         else
+            unfilter_paeth_sse2 (out, src, prev, stride, 4);
+         return true;
+      default:
+         return false;
+      }
+   }
+#endif
+
+   switch (type) {
+   case PNG_FILTER_VALUE_NONE:
+      memcpy (out, src, stride);
+      return true;
+   case PNG_FILTER_VALUE_SUB:
+      unfilter_sub (out, src, stride, bpp);
+      return true;
+   case PNG_FILTER_VALUE_UP:
+      unfilter_up (out, src, prev, stride);
+      return true;
+   case PNG_FILTER_VALUE_AVG:
+      unfilter_avg (out, src, prev, stride, bpp);
+      return true;
+   case PNG_FILTER_VALUE_PAETH:
+      unfilter_paeth (out, src, prev, stride, bpp);
+      return true;
+   default:
+      return false;
+   }
+}
+
+/* public API */
+
+bool
+png_fast_decoder_init_from_memory (struct png_fast_ctx *self,
+                                   const void *data,
+                                   size_t size,
+                                   bool check_crc)
+{
+   assert (self != NULL);
+   assert (data != NULL);
+
+   memset (self, 0x00, sizeof (struct png_fast_ctx));
+
+   self->data = (uint8_t *) data;
+   self->data_size = size;
+   self->check_crc = check_crc;
+
+   if (! parse_header (self)) {
+      png_fast_clear (self);
+      errno = EINVAL;
+      return false;
+   }
+
+   self->prev_row = calloc (1, self->row_stride);
+   if (self->prev_row == NULL) {
+      png_fast_clear (self);
+      errno = ENOMEM;
+      return false;
+   }
+
+   self->status = PNG_STATUS_DECODE_READY;
+
+   return true;
+}
+
+bool
+png_fast_decoder_init_from_filename (struct png_fast_ctx *self,
+                                     const char *filename,
+                                     bool check_crc)
+{
+   assert (self != NULL);
+   assert (filename != NULL);
+
+   FILE *file_obj = fopen (filename, "rb");
+   if (file_obj == NULL)
+      return false;
+
+   /* read the whole file */
+   uint8_t *data = NULL;
+   long size = -1;
+   if (fseek (file_obj, 0, SEEK_END) == 0)
+      size = ftell (file_obj);
+
+   if (size > 0) {
+      rewind (file_obj);
+      data = malloc (size);
+      if (data != NULL && fread (data, 1, size, file_obj) != (size_t) size) {
+         free (data);
+         data = NULL;
+      }
+   }
+   fclose (file_obj);
+
+   if (data == NULL) {
+      errno = EIO;
+      return false;
+   }
+
+   if (! png_fast_decoder_init_from_memory (self, data, size, check_crc)) {
+      free (data);
+      return false;
+   }
+   self->owns_data = true;
+
+   return true;
+}
+
+void
+png_fast_clear (struct png_fast_ctx *self)
+{
+   assert (self != NULL);
+
+   if (self->owns_data)
+      free (self->data);
+   self->data = NULL;
+   self->owns_data = false;
+
+   free (self->inflated);
+   self->inflated = NULL;
+
+   free (self->prev_row);
+   self->prev_row = NULL;
+
+   self->status = PNG_STATUS_NONE;
+}
+
+ssize_t
+png_fast_read (struct png_fast_ctx *self,
+               void *buffer,
+               size_t size,
+               size_t *first_row,
+               size_t *num_rows)
+{
+   assert (self != NULL);
+   assert (self->status == PNG_STATUS_DECODE_READY ||
+           self->status == PNG_STATUS_DONE);
+   assert (size == 0 || buffer != NULL);
+   assert (self->row_stride > 0 && size >= self->row_stride);
+
+   size_t _num_rows = 0;
+   size_t _first_row = 0;
+   size_t result = 0;
+
+   if (self->status == PNG_STATUS_DONE)
+      goto out;
+
+   if (self->inflated == NULL && ! inflate_image (self)) {
+      self->status = PNG_STATUS_ERROR;
+      errno = EINVAL;
+      return -1;
+   }
+
+   _first_row = self->last_decoded_row;
+   uint32_t max_read_rows = size / self->row_stride;
+
+#define MIN(a,b) (a > b ? b : a)
+   _num_rows = MIN (self->height - self->last_decoded_row,
+                    max_read_rows);
+#undef MIN
+
+   /* Rows are reconstructed straight into the caller's buffer. */
+   size_t filtered_stride = self->row_stride + 1;
+   const uint8_t *prev = self->prev_row;
+   for (size_t i = 0; i < _num_rows; i++) {
+      const uint8_t *src =
+         self->inflated + (self->last_decoded_row + i) * filtered_stride;
+      uint8_t *out = (uint8_t *) buffer + i * self->row_stride;
+
+      if (! unfilter_row (src[0],
+                          out,
+                          src + 1,
+                          prev,
+                          self->row_stride,
+                          self->bpp)) {
+         self->status = PNG_STATUS_ERROR;
+         errno = EINVAL;
+         return -1;
+      }
+
+      prev = out;
+   }
+
+   /* the caller's buffer may be reused, keep the last row for the next call */
+   if (_num_rows > 0)
+      memcpy (self->prev_row, prev, self->row_stride);
+
+   self->last_decoded_row += _num_rows;
+   result = _num_rows * self->row_stride;
+
+   if (self->last_decoded_row == self->height) {
+      free (self->inflated);
+      self->inflated = NULL;
+
+      self->status = PNG_STATUS_DONE;
+   }
+
+ out:
+   if (first_row != NULL)
+      *first_row = _first_row;
+
+   if (num_rows != NULL)
+      *num_rows = _num_rows;
+
+   return result;
+}
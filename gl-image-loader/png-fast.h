@@ -0,0 +1,58 @@
+#pragma once
+
+#include "png.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/* An alternative PNG decoder for trusted, locally cached images. Instead of
+ * streaming through libpng, it keeps the whole file in memory, joins all
+ * IDAT chunks in a single buffer, inflates them in one shot and unfilters
+ * rows with SIMD kernels where available. Only 8-bit, non-interlaced gray,
+ * gray+alpha, RGB and RGBA images are handled; initialization fails for
+ * anything else so that callers can fall back to libpng.
+ */
+struct png_fast_ctx {
+   uint8_t *data;
+   size_t data_size;
+   bool owns_data;
+
+   /* When false, chunk CRCs and the zlib Adler-32 are not verified. */
+   bool check_crc;
+
+   enum png_status status;
+
+   uint32_t width;
+   uint32_t height;
+   size_t row_stride;
+   uint8_t format;
+   uint8_t bpp;
+
+   uint8_t *inflated;
+
+   /* Last row returned by png_fast_read(), zeroes before the first one. */
+   uint8_t *prev_row;
+   uint32_t last_decoded_row;
+};
+
+bool
+png_fast_decoder_init_from_filename (struct png_fast_ctx *self,
+                                     const char *filename,
+                                     bool check_crc);
+
+/* 'data' is not copied, and must stay valid until png_fast_clear(). */
+bool
+png_fast_decoder_init_from_memory (struct png_fast_ctx *self,
+                                   const void *data,
+                                   size_t size,
+                                   bool check_crc);
+
+void
+png_fast_clear (struct png_fast_ctx *self);
+
+ssize_t
+png_fast_read (struct png_fast_ctx *self,
+               void *buffer,
+               size_t size,
+               size_t *first_row,
+               size_t *num_rows);
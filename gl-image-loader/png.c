@@ -1,27 +1,84 @@
 #include <assert.h>
 #include <errno.h>
 #include "png.h"
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
-
-bool
-png_decoder_init_from_filename (struct png_ctx *self,
-                                const char *filename)
+#include <zlib.h>
+
+#define PNG_IDAT_CHUNK_SIZE (64 * 1024)
+#define PNG_STRIP_TARGET_SIZE (128 * 1024)
+
+/* A band of consecutive rows that is filtered and deflated on its own, so
+ * that several of them can be compressed at the same time. The rows buffer
+ * holds the row preceding the strip first (needed by the Up, Avg and Paeth
+ * filters), followed by the strip's own rows.
+ */
+struct png_strip {
+   struct png_encoder *encoder;
+
+   uint8_t *rows;
+   uint32_t num_rows;
+   bool last;
+
+   uint8_t *filtered;
+   uint8_t *scratch;
+
+   uint8_t *out;
+   size_t out_size;
+   size_t out_alloc;
+
+   uLong adler;
+   bool ok;
+};
+
+struct png_encoder {
+   struct png_encode_options options;
+   uint8_t bpp;
+   size_t row_stride;
+
+   /* Last row handed to png_write(), unfiltered. Zeroes before the first. */
+   uint8_t *prev_row;
+   uint8_t *filtered_row;
+   uint8_t *scratch_row;
+
+   /* Serial mode: a single raw deflate stream. */
+   z_stream zs;
+   bool zs_ready;
+   uint8_t *zbuf;
+
+   /* Parallel mode: a batch of up to 'num_threads' strips. */
+   struct png_strip *strips;
+   uint32_t num_strips;
+   uint32_t strip_rows;
+
+   /* Adler-32 of all the filtered data, for the zlib stream trailer. */
+   uLong adler;
+
+   uint8_t idat[PNG_IDAT_CHUNK_SIZE];
+   size_t idat_len;
+};
+
+/* libpng read callback for decoders initialized from memory. */
+static void
+read_from_memory (png_structp png_ptr, png_bytep data, png_size_t length)
 {
-   assert (self != NULL);
-   assert (filename != NULL);
+   struct png_ctx *self = png_get_io_ptr (png_ptr);
 
-   memset (self, 0x00, sizeof (struct png_ctx));
+   if (length > self->mem_size - self->mem_offset)
+      png_error (png_ptr, "Read past the end of the PNG data");
 
-  self->file_obj = fopen (filename, "rb");
-  if (self->file_obj == NULL)
-     return false;
+   memcpy (data, self->mem_data + self->mem_offset, length);
+   self->mem_offset += length;
+}
 
+/* Sets up libpng once the source (a file or a memory buffer) is ready and
+ * its first 8 bytes, in 'header', have been consumed.
+ */
+static bool
+decoder_init (struct png_ctx *self, const uint8_t *header)
+{
   /* Check PNG signature. */
-  uint8_t header[8];
-  ssize_t read_size = fread (header, 1, 8, self->file_obj);
-  assert (read_size > 0);
-
   if (png_sig_cmp ((png_const_bytep) header, 0, 8) != 0) {
      png_clear (self);
      errno = EINVAL;
@@ -52,7 +109,10 @@ png_decoder_init_from_filename (struct png_ctx *self,
      return false;
   }
 
-  png_init_io (self->png_ptr, self->file_obj);
+  if (self->file_obj != NULL)
+     png_init_io (self->png_ptr, self->file_obj);
+  else
+     png_set_read_fn (self->png_ptr, self, read_from_memory);
   png_set_sig_bytes (self->png_ptr, 8);
 
   /* @FIXME: does this generates errors? */
@@ -70,11 +130,77 @@ png_decoder_init_from_filename (struct png_ctx *self,
   return true;
 }
 
+bool
+png_decoder_init_from_filename (struct png_ctx *self,
+                                const char *filename)
+{
+   assert (self != NULL);
+   assert (filename != NULL);
+
+   memset (self, 0x00, sizeof (struct png_ctx));
+
+  self->file_obj = fopen (filename, "rb");
+  if (self->file_obj == NULL)
+     return false;
+
+  uint8_t header[8];
+  ssize_t read_size = fread (header, 1, 8, self->file_obj);
+  assert (read_size > 0);
+
+  return decoder_init (self, header);
+}
+
+bool
+png_decoder_init_from_memory (struct png_ctx *self,
+                              const void *data,
+                              size_t size)
+{
+   assert (self != NULL);
+   assert (data != NULL);
+
+   memset (self, 0x00, sizeof (struct png_ctx));
+
+   if (size < 8) {
+      errno = EINVAL;
+      return false;
+   }
+
+   self->mem_data = data;
+   self->mem_size = size;
+   self->mem_offset = 8;
+
+   return decoder_init (self, data);
+}
+
 void
 png_clear (struct png_ctx *self)
 {
    assert (self != NULL);
 
+   if (self->encoder != NULL) {
+      struct png_encoder *encoder = self->encoder;
+
+      if (encoder->zs_ready)
+         deflateEnd (&encoder->zs);
+      free (encoder->zbuf);
+
+      if (encoder->strips != NULL) {
+         for (uint32_t i = 0; i < encoder->options.num_threads; i++) {
+            free (encoder->strips[i].rows);
+            free (encoder->strips[i].filtered);
+            free (encoder->strips[i].scratch);
+            free (encoder->strips[i].out);
+         }
+         free (encoder->strips);
+      }
+
+      free (encoder->prev_row);
+      free (encoder->filtered_row);
+      free (encoder->scratch_row);
+      free (encoder);
+      self->encoder = NULL;
+   }
+
    if (self->png_ptr != NULL) {
       if (self->info_ptr != NULL)
          png_destroy_info_struct (self->png_ptr, &self->info_ptr);
@@ -122,6 +248,14 @@ png_read (struct png_ctx *self,
    for (int32_t i = 0; i < _num_rows; i++)
       rows[i] = buffer + (i * self->row_stride);
 
+   /* Truncated or corrupt data, e.g. from a memory buffer. */
+   if (setjmp (png_jmpbuf (self->png_ptr)) != 0) {
+      free (rows);
+      self->status = PNG_STATUS_ERROR;
+      errno = EIO;
+      return -1;
+   }
+
    png_read_rows (self->png_ptr,
                   rows,
                   NULL,
@@ -146,3 +280,654 @@ png_read (struct png_ctx *self,
 
    return result;
 }
+
+/* encoder */
+
+static void
+write_u32_be (uint8_t *dest, uint32_t value)
+{
+   dest[0] = (value >> 24) & 0xFF;
+   dest[1] = (value >> 16) & 0xFF;
+   dest[2] = (value >> 8) & 0xFF;
+   dest[3] = value & 0xFF;
+}
+
+static bool
+write_chunk (FILE *file_obj,
+             const char *type,
+             const uint8_t *data,
+             uint32_t length)
+{
+   uint8_t header[8];
+   uint8_t crc_be[4];
+
+   write_u32_be (header, length);
+   memcpy (header + 4, type, 4);
+
+   uLong crc = crc32 (0, header + 4, 4);
+   if (length > 0)
+      crc = crc32 (crc, data, length);
+   write_u32_be (crc_be, crc);
+
+   return fwrite (header, 1, 8, file_obj) == 8
+      && (length == 0 || fwrite (data, 1, length, file_obj) == length)
+      && fwrite (crc_be, 1, 4, file_obj) == 4;
+}
+
+static bool
+encoder_flush_idat (struct png_ctx *self)
+{
+   struct png_encoder *encoder = self->encoder;
+
+   if (encoder->idat_len == 0)
+      return true;
+
+   bool ok = write_chunk (self->file_obj,
+                          "IDAT",
+                          encoder->idat,
+                          encoder->idat_len);
+   encoder->idat_len = 0;
+
+   return ok;
+}
+
+/* Appends compressed data to the IDAT stream, splitting it in chunks of
+ * PNG_IDAT_CHUNK_SIZE bytes.
+ */
+static bool
+encoder_emit (struct png_ctx *self, const uint8_t *data, size_t size)
+{
+   struct png_encoder *encoder = self->encoder;
+
+   while (size > 0) {
+      size_t room = PNG_IDAT_CHUNK_SIZE - encoder->idat_len;
+      size_t len = size < room ? size : room;
+
+      memcpy (encoder->idat + encoder->idat_len, data, len);
+      encoder->idat_len += len;
+      data += len;
+      size -= len;
+
+      if (encoder->idat_len == PNG_IDAT_CHUNK_SIZE
+          && ! encoder_flush_idat (self)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static uint8_t
+paeth_predictor (uint8_t a, uint8_t b, uint8_t c)
+{
+   int32_t p = (int32_t) a + b - c;
+   int32_t pa = abs (p - a);
+   int32_t pb = abs (p - b);
+   int32_t pc = abs (p - c);
+
+   if (pa <= pb && pa <= pc)
+      return a;
+   else if (pb <= pc)
+      return b;
+   else
+      return c;
+}
+
+/* Filters one row with the given PNG filter type into 'out', which receives
+ * the filter type byte followed by 'stride' filtered bytes.
+ */
+static void
+filter_row (uint8_t type,
+            uint8_t bpp,
+            size_t stride,
+            const uint8_t *row,
+            const uint8_t *prev,
+            uint8_t *out)
+{
+   out[0] = type;
+   out++;
+
+   switch (type) {
+   case PNG_FILTER_VALUE_NONE:
+      memcpy (out, row, stride);
+      break;
+
+   case PNG_FILTER_VALUE_SUB:
+      memcpy (out, row, bpp);
+      for (size_t i = bpp; i < stride; i++)
+         out[i] = row[i] - row[i - bpp];
+      break;
+
+   case PNG_FILTER_VALUE_UP:
+      for (size_t i = 0; i < stride; i++)
+         out[i] = row[i] - prev[i];
+      break;
+
+   case PNG_FILTER_VALUE_AVG:
+      for (size_t i = 0; i < bpp; i++)
+         out[i] = row[i] - (prev[i] >> 1);
+      for (size_t i = bpp; i < stride; i++)
+         out[i] = row[i] - ((row[i - bpp] + prev[i]) >> 1);
+      break;
+
+   case PNG_FILTER_VALUE_PAETH:
+      for (size_t i = 0; i < bpp; i++)
+         out[i] = row[i] - prev[i];
+      for (size_t i = bpp; i < stride; i++)
+         out[i] = row[i] - paeth_predictor (row[i - bpp],
+                                            prev[i],
+                                            prev[i - bpp]);
+      break;
+
+   default:
+      assert (!"Invalid PNG filter type");
+   }
+}
+
+static uint64_t
+filtered_row_cost (const uint8_t *filtered, size_t stride)
+{
+   uint64_t sum = 0;
+
+   for (size_t i = 1; i <= stride; i++)
+      sum += abs ((int8_t) filtered[i]);
+
+   return sum;
+}
+
+static void
+filter_row_select (enum png_encode_filter filter,
+                   uint8_t bpp,
+                   size_t stride,
+                   const uint8_t *row,
+                   const uint8_t *prev,
+                   uint8_t *out,
+                   uint8_t *scratch)
+{
+   if (filter != PNG_ENCODE_FILTER_ADAPTIVE) {
+      /* the fixed filters map 1:1 to PNG filter types */
+      filter_row ((uint8_t) filter, bpp, stride, row, prev, out);
+      return;
+   }
+
+   filter_row (PNG_FILTER_VALUE_NONE, bpp, stride, row, prev, out);
+   uint64_t best_cost = filtered_row_cost (out, stride);
+
+   for (uint8_t type = PNG_FILTER_VALUE_SUB;
+        type <= PNG_FILTER_VALUE_PAETH;
+        type++) {
+      filter_row (type, bpp, stride, row, prev, scratch);
+
+      uint64_t cost = filtered_row_cost (scratch, stride);
+      if (cost < best_cost) {
+         best_cost = cost;
+         memcpy (out, scratch, stride + 1);
+      }
+   }
+}
+
+static void *
+strip_compress (void *data)
+{
+   struct png_strip *strip = data;
+   struct png_encoder *encoder = strip->encoder;
+   size_t stride = encoder->row_stride;
+   size_t filtered_size = strip->num_rows * (stride + 1);
+
+   strip->ok = false;
+   strip->out_size = 0;
+
+   for (uint32_t i = 0; i < strip->num_rows; i++) {
+      filter_row_select (encoder->options.filter,
+                         encoder->bpp,
+                         stride,
+                         strip->rows + (i + 1) * stride,
+                         strip->rows + i * stride,
+                         strip->filtered + i * (stride + 1),
+                         strip->scratch);
+   }
+
+   strip->adler = adler32 (adler32 (0, NULL, 0),
+                           strip->filtered,
+                           filtered_size);
+
+   /* Each strip is an independent raw deflate stream. All but the last one
+    * end with a sync flush, which byte-aligns the output with a non-final
+    * block, so that the streams can be concatenated into a single valid
+    * one.
+    */
+   z_stream zs = {0, };
+   if (deflateInit2 (&zs,
+                     encoder->options.level,
+                     Z_DEFLATED,
+                     -15,
+                     8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+      return NULL;
+   }
+
+   size_t bound = deflateBound (&zs, filtered_size) + 16;
+   if (strip->out_alloc < bound) {
+      uint8_t *out = realloc (strip->out, bound);
+      if (out == NULL) {
+         deflateEnd (&zs);
+         return NULL;
+      }
+      strip->out = out;
+      strip->out_alloc = bound;
+   }
+
+   int32_t flush = strip->last ? Z_FINISH : Z_SYNC_FLUSH;
+   zs.next_in = strip->filtered;
+   zs.avail_in = filtered_size;
+   zs.next_out = strip->out;
+   zs.avail_out = strip->out_alloc;
+
+   while (true) {
+      int32_t ret = deflate (&zs, flush);
+
+      if (ret == Z_STREAM_END
+          || (ret == Z_OK && flush == Z_SYNC_FLUSH && zs.avail_out > 0)) {
+         strip->ok = true;
+         break;
+      }
+
+      if (ret != Z_OK || zs.avail_out > 0)
+         break;
+
+      /* out of room, grow the output buffer and continue */
+      size_t used = strip->out_alloc;
+      uint8_t *out = realloc (strip->out, strip->out_alloc * 2);
+      if (out == NULL)
+         break;
+      strip->out = out;
+      strip->out_alloc *= 2;
+      zs.next_out = strip->out + used;
+      zs.avail_out = strip->out_alloc - used;
+   }
+
+   strip->out_size = zs.total_out;
+   deflateEnd (&zs);
+
+   return NULL;
+}
+
+/* Compresses the current batch of strips in parallel, and appends their
+ * output to the IDAT stream in order.
+ */
+static bool
+encoder_flush_strips (struct png_ctx *self)
+{
+   struct png_encoder *encoder = self->encoder;
+
+   if (encoder->num_strips == 0)
+      return true;
+
+   pthread_t threads[encoder->num_strips];
+   bool spawned[encoder->num_strips];
+
+   /* the last strip of the batch runs on the calling thread */
+   for (uint32_t i = 0; i < encoder->num_strips - 1; i++) {
+      spawned[i] = pthread_create (&threads[i],
+                                   NULL,
+                                   strip_compress,
+                                   &encoder->strips[i]) == 0;
+      if (! spawned[i])
+         strip_compress (&encoder->strips[i]);
+   }
+   strip_compress (&encoder->strips[encoder->num_strips - 1]);
+
+   bool ok = true;
+   for (uint32_t i = 0; i < encoder->num_strips; i++) {
+      struct png_strip *strip = &encoder->strips[i];
+
+      if (i < encoder->num_strips - 1 && spawned[i])
+         pthread_join (threads[i], NULL);
+
+      ok = ok && strip->ok && encoder_emit (self, strip->out, strip->out_size);
+      encoder->adler = adler32_combine (encoder->adler,
+                                        strip->adler,
+                                        strip->num_rows
+                                        * (encoder->row_stride + 1));
+   }
+
+   /* keep the last row around, it is the 'previous' one of the next strip */
+   struct png_strip *last = &encoder->strips[encoder->num_strips - 1];
+   memcpy (encoder->prev_row,
+           last->rows + last->num_rows * encoder->row_stride,
+           encoder->row_stride);
+
+   encoder->num_strips = 0;
+
+   return ok;
+}
+
+static bool
+encoder_deflate_serial (struct png_ctx *self,
+                        const uint8_t *data,
+                        size_t size,
+                        int32_t flush)
+{
+   struct png_encoder *encoder = self->encoder;
+
+   encoder->zs.next_in = (uint8_t *) data;
+   encoder->zs.avail_in = size;
+
+   do {
+      encoder->zs.next_out = encoder->zbuf;
+      encoder->zs.avail_out = PNG_IDAT_CHUNK_SIZE;
+
+      int32_t ret = deflate (&encoder->zs, flush);
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+         return false;
+
+      if (! encoder_emit (self,
+                          encoder->zbuf,
+                          PNG_IDAT_CHUNK_SIZE - encoder->zs.avail_out)) {
+         return false;
+      }
+   } while (encoder->zs.avail_out == 0);
+
+   return true;
+}
+
+static bool
+encoder_finish (struct png_ctx *self)
+{
+   struct png_encoder *encoder = self->encoder;
+   uint8_t adler_be[4];
+
+   write_u32_be (adler_be, encoder->adler);
+
+   return encoder_emit (self, adler_be, 4)
+      && encoder_flush_idat (self)
+      && write_chunk (self->file_obj, "IEND", NULL, 0)
+      && fflush (self->file_obj) == 0;
+}
+
+void
+png_encode_options_init_default (struct png_encode_options *options)
+{
+   assert (options != NULL);
+
+   options->filter = PNG_ENCODE_FILTER_ADAPTIVE;
+   options->level = PNG_ENCODE_LEVEL_DEFAULT;
+   options->strip_rows = 0;
+
+   long num_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+   options->num_threads = num_cpus > 0 ? num_cpus : 1;
+}
+
+bool
+png_encoder_init_to_filename (struct png_ctx *self,
+                              const char *filename,
+                              uint32_t width,
+                              uint32_t height,
+                              uint8_t format,
+                              const struct png_encode_options *options)
+{
+   assert (self != NULL);
+   assert (filename != NULL);
+   assert (width > 0 && height > 0);
+
+   memset (self, 0x00, sizeof (struct png_ctx));
+
+   uint8_t bpp;
+   switch (format) {
+   case PNG_COLOR_TYPE_GRAY:
+      bpp = 1;
+      break;
+   case PNG_COLOR_TYPE_GRAY_ALPHA:
+      bpp = 2;
+      break;
+   case PNG_COLOR_TYPE_RGB:
+      bpp = 3;
+      break;
+   case PNG_COLOR_TYPE_RGB_ALPHA:
+      bpp = 4;
+      break;
+   default:
+      errno = EINVAL;
+      return false;
+   }
+
+   struct png_encoder *encoder = calloc (1, sizeof (struct png_encoder));
+   if (encoder == NULL) {
+      errno = ENOMEM;
+      return false;
+   }
+   self->encoder = encoder;
+
+   if (options != NULL)
+      encoder->options = *options;
+   else
+      png_encode_options_init_default (&encoder->options);
+
+   if (encoder->options.level < 0 || encoder->options.level > 9)
+      encoder->options.level = PNG_ENCODE_LEVEL_DEFAULT;
+   if (encoder->options.num_threads == 0)
+      encoder->options.num_threads = 1;
+
+   self->width = width;
+   self->height = height;
+   self->format = format;
+   self->row_stride = (size_t) width * bpp;
+
+   encoder->bpp = bpp;
+   encoder->row_stride = self->row_stride;
+   encoder->adler = adler32 (0, NULL, 0);
+
+   encoder->prev_row = calloc (1, self->row_stride);
+   encoder->filtered_row = malloc (self->row_stride + 1);
+   encoder->scratch_row = malloc (self->row_stride + 1);
+   if (encoder->prev_row == NULL
+       || encoder->filtered_row == NULL
+       || encoder->scratch_row == NULL) {
+      png_clear (self);
+      errno = ENOMEM;
+      return false;
+   }
+
+   if (encoder->options.num_threads > 1) {
+      uint32_t strip_rows = encoder->options.strip_rows;
+      if (strip_rows == 0)
+         strip_rows = PNG_STRIP_TARGET_SIZE / self->row_stride;
+      if (strip_rows == 0)
+         strip_rows = 1;
+      encoder->strip_rows = strip_rows;
+
+      encoder->strips = calloc (encoder->options.num_threads,
+                                sizeof (struct png_strip));
+      if (encoder->strips == NULL) {
+         png_clear (self);
+         errno = ENOMEM;
+         return false;
+      }
+
+      for (uint32_t i = 0; i < encoder->options.num_threads; i++) {
+         struct png_strip *strip = &encoder->strips[i];
+
+         strip->encoder = encoder;
+         strip->rows = malloc ((strip_rows + 1) * self->row_stride);
+         strip->filtered = malloc (strip_rows * (self->row_stride + 1));
+         strip->scratch = malloc (self->row_stride + 1);
+         if (strip->rows == NULL
+             || strip->filtered == NULL
+             || strip->scratch == NULL) {
+            png_clear (self);
+            errno = ENOMEM;
+            return false;
+         }
+      }
+   } else {
+      encoder->zbuf = malloc (PNG_IDAT_CHUNK_SIZE);
+      if (encoder->zbuf == NULL
+          || deflateInit2 (&encoder->zs,
+                           encoder->options.level,
+                           Z_DEFLATED,
+                           -15,
+                           8,
+                           Z_DEFAULT_STRATEGY) != Z_OK) {
+         png_clear (self);
+         errno = ENOMEM;
+         return false;
+      }
+      encoder->zs_ready = true;
+   }
+
+   self->file_obj = fopen (filename, "wb");
+   if (self->file_obj == NULL) {
+      png_clear (self);
+      return false;
+   }
+
+   /* PNG signature and header */
+   static const uint8_t signature[8] = {
+      0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A
+   };
+   uint8_t ihdr[13];
+   write_u32_be (ihdr, width);
+   write_u32_be (ihdr + 4, height);
+   ihdr[8] = 8;                           /* bit depth */
+   ihdr[9] = format;                      /* color type */
+   ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+   ihdr[11] = PNG_FILTER_TYPE_BASE;
+   ihdr[12] = PNG_INTERLACE_NONE;
+
+   if (fwrite (signature, 1, 8, self->file_obj) != 8
+       || ! write_chunk (self->file_obj, "IHDR", ihdr, 13)) {
+      png_clear (self);
+      errno = EIO;
+      return false;
+   }
+
+   /* The zlib stream header. The payload is written as raw deflate, and the
+    * Adler-32 trailer is computed separately, which is what allows joining
+    * strips compressed independently.
+    */
+   uint8_t zlib_header[2] = { 0x78, 0 };
+   uint8_t level_flag =
+      encoder->options.level < 2 ? 0 :
+      encoder->options.level < 6 ? 1 :
+      encoder->options.level == 6 ? 2 : 3;
+   zlib_header[1] = level_flag << 6;
+   zlib_header[1] += 31 - ((zlib_header[0] << 8) + zlib_header[1]) % 31;
+   encoder_emit (self, zlib_header, 2);
+
+   self->status = PNG_STATUS_ENCODE_READY;
+
+   return true;
+}
+
+ssize_t
+png_write (struct png_ctx *self,
+           const void *buffer,
+           size_t size,
+           size_t *first_row,
+           size_t *num_rows)
+{
+   assert (self != NULL);
+   assert (self->encoder != NULL);
+   assert (self->status == PNG_STATUS_ENCODE_READY ||
+           self->status == PNG_STATUS_DONE);
+   assert (size == 0 || buffer != NULL);
+   assert (self->row_stride > 0 && size >= self->row_stride);
+
+   struct png_encoder *encoder = self->encoder;
+   size_t _num_rows = 0;
+   size_t _first_row = 0;
+   size_t result = 0;
+
+   if (self->status == PNG_STATUS_DONE)
+      goto out;
+
+   _first_row = self->last_encoded_row;
+   uint32_t max_write_rows = size / self->row_stride;
+
+#define MIN(a,b) (a > b ? b : a)
+   _num_rows = MIN (self->height - self->last_encoded_row,
+                    max_write_rows);
+#undef MIN
+
+   bool ok = true;
+   for (size_t i = 0; i < _num_rows && ok; i++) {
+      const uint8_t *row = (const uint8_t *) buffer + i * self->row_stride;
+      bool last_row = self->last_encoded_row + i + 1 == self->height;
+
+      if (encoder->strips == NULL) {
+         filter_row_select (encoder->options.filter,
+                            encoder->bpp,
+                            self->row_stride,
+                            row,
+                            encoder->prev_row,
+                            encoder->filtered_row,
+                            encoder->scratch_row);
+         memcpy (encoder->prev_row, row, self->row_stride);
+
+         encoder->adler = adler32 (encoder->adler,
+                                   encoder->filtered_row,
+                                   self->row_stride + 1);
+         ok = encoder_deflate_serial (self,
+                                      encoder->filtered_row,
+                                      self->row_stride + 1,
+                                      last_row ? Z_FINISH : Z_NO_FLUSH);
+         continue;
+      }
+
+      struct png_strip *strip = &encoder->strips[encoder->num_strips];
+      if (strip->num_rows == 0) {
+         /* starting a new strip, seed it with the previous row */
+         const uint8_t *prev = encoder->prev_row;
+         if (encoder->num_strips > 0) {
+            struct png_strip *before = &encoder->strips[encoder->num_strips - 1];
+            prev = before->rows + before->num_rows * self->row_stride;
+         }
+         memcpy (strip->rows, prev, self->row_stride);
+         strip->last = false;
+      }
+
+      strip->num_rows++;
+      memcpy (strip->rows + strip->num_rows * self->row_stride,
+              row,
+              self->row_stride);
+
+      if (strip->num_rows == encoder->strip_rows || last_row) {
+         strip->last = last_row;
+         encoder->num_strips++;
+
+         if (encoder->num_strips == encoder->options.num_threads || last_row) {
+            ok = encoder_flush_strips (self);
+            for (uint32_t j = 0; j < encoder->options.num_threads; j++)
+               encoder->strips[j].num_rows = 0;
+         }
+      }
+   }
+
+   if (! ok) {
+      self->status = PNG_STATUS_ERROR;
+      errno = EIO;
+      return -1;
+   }
+
+   self->last_encoded_row += _num_rows;
+   result = _num_rows * self->row_stride;
+
+   if (self->last_encoded_row == self->height) {
+      if (! encoder_finish (self)) {
+         self->status = PNG_STATUS_ERROR;
+         errno = EIO;
+         return -1;
+      }
+
+      self->status = PNG_STATUS_DONE;
+   }
+
+ out:
+   if (first_row != NULL)
+      *first_row = _first_row;
+
+   if (num_rows != NULL)
+      *num_rows = _num_rows;
+
+   return result;
+}
@@ -14,9 +14,53 @@ enum png_status {
    PNG_STATUS_DONE,
 };
 
+/* Row filter selection for the encoder. The fixed filters apply the same
+ * PNG filter type to every row, while PNG_ENCODE_FILTER_ADAPTIVE picks the
+ * filter per row using the minimum sum of absolute differences heuristic
+ * (the one recommended by the PNG spec).
+ */
+enum png_encode_filter {
+   PNG_ENCODE_FILTER_NONE = 0,
+   PNG_ENCODE_FILTER_SUB,
+   PNG_ENCODE_FILTER_UP,
+   PNG_ENCODE_FILTER_AVG,
+   PNG_ENCODE_FILTER_PAETH,
+   PNG_ENCODE_FILTER_ADAPTIVE,
+};
+
+/* Speed vs. size trade-off, mapped onto zlib compression levels. */
+enum png_encode_level {
+   PNG_ENCODE_LEVEL_STORE = 0,
+   PNG_ENCODE_LEVEL_FASTEST = 1,
+   PNG_ENCODE_LEVEL_DEFAULT = 6,
+   PNG_ENCODE_LEVEL_SMALLEST = 9,
+};
+
+struct png_encode_options {
+   enum png_encode_filter filter;
+   int32_t level;
+
+   /* Number of threads compressing row strips in parallel. 0 or 1 means
+    * serial encoding, using a single deflate stream.
+    */
+   uint32_t num_threads;
+
+   /* Rows per independently compressed strip in parallel mode. 0 picks a
+    * size of roughly 128KiB of pixel data per strip.
+    */
+   uint32_t strip_rows;
+};
+
+struct png_encoder;
+
 struct png_ctx {
    FILE *file_obj;
 
+   /* source of decoders initialized from memory */
+   const uint8_t *mem_data;
+   size_t mem_size;
+   size_t mem_offset;
+
    png_structp png_ptr;
    png_infop info_ptr;
 
@@ -28,12 +72,34 @@ struct png_ctx {
    uint8_t format;
 
    uint32_t last_decoded_row;
+
+   struct png_encoder *encoder;
+   uint32_t last_encoded_row;
 };
 
 bool
 png_decoder_init_from_filename (struct png_ctx *self,
                                 const char *filename);
 
+/* Decodes from 'data' instead of a file. The data is not copied and must
+ * stay valid until png_clear() is called.
+ */
+bool
+png_decoder_init_from_memory (struct png_ctx *self,
+                              const void *data,
+                              size_t size);
+
+bool
+png_encoder_init_to_filename (struct png_ctx *self,
+                              const char *filename,
+                              uint32_t width,
+                              uint32_t height,
+                              uint8_t format,
+                              const struct png_encode_options *options);
+
+void
+png_encode_options_init_default (struct png_encode_options *options);
+
 void
 png_clear (struct png_ctx *self);
 
@@ -43,3 +109,10 @@ png_read (struct png_ctx *self,
           size_t size,
           size_t *first_row,
           size_t *num_rows);
+
+ssize_t
+png_write (struct png_ctx *self,
+           const void *buffer,
+           size_t size,
+           size_t *first_row,
+           size_t *num_rows);
@@ -0,0 +1,894 @@
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include "common/now.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include "prefetch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#define PREFETCH_DEFAULT_DEPTH 8
+#define PREFETCH_DEFAULT_SLOT_SIZE (8 * 1024 * 1024)
+#define PREFETCH_MAX_THREADS 8
+
+/* No slot: the data lives in a buffer of its own. */
+#define NO_SLOT UINT32_MAX
+
+enum entry_state {
+   ENTRY_STATE_PENDING = 0,
+   ENTRY_STATE_IN_FLIGHT,
+   ENTRY_STATE_READY,
+   ENTRY_STATE_FAILED,
+   ENTRY_STATE_RELEASED,
+};
+
+struct o_prefetch_entry {
+   const char *filename;
+   enum entry_state state;
+   int32_t error;
+
+   int fd;
+   uint8_t *data;
+   size_t size;
+   size_t done;
+   uint32_t slot;
+
+   /* read ahead, as opposed to synchronously on request */
+   bool prefetched;
+   /* read by the thread pool, even though there is a ring */
+   bool pooled;
+};
+
+/* io_uring is driven through the raw system calls, the ring layout being
+ * described by the offsets the kernel returns from io_uring_setup().
+ */
+struct o_prefetch_uring {
+   int fd;
+   bool fixed_buffers;
+
+   void *sq_ring;
+   size_t sq_ring_size;
+   void *cq_ring;
+   size_t cq_ring_size;
+   struct io_uring_sqe *sqes;
+   size_t sqes_size;
+
+   uint32_t *sq_tail;
+   uint32_t *sq_mask;
+   uint32_t *sq_array;
+   uint32_t *cq_head;
+   uint32_t *cq_tail;
+   uint32_t *cq_mask;
+   struct io_uring_cqe *cqes;
+
+   uint32_t to_submit;
+
+   /* Set while a thread is blocked in io_uring_enter() for completions,
+    * without the lock; the others wait for 'reaped_cond' meanwhile.
+    */
+   bool waiting;
+   pthread_cond_t reaped_cond;
+
+   /* Whether IORING_OP_READ (Linux 5.6) is known to work, or was rejected,
+    * in which case those reads go to the thread pool instead.
+    */
+   bool read_supported;
+   bool read_unsupported;
+};
+
+struct o_prefetch_pool {
+   pthread_t *threads;
+   uint32_t num_threads;
+
+   /* indices of the entries waiting for a thread, a ring of 'depth' */
+   uint32_t *queue;
+   uint32_t queue_head;
+   uint32_t queue_len;
+
+   pthread_cond_t work_cond;
+   pthread_cond_t done_cond;
+   bool quit;
+};
+
+/* Reads the remainder of 'entry' with pread(), returning false with errno
+ * set on failure.
+ */
+static bool
+read_sync (struct o_prefetch_entry *entry)
+{
+   while (entry->done < entry->size) {
+      ssize_t result = pread (entry->fd,
+                              entry->data + entry->done,
+                              entry->size - entry->done,
+                              entry->done);
+      if (result < 0 && errno == EINTR)
+         continue;
+      if (result < 0)
+         return false;
+
+      /* the file got truncated since it was opened */
+      if (result == 0) {
+         entry->size = entry->done;
+         break;
+      }
+
+      entry->done += result;
+   }
+
+   return true;
+}
+
+static void
+entry_finish (struct o_prefetch *self,
+              struct o_prefetch_entry *entry,
+              int32_t error)
+{
+   close (entry->fd);
+   entry->fd = -1;
+
+   if (error == 0) {
+      entry->state = ENTRY_STATE_READY;
+      self->bytes_read += entry->size;
+   } else {
+      entry->state = ENTRY_STATE_FAILED;
+      entry->error = error;
+   }
+}
+
+/* Opens the file of 'entry' and sets up a buffer to read it into. */
+static bool
+entry_open (struct o_prefetch *self, struct o_prefetch_entry *entry)
+{
+   entry->fd = open (entry->filename, O_RDONLY | O_CLOEXEC);
+   if (entry->fd < 0) {
+      entry->state = ENTRY_STATE_FAILED;
+      entry->error = errno;
+      return false;
+   }
+
+   struct stat st;
+   if (fstat (entry->fd, &st) != 0) {
+      entry_finish (self, entry, errno);
+      return false;
+   }
+
+   entry->size = st.st_size;
+   entry->done = 0;
+
+   if (entry->size <= self->slot_size && self->num_free_slots > 0) {
+      entry->slot = self->free_slots[--self->num_free_slots];
+      entry->data = self->slots + (size_t) entry->slot * self->slot_size;
+   } else {
+      entry->slot = NO_SLOT;
+      /* one extra byte, so that empty files get a valid pointer */
+      entry->data = malloc (entry->size + 1);
+      if (entry->data == NULL) {
+         entry_finish (self, entry, ENOMEM);
+         return false;
+      }
+   }
+
+   return true;
+}
+
+static void
+pool_queue_read (struct o_prefetch *self, uint32_t index);
+
+/* io_uring */
+
+static int
+uring_setup (uint32_t entries, struct io_uring_params *params)
+{
+   return syscall (__NR_io_uring_setup, entries, params);
+}
+
+static int
+uring_enter (int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags)
+{
+   return syscall (__NR_io_uring_enter,
+                   fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int
+uring_register (int fd, uint32_t opcode, const void *arg, uint32_t nr_args)
+{
+   return syscall (__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void
+uring_destroy (struct o_prefetch_uring *uring)
+{
+   if (uring->sqes != NULL)
+      munmap (uring->sqes, uring->sqes_size);
+   if (uring->cq_ring != NULL && uring->cq_ring != uring->sq_ring)
+      munmap (uring->cq_ring, uring->cq_ring_size);
+   if (uring->sq_ring != NULL)
+      munmap (uring->sq_ring, uring->sq_ring_size);
+   if (uring->fd >= 0)
+      close (uring->fd);
+
+   pthread_cond_destroy (&uring->reaped_cond);
+   free (uring);
+}
+
+static struct o_prefetch_uring *
+uring_create (struct o_prefetch *self)
+{
+   struct o_prefetch_uring *uring = calloc (1, sizeof (*uring));
+   assert (uring != NULL);
+   pthread_cond_init (&uring->reaped_cond, NULL);
+
+   struct io_uring_params params;
+   memset (&params, 0x00, sizeof (params));
+
+   uring->fd = uring_setup (self->depth, &params);
+   if (uring->fd < 0) {
+      uring_destroy (uring);
+      return NULL;
+   }
+
+   uring->sq_ring_size =
+      params.sq_off.array + params.sq_entries * sizeof (uint32_t);
+   uring->cq_ring_size =
+      params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+
+   if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      if (uring->cq_ring_size > uring->sq_ring_size)
+         uring->sq_ring_size = uring->cq_ring_size;
+      uring->cq_ring_size = uring->sq_ring_size;
+   }
+
+   uring->sq_ring = mmap (NULL,
+                          uring->sq_ring_size,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE,
+                          uring->fd,
+                          IORING_OFF_SQ_RING);
+   if (uring->sq_ring == MAP_FAILED) {
+      uring->sq_ring = NULL;
+      uring_destroy (uring);
+      return NULL;
+   }
+
+   if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      uring->cq_ring = uring->sq_ring;
+   } else {
+      uring->cq_ring = mmap (NULL,
+                             uring->cq_ring_size,
+                             PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE,
+                             uring->fd,
+                             IORING_OFF_CQ_RING);
+      if (uring->cq_ring == MAP_FAILED) {
+         uring->cq_ring = NULL;
+         uring_destroy (uring);
+         return NULL;
+      }
+   }
+
+   uring->sqes_size = params.sq_entries * sizeof (struct io_uring_sqe);
+   uring->sqes = mmap (NULL,
+                       uring->sqes_size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE,
+                       uring->fd,
+                       IORING_OFF_SQES);
+   if (uring->sqes == MAP_FAILED) {
+      uring->sqes = NULL;
+      uring_destroy (uring);
+      return NULL;
+   }
+
+   uint8_t *sq = uring->sq_ring;
+   uring->sq_tail = (uint32_t *) (sq + params.sq_off.tail);
+   uring->sq_mask = (uint32_t *) (sq + params.sq_off.ring_mask);
+   uring->sq_array = (uint32_t *) (sq + params.sq_off.array);
+
+   uint8_t *cq = uring->cq_ring;
+   uring->cq_head = (uint32_t *) (cq + params.cq_off.head);
+   uring->cq_tail = (uint32_t *) (cq + params.cq_off.tail);
+   uring->cq_mask = (uint32_t *) (cq + params.cq_off.ring_mask);
+   uring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+   /* Register the slots, so that the kernel doesn't have to map them on
+    * every read. This can fail, e.g. under a low RLIMIT_MEMLOCK, in which
+    * case plain reads into the same buffers are used.
+    */
+   struct iovec *iovecs = calloc (self->depth, sizeof (struct iovec));
+   assert (iovecs != NULL);
+   for (uint32_t i = 0; i < self->depth; i++) {
+      iovecs[i].iov_base = self->slots + (size_t) i * self->slot_size;
+      iovecs[i].iov_len = self->slot_size;
+   }
+
+   uring->fixed_buffers = uring_register (uring->fd,
+                                          IORING_REGISTER_BUFFERS,
+                                          iovecs,
+                                          self->depth) == 0;
+   free (iovecs);
+
+   return uring;
+}
+
+static bool
+uses_fixed_buffer (const struct o_prefetch_uring *uring,
+                   const struct o_prefetch_entry *entry)
+{
+   return uring->fixed_buffers && entry->slot != NO_SLOT;
+}
+
+/* Queues a read of the remainder of entry 'index'. Submission happens in
+ * uring_flush().
+ */
+static void
+uring_queue_read (struct o_prefetch *self, uint32_t index)
+{
+   struct o_prefetch_uring *uring = self->uring;
+   struct o_prefetch_entry *entry = &self->entries[index];
+
+   if (uring->read_unsupported && ! uses_fixed_buffer (uring, entry)) {
+      pool_queue_read (self, index);
+      return;
+   }
+
+   uint32_t tail = *uring->sq_tail;
+   uint32_t sq_index = tail & *uring->sq_mask;
+   struct io_uring_sqe *sqe = &uring->sqes[sq_index];
+
+   memset (sqe, 0x00, sizeof (*sqe));
+   sqe->fd = entry->fd;
+   sqe->off = entry->done;
+   sqe->addr = (uint64_t) (uintptr_t) (entry->data + entry->done);
+   sqe->len = entry->size - entry->done;
+   sqe->user_data = index;
+
+   if (uses_fixed_buffer (uring, entry)) {
+      sqe->opcode = IORING_OP_READ_FIXED;
+      sqe->buf_index = entry->slot;
+   } else {
+      sqe->opcode = IORING_OP_READ;
+   }
+
+   uring->sq_array[sq_index] = sq_index;
+   __atomic_store_n (uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+   uring->to_submit++;
+}
+
+/* Submits the queued reads, without waiting. */
+static void
+uring_flush (struct o_prefetch *self)
+{
+   struct o_prefetch_uring *uring = self->uring;
+
+   if (uring->to_submit == 0)
+      return;
+
+   int result;
+   do {
+      result = uring_enter (uring->fd, uring->to_submit, 0, 0);
+   } while (result < 0 && errno == EINTR);
+
+   if (result < 0) {
+      printf ("io_uring_enter failed: %s\n", strerror (errno));
+      return;
+   }
+
+   uring->to_submit -= result;
+}
+
+static void
+uring_reap (struct o_prefetch *self)
+{
+   struct o_prefetch_uring *uring = self->uring;
+
+   uint32_t head = *uring->cq_head;
+   uint32_t tail = __atomic_load_n (uring->cq_tail, __ATOMIC_ACQUIRE);
+
+   while (head != tail) {
+      struct io_uring_cqe *cqe = &uring->cqes[head & *uring->cq_mask];
+      struct o_prefetch_entry *entry = &self->entries[cqe->user_data];
+
+      assert (entry->state == ENTRY_STATE_IN_FLIGHT);
+
+      bool fixed = uses_fixed_buffer (uring, entry);
+
+      if (cqe->res == -EINVAL && ! fixed && ! uring->read_supported) {
+         /* an older kernel, the thread pool reads it instead */
+         uring->read_unsupported = true;
+         pool_queue_read (self, cqe->user_data);
+      } else if (cqe->res == -EAGAIN || cqe->res == -EINTR) {
+         uring_queue_read (self, cqe->user_data);
+      } else if (cqe->res < 0) {
+         entry_finish (self, entry, -cqe->res);
+      } else {
+         if (! fixed)
+            uring->read_supported = true;
+         entry->done += cqe->res;
+
+         if (cqe->res == 0)
+            entry->size = entry->done;
+
+         /* short read, queue the rest */
+         if (entry->done < entry->size)
+            uring_queue_read (self, cqe->user_data);
+         else
+            entry_finish (self, entry, 0);
+      }
+
+      head++;
+   }
+
+   __atomic_store_n (uring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Submits the queued reads, waits for at least one completion and reaps
+ * the completions. Must be called with the lock held, which is dropped
+ * while blocked in the kernel so that the other threads can go on. Only
+ * one thread waits there at a time, lest another reap the completion it
+ * waits for: the others wait until it has reaped, and return so that
+ * their callers check their entries again.
+ */
+static bool
+uring_wait (struct o_prefetch *self)
+{
+   struct o_prefetch_uring *uring = self->uring;
+
+   if (uring->waiting) {
+      pthread_cond_wait (&uring->reaped_cond, &self->lock);
+      return true;
+   }
+
+   /* the reads queued meanwhile are submitted by their own threads */
+   uint32_t to_submit = uring->to_submit;
+   uring->to_submit = 0;
+   uring->waiting = true;
+
+   pthread_mutex_unlock (&self->lock);
+
+   int result;
+   do {
+      result = uring_enter (uring->fd,
+                            to_submit,
+                            1,
+                            IORING_ENTER_GETEVENTS);
+   } while (result < 0 && errno == EINTR);
+   int32_t error = errno;
+
+   pthread_mutex_lock (&self->lock);
+
+   uring->waiting = false;
+   if (result < 0) {
+      uring->to_submit += to_submit;
+      printf ("io_uring_enter failed: %s\n", strerror (error));
+   } else {
+      uring->to_submit += to_submit - result;
+      uring_reap (self);
+   }
+   pthread_cond_broadcast (&uring->reaped_cond);
+
+   return result >= 0;
+}
+
+/* pread() thread pool */
+
+static void *
+pool_thread (void *data)
+{
+   struct o_prefetch *self = data;
+   struct o_prefetch_pool *pool = self->pool;
+
+   pthread_mutex_lock (&self->lock);
+
+   while (true) {
+      while (pool->queue_len == 0 && ! pool->quit)
+         pthread_cond_wait (&pool->work_cond, &self->lock);
+
+      if (pool->quit)
+         break;
+
+      uint32_t index = pool->queue[pool->queue_head];
+      pool->queue_head = (pool->queue_head + 1) % self->depth;
+      pool->queue_len--;
+
+      struct o_prefetch_entry *entry = &self->entries[index];
+
+      pthread_mutex_unlock (&self->lock);
+      bool ok = read_sync (entry);
+      int32_t error = ok ? 0 : errno;
+      pthread_mutex_lock (&self->lock);
+
+      entry_finish (self, entry, error);
+      pthread_cond_broadcast (&pool->done_cond);
+   }
+
+   pthread_mutex_unlock (&self->lock);
+
+   return NULL;
+}
+
+static void
+pool_free (struct o_prefetch_pool *pool)
+{
+   pthread_cond_destroy (&pool->work_cond);
+   pthread_cond_destroy (&pool->done_cond);
+   free (pool->threads);
+   free (pool->queue);
+   free (pool);
+}
+
+static void
+pool_destroy (struct o_prefetch *self)
+{
+   struct o_prefetch_pool *pool = self->pool;
+
+   pthread_mutex_lock (&self->lock);
+   pool->quit = true;
+   pthread_cond_broadcast (&pool->work_cond);
+   pthread_mutex_unlock (&self->lock);
+
+   for (uint32_t i = 0; i < pool->num_threads; i++)
+      pthread_join (pool->threads[i], NULL);
+
+   pool_free (pool);
+}
+
+static struct o_prefetch_pool *
+pool_create (struct o_prefetch *self)
+{
+   struct o_prefetch_pool *pool = calloc (1, sizeof (*pool));
+   assert (pool != NULL);
+
+   pool->queue = calloc (self->depth, sizeof (uint32_t));
+   assert (pool->queue != NULL);
+
+   pthread_cond_init (&pool->work_cond, NULL);
+   pthread_cond_init (&pool->done_cond, NULL);
+
+   uint32_t num_threads = self->depth;
+   if (num_threads > PREFETCH_MAX_THREADS)
+      num_threads = PREFETCH_MAX_THREADS;
+
+   pool->threads = calloc (num_threads, sizeof (pthread_t));
+   assert (pool->threads != NULL);
+
+   /* self->pool must be set before the threads start */
+   self->pool = pool;
+
+   for (uint32_t i = 0; i < num_threads; i++) {
+      if (pthread_create (&pool->threads[i], NULL, pool_thread, self) != 0)
+         break;
+      pool->num_threads++;
+   }
+
+   /* no thread to stop, and the lock may be held */
+   if (pool->num_threads == 0) {
+      pool_free (pool);
+      self->pool = NULL;
+      return NULL;
+   }
+
+   return pool;
+}
+
+/* Hands entry 'index', open and in flight, to a thread of the pool, which
+ * is started on first use when there is a ring. Must be called with the
+ * lock held.
+ */
+static void
+pool_queue_read (struct o_prefetch *self, uint32_t index)
+{
+   struct o_prefetch_entry *entry = &self->entries[index];
+
+   if (self->pool == NULL && pool_create (self) == NULL) {
+      entry_finish (self, entry, EAGAIN);
+      return;
+   }
+
+   struct o_prefetch_pool *pool = self->pool;
+   uint32_t tail = (pool->queue_head + pool->queue_len) % self->depth;
+
+   entry->pooled = true;
+   pool->queue[tail] = index;
+   pool->queue_len++;
+   pthread_cond_signal (&pool->work_cond);
+}
+
+/* Starts reading files, in list order, until 'depth' are outstanding. Must
+ * be called with the lock held.
+ */
+static void
+submit_reads (struct o_prefetch *self)
+{
+   while (self->outstanding < self->depth
+          && self->next_submit < self->num_entries) {
+      uint32_t index = self->next_submit++;
+      struct o_prefetch_entry *entry = &self->entries[index];
+
+      /* already read synchronously, or skipped */
+      if (entry->state != ENTRY_STATE_PENDING)
+         continue;
+
+      self->outstanding++;
+      entry->prefetched = true;
+
+      if (! entry_open (self, entry))
+         continue;
+
+      entry->state = ENTRY_STATE_IN_FLIGHT;
+
+      if (entry->size == 0) {
+         entry_finish (self, entry, 0);
+      } else if (self->uring != NULL) {
+         uring_queue_read (self, index);
+      } else {
+         pool_queue_read (self, index);
+      }
+   }
+
+   if (self->uring != NULL)
+      uring_flush (self);
+}
+
+/* public API */
+
+bool
+o_prefetch_init (struct o_prefetch *self,
+                 const char *const *filenames,
+                 uint32_t num_files,
+                 uint32_t depth,
+                 size_t slot_size,
+                 enum o_prefetch_backend backend)
+{
+   assert (self != NULL);
+   assert (filenames != NULL || num_files == 0);
+
+   memset (self, 0x00, sizeof (struct o_prefetch));
+
+   self->depth = depth > 0 ? depth : PREFETCH_DEFAULT_DEPTH;
+   self->slot_size = slot_size > 0 ? slot_size : PREFETCH_DEFAULT_SLOT_SIZE;
+
+   /* page aligned, as required for registered buffers to be pinned */
+   size_t page_size = sysconf (_SC_PAGESIZE);
+   self->slot_size = (self->slot_size + page_size - 1) & ~(page_size - 1);
+
+   self->slots = mmap (NULL,
+                       (size_t) self->depth * self->slot_size,
+                       PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1,
+                       0);
+   if (self->slots == MAP_FAILED) {
+      self->slots = NULL;
+      errno = ENOMEM;
+      return false;
+   }
+
+   self->free_slots = calloc (self->depth, sizeof (uint32_t));
+   assert (self->free_slots != NULL);
+   for (uint32_t i = 0; i < self->depth; i++)
+      self->free_slots[i] = self->depth - 1 - i;
+   self->num_free_slots = self->depth;
+
+   self->entries = calloc (num_files, sizeof (struct o_prefetch_entry));
+   assert (self->entries != NULL || num_files == 0);
+   self->num_entries = num_files;
+
+   for (uint32_t i = 0; i < num_files; i++) {
+      self->entries[i].filename = filenames[i];
+      self->entries[i].fd = -1;
+      self->entries[i].slot = NO_SLOT;
+   }
+
+   pthread_mutex_init (&self->lock, NULL);
+
+   if (backend != O_PREFETCH_BACKEND_THREADS) {
+      self->uring = uring_create (self);
+      if (self->uring != NULL) {
+         self->backend = O_PREFETCH_BACKEND_URING;
+      } else if (backend == O_PREFETCH_BACKEND_URING) {
+         printf ("io_uring not available: %s\n", strerror (errno));
+         o_prefetch_clear (self);
+         return false;
+      }
+   }
+
+   if (self->uring == NULL) {
+      if (pool_create (self) == NULL) {
+         o_prefetch_clear (self);
+         errno = EAGAIN;
+         return false;
+      }
+      self->backend = O_PREFETCH_BACKEND_THREADS;
+   }
+
+   pthread_mutex_lock (&self->lock);
+   submit_reads (self);
+   pthread_mutex_unlock (&self->lock);
+
+   return true;
+}
+
+void
+o_prefetch_clear (struct o_prefetch *self)
+{
+   assert (self != NULL);
+
+   if (self->uring != NULL) {
+      /* wait for the reads still in flight, they target our buffers; those
+       * handed to the pool are dropped with it below
+       */
+      pthread_mutex_lock (&self->lock);
+      for (uint32_t i = 0; i < self->num_entries; i++) {
+         struct o_prefetch_entry *entry = &self->entries[i];
+
+         while (entry->state == ENTRY_STATE_IN_FLIGHT && ! entry->pooled) {
+            if (! uring_wait (self))
+               break;
+         }
+      }
+      pthread_mutex_unlock (&self->lock);
+   }
+
+   if (self->pool != NULL)
+      pool_destroy (self);
+
+   if (self->uring != NULL)
+      uring_destroy (self->uring);
+
+   for (uint32_t i = 0; i < self->num_entries; i++) {
+      struct o_prefetch_entry *entry = &self->entries[i];
+
+      if (entry->fd >= 0)
+         close (entry->fd);
+      if (entry->slot == NO_SLOT)
+         free (entry->data);
+   }
+
+   if (self->slots != NULL) {
+      munmap (self->slots, (size_t) self->depth * self->slot_size);
+      pthread_mutex_destroy (&self->lock);
+   }
+
+   free (self->entries);
+   free (self->free_slots);
+
+   self->entries = NULL;
+   self->num_entries = 0;
+   self->free_slots = NULL;
+   self->slots = NULL;
+   self->uring = NULL;
+   self->pool = NULL;
+}
+
+const uint8_t *
+o_prefetch_get (struct o_prefetch *self, uint32_t index, size_t *size)
+{
+   assert (self != NULL);
+   assert (index < self->num_entries);
+
+   struct o_prefetch_entry *entry = &self->entries[index];
+   const uint8_t *data = NULL;
+
+   pthread_mutex_lock (&self->lock);
+
+   /* Not reached by the read-ahead yet (files requested out of order, or
+    * too far ahead): read it right away, outside of the depth limit.
+    */
+   if (entry->state == ENTRY_STATE_PENDING) {
+      self->sync_reads++;
+
+      double start = now_ms ();
+      if (entry_open (self, entry)) {
+         entry->state = ENTRY_STATE_IN_FLIGHT;
+
+         pthread_mutex_unlock (&self->lock);
+         bool ok = read_sync (entry);
+         int32_t error = ok ? 0 : errno;
+         pthread_mutex_lock (&self->lock);
+
+         entry_finish (self, entry, error);
+      }
+      self->wait_ms += now_ms () - start;
+   } else if (entry->state == ENTRY_STATE_IN_FLIGHT) {
+      self->waits++;
+
+      double start = now_ms ();
+      while (entry->state == ENTRY_STATE_IN_FLIGHT) {
+         if (entry->pooled) {
+            pthread_cond_wait (&self->pool->done_cond, &self->lock);
+         } else if (! uring_wait (self)) {
+            break;
+         }
+      }
+      self->wait_ms += now_ms () - start;
+   } else if (entry->state == ENTRY_STATE_READY) {
+      self->hits++;
+   }
+
+   /* Pick up whatever else completed meanwhile, and top up the queue. */
+   if (self->uring != NULL)
+      uring_reap (self);
+   submit_reads (self);
+
+   switch (entry->state) {
+   case ENTRY_STATE_READY:
+      data = entry->data;
+      if (size != NULL)
+         *size = entry->size;
+      break;
+
+   case ENTRY_STATE_FAILED:
+      errno = entry->error;
+      break;
+
+   default:
+      errno = EINVAL;
+      break;
+   }
+
+   pthread_mutex_unlock (&self->lock);
+
+   return data;
+}
+
+void
+o_prefetch_release (struct o_prefetch *self, uint32_t index)
+{
+   assert (self != NULL);
+   assert (index < self->num_entries);
+
+   struct o_prefetch_entry *entry = &self->entries[index];
+
+   pthread_mutex_lock (&self->lock);
+
+   assert (entry->state == ENTRY_STATE_READY
+           || entry->state == ENTRY_STATE_FAILED);
+
+   if (entry->slot != NO_SLOT)
+      self->free_slots[self->num_free_slots++] = entry->slot;
+   else
+      free (entry->data);
+
+   entry->data = NULL;
+   entry->slot = NO_SLOT;
+   entry->state = ENTRY_STATE_RELEASED;
+
+   /* entries read synchronously don't count towards 'depth' */
+   if (entry->prefetched)
+      self->outstanding--;
+
+   if (self->uring != NULL)
+      uring_reap (self);
+   submit_reads (self);
+
+   pthread_mutex_unlock (&self->lock);
+}
+
+void
+o_prefetch_print_stats (struct o_prefetch *self)
+{
+   assert (self != NULL);
+
+   printf ("Prefetch (%s, depth %u): %.1f MiB read; %u ready on request, "
+           "%u waited, %u read synchronously; %.2f ms blocked on I/O\n",
+           self->backend == O_PREFETCH_BACKEND_URING ?
+           (self->uring->read_unsupported ?
+            "io_uring, pread threads for unregistered buffers" :
+            self->uring->fixed_buffers ?
+            "io_uring, registered buffers" : "io_uring") :
+           "pread threads",
+           self->depth,
+           self->bytes_read / (1024.0 * 1024.0),
+           self->hits,
+           self->waits,
+           self->sync_reads,
+           self->wait_ms);
+}
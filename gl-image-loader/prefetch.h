@@ -0,0 +1,86 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/* Reads a list of files ahead of their use, keeping up to 'depth' reads in
+ * flight, so that decoders can work from memory instead of blocking on
+ * disk. Reads are issued through io_uring into registered buffers, or by a
+ * pool of threads doing pread() where io_uring is not available.
+ *
+ * Files are read in list order. Each one is requested with o_prefetch_get()
+ * and must be handed back with o_prefetch_release() once decoded (or once
+ * the read failed), which frees its buffer for the next read. The API can
+ * be called from several decode threads at once.
+ */
+
+enum o_prefetch_backend {
+   O_PREFETCH_BACKEND_AUTO = 0,
+   O_PREFETCH_BACKEND_URING,
+   O_PREFETCH_BACKEND_THREADS,
+};
+
+struct o_prefetch_entry;
+struct o_prefetch_uring;
+struct o_prefetch_pool;
+
+struct o_prefetch {
+   enum o_prefetch_backend backend;
+
+   struct o_prefetch_entry *entries;
+   uint32_t num_entries;
+
+   /* maximum number of files read and not yet released */
+   uint32_t depth;
+   uint32_t outstanding;
+   uint32_t next_submit;
+
+   /* 'depth' buffers of 'slot_size' bytes each; larger files get a buffer
+    * of their own
+    */
+   size_t slot_size;
+   uint8_t *slots;
+   uint32_t *free_slots;
+   uint32_t num_free_slots;
+
+   struct o_prefetch_uring *uring;
+   struct o_prefetch_pool *pool;
+
+   pthread_mutex_t lock;
+
+   /* statistics */
+   uint64_t bytes_read;
+   uint32_t hits;
+   uint32_t waits;
+   uint32_t sync_reads;
+   double wait_ms;
+};
+
+/* 'filenames' must stay valid until o_prefetch_clear() is called. 'depth'
+ * of 0 picks a default, as does 'slot_size' of 0.
+ */
+bool
+o_prefetch_init (struct o_prefetch *self,
+                 const char *const *filenames,
+                 uint32_t num_files,
+                 uint32_t depth,
+                 size_t slot_size,
+                 enum o_prefetch_backend backend);
+
+void
+o_prefetch_clear (struct o_prefetch *self);
+
+/* Returns the contents of file 'index', waiting for its read to complete if
+ * needed, or NULL with errno set on failure. The data stays valid until
+ * o_prefetch_release() is called for the same index.
+ */
+const uint8_t *
+o_prefetch_get (struct o_prefetch *self, uint32_t index, size_t *size);
+
+void
+o_prefetch_release (struct o_prefetch *self, uint32_t index);
+
+void
+o_prefetch_print_stats (struct o_prefetch *self);
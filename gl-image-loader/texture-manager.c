@@ -0,0 +1,421 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/gl-debug.h"
+#include "image.h"
+#include "texture-manager.h"
+
+/* Pixel data is uploaded progressively, in blocks of about this size. */
+#define UPLOAD_BLOCK_SIZE (64 * 1024)
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+/* FNV-1a hash and size of the contents of a file, used to detect
+ * duplicates.
+ */
+static bool
+hash_file (const char *filename, uint64_t *hash, uint64_t *file_size)
+{
+   FILE *file_obj = fopen (filename, "rb");
+   if (file_obj == NULL)
+      return false;
+
+   uint64_t h = FNV_OFFSET_BASIS;
+   uint64_t total = 0;
+   uint8_t buf[16 * 1024];
+   size_t read_size;
+
+   while ((read_size = fread (buf, 1, sizeof (buf), file_obj)) > 0) {
+      for (size_t i = 0; i < read_size; i++) {
+         h ^= buf[i];
+         h *= FNV_PRIME;
+      }
+      total += read_size;
+   }
+
+   bool ok = ferror (file_obj) == 0;
+   fclose (file_obj);
+
+   *hash = h;
+   *file_size = total;
+
+   return ok;
+}
+
+/* Whether two files have the same contents, for when their hashes match:
+ * a collision must not make an image show another one's pixels.
+ */
+static bool
+files_equal (const char *filename_a, const char *filename_b)
+{
+   FILE *file_a = fopen (filename_a, "rb");
+   if (file_a == NULL)
+      return false;
+
+   FILE *file_b = fopen (filename_b, "rb");
+   if (file_b == NULL) {
+      fclose (file_a);
+      return false;
+   }
+
+   uint8_t buf_a[8 * 1024];
+   uint8_t buf_b[8 * 1024];
+   bool equal = true;
+
+   while (equal) {
+      size_t size_a = fread (buf_a, 1, sizeof (buf_a), file_a);
+      size_t size_b = fread (buf_b, 1, sizeof (buf_b), file_b);
+
+      if (size_a != size_b || memcmp (buf_a, buf_b, size_a) != 0)
+         equal = false;
+      else if (size_a == 0)
+         break;
+   }
+
+   equal = equal && ferror (file_a) == 0 && ferror (file_b) == 0;
+
+   fclose (file_a);
+   fclose (file_b);
+
+   return equal;
+}
+
+static bool
+is_power_of_two (uint32_t value)
+{
+   return value != 0 && (value & (value - 1)) == 0;
+}
+
+/* GPU memory taken by a texture. RGB textures are accounted as 4 bytes per
+ * texel, since that is how most drivers store them.
+ */
+static size_t
+texture_size (uint32_t width, uint32_t height, bool mipmaps)
+{
+   size_t bytes = (size_t) width * height * 4;
+
+   while (mipmaps && (width > 1 || height > 1)) {
+      width = width > 1 ? width / 2 : 1;
+      height = height > 1 ? height / 2 : 1;
+      bytes += (size_t) width * height * 4;
+   }
+
+   return bytes;
+}
+
+static void
+delete_texture (struct o_texture_manager *self, GLuint tex)
+{
+   if (self->gl_state != NULL)
+      o_gl_state_delete_texture (self->gl_state, tex);
+   else
+      glDeleteTextures (1, &tex);
+}
+
+static void
+evict (struct o_texture_manager *self, struct o_texture *texture)
+{
+   assert (texture->tex != 0);
+
+   delete_texture (self, texture->tex);
+   texture->tex = 0;
+
+   self->resident_bytes -= texture->bytes;
+   self->evictions++;
+}
+
+/* Evicts least recently drawn textures until 'bytes' more fit within the
+ * budget. Textures drawn in the current frame are never evicted.
+ */
+static void
+make_room (struct o_texture_manager *self, size_t bytes)
+{
+   while (self->resident_bytes + bytes > self->budget) {
+      struct o_texture *lru = NULL;
+
+      for (struct o_texture *t = self->textures; t != NULL; t = t->next) {
+         if (t->tex == 0 || t->last_used_frame == self->frame)
+            continue;
+
+         if (lru == NULL || t->last_used_frame < lru->last_used_frame)
+            lru = t;
+      }
+
+      if (lru == NULL) {
+         printf ("Texture budget exceeded by textures in use (%zu bytes)\n",
+                 self->resident_bytes + bytes);
+         return;
+      }
+
+      evict (self, lru);
+   }
+}
+
+static bool
+upload (struct o_texture_manager *self, struct o_texture *texture)
+{
+   struct o_image image = {0, };
+
+   if (! o_image_init_from_filename_with_flags (&image,
+                                                texture->filename,
+                                                self->image_flags)) {
+      return false;
+   }
+
+   bool mipmaps = self->mipmaps
+      && is_power_of_two (image.width)
+      && is_power_of_two (image.height);
+   size_t bytes = texture_size (image.width, image.height, mipmaps);
+
+   make_room (self, bytes);
+
+   GLuint tex;
+   glGenTextures (1, &tex);
+   assert (tex > 0);
+   glBindTexture (GL_TEXTURE_2D, tex);
+   glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+   glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+   glTexParameteri (GL_TEXTURE_2D,
+                    GL_TEXTURE_MIN_FILTER,
+                    mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+   glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+   GLuint format = image.format == O_IMAGE_FORMAT_RGB ? GL_RGB : GL_RGBA;
+   size_t row_stride =
+      image.width * (image.format == O_IMAGE_FORMAT_RGB ? 3 : 4);
+   size_t block_size = UPLOAD_BLOCK_SIZE - UPLOAD_BLOCK_SIZE % row_stride;
+   if (block_size < row_stride)
+      block_size = row_stride;
+
+   uint8_t *buf = malloc (block_size);
+   assert (buf != NULL);
+
+   /* Allocate the texture size. */
+   glPixelStorei (GL_UNPACK_ALIGNMENT, 1);
+   glTexImage2D (GL_TEXTURE_2D,
+                 0,
+                 format,
+                 image.width, image.height,
+                 0,
+                 format,
+                 GL_UNSIGNED_BYTE,
+                 NULL);
+   GL_CHECK ();
+
+   /* Load the image into the texture, progressively in blocks. No error
+    * checks in here, the upload is checked as a whole below.
+    */
+   ssize_t size_read;
+   size_t first_row;
+   size_t num_rows;
+   do {
+      size_read = o_image_read (&image,
+                                buf,
+                                block_size,
+                                &first_row,
+                                &num_rows);
+      if (size_read > 0) {
+         glTexSubImage2D (GL_TEXTURE_2D,
+                          0,
+                          0, first_row,
+                          image.width, num_rows,
+                          format,
+                          GL_UNSIGNED_BYTE,
+                          buf);
+      }
+   } while (size_read > 0);
+
+   GL_CHECK ();
+
+   free (buf);
+   o_image_clear (&image);
+
+   if (size_read < 0) {
+      delete_texture (self, tex);
+      return false;
+   }
+
+   if (mipmaps)
+      glGenerateMipmap (GL_TEXTURE_2D);
+
+   texture->tex = tex;
+   texture->bytes = bytes;
+   self->resident_bytes += bytes;
+   if (self->resident_bytes > self->peak_bytes)
+      self->peak_bytes = self->resident_bytes;
+   self->uploads++;
+
+   return true;
+}
+
+/* public API */
+
+void
+o_texture_manager_init (struct o_texture_manager *self,
+                        struct o_gl_state *gl_state,
+                        size_t budget,
+                        uint32_t image_flags,
+                        bool mipmaps)
+{
+   assert (self != NULL);
+
+   memset (self, 0x00, sizeof (struct o_texture_manager));
+
+   self->gl_state = gl_state;
+   self->budget = budget;
+   self->image_flags = image_flags;
+   self->mipmaps = mipmaps;
+}
+
+void
+o_texture_manager_clear (struct o_texture_manager *self)
+{
+   assert (self != NULL);
+
+   struct o_texture *texture = self->textures;
+   while (texture != NULL) {
+      struct o_texture *next = texture->next;
+
+      if (texture->tex != 0)
+         delete_texture (self, texture->tex);
+      free (texture->filename);
+      free (texture);
+
+      texture = next;
+   }
+
+   self->textures = NULL;
+   self->resident_bytes = 0;
+}
+
+struct o_texture *
+o_texture_manager_acquire (struct o_texture_manager *self,
+                           const char *filename)
+{
+   assert (self != NULL);
+   assert (filename != NULL);
+
+   uint64_t hash;
+   uint64_t file_size;
+   if (! hash_file (filename, &hash, &file_size))
+      return NULL;
+
+   for (struct o_texture *t = self->textures; t != NULL; t = t->next) {
+      if (t->hash == hash
+          && t->file_size == file_size
+          && files_equal (t->filename, filename)) {
+         t->refcount++;
+         self->dedup_hits++;
+         return t;
+      }
+   }
+
+   /* read the header only, to validate the image and learn its size */
+   struct o_image image = {0, };
+   if (! o_image_init_from_filename_with_flags (&image,
+                                                filename,
+                                                self->image_flags)) {
+      return NULL;
+   }
+
+   struct o_texture *texture = calloc (1, sizeof (struct o_texture));
+   assert (texture != NULL);
+
+   size_t len = strlen (filename);
+   texture->filename = malloc (len + 1);
+   assert (texture->filename != NULL);
+   memcpy (texture->filename, filename, len + 1);
+
+   texture->hash = hash;
+   texture->file_size = file_size;
+   texture->width = image.width;
+   texture->height = image.height;
+   texture->format = image.format;
+   texture->refcount = 1;
+
+   o_image_clear (&image);
+
+   texture->next = self->textures;
+   self->textures = texture;
+
+   return texture;
+}
+
+void
+o_texture_manager_release (struct o_texture_manager *self,
+                           struct o_texture *texture)
+{
+   assert (self != NULL);
+   assert (texture != NULL);
+   assert (texture->refcount > 0);
+
+   texture->refcount--;
+   if (texture->refcount > 0)
+      return;
+
+   struct o_texture **link = &self->textures;
+   while (*link != texture)
+      link = &(*link)->next;
+   *link = texture->next;
+
+   if (texture->tex != 0) {
+      delete_texture (self, texture->tex);
+      self->resident_bytes -= texture->bytes;
+   }
+
+   free (texture->filename);
+   free (texture);
+}
+
+GLuint
+o_texture_manager_use (struct o_texture_manager *self,
+                       struct o_texture *texture)
+{
+   assert (self != NULL);
+   assert (texture != NULL);
+
+   texture->last_used_frame = self->frame;
+
+   if (texture->tex == 0 && ! upload (self, texture)) {
+      printf ("Failed to upload texture for %s\n", texture->filename);
+      return 0;
+   }
+
+   return texture->tex;
+}
+
+void
+o_texture_manager_end_frame (struct o_texture_manager *self)
+{
+   assert (self != NULL);
+
+   self->frame++;
+}
+
+void
+o_texture_manager_print_stats (struct o_texture_manager *self)
+{
+   assert (self != NULL);
+
+   uint32_t count = 0;
+   uint32_t resident = 0;
+   for (struct o_texture *t = self->textures; t != NULL; t = t->next) {
+      count++;
+      if (t->tex != 0)
+         resident++;
+   }
+
+   printf ("Textures: %u (%u resident), %zu/%zu KiB used, peak %zu KiB; "
+           "%u uploads, %u evictions, %u deduplicated\n",
+           count,
+           resident,
+           self->resident_bytes / 1024,
+           self->budget / 1024,
+           self->peak_bytes / 1024,
+           self->uploads,
+           self->evictions,
+           self->dedup_hits);
+}
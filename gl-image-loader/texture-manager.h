@@ -0,0 +1,93 @@
+#pragma once
+
+#include <GLES2/gl2.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "gl-state.h"
+
+/* Owns the GL textures created for images, keeping the GPU memory they use
+ * within a budget. Textures are uploaded lazily when first used, and the
+ * least recently drawn ones are evicted when the budget would be exceeded;
+ * evicted textures are decoded again on demand. Sources with identical
+ * contents share a single texture, refcounted.
+ */
+
+struct o_texture {
+   char *filename;
+   uint64_t hash;
+   uint64_t file_size;
+
+   uint32_t width;
+   uint32_t height;
+   uint32_t format;
+
+   /* 0 while not resident in GPU memory */
+   GLuint tex;
+   size_t bytes;
+
+   uint32_t refcount;
+   uint64_t last_used_frame;
+
+   struct o_texture *next;
+};
+
+struct o_texture_manager {
+   /* GL state cache told about deleted textures, may be NULL */
+   struct o_gl_state *gl_state;
+
+   size_t budget;
+   size_t resident_bytes;
+   uint32_t image_flags;
+   bool mipmaps;
+
+   uint64_t frame;
+   struct o_texture *textures;
+
+   /* statistics */
+   uint32_t uploads;
+   uint32_t evictions;
+   uint32_t dedup_hits;
+   size_t peak_bytes;
+};
+
+/* 'budget' is in bytes, 'image_flags' are passed to o_image when decoding,
+ * and 'mipmaps' generates a mip chain for power-of-two textures. Textures
+ * are deleted through 'gl_state' if not NULL.
+ */
+void
+o_texture_manager_init (struct o_texture_manager *self,
+                        struct o_gl_state *gl_state,
+                        size_t budget,
+                        uint32_t image_flags,
+                        bool mipmaps);
+
+void
+o_texture_manager_clear (struct o_texture_manager *self);
+
+/* Returns a texture for the image in 'filename', sharing it if one with the
+ * same contents was already acquired. Reads the image header, but doesn't
+ * upload anything until o_texture_manager_use() is called. Returns NULL if
+ * the image can't be loaded.
+ */
+struct o_texture *
+o_texture_manager_acquire (struct o_texture_manager *self,
+                           const char *filename);
+
+void
+o_texture_manager_release (struct o_texture_manager *self,
+                           struct o_texture *texture);
+
+/* Marks 'texture' as drawn in the current frame, uploading it first if it
+ * is not resident. Returns the GL texture name, or 0 on failure.
+ */
+GLuint
+o_texture_manager_use (struct o_texture_manager *self,
+                       struct o_texture *texture);
+
+void
+o_texture_manager_end_frame (struct o_texture_manager *self);
+
+void
+o_texture_manager_print_stats (struct o_texture_manager *self);
@@ -0,0 +1,312 @@
+/*
+ * Example:
+ *
+ * GPGPU convolution: gaussian blurs of growing radius and a sharpen
+ *                    filter on RGBA8 and R8 images, with the tiled
+ *                    shared-memory kernels, the naive global-memory ones
+ *                    and the CPU, checking the GPU results against the
+ *                    CPU and printing megapixels per second.
+ *
+ * Usage: gpgpu-convolution [-w width] [-h height] [-i iterations]
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "convolution.h"
+#include "gpgpu.h"
+
+#define MAX_RADIUS 32
+
+static int32_t
+clamp (int32_t value, int32_t max)
+{
+   return value < 0 ? 0 : (value > max ? max : value);
+}
+
+/* The reference, with the same float intermediate as the GPU. */
+static void
+cpu_convolve (const uint8_t *src,
+              uint8_t *dst,
+              float *temp,
+              uint32_t width,
+              uint32_t height,
+              uint32_t channels,
+              uint32_t radius,
+              const float *weights_x,
+              const float *weights_y)
+{
+   for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width; x++) {
+         for (uint32_t c = 0; c < channels; c++) {
+            float sum = 0;
+            for (uint32_t k = 0; k <= 2 * radius; k++) {
+               int32_t sx = clamp ((int32_t) (x + k) - (int32_t) radius,
+                                   width - 1);
+               sum += weights_x[k]
+                  * (src[((size_t) y * width + sx) * channels + c] / 255.0f);
+            }
+            temp[((size_t) y * width + x) * channels + c] = sum;
+         }
+      }
+   }
+
+   for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width; x++) {
+         for (uint32_t c = 0; c < channels; c++) {
+            float sum = 0;
+            for (uint32_t k = 0; k <= 2 * radius; k++) {
+               int32_t sy = clamp ((int32_t) (y + k) - (int32_t) radius,
+                                   height - 1);
+               sum += weights_y[k]
+                  * temp[((size_t) sy * width + x) * channels + c];
+            }
+            sum = sum < 0 ? 0 : (sum > 1 ? 1 : sum);
+            dst[((size_t) y * width + x) * channels + c] =
+               (uint8_t) roundf (sum * 255.0f);
+         }
+      }
+   }
+}
+
+/* Rounding may differ by one between the GPU and the CPU. */
+static bool
+compare (const uint8_t *a, const uint8_t *b, size_t size)
+{
+   for (size_t i = 0; i < size; i++) {
+      if (abs ((int32_t) a[i] - (int32_t) b[i]) > 1) {
+         printf ("byte %zu: %u, expected %u\n", i, a[i], b[i]);
+         return false;
+      }
+   }
+
+   return true;
+}
+
+/* Runs 'conv' and returns its megapixels per second, or a negative value
+ * if it failed or its result differs from 'expected'.
+ */
+static double
+run_gpu (struct gpgpu_context *ctx,
+         struct gpgpu_convolution *conv,
+         struct gpgpu_buffer *src,
+         struct gpgpu_buffer *dst,
+         uint32_t width,
+         uint32_t height,
+         uint32_t iterations,
+         const uint8_t *expected,
+         uint8_t *result)
+{
+   if (! gpgpu_convolution_run (conv, src, dst, width, height)
+       || ! gpgpu_buffer_download (dst, result, 0, dst->size)
+       || ! compare (result, expected, dst->size)) {
+      return -1.0;
+   }
+
+   double start = gpgpu_now_ms ();
+   for (uint32_t i = 0; i < iterations; i++)
+      gpgpu_convolution_run (conv, src, dst, width, height);
+   gpgpu_context_wait_idle (ctx);
+   double ms = gpgpu_now_ms () - start;
+
+   return (double) width * height * iterations / (ms * 1000.0);
+}
+
+static bool
+bench (struct gpgpu_context *ctx,
+       enum gpgpu_pixel_format format,
+       const char *filter,
+       uint32_t radius,
+       const float *weights,
+       uint32_t width,
+       uint32_t height,
+       uint32_t iterations)
+{
+   uint32_t channels = format == GPGPU_PIXEL_FORMAT_RGBA8 ? 4 : 1;
+   size_t size = (size_t) width * height * channels;
+
+   uint8_t *image = malloc (size);
+   uint8_t *expected = malloc (size);
+   uint8_t *result = malloc (size);
+   float *temp = malloc (size * sizeof (float));
+   assert (image != NULL && expected != NULL);
+   assert (result != NULL && temp != NULL);
+
+   srand (radius);
+   for (size_t i = 0; i < size; i++)
+      image[i] = rand () & 0xff;
+
+   double start = gpgpu_now_ms ();
+   cpu_convolve (image,
+                 expected,
+                 temp,
+                 width,
+                 height,
+                 channels,
+                 radius,
+                 weights,
+                 weights);
+   double cpu_mps = (double) width * height / ((gpgpu_now_ms () - start) * 1000.0);
+
+   struct gpgpu_buffer src;
+   struct gpgpu_buffer dst;
+   bool ok = gpgpu_buffer_init (&src, size, GL_STATIC_DRAW)
+      && gpgpu_buffer_init (&dst, size, GL_DYNAMIC_COPY)
+      && gpgpu_buffer_upload (&src, image, 0, size);
+
+   double mps[2] = { -1.0, -1.0 };
+   uint32_t tile_size[2][2] = { { 0 } };
+
+   for (uint32_t tiled = 0; tiled < 2 && ok; tiled++) {
+      struct gpgpu_convolution conv;
+      if (! gpgpu_convolution_init (&conv,
+                                    ctx,
+                                    format,
+                                    radius,
+                                    weights,
+                                    weights,
+                                    tiled)) {
+         ok = false;
+         break;
+      }
+
+      mps[tiled] = run_gpu (ctx,
+                            &conv,
+                            &src,
+                            &dst,
+                            width,
+                            height,
+                            iterations,
+                            expected,
+                            result);
+      ok = mps[tiled] >= 0;
+      if (tiled && conv.tiled)
+         memcpy (tile_size, conv.tile_size, sizeof (tile_size));
+
+      gpgpu_convolution_finish (&conv);
+   }
+
+   if (ok) {
+      char tiles[32] = "-";
+      if (tile_size[0][0] > 0) {
+         snprintf (tiles, sizeof (tiles), "%ux%u, %ux%u",
+                   tile_size[0][0], tile_size[0][1],
+                   tile_size[1][0], tile_size[1][1]);
+      }
+      printf ("%-6s %-8s %6u %10.1f %10.1f %10.1f %8.2fx   %s\n",
+              channels == 4 ? "RGBA8" : "R8",
+              filter,
+              radius,
+              cpu_mps,
+              mps[0],
+              mps[1],
+              mps[1] / mps[0],
+              tiles);
+   } else {
+      printf ("%-6s %-8s %6u FAILED\n",
+              channels == 4 ? "RGBA8" : "R8",
+              filter,
+              radius);
+   }
+
+   gpgpu_buffer_finish (&dst);
+   gpgpu_buffer_finish (&src);
+   free (temp);
+   free (result);
+   free (expected);
+   free (image);
+
+   return ok;
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   uint32_t width = 1024;
+   uint32_t height = 1024;
+   uint32_t iterations = 5;
+
+   for (int32_t i = 1; i < argc; i++) {
+      if (strcmp (argv[i], "-w") == 0 && i + 1 < argc) {
+         width = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-h") == 0 && i + 1 < argc) {
+         height = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-i") == 0 && i + 1 < argc) {
+         iterations = strtoul (argv[++i], NULL, 10);
+      } else {
+         printf ("Usage: %s [-w width] [-h height] [-i iterations]\n",
+                 argv[0]);
+         return -1;
+      }
+   }
+
+   /* R8 rows are filtered 4 pixels at a time vertically */
+   if (width == 0 || width % 4 != 0 || height == 0 || iterations == 0) {
+      printf ("Invalid arguments, the width must be a multiple of 4\n");
+      return -1;
+   }
+
+   struct gpgpu_context ctx;
+   if (! gpgpu_context_init (&ctx, NULL))
+      return -1;
+
+   gpgpu_context_print_info (&ctx);
+   printf ("\n%ux%u, %u iterations, megapixels per second:\n",
+           width, height, iterations);
+   printf ("%-6s %-8s %6s %10s %10s %10s %9s   %s\n",
+           "format", "filter", "radius", "CPU", "naive", "tiled",
+           "speedup", "tiles (h, v)");
+
+   static const enum gpgpu_pixel_format formats[] = {
+      GPGPU_PIXEL_FORMAT_RGBA8,
+      GPGPU_PIXEL_FORMAT_R8,
+   };
+   static const uint32_t radii[] = { 1, 2, 4, 8, 16, MAX_RADIUS };
+
+   bool ok = true;
+   for (uint32_t f = 0; f < 2; f++) {
+      float weights[2 * MAX_RADIUS + 1];
+
+      for (uint32_t r = 0; r < sizeof (radii) / sizeof (radii[0]); r++) {
+         gpgpu_convolution_gaussian (weights, radii[r], radii[r] / 2.0f);
+         ok = bench (&ctx,
+                     formats[f],
+                     "blur",
+                     radii[r],
+                     weights,
+                     width,
+                     height,
+                     iterations) && ok;
+      }
+
+      /* 1 - laplacian, on each axis */
+      static const float sharpen[] = { -0.5f, 2.0f, -0.5f };
+      ok = bench (&ctx,
+                  formats[f],
+                  "sharpen",
+                  1,
+                  sharpen,
+                  width,
+                  height,
+                  iterations) && ok;
+   }
+
+   printf ("\nResults: %s\n", ok ? "OK" : "FAILED");
+
+   gpgpu_context_finish (&ctx);
+
+   return ok ? 0 : -1;
+}
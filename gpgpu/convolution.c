@@ -0,0 +1,340 @@
+/*
+ * GPGPU: separable 2D convolution
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <assert.h>
+#include "convolution.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Both passes of both formats, selected by defines: RADIUS, VERTICAL,
+ * R8, TILED with TILE_X and TILE_Y, and WEIGHTS_OFFSET.
+ *
+ * The horizontal pass reads the packed image, and writes a float (R8) or
+ * a vec4 (RGBA8) per pixel. The vertical pass reads those as vec4 and
+ * packs them back: for R8, a vec4 is 4 pixels side by side, which the
+ * vertical pass filters independently, so it needn't know the format.
+ */
+static const char *CONVOLUTION_SRC =
+   "#version 310 es\n"
+   "#if defined (TILED)\n"
+   "layout (local_size_x = TILE_X, local_size_y = TILE_Y) in;\n"
+   "#else\n"
+   "layout (local_size_x = 16, local_size_y = 16) in;\n"
+   "#endif\n"
+   "\n"
+   "#if defined (VERTICAL)\n"
+   "layout (std430, binding = 0) readonly buffer Src { vec4 src[]; };\n"
+   "layout (std430, binding = 1) writeonly buffer Dst { uint dst[]; };\n"
+   "#define ELEM vec4\n"
+   "#elif defined (R8)\n"
+   "layout (std430, binding = 0) readonly buffer Src { uint src[]; };\n"
+   "layout (std430, binding = 1) writeonly buffer Dst { float dst[]; };\n"
+   "#define ELEM float\n"
+   "#else\n"
+   "layout (std430, binding = 0) readonly buffer Src { uint src[]; };\n"
+   "layout (std430, binding = 1) writeonly buffer Dst { vec4 dst[]; };\n"
+   "#define ELEM vec4\n"
+   "#endif\n"
+   "layout (std430, binding = 2) readonly buffer Weights {\n"
+   "   float weights[];\n"
+   "};\n"
+   "\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "\n"
+   "ELEM load (ivec2 p) {\n"
+   "   ivec2 size = ivec2 (gpgpu_global_size.xy);\n"
+   "   p = clamp (p, ivec2 (0), size - 1);\n"
+   "   uint i = uint (p.y * size.x + p.x);\n"
+   "#if defined (VERTICAL)\n"
+   "   return src[i];\n"
+   "#elif defined (R8)\n"
+   "   return float ((src[i >> 2] >> ((i & 3u) * 8u)) & 0xffu) / 255.0;\n"
+   "#else\n"
+   "   return unpackUnorm4x8 (src[i]);\n"
+   "#endif\n"
+   "}\n"
+   "\n"
+   "#if defined (TILED)\n"
+   "#if defined (VERTICAL)\n"
+   "#define ALONG TILE_Y\n"
+   "#define APRON (TILE_Y + 2 * RADIUS)\n"
+   "shared ELEM tile[APRON][TILE_X];\n"
+   "#define TILE(along, across) tile[along][across]\n"
+   "#else\n"
+   "#define ALONG TILE_X\n"
+   "#define APRON (TILE_X + 2 * RADIUS)\n"
+   "shared ELEM tile[TILE_Y][APRON];\n"
+   "#define TILE(along, across) tile[across][along]\n"
+   "#endif\n"
+   "#endif\n"
+   "\n"
+   "void main (void) {\n"
+   "   ivec2 p = ivec2 (gl_GlobalInvocationID.xy);\n"
+   "   ELEM sum = ELEM (0.0);\n"
+   "\n"
+   "#if defined (TILED)\n"
+   "   /* all invocations load, even those past the edges: barrier () */\n"
+   "   ivec2 l = ivec2 (gl_LocalInvocationID.xy);\n"
+   "   ivec2 origin = ivec2 (gl_WorkGroupID.xy * gl_WorkGroupSize.xy);\n"
+   "#if defined (VERTICAL)\n"
+   "   int along = l.y;\n"
+   "   int across = l.x;\n"
+   "   for (int i = along; i < APRON; i += ALONG)\n"
+   "      TILE (i, across) = load (ivec2 (p.x, origin.y - RADIUS + i));\n"
+   "#else\n"
+   "   int along = l.x;\n"
+   "   int across = l.y;\n"
+   "   for (int i = along; i < APRON; i += ALONG)\n"
+   "      TILE (i, across) = load (ivec2 (origin.x - RADIUS + i, p.y));\n"
+   "#endif\n"
+   "   memoryBarrierShared ();\n"
+   "   barrier ();\n"
+   "\n"
+   "   for (int k = 0; k <= 2 * RADIUS; k++)\n"
+   "      sum += weights[WEIGHTS_OFFSET + k] * TILE (along + k, across);\n"
+   "#else\n"
+   "#if defined (VERTICAL)\n"
+   "   ivec2 axis = ivec2 (0, 1);\n"
+   "#else\n"
+   "   ivec2 axis = ivec2 (1, 0);\n"
+   "#endif\n"
+   "   for (int k = 0; k <= 2 * RADIUS; k++) {\n"
+   "      ELEM value = load (p + axis * (k - RADIUS));\n"
+   "      sum += weights[WEIGHTS_OFFSET + k] * value;\n"
+   "   }\n"
+   "#endif\n"
+   "\n"
+   "   if (any (greaterThanEqual (uvec2 (p), gpgpu_global_size.xy)))\n"
+   "      return;\n"
+   "   uint i = uint (p.y) * gpgpu_global_size.x + uint (p.x);\n"
+   "#if defined (VERTICAL)\n"
+   "   dst[i] = packUnorm4x8 (sum);\n"
+   "#else\n"
+   "   dst[i] = sum;\n"
+   "#endif\n"
+   "}\n";
+
+/* preferred tile sizes along and across the pass' direction: long rows
+ * for the horizontal pass, and columns at least as wide as a GPU reads at
+ * once for the vertical one
+ */
+#define HORIZONTAL_ALONG 128
+#define HORIZONTAL_ACROSS 4
+#define VERTICAL_ALONG 32
+#define VERTICAL_ACROSS 16
+
+/* below that, the apron is most of what a tile loads */
+#define MIN_ALONG 16
+
+/* Fits a tile of 'along' x 'across' invocations, shrunk as needed, and of
+ * 'along' + 2 * radius by 'across' elements of 'elem_size' bytes, in the
+ * limits of 'ctx'. 'dim' is the direction of the pass, 0 for x.
+ */
+static bool
+fit_tile (struct gpgpu_context *ctx,
+          uint32_t radius,
+          uint32_t elem_size,
+          uint32_t dim,
+          uint32_t along,
+          uint32_t across,
+          uint32_t size[2])
+{
+   if (along > (uint32_t) ctx->max_work_group_size[dim])
+      along = ctx->max_work_group_size[dim];
+   if (across > (uint32_t) ctx->max_work_group_size[1 - dim])
+      across = ctx->max_work_group_size[1 - dim];
+
+   while (along * across > (uint32_t) ctx->max_work_group_invocations) {
+      if (across > 1)
+         across /= 2;
+      else
+         along /= 2;
+   }
+
+   while ((uint64_t) (along + 2 * radius) * across * elem_size
+          > (uint64_t) ctx->max_shared_memory_size) {
+      if (across > 1)
+         across /= 2;
+      else if (along > MIN_ALONG)
+         along /= 2;
+      else
+         return false;
+   }
+
+   size[dim] = along;
+   size[1 - dim] = across;
+
+   return true;
+}
+
+static bool
+build_pass (struct gpgpu_convolution *conv,
+            struct gpgpu_kernel *kernel,
+            bool vertical,
+            const uint32_t tile_size[2])
+{
+   char defines[256];
+   int32_t len = snprintf (defines, sizeof (defines),
+                           "#define RADIUS %u\n#define WEIGHTS_OFFSET %u\n",
+                           conv->radius,
+                           vertical ? 2 * conv->radius + 1 : 0);
+   if (vertical)
+      len += snprintf (defines + len, sizeof (defines) - len,
+                       "#define VERTICAL\n");
+   if (conv->format == GPGPU_PIXEL_FORMAT_R8)
+      len += snprintf (defines + len, sizeof (defines) - len, "#define R8\n");
+   if (conv->tiled) {
+      snprintf (defines + len, sizeof (defines) - len,
+                "#define TILED\n#define TILE_X %u\n#define TILE_Y %u\n",
+                tile_size[0],
+                tile_size[1]);
+   }
+
+   return gpgpu_kernel_init_with_defines (kernel,
+                                          conv->ctx,
+                                          CONVOLUTION_SRC,
+                                          defines);
+}
+
+/* public API */
+
+bool
+gpgpu_convolution_init (struct gpgpu_convolution *conv,
+                        struct gpgpu_context *ctx,
+                        enum gpgpu_pixel_format format,
+                        uint32_t radius,
+                        const float *weights_x,
+                        const float *weights_y,
+                        bool tiled)
+{
+   assert (conv != NULL);
+   assert (ctx != NULL);
+   assert (weights_x != NULL && weights_y != NULL);
+
+   memset (conv, 0x00, sizeof (struct gpgpu_convolution));
+   conv->ctx = ctx;
+   conv->format = format;
+   conv->radius = radius;
+
+   /* the horizontal pass keeps a float per pixel for R8 */
+   uint32_t horizontal_elem_size =
+      format == GPGPU_PIXEL_FORMAT_R8 ? sizeof (float) : 4 * sizeof (float);
+
+   conv->tiled = tiled
+      && fit_tile (ctx,
+                   radius,
+                   horizontal_elem_size,
+                   0,
+                   HORIZONTAL_ALONG,
+                   HORIZONTAL_ACROSS,
+                   conv->tile_size[0])
+      && fit_tile (ctx,
+                   radius,
+                   4 * sizeof (float),
+                   1,
+                   VERTICAL_ALONG,
+                   VERTICAL_ACROSS,
+                   conv->tile_size[1]);
+   if (tiled && ! conv->tiled)
+      printf ("No tile of radius %u fits in shared memory, not tiling\n",
+              radius);
+
+   uint32_t num_weights = 2 * radius + 1;
+   if (! gpgpu_buffer_init (&conv->weights,
+                            2 * num_weights * sizeof (float),
+                            GL_STATIC_DRAW)) {
+      return false;
+   }
+
+   bool ok = gpgpu_buffer_upload (&conv->weights,
+                                  weights_x,
+                                  0,
+                                  num_weights * sizeof (float))
+      && gpgpu_buffer_upload (&conv->weights,
+                              weights_y,
+                              num_weights * sizeof (float),
+                              num_weights * sizeof (float))
+      && build_pass (conv, &conv->horizontal, false, conv->tile_size[0])
+      && build_pass (conv, &conv->vertical, true, conv->tile_size[1]);
+   if (! ok) {
+      gpgpu_convolution_finish (conv);
+      return false;
+   }
+
+   return true;
+}
+
+void
+gpgpu_convolution_finish (struct gpgpu_convolution *conv)
+{
+   assert (conv != NULL);
+
+   gpgpu_kernel_finish (&conv->vertical);
+   gpgpu_kernel_finish (&conv->horizontal);
+   gpgpu_buffer_finish (&conv->temp);
+   gpgpu_buffer_finish (&conv->weights);
+}
+
+bool
+gpgpu_convolution_run (struct gpgpu_convolution *conv,
+                       struct gpgpu_buffer *src,
+                       struct gpgpu_buffer *dst,
+                       uint32_t width,
+                       uint32_t height)
+{
+   assert (conv != NULL);
+   assert (src != NULL && dst != NULL);
+   assert (width > 0 && height > 0);
+
+   /* the vertical pass takes 4 pixels at once */
+   uint32_t vertical_width = width;
+   if (conv->format == GPGPU_PIXEL_FORMAT_R8) {
+      assert (width % 4 == 0);
+      vertical_width = width / 4;
+   }
+
+   size_t temp_size = (size_t) vertical_width * height * 4 * sizeof (float);
+   if (conv->temp.size < temp_size) {
+      gpgpu_buffer_finish (&conv->temp);
+      if (! gpgpu_buffer_init (&conv->temp, temp_size, GL_DYNAMIC_COPY))
+         return false;
+   }
+
+   gpgpu_kernel_bind_buffer (&conv->horizontal, 0, src);
+   gpgpu_kernel_bind_buffer (&conv->horizontal, 1, &conv->temp);
+   gpgpu_kernel_bind_buffer (&conv->horizontal, 2, &conv->weights);
+   if (! gpgpu_kernel_dispatch (&conv->horizontal, width, height, 1))
+      return false;
+
+   gpgpu_kernel_bind_buffer (&conv->vertical, 0, &conv->temp);
+   gpgpu_kernel_bind_buffer (&conv->vertical, 1, dst);
+
+   return gpgpu_kernel_dispatch (&conv->vertical, vertical_width, height, 1);
+}
+
+void
+gpgpu_convolution_gaussian (float *weights, uint32_t radius, float sigma)
+{
+   assert (weights != NULL);
+   assert (sigma > 0);
+
+   float sum = 0;
+   for (uint32_t i = 0; i <= 2 * radius; i++) {
+      float x = (float) i - (float) radius;
+      weights[i] = expf (-x * x / (2 * sigma * sigma));
+      sum += weights[i];
+   }
+
+   for (uint32_t i = 0; i <= 2 * radius; i++)
+      weights[i] /= sum;
+}
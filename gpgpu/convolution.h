@@ -0,0 +1,82 @@
+/*
+ * GPGPU: separable 2D convolution
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gpgpu.h"
+
+/* Filters like blur and sharpen as a horizontal pass, then a vertical one,
+ * each with its own 2 * radius + 1 weights.
+ *
+ * Images are tightly packed in buffers, RGBA8 (4 bytes per pixel, R
+ * first) or R8 (1 byte per pixel, widths a multiple of 4). The horizontal
+ * pass keeps its results as floats in a buffer of the convolution, so
+ * that they are only rounded once.
+ *
+ * Tiled kernels load a tile of the image plus an apron of 'radius' pixels
+ * on both sides into shared memory once, instead of reading each pixel
+ * 2 * radius + 1 times from global memory. Tile sizes are the largest
+ * that the shared memory and work group limits of the context allow; with
+ * radii too big for any tile to fit, the naive kernels are used.
+ */
+
+enum gpgpu_pixel_format {
+   GPGPU_PIXEL_FORMAT_RGBA8,
+   GPGPU_PIXEL_FORMAT_R8,
+};
+
+struct gpgpu_convolution {
+   struct gpgpu_context *ctx;
+   enum gpgpu_pixel_format format;
+   uint32_t radius;
+   bool tiled;
+
+   struct gpgpu_kernel horizontal;
+   struct gpgpu_kernel vertical;
+
+   /* local sizes, [pass][dimension], when tiled */
+   uint32_t tile_size[2][2];
+
+   struct gpgpu_buffer weights;
+   struct gpgpu_buffer temp;
+};
+
+/* 'weights_x' and 'weights_y' hold 2 * radius + 1 weights each, for the
+ * pixels from -radius to +radius. With 'tiled' false, the kernels read
+ * global memory for every weight, for comparison.
+ */
+bool     gpgpu_convolution_init     (struct gpgpu_convolution *conv,
+                                     struct gpgpu_context *ctx,
+                                     enum gpgpu_pixel_format format,
+                                     uint32_t radius,
+                                     const float *weights_x,
+                                     const float *weights_y,
+                                     bool tiled);
+
+void     gpgpu_convolution_finish   (struct gpgpu_convolution *conv);
+
+/* Filters 'width' x 'height' pixels of 'src' into 'dst'. Pixels past the
+ * edges are those of the edges.
+ */
+bool     gpgpu_convolution_run      (struct gpgpu_convolution *conv,
+                                     struct gpgpu_buffer *src,
+                                     struct gpgpu_buffer *dst,
+                                     uint32_t width,
+                                     uint32_t height);
+
+/* Writes the 2 * radius + 1 weights of a normalized gaussian. */
+void     gpgpu_convolution_gaussian (float *weights,
+                                     uint32_t radius,
+                                     float sigma);
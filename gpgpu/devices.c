@@ -0,0 +1,266 @@
+/*
+ * GPGPU: device discovery
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include "devices.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DRI_DIR "/dev/dri"
+#define RENDER_NODE_PREFIX "renderD"
+
+static bool
+add_device (struct gpgpu_device *devices,
+            uint32_t max_devices,
+            uint32_t *count,
+            enum gpgpu_device_type type,
+            const char *name,
+            EGLDeviceEXT egl_device)
+{
+   for (uint32_t i = 0; i < *count; i++) {
+      if (devices[i].type == type && strcmp (devices[i].name, name) == 0)
+         return true;
+   }
+
+   if (*count >= max_devices)
+      return false;
+
+   struct gpgpu_device *device = &devices[*count];
+   memset (device, 0x00, sizeof (struct gpgpu_device));
+   device->type = type;
+   snprintf (device->name, GPGPU_DEVICE_NAME_MAX, "%s", name);
+   device->egl_device = egl_device;
+   (*count)++;
+
+   return true;
+}
+
+static void
+enumerate_egl_devices (struct gpgpu_device *devices,
+                       uint32_t max_devices,
+                       uint32_t *count)
+{
+   const char *client_extensions = eglQueryString (EGL_NO_DISPLAY,
+                                                   EGL_EXTENSIONS);
+   if (! gpgpu_has_extension (client_extensions,
+                              "EGL_EXT_device_enumeration")) {
+      return;
+   }
+
+   PFNEGLQUERYDEVICESEXTPROC QueryDevices = (PFNEGLQUERYDEVICESEXTPROC)
+      eglGetProcAddress ("eglQueryDevicesEXT");
+   PFNEGLQUERYDEVICESTRINGEXTPROC QueryDeviceString =
+      (PFNEGLQUERYDEVICESTRINGEXTPROC)
+      eglGetProcAddress ("eglQueryDeviceStringEXT");
+   if (QueryDevices == NULL || QueryDeviceString == NULL)
+      return;
+
+   EGLDeviceEXT egl_devices[GPGPU_MAX_DEVICES];
+   EGLint num_egl_devices = 0;
+   if (! QueryDevices (GPGPU_MAX_DEVICES, egl_devices, &num_egl_devices))
+      return;
+
+   bool platform_device = gpgpu_has_extension (client_extensions,
+                                               "EGL_EXT_platform_device");
+
+   for (EGLint i = 0; i < num_egl_devices; i++) {
+      const char *extensions = QueryDeviceString (egl_devices[i],
+                                                  EGL_EXTENSIONS);
+
+      const char *render_node = NULL;
+      if (gpgpu_has_extension (extensions, "EGL_EXT_device_drm_render_node"))
+         render_node = QueryDeviceString (egl_devices[i],
+                                          EGL_DRM_RENDER_NODE_FILE_EXT);
+
+      if (render_node != NULL) {
+         add_device (devices,
+                     max_devices,
+                     count,
+                     GPGPU_DEVICE_RENDER_NODE,
+                     render_node,
+                     EGL_NO_DEVICE_EXT);
+      } else if (platform_device) {
+         char name[GPGPU_DEVICE_NAME_MAX];
+         if (gpgpu_has_extension (extensions, "EGL_MESA_device_software"))
+            snprintf (name, sizeof (name), "software");
+         else
+            snprintf (name, sizeof (name), "egl-device-%d", i);
+
+         add_device (devices,
+                     max_devices,
+                     count,
+                     GPGPU_DEVICE_EGL,
+                     name,
+                     egl_devices[i]);
+      }
+   }
+}
+
+static int
+compare_strings (const void *a, const void *b)
+{
+   return strcmp (*(const char *const *) a, *(const char *const *) b);
+}
+
+static void
+scan_render_nodes (struct gpgpu_device *devices,
+                   uint32_t max_devices,
+                   uint32_t *count)
+{
+   DIR *dir = opendir (DRI_DIR);
+   if (dir == NULL)
+      return;
+
+   char *names[GPGPU_MAX_DEVICES];
+   uint32_t num_names = 0;
+
+   struct dirent *entry;
+   while ((entry = readdir (dir)) != NULL && num_names < GPGPU_MAX_DEVICES) {
+      if (strncmp (entry->d_name,
+                   RENDER_NODE_PREFIX,
+                   strlen (RENDER_NODE_PREFIX)) != 0) {
+         continue;
+      }
+
+      size_t len = strlen (DRI_DIR) + 1 + strlen (entry->d_name) + 1;
+      names[num_names] = malloc (len);
+      assert (names[num_names] != NULL);
+      snprintf (names[num_names], len, "%s/%s", DRI_DIR, entry->d_name);
+      num_names++;
+   }
+
+   closedir (dir);
+
+   /* in minor number order, renderD128 first */
+   qsort (names, num_names, sizeof (char *), compare_strings);
+
+   for (uint32_t i = 0; i < num_names; i++) {
+      add_device (devices,
+                  max_devices,
+                  count,
+                  GPGPU_DEVICE_RENDER_NODE,
+                  names[i],
+                  EGL_NO_DEVICE_EXT);
+      free (names[i]);
+   }
+}
+
+/* public API */
+
+uint32_t
+gpgpu_devices_enumerate (struct gpgpu_device *devices, uint32_t max_devices)
+{
+   assert (devices != NULL);
+
+   uint32_t count = 0;
+
+   enumerate_egl_devices (devices, max_devices, &count);
+   scan_render_nodes (devices, max_devices, &count);
+
+   if (count == 0) {
+      add_device (devices,
+                  max_devices,
+                  &count,
+                  GPGPU_DEVICE_SURFACELESS,
+                  "surfaceless",
+                  EGL_NO_DEVICE_EXT);
+   }
+
+   return count;
+}
+
+bool
+gpgpu_device_probe (const struct gpgpu_device *device,
+                    struct gpgpu_device_info *info)
+{
+   assert (device != NULL);
+   assert (info != NULL);
+
+   memset (info, 0x00, sizeof (struct gpgpu_device_info));
+   info->device = *device;
+
+   struct gpgpu_context ctx;
+   if (! gpgpu_context_init_device (&ctx, device))
+      return false;
+
+   info->usable = true;
+
+   snprintf (info->renderer, GPGPU_DEVICE_STRING_MAX, "%s",
+             glGetString (GL_RENDERER));
+   snprintf (info->version, GPGPU_DEVICE_STRING_MAX, "%s",
+             glGetString (GL_VERSION));
+
+   memcpy (info->max_work_group_count,
+           ctx.max_work_group_count,
+           sizeof (info->max_work_group_count));
+   memcpy (info->max_work_group_size,
+           ctx.max_work_group_size,
+           sizeof (info->max_work_group_size));
+   info->max_work_group_invocations = ctx.max_work_group_invocations;
+   info->max_shared_memory_size = ctx.max_shared_memory_size;
+
+   const char *extensions = (const char *) glGetString (GL_EXTENSIONS);
+   glGetIntegerv (GL_NUM_EXTENSIONS, &info->num_extensions);
+   info->shader_image_atomic =
+      gpgpu_has_extension (extensions, "GL_OES_shader_image_atomic");
+   info->timer_query =
+      gpgpu_has_extension (extensions, "GL_EXT_disjoint_timer_query");
+   info->program_binary = ctx.program_cache.GetProgramBinary != NULL;
+   info->dma_buf_import =
+      gpgpu_has_extension (eglQueryString (ctx.display, EGL_EXTENSIONS),
+                           "EGL_EXT_image_dma_buf_import");
+
+   gpgpu_context_finish (&ctx);
+
+   return true;
+}
+
+void
+gpgpu_device_print_info (const struct gpgpu_device_info *info)
+{
+   static const char *type_names[] = {
+      [GPGPU_DEVICE_RENDER_NODE] = "render node",
+      [GPGPU_DEVICE_EGL] = "EGL device",
+      [GPGPU_DEVICE_SURFACELESS] = "surfaceless",
+   };
+
+   assert (info != NULL);
+
+   printf ("%s (%s)", info->device.name, type_names[info->device.type]);
+   if (! info->usable) {
+      printf (": no GLES 3.1 context\n");
+      return;
+   }
+
+   printf (": %s, %s\n", info->renderer, info->version);
+   printf ("  work groups: count %d x %d x %d, size %d x %d x %d, "
+           "%d invocations, %d bytes of shared memory\n",
+           info->max_work_group_count[0],
+           info->max_work_group_count[1],
+           info->max_work_group_count[2],
+           info->max_work_group_size[0],
+           info->max_work_group_size[1],
+           info->max_work_group_size[2],
+           info->max_work_group_invocations,
+           info->max_shared_memory_size);
+   printf ("  %d extensions; image atomics: %s, timer queries: %s, "
+           "program binaries: %s, dma-buf import: %s\n",
+           info->num_extensions,
+           info->shader_image_atomic ? "yes" : "no",
+           info->timer_query ? "yes" : "no",
+           info->program_binary ? "yes" : "no",
+           info->dma_buf_import ? "yes" : "no");
+}
@@ -0,0 +1,64 @@
+/*
+ * GPGPU: device discovery
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gpgpu.h"
+
+#define GPGPU_MAX_DEVICES 16
+#define GPGPU_DEVICE_STRING_MAX 128
+
+/* What a device can do, found by creating a context on it. */
+struct gpgpu_device_info {
+   struct gpgpu_device device;
+
+   /* false if no GLES 3.1 context could be created on the device */
+   bool usable;
+
+   char renderer[GPGPU_DEVICE_STRING_MAX];
+   char version[GPGPU_DEVICE_STRING_MAX];
+
+   GLint max_work_group_count[3];
+   GLint max_work_group_size[3];
+   GLint max_work_group_invocations;
+   GLint max_shared_memory_size;
+
+   /* extensions the gpgpu code can make use of */
+   GLint num_extensions;
+   bool shader_image_atomic;
+   bool timer_query;
+   bool program_binary;
+   bool dma_buf_import;
+};
+
+/* Lists up to 'max_devices' devices into 'devices', and returns how many.
+ *
+ * Devices come from EGL_EXT_device_enumeration where available. Those with
+ * a render node (EGL_EXT_device_drm_render_node) are listed as render
+ * nodes, so that they are used through GBM like render-nodes-minimal does;
+ * the others (e.g. Mesa's software device) as EGL devices. Render nodes
+ * EGL didn't list are found by scanning /dev/dri/renderD*. Without any of
+ * that, the surfaceless platform is the one device.
+ */
+uint32_t gpgpu_devices_enumerate (struct gpgpu_device *devices,
+                                  uint32_t max_devices);
+
+/* Fills 'info' by creating a context on 'device'. Must not be called with
+ * a context current that is still in use: it leaves none current.
+ */
+bool     gpgpu_device_probe      (const struct gpgpu_device *device,
+                                  struct gpgpu_device_info *info);
+
+void     gpgpu_device_print_info (const struct gpgpu_device_info *info);
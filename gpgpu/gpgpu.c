@@ -0,0 +1,742 @@
+/*
+ * GPGPU: compute shaders on a DRM render node
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <fcntl.h>
+#include <gbm.h>
+#include "gpgpu.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common/gl-debug.h"
+#include "common/gl-proc.h"
+#include "common/now.h"
+
+/* Opens render node 'path' and an EGL display on top of it. */
+static bool
+open_render_node (struct gpgpu_context *ctx, const char *path)
+{
+   ctx->fd = open (path, O_RDWR | O_CLOEXEC);
+   if (ctx->fd < 0)
+      return false;
+
+   ctx->gbm = gbm_create_device (ctx->fd);
+   if (ctx->gbm != NULL) {
+      ctx->display = eglGetPlatformDisplay (EGL_PLATFORM_GBM_MESA,
+                                            ctx->gbm,
+                                            NULL);
+      if (ctx->display != EGL_NO_DISPLAY
+          && eglInitialize (ctx->display, NULL, NULL)) {
+         return true;
+      }
+
+      ctx->display = EGL_NO_DISPLAY;
+      gbm_device_destroy (ctx->gbm);
+      ctx->gbm = NULL;
+   }
+
+   close (ctx->fd);
+   ctx->fd = -1;
+
+   return false;
+}
+
+static bool
+open_platform (struct gpgpu_context *ctx,
+               const char *platform_extension,
+               EGLenum platform,
+               void *native_display)
+{
+   const char *client_extensions = eglQueryString (EGL_NO_DISPLAY,
+                                                   EGL_EXTENSIONS);
+   if (! gpgpu_has_extension (client_extensions, platform_extension))
+      return false;
+
+   ctx->display = eglGetPlatformDisplay (platform, native_display, NULL);
+   if (ctx->display != EGL_NO_DISPLAY
+       && eglInitialize (ctx->display, NULL, NULL)) {
+      return true;
+   }
+
+   ctx->display = EGL_NO_DISPLAY;
+
+   return false;
+}
+
+static bool
+open_display (struct gpgpu_context *ctx, const struct gpgpu_device *device)
+{
+   switch (device->type) {
+   case GPGPU_DEVICE_RENDER_NODE:
+      return open_render_node (ctx, device->name);
+   case GPGPU_DEVICE_EGL:
+      return open_platform (ctx,
+                            "EGL_EXT_platform_device",
+                            EGL_PLATFORM_DEVICE_EXT,
+                            device->egl_device);
+   case GPGPU_DEVICE_SURFACELESS:
+      return open_platform (ctx,
+                            "EGL_MESA_platform_surfaceless",
+                            EGL_PLATFORM_SURFACELESS_MESA,
+                            EGL_DEFAULT_DISPLAY);
+   }
+
+   return false;
+}
+
+static bool
+create_context (struct gpgpu_context *ctx, EGLContext share_context)
+{
+   const char *extensions = eglQueryString (ctx->display, EGL_EXTENSIONS);
+   if (! gpgpu_has_extension (extensions, "EGL_KHR_create_context")
+       || ! gpgpu_has_extension (extensions,
+                                 "EGL_KHR_surfaceless_context")) {
+      printf ("EGL_KHR_create_context and EGL_KHR_surfaceless_context "
+              "are required\n");
+      return false;
+   }
+
+   static const EGLint config_attribs[] = {
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT_KHR,
+      EGL_NONE
+   };
+   EGLConfig cfg = EGL_NO_CONFIG_KHR;
+   EGLint count = 0;
+
+   /* no surface is ever created, so any config would do */
+   if (! eglChooseConfig (ctx->display, config_attribs, &cfg, 1, &count)
+       || count == 0) {
+      if (! gpgpu_has_extension (extensions, "EGL_KHR_no_config_context")) {
+         printf ("No EGL config for GLES 3\n");
+         return false;
+      }
+      cfg = EGL_NO_CONFIG_KHR;
+   }
+
+   if (! eglBindAPI (EGL_OPENGL_ES_API))
+      return false;
+
+   static const EGLint attribs[] = {
+      EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+      EGL_CONTEXT_MINOR_VERSION_KHR, 1,
+#ifndef NDEBUG
+      EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR,
+#endif
+      EGL_NONE
+   };
+   ctx->context = eglCreateContext (ctx->display,
+                                    cfg,
+                                    share_context,
+                                    attribs);
+   if (ctx->context == EGL_NO_CONTEXT) {
+      printf ("Failed to create a GLES 3.1 context\n");
+      return false;
+   }
+
+   return true;
+}
+
+static void
+query_limits (struct gpgpu_context *ctx)
+{
+   for (uint32_t i = 0; i < 3; i++) {
+      glGetIntegeri_v (GL_MAX_COMPUTE_WORK_GROUP_COUNT,
+                       i,
+                       &ctx->max_work_group_count[i]);
+      glGetIntegeri_v (GL_MAX_COMPUTE_WORK_GROUP_SIZE,
+                       i,
+                       &ctx->max_work_group_size[i]);
+   }
+
+   glGetIntegerv (GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS,
+                  &ctx->max_work_group_invocations);
+   glGetIntegerv (GL_MAX_COMPUTE_SHARED_MEMORY_SIZE,
+                  &ctx->max_shared_memory_size);
+   glGetIntegerv (GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS,
+                  &ctx->max_storage_buffer_bindings);
+   glGetIntegerv (GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT,
+                  &ctx->storage_buffer_offset_alignment);
+}
+
+/* public API */
+
+bool
+gpgpu_context_init (struct gpgpu_context *ctx, const char *device)
+{
+   struct gpgpu_device default_device = {
+      .type = GPGPU_DEVICE_RENDER_NODE,
+      .name = GPGPU_DEFAULT_DEVICE,
+   };
+
+   if (device != NULL) {
+      snprintf (default_device.name, GPGPU_DEVICE_NAME_MAX, "%s", device);
+      return gpgpu_context_init_device (ctx, &default_device);
+   }
+
+   if (access (GPGPU_DEFAULT_DEVICE, R_OK | W_OK) != 0) {
+      default_device.type = GPGPU_DEVICE_SURFACELESS;
+      snprintf (default_device.name, GPGPU_DEVICE_NAME_MAX, "surfaceless");
+   }
+
+   return gpgpu_context_init_device (ctx, &default_device);
+}
+
+bool
+gpgpu_context_init_device (struct gpgpu_context *ctx,
+                           const struct gpgpu_device *device)
+{
+   assert (ctx != NULL);
+   assert (device != NULL);
+
+   memset (ctx, 0x00, sizeof (struct gpgpu_context));
+   ctx->fd = -1;
+   ctx->display = EGL_NO_DISPLAY;
+   ctx->context = EGL_NO_CONTEXT;
+   ctx->device = *device;
+
+   if (! open_display (ctx, device)) {
+      printf ("Failed to open EGL display of device %s\n", device->name);
+      return false;
+   }
+
+   if (! create_context (ctx, EGL_NO_CONTEXT)
+       || ! gpgpu_context_make_current (ctx)) {
+      gpgpu_context_finish (ctx);
+      return false;
+   }
+
+   /* report GL errors through KHR_debug in debug builds */
+   gl_debug_init (&ctx->debug, (GlGetProcAddress) eglGetProcAddress);
+
+   query_limits (ctx);
+
+   gl_program_cache_init (&ctx->program_cache,
+                          NULL,
+                          (GlGetProcAddress) eglGetProcAddress);
+   GL_CHECK ();
+
+   return true;
+}
+
+bool
+gpgpu_context_init_shared (struct gpgpu_context *ctx,
+                           struct gpgpu_context *primary)
+{
+   assert (ctx != NULL);
+   assert (primary != NULL && primary->primary == NULL);
+
+   memset (ctx, 0x00, sizeof (struct gpgpu_context));
+   ctx->device = primary->device;
+   ctx->primary = primary;
+   ctx->fd = primary->fd;
+   ctx->gbm = primary->gbm;
+   ctx->display = primary->display;
+   ctx->context = EGL_NO_CONTEXT;
+
+   if (! create_context (ctx, primary->context)
+       || ! gpgpu_context_make_current (ctx)) {
+      gpgpu_context_finish (ctx);
+      gpgpu_context_make_current (primary);
+      return false;
+   }
+
+   /* debug callbacks and program binary support are per context */
+   gl_debug_init (&ctx->debug, (GlGetProcAddress) eglGetProcAddress);
+
+   query_limits (ctx);
+
+   gl_program_cache_init (&ctx->program_cache,
+                          NULL,
+                          (GlGetProcAddress) eglGetProcAddress);
+   GL_CHECK ();
+
+   return gpgpu_context_make_current (primary);
+}
+
+void
+gpgpu_context_finish (struct gpgpu_context *ctx)
+{
+   assert (ctx != NULL);
+
+   gl_program_cache_finish (&ctx->program_cache);
+
+   if (ctx->context != EGL_NO_CONTEXT) {
+      /* shared contexts are finished from the primary's thread */
+      if (ctx->primary == NULL || eglGetCurrentContext () == ctx->context) {
+         eglMakeCurrent (ctx->display,
+                         EGL_NO_SURFACE,
+                         EGL_NO_SURFACE,
+                         EGL_NO_CONTEXT);
+         gl_debug_make_current (NULL);
+      }
+      eglDestroyContext (ctx->display, ctx->context);
+      ctx->context = EGL_NO_CONTEXT;
+   }
+
+   if (ctx->primary != NULL) {
+      ctx->display = EGL_NO_DISPLAY;
+      ctx->gbm = NULL;
+      ctx->fd = -1;
+      ctx->primary = NULL;
+      return;
+   }
+
+   if (ctx->display != EGL_NO_DISPLAY) {
+      eglTerminate (ctx->display);
+      ctx->display = EGL_NO_DISPLAY;
+   }
+
+   if (ctx->gbm != NULL) {
+      gbm_device_destroy (ctx->gbm);
+      ctx->gbm = NULL;
+   }
+
+   if (ctx->fd >= 0) {
+      close (ctx->fd);
+      ctx->fd = -1;
+   }
+}
+
+bool
+gpgpu_context_make_current (struct gpgpu_context *ctx)
+{
+   assert (ctx != NULL);
+
+   if (! eglMakeCurrent (ctx->display,
+                         EGL_NO_SURFACE,
+                         EGL_NO_SURFACE,
+                         ctx->context)) {
+      return false;
+   }
+
+   /* GL_CHECK()s apply to the context current on each thread */
+   gl_debug_make_current (&ctx->debug);
+
+   return true;
+}
+
+void
+gpgpu_context_print_info (struct gpgpu_context *ctx)
+{
+   assert (ctx != NULL);
+
+   printf ("Device: %s\n", ctx->device.name);
+   printf ("GL_RENDERER: %s\n", glGetString (GL_RENDERER));
+   printf ("GL_VERSION: %s\n", glGetString (GL_VERSION));
+   printf ("GL_MAX_COMPUTE_WORK_GROUP_COUNT: %d, %d, %d\n",
+           ctx->max_work_group_count[0],
+           ctx->max_work_group_count[1],
+           ctx->max_work_group_count[2]);
+   printf ("GL_MAX_COMPUTE_WORK_GROUP_SIZE: %d, %d, %d\n",
+           ctx->max_work_group_size[0],
+           ctx->max_work_group_size[1],
+           ctx->max_work_group_size[2]);
+   printf ("GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS: %d\n",
+           ctx->max_work_group_invocations);
+   printf ("GL_MAX_COMPUTE_SHARED_MEMORY_SIZE: %d\n",
+           ctx->max_shared_memory_size);
+}
+
+void
+gpgpu_context_wait_idle (struct gpgpu_context *ctx)
+{
+   assert (ctx != NULL);
+
+   struct gpgpu_fence fence;
+   if (gpgpu_fence_init (&fence)) {
+      gpgpu_fence_wait (&fence, GL_TIMEOUT_IGNORED);
+      gpgpu_fence_finish (&fence);
+   } else {
+      glFinish ();
+   }
+}
+
+bool
+gpgpu_buffer_init (struct gpgpu_buffer *buf, size_t size, GLenum usage)
+{
+   assert (buf != NULL);
+   assert (size > 0);
+
+   memset (buf, 0x00, sizeof (struct gpgpu_buffer));
+
+   glGenBuffers (1, &buf->id);
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buf->id);
+   GL_CHECK ();
+   glBufferData (GL_SHADER_STORAGE_BUFFER, size, NULL, usage);
+
+   /* out of memory is the error to expect, and not a bug */
+   if (gl_debug_take_error () != GL_NO_ERROR) {
+      glDeleteBuffers (1, &buf->id);
+      buf->id = 0;
+      return false;
+   }
+
+   buf->size = size;
+
+   return true;
+}
+
+void
+gpgpu_buffer_finish (struct gpgpu_buffer *buf)
+{
+   assert (buf != NULL);
+
+   if (buf->id != 0)
+      glDeleteBuffers (1, &buf->id);
+   buf->id = 0;
+   buf->size = 0;
+}
+
+void *
+gpgpu_buffer_map (struct gpgpu_buffer *buf,
+                  size_t offset,
+                  size_t size,
+                  GLbitfield access)
+{
+   assert (buf != NULL && buf->id != 0);
+   assert (offset + size <= buf->size);
+
+   /* Shader writes are incoherent: without a barrier, a mapping may not
+    * see them even though the driver waited for the kernel.
+    */
+   if (access & GL_MAP_READ_BIT)
+      glMemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buf->id);
+   void *data = glMapBufferRange (GL_SHADER_STORAGE_BUFFER,
+                                  offset,
+                                  size,
+                                  access);
+   GL_CHECK ();
+
+   return data;
+}
+
+bool
+gpgpu_buffer_unmap (struct gpgpu_buffer *buf)
+{
+   assert (buf != NULL && buf->id != 0);
+
+   glBindBuffer (GL_SHADER_STORAGE_BUFFER, buf->id);
+
+   /* false if the contents got lost, e.g. on a mode switch */
+   bool ok = glUnmapBuffer (GL_SHADER_STORAGE_BUFFER) == GL_TRUE;
+   GL_CHECK ();
+
+   return ok;
+}
+
+bool
+gpgpu_buffer_upload (struct gpgpu_buffer *buf,
+                     const void *data,
+                     size_t offset,
+                     size_t size)
+{
+   assert (data != NULL);
+
+   void *dst = gpgpu_buffer_map (buf,
+                                 offset,
+                                 size,
+                                 GL_MAP_WRITE_BIT
+                                 | GL_MAP_INVALIDATE_RANGE_BIT);
+   if (dst == NULL)
+      return false;
+
+   memcpy (dst, data, size);
+
+   return gpgpu_buffer_unmap (buf);
+}
+
+bool
+gpgpu_buffer_download (struct gpgpu_buffer *buf,
+                       void *data,
+                       size_t offset,
+                       size_t size)
+{
+   assert (data != NULL);
+
+   const void *src = gpgpu_buffer_map (buf, offset, size, GL_MAP_READ_BIT);
+   if (src == NULL)
+      return false;
+
+   memcpy (data, src, size);
+
+   return gpgpu_buffer_unmap (buf);
+}
+
+void
+gpgpu_buffer_copy (struct gpgpu_buffer *dst,
+                   size_t dst_offset,
+                   struct gpgpu_buffer *src,
+                   size_t src_offset,
+                   size_t size)
+{
+   assert (dst != NULL && dst->id != 0);
+   assert (src != NULL && src->id != 0);
+   assert (dst_offset + size <= dst->size);
+   assert (src_offset + size <= src->size);
+
+   /* copies read buffers through another path than shaders */
+   glMemoryBarrier (GL_BUFFER_UPDATE_BARRIER_BIT);
+
+   glBindBuffer (GL_COPY_READ_BUFFER, src->id);
+   glBindBuffer (GL_COPY_WRITE_BUFFER, dst->id);
+   glCopyBufferSubData (GL_COPY_READ_BUFFER,
+                        GL_COPY_WRITE_BUFFER,
+                        src_offset,
+                        dst_offset,
+                        size);
+   GL_CHECK ();
+}
+
+bool
+gpgpu_kernel_init (struct gpgpu_kernel *kernel,
+                   struct gpgpu_context *ctx,
+                   const char *source)
+{
+   return gpgpu_kernel_init_with_defines (kernel, ctx, source, NULL);
+}
+
+bool
+gpgpu_kernel_init_with_defines (struct gpgpu_kernel *kernel,
+                                struct gpgpu_context *ctx,
+                                const char *source,
+                                const char *defines)
+{
+   assert (kernel != NULL);
+   assert (ctx != NULL);
+   assert (source != NULL);
+
+   memset (kernel, 0x00, sizeof (struct gpgpu_kernel));
+   kernel->ctx = ctx;
+
+   /* #version must come first */
+   char *full_source = NULL;
+   if (defines != NULL) {
+      const char *body = strchr (source, '\n');
+      body = body != NULL ? body + 1 : source + strlen (source);
+
+      size_t version_len = body - source;
+      size_t len = version_len + strlen (defines) + strlen (body) + 1;
+      full_source = malloc (len);
+      assert (full_source != NULL);
+      snprintf (full_source, len, "%.*s%s%s",
+                (int) version_len, source, defines, body);
+      source = full_source;
+   }
+
+   const GLenum type = GL_COMPUTE_SHADER;
+   kernel->program = gl_program_cache_get_program (&ctx->program_cache,
+                                                   &source,
+                                                   &type,
+                                                   1,
+                                                   NULL,
+                                                   0);
+   free (full_source);
+   if (kernel->program == 0)
+      return false;
+
+   glGetProgramiv (kernel->program,
+                   GL_COMPUTE_WORK_GROUP_SIZE,
+                   kernel->local_size);
+   kernel->global_size_location =
+      glGetUniformLocation (kernel->program, GPGPU_GLOBAL_SIZE_UNIFORM);
+   GL_CHECK ();
+
+   return true;
+}
+
+void
+gpgpu_kernel_finish (struct gpgpu_kernel *kernel)
+{
+   assert (kernel != NULL);
+
+   if (kernel->program != 0)
+      glDeleteProgram (kernel->program);
+   kernel->program = 0;
+}
+
+GLint
+gpgpu_kernel_uniform_location (struct gpgpu_kernel *kernel, const char *name)
+{
+   assert (kernel != NULL && kernel->program != 0);
+   assert (name != NULL);
+
+   return glGetUniformLocation (kernel->program, name);
+}
+
+void
+gpgpu_kernel_set_int (struct gpgpu_kernel *kernel,
+                      const char *name,
+                      int32_t value)
+{
+   GLint location = gpgpu_kernel_uniform_location (kernel, name);
+
+   /* unused uniforms are optimized out, setting them is not an error */
+   if (location >= 0)
+      glProgramUniform1i (kernel->program, location, value);
+   GL_CHECK ();
+}
+
+void
+gpgpu_kernel_set_uint (struct gpgpu_kernel *kernel,
+                       const char *name,
+                       uint32_t value)
+{
+   GLint location = gpgpu_kernel_uniform_location (kernel, name);
+
+   if (location >= 0)
+      glProgramUniform1ui (kernel->program, location, value);
+   GL_CHECK ();
+}
+
+void
+gpgpu_kernel_set_float (struct gpgpu_kernel *kernel,
+                        const char *name,
+                        float value)
+{
+   GLint location = gpgpu_kernel_uniform_location (kernel, name);
+
+   if (location >= 0)
+      glProgramUniform1f (kernel->program, location, value);
+   GL_CHECK ();
+}
+
+void
+gpgpu_kernel_bind_buffer (struct gpgpu_kernel *kernel,
+                          uint32_t binding,
+                          struct gpgpu_buffer *buf)
+{
+   assert (kernel != NULL);
+   assert (buf != NULL && buf->id != 0);
+   assert ((GLint) binding < kernel->ctx->max_storage_buffer_bindings);
+
+   /* Bindings are context state rather than program state, like GL's; the
+    * kernel is only there to tell which context.
+    */
+   glBindBufferBase (GL_SHADER_STORAGE_BUFFER, binding, buf->id);
+   GL_CHECK ();
+}
+
+void
+gpgpu_kernel_bind_texture (struct gpgpu_kernel *kernel,
+                           uint32_t unit,
+                           GLuint texture)
+{
+   assert (kernel != NULL);
+   assert (texture != 0);
+
+   glActiveTexture (GL_TEXTURE0 + unit);
+   glBindTexture (GL_TEXTURE_2D, texture);
+   GL_CHECK ();
+}
+
+bool
+gpgpu_kernel_dispatch (struct gpgpu_kernel *kernel,
+                       uint32_t size_x,
+                       uint32_t size_y,
+                       uint32_t size_z)
+{
+   assert (kernel != NULL && kernel->program != 0);
+   assert (size_x > 0 && size_y > 0 && size_z > 0);
+
+   const uint32_t size[3] = { size_x, size_y, size_z };
+   GLuint groups[3];
+
+   for (uint32_t i = 0; i < 3; i++) {
+      uint64_t local = kernel->local_size[i];
+      uint64_t count = (size[i] + local - 1) / local;
+
+      if (count > (uint64_t) kernel->ctx->max_work_group_count[i]) {
+         printf ("Dispatch of %u invocations needs %llu work groups in "
+                 "dimension %u, the limit is %d\n",
+                 size[i],
+                 (unsigned long long) count,
+                 i,
+                 kernel->ctx->max_work_group_count[i]);
+         return false;
+      }
+      groups[i] = count;
+   }
+
+   if (kernel->global_size_location >= 0) {
+      glProgramUniform3ui (kernel->program,
+                           kernel->global_size_location,
+                           size_x,
+                           size_y,
+                           size_z);
+   }
+
+   glUseProgram (kernel->program);
+   glDispatchCompute (groups[0], groups[1], groups[2]);
+
+   /* for kernels that consume the output of this one */
+   glMemoryBarrier (GL_SHADER_STORAGE_BARRIER_BIT
+                    | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+   GL_CHECK ();
+
+   kernel->dispatches++;
+
+   return true;
+}
+
+bool
+gpgpu_fence_init (struct gpgpu_fence *fence)
+{
+   assert (fence != NULL);
+
+   fence->sync = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   if (fence->sync == NULL)
+      return false;
+
+   /* a fence nobody flushed may never signal */
+   glFlush ();
+
+   return true;
+}
+
+void
+gpgpu_fence_finish (struct gpgpu_fence *fence)
+{
+   assert (fence != NULL);
+
+   if (fence->sync != NULL)
+      glDeleteSync (fence->sync);
+   fence->sync = NULL;
+}
+
+bool
+gpgpu_fence_wait (struct gpgpu_fence *fence, uint64_t timeout_ns)
+{
+   assert (fence != NULL && fence->sync != NULL);
+
+   GLenum status = glClientWaitSync (fence->sync, 0, timeout_ns);
+   GL_CHECK ();
+
+   return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+double
+gpgpu_now_ms (void)
+{
+   return now_ms ();
+}
+
+bool
+gpgpu_has_extension (const char *extensions, const char *name)
+{
+   return gl_has_extension_in (extensions, name);
+}
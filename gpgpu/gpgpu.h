@@ -0,0 +1,263 @@
+/*
+ * GPGPU: compute shaders on a DRM render node
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES3/gl31.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common/gl-debug.h"
+#include "common/gl-program-cache.h"
+
+/* A small library around the setup of render-nodes-minimal: a window-less
+ * EGL + GLES 3.1 context on a DRM render node, shader storage buffers,
+ * compute kernels, and fences to wait for their completion.
+ *
+ * All functions must be called with the context of the object current
+ * (gpgpu_context_make_current()), on the thread that made it current.
+ */
+
+#define GPGPU_DEFAULT_DEVICE "/dev/dri/renderD128"
+
+/* Uniform a kernel may declare as 'uniform uvec3 gpgpu_global_size;'. It is
+ * set on dispatch to the number of invocations asked for, so that the
+ * invocations of the last, partial work groups can bail out.
+ */
+#define GPGPU_GLOBAL_SIZE_UNIFORM "gpgpu_global_size"
+
+#define GPGPU_DEVICE_NAME_MAX 64
+
+struct gbm_device;
+
+enum gpgpu_device_type {
+   /* a DRM render node, 'name' is its path */
+   GPGPU_DEVICE_RENDER_NODE,
+
+   /* an EGL_EXT_device_enumeration device without a render node, e.g.
+    * Mesa's software device
+    */
+   GPGPU_DEVICE_EGL,
+
+   /* Mesa's surfaceless platform, on whatever device it picks */
+   GPGPU_DEVICE_SURFACELESS,
+};
+
+struct gpgpu_device {
+   enum gpgpu_device_type type;
+   char name[GPGPU_DEVICE_NAME_MAX];
+
+   /* GPGPU_DEVICE_EGL only */
+   EGLDeviceEXT egl_device;
+};
+
+struct gpgpu_context {
+   struct gpgpu_device device;
+
+   /* the context this one shares its display and GL objects with, NULL if
+    * it owns them
+    */
+   struct gpgpu_context *primary;
+
+   /* the render node, -1 if the device is not one */
+   int32_t fd;
+   struct gbm_device *gbm;
+
+   EGLDisplay display;
+   EGLContext context;
+
+   struct gl_program_cache program_cache;
+   struct gl_debug debug;
+
+   /* limits */
+   GLint max_work_group_count[3];
+   GLint max_work_group_size[3];
+   GLint max_work_group_invocations;
+   GLint max_shared_memory_size;
+   GLint max_storage_buffer_bindings;
+   GLint storage_buffer_offset_alignment;
+};
+
+struct gpgpu_buffer {
+   GLuint id;
+   size_t size;
+};
+
+struct gpgpu_kernel {
+   struct gpgpu_context *ctx;
+   GLuint program;
+   GLint local_size[3];
+   GLint global_size_location;
+
+   /* statistics */
+   uint64_t dispatches;
+};
+
+struct gpgpu_fence {
+   GLsync sync;
+};
+
+/* Creates a context on render node 'device' (e.g. GPGPU_DEFAULT_DEVICE).
+ * With a NULL 'device', GPGPU_DEFAULT_DEVICE is tried first and Mesa's
+ * surfaceless platform (e.g. llvmpipe) is the fallback, so that the code
+ * also runs on machines without a GPU. The context is left current.
+ */
+bool     gpgpu_context_init             (struct gpgpu_context *ctx,
+                                         const char *device);
+
+/* Creates a context on 'device', e.g. one from gpgpu_devices_enumerate(). */
+bool     gpgpu_context_init_device      (struct gpgpu_context *ctx,
+                                         const struct gpgpu_device *device);
+
+/* Creates a context in the share group of 'primary', on the same display:
+ * buffers, programs and fences of either are objects of both. It is meant
+ * to be made current on another thread, so 'primary' is left current.
+ * Finishing it leaves the display to 'primary', which must be finished
+ * last.
+ */
+bool     gpgpu_context_init_shared      (struct gpgpu_context *ctx,
+                                         struct gpgpu_context *primary);
+
+void     gpgpu_context_finish           (struct gpgpu_context *ctx);
+
+bool     gpgpu_context_make_current     (struct gpgpu_context *ctx);
+
+void     gpgpu_context_print_info       (struct gpgpu_context *ctx);
+
+/* Blocks until all the work submitted so far has completed. */
+void     gpgpu_context_wait_idle        (struct gpgpu_context *ctx);
+
+/* 'usage' is a glBufferData() usage hint, e.g. GL_DYNAMIC_COPY for buffers
+ * that kernels write and the CPU reads back.
+ */
+bool     gpgpu_buffer_init              (struct gpgpu_buffer *buf,
+                                         size_t size,
+                                         GLenum usage);
+
+void     gpgpu_buffer_finish            (struct gpgpu_buffer *buf);
+
+/* Maps a range of the buffer, see glMapBufferRange(). Mapping for reading
+ * makes the writes of kernels dispatched before visible.
+ */
+void    *gpgpu_buffer_map               (struct gpgpu_buffer *buf,
+                                         size_t offset,
+                                         size_t size,
+                                         GLbitfield access);
+
+bool     gpgpu_buffer_unmap             (struct gpgpu_buffer *buf);
+
+/* Copies 'size' bytes of 'data' to the buffer at 'offset', through a
+ * mapping that invalidates the range (the driver needn't preserve or wait
+ * on its old contents).
+ */
+bool     gpgpu_buffer_upload            (struct gpgpu_buffer *buf,
+                                         const void *data,
+                                         size_t offset,
+                                         size_t size);
+
+/* Copies 'size' bytes of the buffer at 'offset' to 'data', waiting for the
+ * kernels writing it to finish.
+ */
+bool     gpgpu_buffer_download          (struct gpgpu_buffer *buf,
+                                         void *data,
+                                         size_t offset,
+                                         size_t size);
+
+/* Copies 'size' bytes from 'src' at 'src_offset' to 'dst' at 'dst_offset'
+ * on the GPU, after the kernels writing 'src' (e.g. to a GL_STREAM_READ
+ * buffer that maps faster than the one kernels write to).
+ */
+void     gpgpu_buffer_copy              (struct gpgpu_buffer *dst,
+                                         size_t dst_offset,
+                                         struct gpgpu_buffer *src,
+                                         size_t src_offset,
+                                         size_t size);
+
+/* Builds a kernel from the GLSL ES 3.10 compute shader 'source', through
+ * the context's program binary cache.
+ */
+bool     gpgpu_kernel_init              (struct gpgpu_kernel *kernel,
+                                         struct gpgpu_context *ctx,
+                                         const char *source);
+
+/* Like gpgpu_kernel_init(), with 'defines' (e.g. "#define N 64\n")
+ * inserted after the #version line of 'source', so that one source can be
+ * built with different constants, like shared memory array sizes.
+ */
+bool     gpgpu_kernel_init_with_defines (struct gpgpu_kernel *kernel,
+                                         struct gpgpu_context *ctx,
+                                         const char *source,
+                                         const char *defines);
+
+void     gpgpu_kernel_finish            (struct gpgpu_kernel *kernel);
+
+/* Returns -1 if the kernel has no active uniform 'name'. */
+GLint    gpgpu_kernel_uniform_location  (struct gpgpu_kernel *kernel,
+                                         const char *name);
+
+void     gpgpu_kernel_set_int           (struct gpgpu_kernel *kernel,
+                                         const char *name,
+                                         int32_t value);
+
+void     gpgpu_kernel_set_uint          (struct gpgpu_kernel *kernel,
+                                         const char *name,
+                                         uint32_t value);
+
+void     gpgpu_kernel_set_float         (struct gpgpu_kernel *kernel,
+                                         const char *name,
+                                         float value);
+
+/* Binds 'buf' to 'layout (binding = N) buffer' block N of the kernels. */
+void     gpgpu_kernel_bind_buffer       (struct gpgpu_kernel *kernel,
+                                         uint32_t binding,
+                                         struct gpgpu_buffer *buf);
+
+/* Binds 2D texture 'texture' to texture unit 'unit', for the kernels'
+ * 'layout (binding = N) uniform sampler2D' N.
+ */
+void     gpgpu_kernel_bind_texture      (struct gpgpu_kernel *kernel,
+                                         uint32_t unit,
+                                         GLuint texture);
+
+/* Runs at least size_x * size_y * size_z invocations of the kernel, in as
+ * few work groups of the kernel's local size as that takes. Kernels
+ * dispatched later see the buffer and image writes of this one.
+ */
+bool     gpgpu_kernel_dispatch          (struct gpgpu_kernel *kernel,
+                                         uint32_t size_x,
+                                         uint32_t size_y,
+                                         uint32_t size_z);
+
+/* A monotonic clock, in milliseconds, for timing work on the host. */
+double   gpgpu_now_ms                   (void);
+
+/* Whether space-separated extension list 'extensions' (of EGL or GL)
+ * contains 'name'.
+ */
+bool     gpgpu_has_extension            (const char *extensions,
+                                         const char *name);
+
+/* Signals once all the work submitted before it has completed. Inserting
+ * a fence flushes the work to the GPU.
+ */
+bool     gpgpu_fence_init               (struct gpgpu_fence *fence);
+
+void     gpgpu_fence_finish             (struct gpgpu_fence *fence);
+
+/* Returns true if the fence signaled within 'timeout_ns' nanoseconds
+ * (GL_TIMEOUT_IGNORED waits forever, 0 polls).
+ */
+bool     gpgpu_fence_wait               (struct gpgpu_fence *fence,
+                                         uint64_t timeout_ns);
@@ -0,0 +1,252 @@
+/*
+ * Example:
+ *
+ * GPGPU image pipeline: two compute stages handing an RGBA8 image to each
+ *                       other through a dma-buf, without copying pixels.
+ *
+ * A test pattern is written straight into a GBM buffer object, like an
+ * image decoder would write its output rows. The first stage inverts it
+ * into a second buffer object, which is exported as a dma-buf fd and
+ * imported again, as the next stage or another process would. The second
+ * stage converts that to grayscale, and the result is checked on the CPU
+ * through a mapping of its buffer object.
+ *
+ * Without GBM (e.g. on llvmpipe), the images are textures and the same
+ * pipeline runs with copies in and out.
+ *
+ * Usage: gpgpu-image-pipeline [-w width] [-h height] [-i iterations]
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gpgpu.h"
+#include "image.h"
+
+static const char *INVERT_SRC =
+   "#version 310 es\n"
+   "layout (local_size_x = 8, local_size_y = 8) in;\n"
+   "layout (rgba8, binding = 0) readonly uniform highp image2D src;\n"
+   "layout (rgba8, binding = 1) writeonly uniform highp image2D dst;\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "void main (void) {\n"
+   "   uvec2 p = gl_GlobalInvocationID.xy;\n"
+   "   if (any (greaterThanEqual (p, gpgpu_global_size.xy)))\n"
+   "      return;\n"
+   "   vec4 c = imageLoad (src, ivec2 (p));\n"
+   "   imageStore (dst, ivec2 (p), vec4 (1.0 - c.rgb, c.a));\n"
+   "}\n";
+
+/* integer weights, so that the CPU can tell the exact expected result */
+static const char *GRAYSCALE_SRC =
+   "#version 310 es\n"
+   "layout (local_size_x = 8, local_size_y = 8) in;\n"
+   "layout (rgba8, binding = 0) readonly uniform highp image2D src;\n"
+   "layout (rgba8, binding = 1) writeonly uniform highp image2D dst;\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "void main (void) {\n"
+   "   uvec2 p = gl_GlobalInvocationID.xy;\n"
+   "   if (any (greaterThanEqual (p, gpgpu_global_size.xy)))\n"
+   "      return;\n"
+   "   uvec4 c = uvec4 (round (imageLoad (src, ivec2 (p)) * 255.0));\n"
+   "   uint y = (77u * c.r + 150u * c.g + 29u * c.b) >> 8;\n"
+   "   imageStore (dst, ivec2 (p), vec4 (uvec4 (y, y, y, c.a)) / 255.0);\n"
+   "}\n";
+
+static void
+write_pattern (uint8_t *pixels,
+               uint32_t width,
+               uint32_t height,
+               uint32_t stride)
+{
+   for (uint32_t y = 0; y < height; y++) {
+      uint8_t *row = pixels + (size_t) y * stride;
+      for (uint32_t x = 0; x < width; x++) {
+         row[x * 4 + 0] = x * 255 / width;
+         row[x * 4 + 1] = y * 255 / height;
+         row[x * 4 + 2] = (x ^ y) & 0xff;
+         row[x * 4 + 3] = 255;
+      }
+   }
+}
+
+static bool
+check_result (const uint8_t *pixels,
+              uint32_t width,
+              uint32_t height,
+              uint32_t stride)
+{
+   for (uint32_t y = 0; y < height; y++) {
+      const uint8_t *row = pixels + (size_t) y * stride;
+      for (uint32_t x = 0; x < width; x++) {
+         uint32_t r = 255 - x * 255 / width;
+         uint32_t g = 255 - y * 255 / height;
+         uint32_t b = 255 - ((x ^ y) & 0xff);
+         uint32_t expected = (77 * r + 150 * g + 29 * b) >> 8;
+
+         if (row[x * 4] != expected || row[x * 4 + 3] != 255) {
+            printf ("Pixel %u,%u is %u, expected %u\n",
+                    x, y, row[x * 4], expected);
+            return false;
+         }
+      }
+   }
+
+   return true;
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   uint32_t width = 1920;
+   uint32_t height = 1080;
+   uint32_t iterations = 10;
+
+   for (int32_t i = 1; i < argc; i++) {
+      if (strcmp (argv[i], "-w") == 0 && i + 1 < argc) {
+         width = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-h") == 0 && i + 1 < argc) {
+         height = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-i") == 0 && i + 1 < argc) {
+         iterations = strtoul (argv[++i], NULL, 10);
+      } else {
+         printf ("Usage: %s [-w width] [-h height] [-i iterations]\n",
+                 argv[0]);
+         return -1;
+      }
+   }
+
+   if (width == 0 || height == 0 || iterations == 0) {
+      printf ("Invalid arguments\n");
+      return -1;
+   }
+
+   struct gpgpu_context ctx;
+   if (! gpgpu_context_init (&ctx, NULL))
+      return -1;
+
+   gpgpu_context_print_info (&ctx);
+
+   bool zero_copy = gpgpu_image_zero_copy_supported (&ctx);
+   printf ("Images: %s\n\n",
+           zero_copy
+           ? "GBM buffer objects, shared through dma-buf"
+           : "textures, copied to and from (no GBM or dma-buf import)");
+
+   struct gpgpu_kernel invert;
+   struct gpgpu_kernel grayscale;
+   if (! gpgpu_kernel_init (&invert, &ctx, INVERT_SRC)
+       || ! gpgpu_kernel_init (&grayscale, &ctx, GRAYSCALE_SRC)) {
+      return -1;
+   }
+
+   struct gpgpu_image src;
+   struct gpgpu_image mid;
+   struct gpgpu_image out;
+   if (! gpgpu_image_init (&src, &ctx, width, height)
+       || ! gpgpu_image_init (&mid, &ctx, width, height)
+       || ! gpgpu_image_init (&out, &ctx, width, height)) {
+      return -1;
+   }
+
+   /* the "decoder" writes its output in place */
+   uint32_t stride;
+   uint8_t *pixels = gpgpu_image_map (&src, GL_MAP_WRITE_BIT, &stride);
+   if (pixels != NULL) {
+      write_pattern (pixels, width, height, stride);
+      gpgpu_image_unmap (&src);
+   } else {
+      stride = width * 4;
+      pixels = malloc ((size_t) stride * height);
+      assert (pixels != NULL);
+      write_pattern (pixels, width, height, stride);
+      gpgpu_image_upload (&src, pixels, stride);
+      free (pixels);
+   }
+
+   /* The next stage gets the first stage's output as a dma-buf fd; another
+    * process would receive it over a Unix socket.
+    */
+   struct gpgpu_image next;
+   struct gpgpu_image *stage2_input = &mid;
+   if (zero_copy) {
+      struct gpgpu_dma_buf dma_buf;
+      if (! gpgpu_image_export_dma_buf (&mid, &dma_buf))
+         return -1;
+
+      printf ("Exported dma-buf: fd %d, %ux%u, stride %u, modifier 0x%llx\n",
+              dma_buf.fd,
+              dma_buf.width,
+              dma_buf.height,
+              dma_buf.stride,
+              (unsigned long long) dma_buf.modifier);
+
+      bool ok = gpgpu_image_init_from_dma_buf (&next, &ctx, &dma_buf);
+      close (dma_buf.fd);
+      if (! ok)
+         return -1;
+      stage2_input = &next;
+   }
+
+   double start = gpgpu_now_ms ();
+   for (uint32_t i = 0; i < iterations; i++) {
+      gpgpu_kernel_bind_image (&invert, 0, &src, GL_READ_ONLY);
+      gpgpu_kernel_bind_image (&invert, 1, &mid, GL_WRITE_ONLY);
+      gpgpu_kernel_dispatch (&invert, width, height, 1);
+
+      gpgpu_kernel_bind_image (&grayscale, 0, stage2_input, GL_READ_ONLY);
+      gpgpu_kernel_bind_image (&grayscale, 1, &out, GL_WRITE_ONLY);
+      gpgpu_kernel_dispatch (&grayscale, width, height, 1);
+   }
+   gpgpu_context_wait_idle (&ctx);
+   double elapsed = gpgpu_now_ms () - start;
+
+   printf ("%u iterations of 2 stages on %ux%u: %.3f ms each, "
+           "%.1f MP/s per stage\n",
+           iterations,
+           width,
+           height,
+           elapsed / iterations,
+           2.0 * iterations * width * height / (elapsed * 1000.0));
+
+   /* the result is read in place too */
+   bool ok;
+   pixels = gpgpu_image_map (&out, GL_MAP_READ_BIT, &stride);
+   if (pixels != NULL) {
+      ok = check_result (pixels, width, height, stride);
+      gpgpu_image_unmap (&out);
+   } else {
+      stride = width * 4;
+      pixels = malloc ((size_t) stride * height);
+      assert (pixels != NULL);
+      ok = gpgpu_image_download (&out, pixels, stride)
+         && check_result (pixels, width, height, stride);
+      free (pixels);
+   }
+
+   printf ("Result: %s\n", ok ? "OK" : "FAILED");
+
+   if (zero_copy)
+      gpgpu_image_finish (&next);
+   gpgpu_image_finish (&out);
+   gpgpu_image_finish (&mid);
+   gpgpu_image_finish (&src);
+   gpgpu_kernel_finish (&grayscale);
+   gpgpu_kernel_finish (&invert);
+   gpgpu_context_finish (&ctx);
+
+   return ok ? 0 : -1;
+}
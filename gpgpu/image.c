@@ -0,0 +1,515 @@
+/*
+ * GPGPU: images in GBM buffer objects, shared through dma-buf
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <gbm.h>
+#include "image.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <GLES2/gl2ext.h>
+
+#include "common/gl-debug.h"
+
+#define BYTES_PER_PIXEL 4
+
+/* Entry points of the extensions, the same for every display and context
+ * as eglGetProcAddress() returns dispatch stubs.
+ */
+static struct {
+   bool loaded;
+   PFNEGLCREATEIMAGEKHRPROC CreateImage;
+   PFNEGLDESTROYIMAGEKHRPROC DestroyImage;
+   PFNGLEGLIMAGETARGETTEXSTORAGEEXTPROC ImageTargetTexStorage;
+} procs;
+
+static void
+load_procs (void)
+{
+   if (procs.loaded)
+      return;
+
+   procs.CreateImage = (PFNEGLCREATEIMAGEKHRPROC)
+      eglGetProcAddress ("eglCreateImageKHR");
+   procs.DestroyImage = (PFNEGLDESTROYIMAGEKHRPROC)
+      eglGetProcAddress ("eglDestroyImageKHR");
+   procs.ImageTargetTexStorage = (PFNGLEGLIMAGETARGETTEXSTORAGEEXTPROC)
+      eglGetProcAddress ("glEGLImageTargetTexStorageEXT");
+   procs.loaded = true;
+}
+
+/* Creates the EGLImage of 'dma_buf' and an immutable texture on it, as
+ * glBindImageTexture() only takes immutable textures on GLES.
+ */
+static bool
+import_dma_buf (struct gpgpu_image *image, const struct gpgpu_dma_buf *dma_buf)
+{
+   EGLint attribs[] = {
+      EGL_WIDTH, dma_buf->width,
+      EGL_HEIGHT, dma_buf->height,
+      EGL_LINUX_DRM_FOURCC_EXT, dma_buf->fourcc,
+      EGL_DMA_BUF_PLANE0_FD_EXT, dma_buf->fd,
+      EGL_DMA_BUF_PLANE0_OFFSET_EXT, dma_buf->offset,
+      EGL_DMA_BUF_PLANE0_PITCH_EXT, dma_buf->stride,
+      EGL_NONE, 0,
+      EGL_NONE, 0,
+      EGL_NONE
+   };
+
+   if (dma_buf->modifier != GPGPU_DMA_BUF_MOD_INVALID) {
+      const char *extensions = eglQueryString (image->ctx->display,
+                                               EGL_EXTENSIONS);
+      if (gpgpu_has_extension (extensions,
+                               "EGL_EXT_image_dma_buf_import_modifiers")) {
+         attribs[12] = EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT;
+         attribs[13] = (EGLint) (dma_buf->modifier & 0xffffffff);
+         attribs[14] = EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT;
+         attribs[15] = (EGLint) (dma_buf->modifier >> 32);
+      } else if (dma_buf->modifier != 0) {
+         printf ("Tiled dma-bufs need "
+                 "EGL_EXT_image_dma_buf_import_modifiers\n");
+         return false;
+      }
+   }
+
+   image->egl_image = procs.CreateImage (image->ctx->display,
+                                         EGL_NO_CONTEXT,
+                                         EGL_LINUX_DMA_BUF_EXT,
+                                         NULL,
+                                         attribs);
+   if (image->egl_image == EGL_NO_IMAGE_KHR) {
+      printf ("Failed to import dma-buf as an EGLImage: 0x%x\n",
+              eglGetError ());
+      return false;
+   }
+
+   glGenTextures (1, &image->texture);
+   glBindTexture (GL_TEXTURE_2D, image->texture);
+   GL_CHECK ();
+   procs.ImageTargetTexStorage (GL_TEXTURE_2D, image->egl_image, NULL);
+   glBindTexture (GL_TEXTURE_2D, 0);
+
+   /* e.g. a format or layout the GL driver can't sample */
+   if (gl_debug_take_error () != GL_NO_ERROR) {
+      printf ("Failed to create a texture on the EGLImage\n");
+      return false;
+   }
+
+   return true;
+}
+
+static bool
+init_texture (struct gpgpu_image *image)
+{
+   glGenTextures (1, &image->texture);
+   glBindTexture (GL_TEXTURE_2D, image->texture);
+   GL_CHECK ();
+   glTexStorage2D (GL_TEXTURE_2D, 1, GL_RGBA8, image->width, image->height);
+   glBindTexture (GL_TEXTURE_2D, 0);
+
+   /* may run out of memory for large images */
+   return gl_debug_take_error () == GL_NO_ERROR;
+}
+
+static bool
+init_bo (struct gpgpu_image *image)
+{
+   /* Linear, so that mapping doesn't detile through a copy, and other
+    * devices (encoders, displays) can read it; not every GPU can render to
+    * linear buffers though.
+    */
+   image->bo = gbm_bo_create (image->ctx->gbm,
+                              image->width,
+                              image->height,
+                              GBM_FORMAT_ABGR8888,
+                              GBM_BO_USE_RENDERING | GBM_BO_USE_LINEAR);
+   if (image->bo == NULL) {
+      image->bo = gbm_bo_create (image->ctx->gbm,
+                                 image->width,
+                                 image->height,
+                                 GBM_FORMAT_ABGR8888,
+                                 GBM_BO_USE_RENDERING);
+   }
+   if (image->bo == NULL) {
+      printf ("Failed to create a %ux%u GBM buffer object\n",
+              image->width,
+              image->height);
+      return false;
+   }
+
+   struct gpgpu_dma_buf dma_buf;
+   if (! gpgpu_image_export_dma_buf (image, &dma_buf))
+      return false;
+
+   bool ok = import_dma_buf (image, &dma_buf);
+   close (dma_buf.fd);
+
+   return ok;
+}
+
+/* public API */
+
+bool
+gpgpu_image_zero_copy_supported (struct gpgpu_context *ctx)
+{
+   assert (ctx != NULL);
+
+   if (ctx->gbm == NULL)
+      return false;
+
+   load_procs ();
+   if (procs.CreateImage == NULL
+       || procs.DestroyImage == NULL
+       || procs.ImageTargetTexStorage == NULL) {
+      return false;
+   }
+
+   return gpgpu_has_extension (eglQueryString (ctx->display, EGL_EXTENSIONS),
+                               "EGL_EXT_image_dma_buf_import")
+      && gpgpu_has_extension ((const char *) glGetString (GL_EXTENSIONS),
+                              "GL_EXT_EGL_image_storage");
+}
+
+bool
+gpgpu_image_init (struct gpgpu_image *image,
+                  struct gpgpu_context *ctx,
+                  uint32_t width,
+                  uint32_t height)
+{
+   assert (image != NULL);
+   assert (ctx != NULL);
+   assert (width > 0 && height > 0);
+
+   memset (image, 0x00, sizeof (struct gpgpu_image));
+   image->ctx = ctx;
+   image->width = width;
+   image->height = height;
+   image->egl_image = EGL_NO_IMAGE_KHR;
+
+   bool ok = gpgpu_image_zero_copy_supported (ctx)
+      ? init_bo (image)
+      : init_texture (image);
+   if (! ok) {
+      gpgpu_image_finish (image);
+      return false;
+   }
+
+   return true;
+}
+
+bool
+gpgpu_image_init_from_dma_buf (struct gpgpu_image *image,
+                               struct gpgpu_context *ctx,
+                               const struct gpgpu_dma_buf *dma_buf)
+{
+   assert (image != NULL);
+   assert (ctx != NULL);
+   assert (dma_buf != NULL && dma_buf->fd >= 0);
+
+   memset (image, 0x00, sizeof (struct gpgpu_image));
+   image->ctx = ctx;
+   image->width = dma_buf->width;
+   image->height = dma_buf->height;
+   image->egl_image = EGL_NO_IMAGE_KHR;
+
+   if (dma_buf->fourcc != GBM_FORMAT_ABGR8888) {
+      printf ("Only RGBA8 (ABGR8888) dma-bufs are supported\n");
+      return false;
+   }
+
+   if (! gpgpu_image_zero_copy_supported (ctx)) {
+      printf ("Importing dma-bufs needs GBM, EGL_EXT_image_dma_buf_import "
+              "and GL_EXT_EGL_image_storage\n");
+      return false;
+   }
+
+   /* The buffer object is only there to map the pixels. Without a
+    * modifier the layout is the driver's business: importing it as linear
+    * would map tiled pixels in the wrong places.
+    */
+   if (dma_buf->modifier != GPGPU_DMA_BUF_MOD_INVALID) {
+      struct gbm_import_fd_modifier_data import_data = {
+         .width = dma_buf->width,
+         .height = dma_buf->height,
+         .format = dma_buf->fourcc,
+         .num_fds = 1,
+         .fds = { dma_buf->fd },
+         .strides = { dma_buf->stride },
+         .offsets = { dma_buf->offset },
+         .modifier = dma_buf->modifier,
+      };
+      image->bo = gbm_bo_import (ctx->gbm,
+                                 GBM_BO_IMPORT_FD_MODIFIER,
+                                 &import_data,
+                                 GBM_BO_USE_RENDERING);
+   } else if (dma_buf->offset == 0) {
+      struct gbm_import_fd_data import_data = {
+         .fd = dma_buf->fd,
+         .width = dma_buf->width,
+         .height = dma_buf->height,
+         .stride = dma_buf->stride,
+         .format = dma_buf->fourcc,
+      };
+      image->bo = gbm_bo_import (ctx->gbm,
+                                 GBM_BO_IMPORT_FD,
+                                 &import_data,
+                                 GBM_BO_USE_RENDERING);
+   } else {
+      printf ("dma-bufs at an offset need a modifier\n");
+      return false;
+   }
+   if (image->bo == NULL) {
+      printf ("Failed to import dma-buf as a GBM buffer object\n");
+      return false;
+   }
+
+   if (! import_dma_buf (image, dma_buf)) {
+      gpgpu_image_finish (image);
+      return false;
+   }
+
+   return true;
+}
+
+void
+gpgpu_image_finish (struct gpgpu_image *image)
+{
+   assert (image != NULL);
+
+   if (image->map_data != NULL)
+      gpgpu_image_unmap (image);
+
+   if (image->texture != 0)
+      glDeleteTextures (1, &image->texture);
+   image->texture = 0;
+
+   if (image->egl_image != EGL_NO_IMAGE_KHR)
+      procs.DestroyImage (image->ctx->display, image->egl_image);
+   image->egl_image = EGL_NO_IMAGE_KHR;
+
+   if (image->bo != NULL)
+      gbm_bo_destroy (image->bo);
+   image->bo = NULL;
+}
+
+void *
+gpgpu_image_map (struct gpgpu_image *image,
+                 GLbitfield access,
+                 uint32_t *stride)
+{
+   assert (image != NULL);
+   assert (image->map_data == NULL);
+   assert (stride != NULL);
+
+   if (image->bo == NULL)
+      return NULL;
+
+   /* GL doesn't know about the mapping, so nothing short of waiting for
+    * the kernels makes their stores visible to it, or prevents them from
+    * overwriting what the CPU writes.
+    */
+   glMemoryBarrier (GL_ALL_BARRIER_BITS);
+   glFinish ();
+
+   uint32_t flags = 0;
+   if (access & GL_MAP_READ_BIT)
+      flags |= GBM_BO_TRANSFER_READ;
+   if (access & GL_MAP_WRITE_BIT)
+      flags |= GBM_BO_TRANSFER_WRITE;
+
+   void *pixels = gbm_bo_map (image->bo,
+                              0,
+                              0,
+                              image->width,
+                              image->height,
+                              flags,
+                              stride,
+                              &image->map_data);
+   if (pixels == NULL) {
+      image->map_data = NULL;
+      printf ("Failed to map GBM buffer object\n");
+   }
+
+   return pixels;
+}
+
+void
+gpgpu_image_unmap (struct gpgpu_image *image)
+{
+   assert (image != NULL && image->bo != NULL);
+   assert (image->map_data != NULL);
+
+   gbm_bo_unmap (image->bo, image->map_data);
+   image->map_data = NULL;
+}
+
+bool
+gpgpu_image_upload (struct gpgpu_image *image,
+                    const void *pixels,
+                    uint32_t stride)
+{
+   assert (image != NULL);
+   assert (pixels != NULL);
+   assert (stride % BYTES_PER_PIXEL == 0);
+
+   size_t row_size = image->width * BYTES_PER_PIXEL;
+
+   if (image->bo != NULL) {
+      uint32_t dst_stride;
+      uint8_t *dst = gpgpu_image_map (image, GL_MAP_WRITE_BIT, &dst_stride);
+      if (dst == NULL)
+         return false;
+
+      for (uint32_t y = 0; y < image->height; y++) {
+         memcpy (dst + (size_t) y * dst_stride,
+                 (const uint8_t *) pixels + (size_t) y * stride,
+                 row_size);
+      }
+
+      gpgpu_image_unmap (image);
+      return true;
+   }
+
+   /* kernels still reading the texture must see the old contents */
+   glMemoryBarrier (GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+   glPixelStorei (GL_UNPACK_ALIGNMENT, 1);
+   glPixelStorei (GL_UNPACK_ROW_LENGTH, stride / BYTES_PER_PIXEL);
+   glBindTexture (GL_TEXTURE_2D, image->texture);
+   glTexSubImage2D (GL_TEXTURE_2D,
+                    0,
+                    0, 0,
+                    image->width, image->height,
+                    GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    pixels);
+   glBindTexture (GL_TEXTURE_2D, 0);
+   glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+   glPixelStorei (GL_UNPACK_ALIGNMENT, 4);
+   GL_CHECK ();
+
+   return true;
+}
+
+bool
+gpgpu_image_download (struct gpgpu_image *image,
+                      void *pixels,
+                      uint32_t stride)
+{
+   assert (image != NULL);
+   assert (pixels != NULL);
+   assert (stride % BYTES_PER_PIXEL == 0);
+
+   size_t row_size = image->width * BYTES_PER_PIXEL;
+
+   if (image->bo != NULL) {
+      uint32_t src_stride;
+      const uint8_t *src = gpgpu_image_map (image,
+                                            GL_MAP_READ_BIT,
+                                            &src_stride);
+      if (src == NULL)
+         return false;
+
+      for (uint32_t y = 0; y < image->height; y++) {
+         memcpy ((uint8_t *) pixels + (size_t) y * stride,
+                 src + (size_t) y * src_stride,
+                 row_size);
+      }
+
+      gpgpu_image_unmap (image);
+      return true;
+   }
+
+   /* GLES can't read textures back but through a framebuffer */
+   glMemoryBarrier (GL_FRAMEBUFFER_BARRIER_BIT);
+
+   GLuint fbo;
+   glGenFramebuffers (1, &fbo);
+   glBindFramebuffer (GL_READ_FRAMEBUFFER, fbo);
+   glFramebufferTexture2D (GL_READ_FRAMEBUFFER,
+                           GL_COLOR_ATTACHMENT0,
+                           GL_TEXTURE_2D,
+                           image->texture,
+                           0);
+
+   bool ok = glCheckFramebufferStatus (GL_READ_FRAMEBUFFER)
+      == GL_FRAMEBUFFER_COMPLETE;
+   if (ok) {
+      glPixelStorei (GL_PACK_ALIGNMENT, 1);
+      glPixelStorei (GL_PACK_ROW_LENGTH, stride / BYTES_PER_PIXEL);
+      glReadPixels (0, 0,
+                    image->width, image->height,
+                    GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    pixels);
+      glPixelStorei (GL_PACK_ROW_LENGTH, 0);
+      glPixelStorei (GL_PACK_ALIGNMENT, 4);
+   }
+
+   glBindFramebuffer (GL_READ_FRAMEBUFFER, 0);
+   glDeleteFramebuffers (1, &fbo);
+   GL_CHECK ();
+
+   return ok;
+}
+
+bool
+gpgpu_image_export_dma_buf (struct gpgpu_image *image,
+                            struct gpgpu_dma_buf *dma_buf)
+{
+   assert (image != NULL);
+   assert (dma_buf != NULL);
+
+   if (image->bo == NULL)
+      return false;
+
+   dma_buf->fd = gbm_bo_get_fd (image->bo);
+   if (dma_buf->fd < 0) {
+      printf ("Failed to export GBM buffer object as a dma-buf\n");
+      return false;
+   }
+
+   dma_buf->width = image->width;
+   dma_buf->height = image->height;
+   dma_buf->fourcc = GBM_FORMAT_ABGR8888;
+   dma_buf->stride = gbm_bo_get_stride (image->bo);
+   dma_buf->offset = gbm_bo_get_offset (image->bo, 0);
+   dma_buf->modifier = gbm_bo_get_modifier (image->bo);
+
+   return true;
+}
+
+void
+gpgpu_kernel_bind_image (struct gpgpu_kernel *kernel,
+                         uint32_t unit,
+                         struct gpgpu_image *image,
+                         GLenum access)
+{
+   assert (kernel != NULL);
+   assert (image != NULL && image->texture != 0);
+   assert (access == GL_READ_ONLY
+           || access == GL_WRITE_ONLY
+           || access == GL_READ_WRITE);
+
+   /* like buffers, image units are context state */
+   glBindImageTexture (unit,
+                       image->texture,
+                       0,
+                       GL_FALSE,
+                       0,
+                       access,
+                       GL_RGBA8);
+   GL_CHECK ();
+}
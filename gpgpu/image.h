@@ -0,0 +1,124 @@
+/*
+ * GPGPU: images in GBM buffer objects, shared through dma-buf
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gpgpu.h"
+
+/* RGBA8 images that kernels access as 'layout (rgba8) uniform image2D'.
+ *
+ * On a render node, the pixels live in a GBM buffer object: the CPU writes
+ * them in place through gbm_bo_map() (e.g. a decoder writing its output
+ * rows), GL samples and stores to the very same memory through an
+ * EGLImage, and the buffer can be exported as a dma-buf fd for the next
+ * stage to import, in this process or another one (the fd can be passed
+ * over a Unix socket with SCM_RIGHTS). No pixel is ever copied.
+ *
+ * Without GBM or the EGL and GL extensions for it, images fall back to
+ * plain textures, written and read with copies, and can't be exported.
+ */
+
+struct gbm_bo;
+
+/* A dma-buf holding a single-plane image, as the EGL_EXT_image_dma_buf_import
+ * attributes describe it.
+ */
+struct gpgpu_dma_buf {
+   int32_t fd;
+   uint32_t width;
+   uint32_t height;
+
+   /* DRM fourcc, GBM_FORMAT_ABGR8888 for RGBA8 */
+   uint32_t fourcc;
+   uint32_t stride;
+   uint32_t offset;
+
+   /* DRM format modifier (tiling), GPGPU_DMA_BUF_MOD_INVALID if unknown */
+   uint64_t modifier;
+};
+
+/* DRM_FORMAT_MOD_INVALID, without requiring libdrm's headers */
+#define GPGPU_DMA_BUF_MOD_INVALID ((1ULL << 56) - 1)
+
+struct gpgpu_image {
+   struct gpgpu_context *ctx;
+   uint32_t width;
+   uint32_t height;
+   GLuint texture;
+
+   /* NULL for images that fell back to plain textures */
+   struct gbm_bo *bo;
+   EGLImageKHR egl_image;
+
+   /* of the current gpgpu_image_map(), if any */
+   void *map_data;
+};
+
+/* Whether images of 'ctx' live in GBM buffer objects, rather than in
+ * textures copied from and to.
+ */
+bool     gpgpu_image_zero_copy_supported (struct gpgpu_context *ctx);
+
+bool     gpgpu_image_init                (struct gpgpu_image *image,
+                                          struct gpgpu_context *ctx,
+                                          uint32_t width,
+                                          uint32_t height);
+
+/* Wraps the pixels of 'dma_buf', e.g. exported by an earlier stage or
+ * another process, without copying them. The caller keeps ownership of
+ * 'dma_buf->fd', which may be closed right after.
+ */
+bool     gpgpu_image_init_from_dma_buf   (struct gpgpu_image *image,
+                                          struct gpgpu_context *ctx,
+                                          const struct gpgpu_dma_buf *dma_buf);
+
+void     gpgpu_image_finish              (struct gpgpu_image *image);
+
+/* Maps the pixels of a GBM-backed image for the CPU, and returns them with
+ * their row 'stride' in bytes; NULL for textures. Mapping for reading waits
+ * for the kernels dispatched so far.
+ */
+void    *gpgpu_image_map                 (struct gpgpu_image *image,
+                                          GLbitfield access,
+                                          uint32_t *stride);
+
+void     gpgpu_image_unmap               (struct gpgpu_image *image);
+
+/* Copies RGBA8 pixels with rows 'stride' bytes apart to and from the image,
+ * for images of either kind.
+ */
+bool     gpgpu_image_upload              (struct gpgpu_image *image,
+                                          const void *pixels,
+                                          uint32_t stride);
+
+bool     gpgpu_image_download            (struct gpgpu_image *image,
+                                          void *pixels,
+                                          uint32_t stride);
+
+/* Returns a new dma-buf fd for the image in 'dma_buf', to be closed by the
+ * caller. Consumers must not read it before the kernels writing it have
+ * completed (see gpgpu_fence), as not every driver syncs dma-bufs
+ * implicitly. False for images that aren't GBM-backed.
+ */
+bool     gpgpu_image_export_dma_buf      (struct gpgpu_image *image,
+                                          struct gpgpu_dma_buf *dma_buf);
+
+/* Binds 'image' to image unit 'unit' ('layout (binding = N)'), with
+ * 'access' GL_READ_ONLY, GL_WRITE_ONLY or GL_READ_WRITE.
+ */
+void     gpgpu_kernel_bind_image         (struct gpgpu_kernel *kernel,
+                                          uint32_t unit,
+                                          struct gpgpu_image *image,
+                                          GLenum access);
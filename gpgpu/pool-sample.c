@@ -0,0 +1,281 @@
+/*
+ * Example:
+ *
+ * GPGPU pool: jobs that each fill a buffer on the CPU and run many small
+ *             dispatches on it, run on the main thread's context alone,
+ *             then by pools of 1, 2, 4... worker threads with shared
+ *             contexts, to show how throughput scales with the number of
+ *             threads building and submitting commands.
+ *
+ * Usage: gpgpu-pool [-t max workers] [-j jobs] [-d dispatches] [-n elements]
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpgpu.h"
+#include "pool.h"
+
+static const char *ADD_SRC =
+   "#version 310 es\n"
+   "layout (local_size_x = 64) in;\n"
+   "layout (std430, binding = 0) buffer Data { uint data[]; };\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "uniform uint value;\n"
+   "void main (void) {\n"
+   "   uint i = gl_GlobalInvocationID.x;\n"
+   "   if (i >= gpgpu_global_size.x)\n"
+   "      return;\n"
+   "   data[i] += value;\n"
+   "}\n";
+
+/* the main thread's kernel comes after those of the workers */
+#define MAIN_THREAD GPGPU_POOL_MAX_WORKERS
+
+struct sample {
+   struct gpgpu_kernel kernels[GPGPU_POOL_MAX_WORKERS + 1];
+   uint32_t n;
+   uint32_t dispatches;
+};
+
+struct sample_job {
+   struct gpgpu_pool_job job;
+   struct sample *sample;
+   struct gpgpu_buffer buffer;
+   uint32_t *input;
+   uint32_t index;
+};
+
+static bool
+run_job (struct gpgpu_context *ctx, uint32_t worker, void *data)
+{
+   struct sample_job *job = data;
+   struct sample *sample = job->sample;
+   struct gpgpu_kernel *kernel = &sample->kernels[worker];
+
+   /* kernels are per worker, as uniforms are program state */
+   if (kernel->program == 0 && ! gpgpu_kernel_init (kernel, ctx, ADD_SRC))
+      return false;
+
+   for (uint32_t i = 0; i < sample->n; i++)
+      job->input[i] = (i * 2654435761u) ^ job->index;
+   if (! gpgpu_buffer_upload (&job->buffer,
+                              job->input,
+                              0,
+                              sample->n * sizeof (uint32_t))) {
+      return false;
+   }
+
+   gpgpu_kernel_bind_buffer (kernel, 0, &job->buffer);
+   for (uint32_t d = 1; d <= sample->dispatches; d++) {
+      gpgpu_kernel_set_uint (kernel, "value", d);
+      if (! gpgpu_kernel_dispatch (kernel, sample->n, 1, 1))
+         return false;
+   }
+
+   return true;
+}
+
+static bool
+check_job (struct sample_job *job, uint32_t *output)
+{
+   struct sample *sample = job->sample;
+   uint32_t added = sample->dispatches * (sample->dispatches + 1) / 2;
+
+   if (! gpgpu_buffer_download (&job->buffer,
+                                output,
+                                0,
+                                sample->n * sizeof (uint32_t))) {
+      return false;
+   }
+
+   for (uint32_t i = 0; i < sample->n; i++) {
+      uint32_t expected = ((i * 2654435761u) ^ job->index) + added;
+      if (output[i] != expected) {
+         printf ("job %u, element %u: %u, expected %u\n",
+                 job->index, i, output[i], expected);
+         return false;
+      }
+   }
+
+   return true;
+}
+
+/* Runs all the jobs by 'num_workers' workers, or on the main thread if 0,
+ * and returns how long it took, or a negative value if a job failed.
+ */
+static double
+run_jobs (struct gpgpu_context *ctx,
+          struct sample *sample,
+          struct sample_job *jobs,
+          uint32_t num_jobs,
+          uint32_t num_workers,
+          uint32_t *output)
+{
+   struct gpgpu_pool pool;
+   if (num_workers > 0 && ! gpgpu_pool_init (&pool, ctx, num_workers))
+      return -1.0;
+
+   bool ok = true;
+   double start = gpgpu_now_ms ();
+
+   if (num_workers == 0) {
+      for (uint32_t i = 0; i < num_jobs; i++)
+         ok = run_job (ctx, MAIN_THREAD, &jobs[i]) && ok;
+      gpgpu_context_wait_idle (ctx);
+   } else {
+      for (uint32_t i = 0; i < num_jobs; i++)
+         gpgpu_pool_submit (&pool, &jobs[i].job);
+      for (uint32_t i = 0; i < num_jobs; i++)
+         ok = gpgpu_pool_wait (&pool, &jobs[i].job) && ok;
+   }
+
+   double ms = gpgpu_now_ms () - start;
+
+   for (uint32_t i = 0; i < num_jobs && ok; i++)
+      ok = check_job (&jobs[i], output);
+
+   if (num_workers > 0) {
+      gpgpu_pool_print_stats (&pool);
+      gpgpu_pool_finish (&pool);
+
+      /* the programs outlive the workers' contexts, in the share group */
+      for (uint32_t i = 0; i < num_workers; i++)
+         gpgpu_kernel_finish (&sample->kernels[i]);
+   }
+
+   return ok ? ms : -1.0;
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   uint32_t max_workers = 4;
+   uint32_t num_jobs = 64;
+   struct sample sample = {
+      .n = 16384,
+      .dispatches = 64,
+   };
+
+   for (int32_t i = 1; i < argc; i++) {
+      if (strcmp (argv[i], "-t") == 0 && i + 1 < argc) {
+         max_workers = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-j") == 0 && i + 1 < argc) {
+         num_jobs = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-d") == 0 && i + 1 < argc) {
+         sample.dispatches = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-n") == 0 && i + 1 < argc) {
+         sample.n = strtoul (argv[++i], NULL, 10);
+      } else {
+         printf ("Usage: %s [-t max workers] [-j jobs] [-d dispatches] "
+                 "[-n elements]\n",
+                 argv[0]);
+         return -1;
+      }
+   }
+
+   if (max_workers == 0 || max_workers > GPGPU_POOL_MAX_WORKERS
+       || num_jobs == 0 || sample.dispatches == 0 || sample.n == 0) {
+      printf ("Invalid arguments\n");
+      return -1;
+   }
+
+   struct gpgpu_context ctx;
+   if (! gpgpu_context_init (&ctx, NULL))
+      return -1;
+
+   gpgpu_context_print_info (&ctx);
+   printf ("\n");
+
+   struct sample_job *jobs = calloc (num_jobs, sizeof (struct sample_job));
+   uint32_t *output = malloc (sample.n * sizeof (uint32_t));
+   assert (jobs != NULL && output != NULL);
+
+   for (uint32_t i = 0; i < num_jobs; i++) {
+      jobs[i].job.run = run_job;
+      jobs[i].job.data = &jobs[i];
+      jobs[i].sample = &sample;
+      jobs[i].index = i;
+      jobs[i].input = malloc (sample.n * sizeof (uint32_t));
+      assert (jobs[i].input != NULL);
+      if (! gpgpu_buffer_init (&jobs[i].buffer,
+                               sample.n * sizeof (uint32_t),
+                               GL_DYNAMIC_COPY)) {
+         return -1;
+      }
+   }
+
+   /* the workers' contexts must see the buffers' storage */
+   gpgpu_context_wait_idle (&ctx);
+
+   double ms[GPGPU_POOL_MAX_WORKERS + 1];
+   uint32_t counts[GPGPU_POOL_MAX_WORKERS + 1];
+   uint32_t num_counts = 0;
+   bool ok = true;
+
+   counts[num_counts++] = 0;
+   for (uint32_t t = 1; t <= max_workers; t *= 2)
+      counts[num_counts++] = t;
+   if (counts[num_counts - 1] != max_workers)
+      counts[num_counts++] = max_workers;
+
+   for (uint32_t i = 0; i < num_counts; i++) {
+      if (counts[i] == 0)
+         printf ("Main thread:\n");
+      else
+         printf ("%u worker(s):\n", counts[i]);
+
+      ms[i] = run_jobs (&ctx,
+                        &sample,
+                        jobs,
+                        num_jobs,
+                        counts[i],
+                        output);
+      ok = ms[i] >= 0 && ok;
+   }
+
+   printf ("\n%u jobs of %u dispatches on %u elements:\n",
+           num_jobs, sample.dispatches, sample.n);
+   printf ("%-12s %10s %10s %9s\n", "threads", "ms", "jobs/s", "speedup");
+   for (uint32_t i = 0; i < num_counts; i++) {
+      char name[32];
+      if (counts[i] == 0)
+         snprintf (name, sizeof (name), "main");
+      else
+         snprintf (name, sizeof (name), "%u worker(s)", counts[i]);
+
+      if (ms[i] < 0) {
+         printf ("%-12s FAILED\n", name);
+         continue;
+      }
+      printf ("%-12s %10.1f %10.1f %8.2fx\n",
+              name,
+              ms[i],
+              num_jobs * 1000.0 / ms[i],
+              ms[0] / ms[i]);
+   }
+   printf ("\nResults: %s\n", ok ? "OK" : "FAILED");
+
+   gpgpu_kernel_finish (&sample.kernels[MAIN_THREAD]);
+   for (uint32_t i = 0; i < num_jobs; i++) {
+      gpgpu_buffer_finish (&jobs[i].buffer);
+      free (jobs[i].input);
+   }
+   free (jobs);
+   free (output);
+   gpgpu_context_finish (&ctx);
+
+   return ok ? 0 : -1;
+}
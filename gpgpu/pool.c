@@ -0,0 +1,214 @@
+/*
+ * GPGPU: worker threads with shared contexts
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include "pool.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Returns the oldest queued job, or NULL once the pool quits and no job is
+ * left.
+ */
+static struct gpgpu_pool_job *
+take_job (struct gpgpu_pool *pool)
+{
+   pthread_mutex_lock (&pool->mutex);
+
+   while (pool->first == NULL && ! pool->quit)
+      pthread_cond_wait (&pool->job_queued, &pool->mutex);
+
+   struct gpgpu_pool_job *job = pool->first;
+   if (job != NULL) {
+      pool->first = job->next;
+      if (pool->first == NULL)
+         pool->last = NULL;
+   }
+
+   pthread_mutex_unlock (&pool->mutex);
+
+   return job;
+}
+
+static void *
+worker_main (void *data)
+{
+   struct gpgpu_pool_worker *worker = data;
+   struct gpgpu_pool *pool = worker->pool;
+
+   bool current = gpgpu_context_make_current (&worker->ctx);
+   if (! current)
+      printf ("Worker %u failed to make its context current\n", worker->index);
+
+   struct gpgpu_pool_job *job;
+   while ((job = take_job (pool)) != NULL) {
+      double start = gpgpu_now_ms ();
+
+      bool ok = current && job->run (&worker->ctx, worker->index, job->data);
+
+      /* flushed, so that other contexts can wait on it */
+      if (! current || ! gpgpu_fence_init (&job->fence)) {
+         if (current)
+            glFinish ();
+         job->fence.sync = NULL;
+      }
+
+      worker->busy_ms += gpgpu_now_ms () - start;
+      worker->jobs++;
+
+      pthread_mutex_lock (&pool->mutex);
+      job->ok = ok;
+      job->submitted = true;
+      pthread_cond_broadcast (&pool->job_submitted);
+      pthread_mutex_unlock (&pool->mutex);
+   }
+
+   if (current) {
+      eglMakeCurrent (worker->ctx.display,
+                      EGL_NO_SURFACE,
+                      EGL_NO_SURFACE,
+                      EGL_NO_CONTEXT);
+      gl_debug_make_current (NULL);
+   }
+
+   return NULL;
+}
+
+/* Stops and joins the first 'num_threads' workers, and finishes the
+ * contexts of all of them.
+ */
+static void
+stop_workers (struct gpgpu_pool *pool, uint32_t num_threads)
+{
+   pthread_mutex_lock (&pool->mutex);
+   pool->quit = true;
+   pthread_cond_broadcast (&pool->job_queued);
+   pthread_mutex_unlock (&pool->mutex);
+
+   for (uint32_t i = 0; i < num_threads; i++)
+      pthread_join (pool->workers[i].thread, NULL);
+
+   for (uint32_t i = 0; i < pool->num_workers; i++)
+      gpgpu_context_finish (&pool->workers[i].ctx);
+}
+
+/* public API */
+
+bool
+gpgpu_pool_init (struct gpgpu_pool *pool,
+                 struct gpgpu_context *primary,
+                 uint32_t num_workers)
+{
+   assert (pool != NULL);
+   assert (primary != NULL);
+   assert (num_workers > 0 && num_workers <= GPGPU_POOL_MAX_WORKERS);
+
+   memset (pool, 0x00, sizeof (struct gpgpu_pool));
+   pool->primary = primary;
+
+   pthread_mutex_init (&pool->mutex, NULL);
+   pthread_cond_init (&pool->job_queued, NULL);
+   pthread_cond_init (&pool->job_submitted, NULL);
+
+   for (uint32_t i = 0; i < num_workers; i++) {
+      struct gpgpu_pool_worker *worker = &pool->workers[i];
+
+      worker->pool = pool;
+      worker->index = i;
+      if (! gpgpu_context_init_shared (&worker->ctx, primary)) {
+         printf ("Failed to create the context of worker %u\n", i);
+         stop_workers (pool, 0);
+         return false;
+      }
+      pool->num_workers++;
+   }
+
+   for (uint32_t i = 0; i < num_workers; i++) {
+      struct gpgpu_pool_worker *worker = &pool->workers[i];
+
+      if (pthread_create (&worker->thread, NULL, worker_main, worker) != 0) {
+         printf ("Failed to start worker %u\n", i);
+         stop_workers (pool, i);
+         return false;
+      }
+   }
+
+   return true;
+}
+
+void
+gpgpu_pool_finish (struct gpgpu_pool *pool)
+{
+   assert (pool != NULL);
+
+   stop_workers (pool, pool->num_workers);
+
+   pthread_cond_destroy (&pool->job_submitted);
+   pthread_cond_destroy (&pool->job_queued);
+   pthread_mutex_destroy (&pool->mutex);
+}
+
+void
+gpgpu_pool_submit (struct gpgpu_pool *pool, struct gpgpu_pool_job *job)
+{
+   assert (pool != NULL);
+   assert (job != NULL && job->run != NULL);
+
+   job->next = NULL;
+   job->fence.sync = NULL;
+   job->submitted = false;
+   job->ok = false;
+
+   pthread_mutex_lock (&pool->mutex);
+   if (pool->last != NULL)
+      pool->last->next = job;
+   else
+      pool->first = job;
+   pool->last = job;
+   pthread_cond_signal (&pool->job_queued);
+   pthread_mutex_unlock (&pool->mutex);
+}
+
+bool
+gpgpu_pool_wait (struct gpgpu_pool *pool, struct gpgpu_pool_job *job)
+{
+   assert (pool != NULL);
+   assert (job != NULL);
+
+   pthread_mutex_lock (&pool->mutex);
+   while (! job->submitted)
+      pthread_cond_wait (&pool->job_submitted, &pool->mutex);
+   pthread_mutex_unlock (&pool->mutex);
+
+   /* no fence means the worker waited for the job with glFinish() */
+   bool ok = job->ok;
+   if (job->fence.sync != NULL) {
+      ok = gpgpu_fence_wait (&job->fence, GL_TIMEOUT_IGNORED) && ok;
+      gpgpu_fence_finish (&job->fence);
+   }
+
+   return ok;
+}
+
+void
+gpgpu_pool_print_stats (struct gpgpu_pool *pool)
+{
+   assert (pool != NULL);
+
+   for (uint32_t i = 0; i < pool->num_workers; i++) {
+      printf ("Worker %u: %llu jobs, %.1f ms building and submitting\n",
+              i,
+              (unsigned long long) pool->workers[i].jobs,
+              pool->workers[i].busy_ms);
+   }
+}
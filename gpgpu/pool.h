@@ -0,0 +1,102 @@
+/*
+ * GPGPU: worker threads with shared contexts
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gpgpu.h"
+
+/* A pool of worker threads, each with its own context in the share group
+ * of a primary context (gpgpu_context_init_shared()), current on it for
+ * the life of the pool. Jobs submitted from any thread are run by the
+ * first idle worker, so that several threads build and submit GL commands
+ * at the same time, instead of serializing all of them onto the thread of
+ * a single context.
+ *
+ * Buffers and programs are objects of the whole share group, but the
+ * state of a context is not: a job binds what it uses, and kernels are
+ * best kept per worker, as uniforms are program state. Once a job ran, its
+ * worker inserts a fence and flushes it; threads of the other contexts of
+ * the group wait on that fence (gpgpu_pool_wait()) before reading what the
+ * job wrote. The other way around, what a context wrote must have completed
+ * (e.g. gpgpu_context_wait_idle()) before jobs read it.
+ */
+
+#define GPGPU_POOL_MAX_WORKERS 32
+
+struct gpgpu_pool;
+
+struct gpgpu_pool_job {
+   /* Builds and submits the GL commands of the job, on the context of
+    * worker 'worker', current. Returns false on failure.
+    */
+   bool (*run) (struct gpgpu_context *ctx, uint32_t worker, void *data);
+
+   void *data;
+
+   /* set by the pool */
+   struct gpgpu_pool_job *next;
+   struct gpgpu_fence fence;
+   bool submitted;
+   bool ok;
+};
+
+struct gpgpu_pool_worker {
+   struct gpgpu_pool *pool;
+   uint32_t index;
+   struct gpgpu_context ctx;
+   pthread_t thread;
+
+   /* statistics */
+   uint64_t jobs;
+   double busy_ms;
+};
+
+struct gpgpu_pool {
+   struct gpgpu_context *primary;
+   struct gpgpu_pool_worker workers[GPGPU_POOL_MAX_WORKERS];
+   uint32_t num_workers;
+
+   /* jobs not taken by a worker yet, oldest first */
+   pthread_mutex_t mutex;
+   pthread_cond_t job_queued;
+   pthread_cond_t job_submitted;
+   struct gpgpu_pool_job *first;
+   struct gpgpu_pool_job *last;
+   bool quit;
+};
+
+/* Must be called with 'primary' current, which it stays. */
+bool     gpgpu_pool_init        (struct gpgpu_pool *pool,
+                                 struct gpgpu_context *primary,
+                                 uint32_t num_workers);
+
+/* Runs the jobs still queued, then stops the workers and finishes their
+ * contexts. Must be called from the thread of 'primary'.
+ */
+void     gpgpu_pool_finish      (struct gpgpu_pool *pool);
+
+/* Queues 'job', which must stay valid until gpgpu_pool_wait() returned. */
+void     gpgpu_pool_submit      (struct gpgpu_pool *pool,
+                                 struct gpgpu_pool_job *job);
+
+/* Waits for a worker to have submitted 'job', then for the GPU to have
+ * completed it, from the context current on the calling thread, which
+ * must be one of the share group. Returns false if the job failed.
+ */
+bool     gpgpu_pool_wait        (struct gpgpu_pool *pool,
+                                 struct gpgpu_pool_job *job);
+
+void     gpgpu_pool_print_stats (struct gpgpu_pool *pool);
@@ -0,0 +1,400 @@
+/*
+ * Example:
+ *
+ * GPGPU primitives benchmark: checks scan, reduce and radix sort against
+ *                             CPU references, and measures their element
+ *                             throughput across input sizes.
+ *
+ * Usage: gpgpu-primitives [-d /dev/dri/renderDN] [-n max elements]
+ *                         [-i iterations]
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpgpu.h"
+#include "primitives.h"
+
+#define MIN_ELEMENTS 1024
+
+/* xorshift32, a fixed seed makes failures reproducible */
+static uint32_t
+random_u32 (uint32_t *state)
+{
+   uint32_t x = *state;
+
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   *state = x;
+
+   return x;
+}
+
+/* CPU references */
+
+static bool
+check_scan (const uint32_t *in, const uint32_t *out, uint32_t n)
+{
+   uint32_t sum = 0;
+
+   for (uint32_t i = 0; i < n; i++) {
+      if (out[i] != sum) {
+         printf ("scan: out[%u] = %u, expected %u\n", i, out[i], sum);
+         return false;
+      }
+      sum += in[i];
+   }
+
+   return true;
+}
+
+static uint32_t
+reference_reduce (enum gpgpu_reduce_op op, const uint32_t *in, uint32_t n)
+{
+   uint32_t result = op == GPGPU_REDUCE_MIN ? UINT32_MAX : 0;
+
+   for (uint32_t i = 0; i < n; i++) {
+      switch (op) {
+      case GPGPU_REDUCE_SUM:
+         result += in[i];
+         break;
+      case GPGPU_REDUCE_MIN:
+         result = in[i] < result ? in[i] : result;
+         break;
+      default:
+         result = in[i] > result ? in[i] : result;
+         break;
+      }
+   }
+
+   return result;
+}
+
+struct pair {
+   uint32_t key;
+   uint32_t value;
+};
+
+/* values are the original indices, so this orders like a stable sort */
+static int
+compare_pairs (const void *a, const void *b)
+{
+   const struct pair *pa = a;
+   const struct pair *pb = b;
+
+   if (pa->key != pb->key)
+      return (pa->key > pb->key) - (pa->key < pb->key);
+
+   return (pa->value > pb->value) - (pa->value < pb->value);
+}
+
+static bool
+check_sort (const uint32_t *in,
+            const uint32_t *keys,
+            const uint32_t *values,
+            uint32_t n)
+{
+   struct pair *expected = malloc (n * sizeof (struct pair));
+   assert (expected != NULL);
+
+   for (uint32_t i = 0; i < n; i++) {
+      expected[i].key = in[i];
+      expected[i].value = i;
+   }
+   qsort (expected, n, sizeof (struct pair), compare_pairs);
+
+   bool ok = true;
+   for (uint32_t i = 0; i < n && ok; i++) {
+      if (keys[i] != expected[i].key
+          || (values != NULL && values[i] != expected[i].value)) {
+         printf ("sort: element %u = (%u, %u), expected (%u, %u)\n",
+                 i,
+                 keys[i],
+                 values != NULL ? values[i] : 0,
+                 expected[i].key,
+                 expected[i].value);
+         ok = false;
+      }
+   }
+
+   free (expected);
+
+   return ok;
+}
+
+/* benchmarks, each returns milliseconds per run, or a negative value if the
+ * result is wrong
+ */
+
+static double
+bench_scan (struct gpgpu_primitives *prims,
+            const uint32_t *data,
+            uint32_t n,
+            uint32_t iterations)
+{
+   size_t size = n * sizeof (uint32_t);
+   struct gpgpu_buffer in;
+   struct gpgpu_buffer out;
+
+   if (! gpgpu_buffer_init (&in, size, GL_STATIC_DRAW)
+       || ! gpgpu_buffer_init (&out, size, GL_DYNAMIC_COPY)) {
+      return -1;
+   }
+
+   gpgpu_buffer_upload (&in, data, 0, size);
+
+   /* warm up, and check */
+   uint32_t *result = malloc (size);
+   assert (result != NULL);
+   bool ok = gpgpu_scan (prims, &in, &out, n)
+      && gpgpu_buffer_download (&out, result, 0, size)
+      && check_scan (data, result, n);
+   free (result);
+
+   double start = gpgpu_now_ms ();
+   for (uint32_t i = 0; ok && i < iterations; i++)
+      ok = gpgpu_scan (prims, &in, &out, n);
+   gpgpu_context_wait_idle (prims->ctx);
+   double elapsed = (gpgpu_now_ms () - start) / iterations;
+
+   gpgpu_buffer_finish (&out);
+   gpgpu_buffer_finish (&in);
+
+   return ok ? elapsed : -1;
+}
+
+static double
+bench_reduce (struct gpgpu_primitives *prims,
+              enum gpgpu_reduce_op op,
+              const uint32_t *data,
+              uint32_t n,
+              uint32_t iterations)
+{
+   size_t size = n * sizeof (uint32_t);
+   struct gpgpu_buffer in;
+
+   if (! gpgpu_buffer_init (&in, size, GL_STATIC_DRAW))
+      return -1;
+
+   gpgpu_buffer_upload (&in, data, 0, size);
+
+   uint32_t expected = reference_reduce (op, data, n);
+   bool ok = true;
+
+   /* includes reading the result back, which is what callers wait for */
+   double start = gpgpu_now_ms ();
+   for (uint32_t i = 0; ok && i < iterations; i++) {
+      uint32_t result = 0;
+      ok = gpgpu_reduce (prims, op, &in, n, &result);
+      if (ok && result != expected) {
+         printf ("reduce: %u, expected %u\n", result, expected);
+         ok = false;
+      }
+   }
+   double elapsed = (gpgpu_now_ms () - start) / iterations;
+
+   gpgpu_buffer_finish (&in);
+
+   return ok ? elapsed : -1;
+}
+
+static double
+bench_sort (struct gpgpu_primitives *prims,
+            const uint32_t *data,
+            uint32_t n,
+            uint32_t iterations,
+            bool with_values)
+{
+   size_t size = n * sizeof (uint32_t);
+   struct gpgpu_buffer keys;
+   struct gpgpu_buffer values;
+
+   if (! gpgpu_buffer_init (&keys, size, GL_DYNAMIC_COPY)
+       || ! gpgpu_buffer_init (&values, size, GL_DYNAMIC_COPY)) {
+      return -1;
+   }
+
+   uint32_t *indices = malloc (size);
+   uint32_t *result_keys = malloc (size);
+   uint32_t *result_values = malloc (size);
+   assert (indices != NULL && result_keys != NULL && result_values != NULL);
+   for (uint32_t i = 0; i < n; i++)
+      indices[i] = i;
+
+   bool ok = true;
+   double elapsed = 0;
+
+   /* the sort is in place, so the input goes up again on each run */
+   for (uint32_t i = 0; ok && i < iterations + 1; i++) {
+      gpgpu_buffer_upload (&keys, data, 0, size);
+      if (with_values)
+         gpgpu_buffer_upload (&values, indices, 0, size);
+      gpgpu_context_wait_idle (prims->ctx);
+
+      double start = gpgpu_now_ms ();
+      ok = gpgpu_sort (prims, &keys, with_values ? &values : NULL, n);
+      gpgpu_context_wait_idle (prims->ctx);
+
+      /* the first run warms up, and is checked */
+      if (i > 0) {
+         elapsed += gpgpu_now_ms () - start;
+         continue;
+      }
+
+      ok = ok
+         && gpgpu_buffer_download (&keys, result_keys, 0, size)
+         && (! with_values
+             || gpgpu_buffer_download (&values, result_values, 0, size))
+         && check_sort (data,
+                        result_keys,
+                        with_values ? result_values : NULL,
+                        n);
+   }
+
+   free (result_values);
+   free (result_keys);
+   free (indices);
+   gpgpu_buffer_finish (&values);
+   gpgpu_buffer_finish (&keys);
+
+   return ok ? elapsed / iterations : -1;
+}
+
+static void
+print_throughput (double ms, uint32_t n, bool *ok)
+{
+   if (ms < 0) {
+      printf ("    FAILED");
+      *ok = false;
+   } else {
+      printf (" %9.1f", n / (ms * 1000.0));
+   }
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   const char *device = NULL;
+   uint32_t max_n = 1 << 22;
+   uint32_t iterations = 5;
+
+   for (int32_t i = 1; i < argc; i++) {
+      if (strcmp (argv[i], "-d") == 0 && i + 1 < argc) {
+         device = argv[++i];
+      } else if (strcmp (argv[i], "-n") == 0 && i + 1 < argc) {
+         max_n = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-i") == 0 && i + 1 < argc) {
+         iterations = strtoul (argv[++i], NULL, 10);
+      } else {
+         printf ("Usage: %s [-d /dev/dri/renderDN] [-n max elements] "
+                 "[-i iterations]\n",
+                 argv[0]);
+         return -1;
+      }
+   }
+
+   if (max_n < MIN_ELEMENTS)
+      max_n = MIN_ELEMENTS;
+   if (iterations == 0)
+      iterations = 1;
+
+   struct gpgpu_context ctx;
+   if (! gpgpu_context_init (&ctx, device))
+      return -1;
+
+   gpgpu_context_print_info (&ctx);
+
+   struct gpgpu_primitives prims;
+   if (! gpgpu_primitives_init (&prims, &ctx)) {
+      gpgpu_context_finish (&ctx);
+      return -1;
+   }
+
+   printf ("Work group size: %u\n\n", prims.work_group_size);
+
+   uint32_t *data = malloc (max_n * sizeof (uint32_t));
+   assert (data != NULL);
+
+   bool ok = true;
+
+   printf ("Million elements per second\n");
+   printf ("%10s %9s %9s %9s %9s %9s %9s\n",
+           "elements", "scan", "sum", "min", "max", "sort", "sort kv");
+
+   /* sizes are off powers of two, so that the last blocks are partial */
+   for (uint32_t n = MIN_ELEMENTS; n <= max_n; n *= 4) {
+      uint32_t size = n - n / 7;
+      uint32_t seed = 0x12345678 ^ size;
+
+      /* scan and sum of small values, so that sums stay in range */
+      for (uint32_t i = 0; i < size; i++)
+         data[i] = random_u32 (&seed) & 0xff;
+
+      printf ("%10u", size);
+      print_throughput (bench_scan (&prims, data, size, iterations),
+                        size,
+                        &ok);
+      print_throughput (bench_reduce (&prims,
+                                      GPGPU_REDUCE_SUM,
+                                      data,
+                                      size,
+                                      iterations),
+                        size,
+                        &ok);
+
+      /* full range keys, with duplicates to exercise stability */
+      for (uint32_t i = 0; i < size; i++) {
+         data[i] = random_u32 (&seed);
+         if (i % 5 == 0)
+            data[i] = data[i / 2];
+      }
+
+      print_throughput (bench_reduce (&prims,
+                                      GPGPU_REDUCE_MIN,
+                                      data,
+                                      size,
+                                      iterations),
+                        size,
+                        &ok);
+      print_throughput (bench_reduce (&prims,
+                                      GPGPU_REDUCE_MAX,
+                                      data,
+                                      size,
+                                      iterations),
+                        size,
+                        &ok);
+      print_throughput (bench_sort (&prims, data, size, iterations, false),
+                        size,
+                        &ok);
+      print_throughput (bench_sort (&prims, data, size, iterations, true),
+                        size,
+                        &ok);
+      printf ("\n");
+      fflush (stdout);
+
+      /* don't wrap around */
+      if (n > UINT32_MAX / 4)
+         break;
+   }
+
+   printf ("\n%s\n", ok ? "All results match the CPU" : "FAILED");
+
+   free (data);
+   gpgpu_primitives_finish (&prims);
+   gpgpu_context_finish (&ctx);
+
+   return ok ? 0 : -1;
+}
@@ -0,0 +1,610 @@
+/*
+ * GPGPU: parallel primitives
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <assert.h>
+#include "primitives.h"
+#include <stdio.h>
+#include <string.h>
+
+#define RADIX_BITS 4
+#define RADIX (1 << RADIX_BITS)
+#define RADIX_PASSES (32 / RADIX_BITS)
+
+/* Shared by all kernels: WORK_GROUP_SIZE comes from the defines, SYNC()
+ * makes the shared memory writes of the work group visible to all of it.
+ */
+#define KERNEL_HEADER                                                   \
+   "#version 310 es\n"                                                  \
+   "layout (local_size_x = WORK_GROUP_SIZE) in;\n"                      \
+   "#define WG uint (WORK_GROUP_SIZE)\n"                                \
+   "#define SYNC() memoryBarrierShared (); barrier ()\n"
+
+static const char *SCAN_SRC =
+   KERNEL_HEADER
+   "#define BLOCK_SIZE (2u * WG)\n"
+   "layout (std430, binding = 0) readonly buffer In { uint data_in[]; };\n"
+   "layout (std430, binding = 1) writeonly buffer Out { uint data_out[]; };\n"
+   "layout (std430, binding = 2) writeonly buffer Sums { uint sums[]; };\n"
+   "uniform uint n;\n"
+   "shared uint s_data[BLOCK_SIZE];\n"
+   "void main (void) {\n"
+   "   uint lid = gl_LocalInvocationID.x;\n"
+   "   uint i0 = gl_WorkGroupID.x * BLOCK_SIZE + lid;\n"
+   "   uint i1 = i0 + WG;\n"
+   "   s_data[lid] = i0 < n ? data_in[i0] : 0u;\n"
+   "   s_data[lid + WG] = i1 < n ? data_in[i1] : 0u;\n"
+   /* up-sweep: build partial sums in place */
+   "   uint offset = 1u;\n"
+   "   for (uint d = BLOCK_SIZE >> 1; d > 0u; d >>= 1) {\n"
+   "      SYNC ();\n"
+   "      if (lid < d) {\n"
+   "         uint ai = offset * (2u * lid + 1u) - 1u;\n"
+   "         uint bi = offset * (2u * lid + 2u) - 1u;\n"
+   "         s_data[bi] += s_data[ai];\n"
+   "      }\n"
+   "      offset <<= 1;\n"
+   "   }\n"
+   "   SYNC ();\n"
+   "   if (lid == 0u) {\n"
+   "      sums[gl_WorkGroupID.x] = s_data[BLOCK_SIZE - 1u];\n"
+   "      s_data[BLOCK_SIZE - 1u] = 0u;\n"
+   "   }\n"
+   /* down-sweep */
+   "   for (uint d = 1u; d < BLOCK_SIZE; d <<= 1) {\n"
+   "      offset >>= 1;\n"
+   "      SYNC ();\n"
+   "      if (lid < d) {\n"
+   "         uint ai = offset * (2u * lid + 1u) - 1u;\n"
+   "         uint bi = offset * (2u * lid + 2u) - 1u;\n"
+   "         uint t = s_data[ai];\n"
+   "         s_data[ai] = s_data[bi];\n"
+   "         s_data[bi] += t;\n"
+   "      }\n"
+   "   }\n"
+   "   SYNC ();\n"
+   "   if (i0 < n)\n"
+   "      data_out[i0] = s_data[lid];\n"
+   "   if (i1 < n)\n"
+   "      data_out[i1] = s_data[lid + WG];\n"
+   "}\n";
+
+static const char *SCAN_ADD_SRC =
+   KERNEL_HEADER
+   "#define BLOCK_SIZE (2u * WG)\n"
+   "layout (std430, binding = 0) buffer Data { uint data[]; };\n"
+   "layout (std430, binding = 1) readonly buffer Sums { uint sums[]; };\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "void main (void) {\n"
+   "   uint i = gl_GlobalInvocationID.x;\n"
+   "   if (i >= gpgpu_global_size.x)\n"
+   "      return;\n"
+   "   data[i] += sums[i / BLOCK_SIZE];\n"
+   "}\n";
+
+static const char *REDUCE_SRC =
+   KERNEL_HEADER
+   "#define BLOCK_SIZE (2u * WG)\n"
+   "#if defined (OP_SUM)\n"
+   "#define IDENTITY 0u\n"
+   "#define COMBINE(a, b) ((a) + (b))\n"
+   "#elif defined (OP_MIN)\n"
+   "#define IDENTITY 0xffffffffu\n"
+   "#define COMBINE(a, b) min (a, b)\n"
+   "#else\n"
+   "#define IDENTITY 0u\n"
+   "#define COMBINE(a, b) max (a, b)\n"
+   "#endif\n"
+   "layout (std430, binding = 0) readonly buffer In { uint data_in[]; };\n"
+   "layout (std430, binding = 1) writeonly buffer Out { uint data_out[]; };\n"
+   "uniform uint n;\n"
+   "shared uint s_data[WG];\n"
+   "void main (void) {\n"
+   "   uint lid = gl_LocalInvocationID.x;\n"
+   "   uint i0 = gl_WorkGroupID.x * BLOCK_SIZE + lid;\n"
+   "   uint i1 = i0 + WG;\n"
+   "   uint a = i0 < n ? data_in[i0] : IDENTITY;\n"
+   "   uint b = i1 < n ? data_in[i1] : IDENTITY;\n"
+   "   s_data[lid] = COMBINE (a, b);\n"
+   "   for (uint s = WG >> 1; s > 0u; s >>= 1) {\n"
+   "      SYNC ();\n"
+   "      if (lid < s)\n"
+   "         s_data[lid] = COMBINE (s_data[lid], s_data[lid + s]);\n"
+   "   }\n"
+   "   if (lid == 0u)\n"
+   "      data_out[gl_WorkGroupID.x] = s_data[0];\n"
+   "}\n";
+
+/* Sort elements are keys, or key-value pairs packed into a uvec2 so that
+ * a pass needs no more than the 4 storage blocks GLES 3.1 guarantees.
+ */
+#define SORT_HEADER                                                     \
+   KERNEL_HEADER                                                        \
+   "#define RADIX_MASK 15u\n"                                           \
+   "#if WITH_VALUES\n"                                                  \
+   "#define ELEMENT uvec2\n"                                            \
+   "#define KEY(e) (e).x\n"                                             \
+   "#else\n"                                                            \
+   "#define ELEMENT uint\n"                                             \
+   "#define KEY(e) (e)\n"                                               \
+   "#endif\n"
+
+/* histogram[digit * num_blocks + block] = count of 'digit' in 'block', a
+ * layout whose exclusive scan is the offset of each digit of each block in
+ * the output.
+ */
+static const char *RADIX_COUNT_SRC =
+   SORT_HEADER
+   "layout (std430, binding = 0) readonly buffer In { ELEMENT data_in[]; };\n"
+   "layout (std430, binding = 1) writeonly buffer Histogram {\n"
+   "   uint histogram[];\n"
+   "};\n"
+   "uniform uint n;\n"
+   "uniform uint shift;\n"
+   "uniform uint num_blocks;\n"
+   "shared uint s_count[RADIX_MASK + 1u];\n"
+   "void main (void) {\n"
+   "   uint lid = gl_LocalInvocationID.x;\n"
+   "   uint i = gl_GlobalInvocationID.x;\n"
+   "   if (lid <= RADIX_MASK)\n"
+   "      s_count[lid] = 0u;\n"
+   "   SYNC ();\n"
+   "   if (i < n)\n"
+   "      atomicAdd (s_count[(KEY (data_in[i]) >> shift) & RADIX_MASK], 1u);\n"
+   "   SYNC ();\n"
+   "   if (lid <= RADIX_MASK)\n"
+   "      histogram[lid * num_blocks + gl_WorkGroupID.x] = s_count[lid];\n"
+   "}\n";
+
+/* Ranks each element among the ones of the same digit in its block with a
+ * single scan, of 16 counters of 16 bits (one per digit) packed in two
+ * uvec4s, rather than one scan per bit of the digit: barriers are what
+ * block-wide scans cost the most. Blocks of up to 65535 elements fit.
+ */
+static const char *RADIX_SCATTER_SRC =
+   SORT_HEADER
+   "layout (std430, binding = 0) readonly buffer In { ELEMENT data_in[]; };\n"
+   "layout (std430, binding = 1) writeonly buffer Out {\n"
+   "   ELEMENT data_out[];\n"
+   "};\n"
+   "layout (std430, binding = 2) readonly buffer Offsets {\n"
+   "   uint offsets[];\n"
+   "};\n"
+   "uniform uint n;\n"
+   "uniform uint shift;\n"
+   "uniform uint num_blocks;\n"
+   "shared uvec4 s_low[WG];\n"
+   "shared uvec4 s_high[WG];\n"
+   "void main (void) {\n"
+   "   uint lid = gl_LocalInvocationID.x;\n"
+   "   uint i = gl_GlobalInvocationID.x;\n"
+   "   ELEMENT e = i < n ? data_in[i] : ELEMENT (0u);\n"
+   "   uint digit = (KEY (e) >> shift) & RADIX_MASK;\n"
+   "   uint component = (digit >> 1) & 3u;\n"
+   "   uint counter_shift = (digit & 1u) * 16u;\n"
+   "   uvec4 low = uvec4 (0u);\n"
+   "   uvec4 high = uvec4 (0u);\n"
+   "   if (i < n) {\n"
+   "      if (digit < 8u)\n"
+   "         low[component] = 1u << counter_shift;\n"
+   "      else\n"
+   "         high[component] = 1u << counter_shift;\n"
+   "   }\n"
+   "   s_low[lid] = low;\n"
+   "   s_high[lid] = high;\n"
+   /* exclusive Blelloch scan of the counters */
+   "   uint offset = 1u;\n"
+   "   for (uint d = WG >> 1; d > 0u; d >>= 1) {\n"
+   "      SYNC ();\n"
+   "      if (lid < d) {\n"
+   "         uint ai = offset * (2u * lid + 1u) - 1u;\n"
+   "         uint bi = offset * (2u * lid + 2u) - 1u;\n"
+   "         s_low[bi] += s_low[ai];\n"
+   "         s_high[bi] += s_high[ai];\n"
+   "      }\n"
+   "      offset <<= 1;\n"
+   "   }\n"
+   "   SYNC ();\n"
+   "   if (lid == 0u) {\n"
+   "      s_low[WG - 1u] = uvec4 (0u);\n"
+   "      s_high[WG - 1u] = uvec4 (0u);\n"
+   "   }\n"
+   "   for (uint d = 1u; d < WG; d <<= 1) {\n"
+   "      offset >>= 1;\n"
+   "      SYNC ();\n"
+   "      if (lid < d) {\n"
+   "         uint ai = offset * (2u * lid + 1u) - 1u;\n"
+   "         uint bi = offset * (2u * lid + 2u) - 1u;\n"
+   "         uvec4 t = s_low[ai];\n"
+   "         s_low[ai] = s_low[bi];\n"
+   "         s_low[bi] += t;\n"
+   "         t = s_high[ai];\n"
+   "         s_high[ai] = s_high[bi];\n"
+   "         s_high[bi] += t;\n"
+   "      }\n"
+   "   }\n"
+   "   SYNC ();\n"
+   "   if (i < n) {\n"
+   "      uvec4 counters = digit < 8u ? s_low[lid] : s_high[lid];\n"
+   "      uint rank = (counters[component] >> counter_shift) & 0xffffu;\n"
+   "      uint base = offsets[digit * num_blocks + gl_WorkGroupID.x];\n"
+   "      data_out[base + rank] = e;\n"
+   "   }\n"
+   "}\n";
+
+static const char *PACK_PAIRS_SRC =
+   KERNEL_HEADER
+   "layout (std430, binding = 0) readonly buffer Keys { uint keys[]; };\n"
+   "layout (std430, binding = 1) readonly buffer Values { uint values[]; };\n"
+   "layout (std430, binding = 2) writeonly buffer Pairs { uvec2 pairs[]; };\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "void main (void) {\n"
+   "   uint i = gl_GlobalInvocationID.x;\n"
+   "   if (i >= gpgpu_global_size.x)\n"
+   "      return;\n"
+   "   pairs[i] = uvec2 (keys[i], values[i]);\n"
+   "}\n";
+
+static const char *UNPACK_PAIRS_SRC =
+   KERNEL_HEADER
+   "layout (std430, binding = 0) readonly buffer Pairs { uvec2 pairs[]; };\n"
+   "layout (std430, binding = 1) writeonly buffer Keys { uint keys[]; };\n"
+   "layout (std430, binding = 2) writeonly buffer Values { uint values[]; };\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "void main (void) {\n"
+   "   uint i = gl_GlobalInvocationID.x;\n"
+   "   if (i >= gpgpu_global_size.x)\n"
+   "      return;\n"
+   "   keys[i] = pairs[i].x;\n"
+   "   values[i] = pairs[i].y;\n"
+   "}\n";
+
+/* Largest power of two the limits allow, for the biggest shared memory
+ * footprint of the kernels: the digit counters of the scatter.
+ */
+static uint32_t
+choose_work_group_size (struct gpgpu_context *ctx)
+{
+   uint32_t limit = GPGPU_PRIMITIVES_MAX_WORK_GROUP_SIZE;
+   if ((uint32_t) ctx->max_work_group_invocations < limit)
+      limit = ctx->max_work_group_invocations;
+   if ((uint32_t) ctx->max_work_group_size[0] < limit)
+      limit = ctx->max_work_group_size[0];
+
+   uint32_t size = 1;
+   while (size * 2 <= limit)
+      size *= 2;
+
+   const uint32_t bytes_per_invocation = RADIX * sizeof (uint16_t);
+   while (size > RADIX
+          && size * bytes_per_invocation
+             > (uint32_t) ctx->max_shared_memory_size) {
+      size /= 2;
+   }
+
+   return size;
+}
+
+static bool
+init_kernel (struct gpgpu_primitives *prims,
+             struct gpgpu_kernel *kernel,
+             const char *source,
+             const char *extra_defines)
+{
+   char defines[256];
+
+   snprintf (defines, sizeof (defines),
+             "#define WORK_GROUP_SIZE %u\n"
+             "%s",
+             prims->work_group_size,
+             extra_defines);
+
+   return gpgpu_kernel_init_with_defines (kernel,
+                                          prims->ctx,
+                                          source,
+                                          defines);
+}
+
+static bool
+ensure_buffer (struct gpgpu_buffer *buf, size_t size)
+{
+   if (buf->size >= size)
+      return true;
+
+   gpgpu_buffer_finish (buf);
+
+   return gpgpu_buffer_init (buf, size, GL_DYNAMIC_COPY);
+}
+
+static uint32_t
+div_round_up (uint32_t a, uint32_t b)
+{
+   return (uint32_t) (((uint64_t) a + b - 1) / b);
+}
+
+static bool
+scan_level (struct gpgpu_primitives *prims,
+            struct gpgpu_buffer *in,
+            struct gpgpu_buffer *out,
+            uint32_t n,
+            uint32_t level)
+{
+   uint32_t block_size = 2 * prims->work_group_size;
+   uint32_t num_blocks = div_round_up (n, block_size);
+
+   if (level >= GPGPU_SCAN_MAX_LEVELS)
+      return false;
+
+   struct gpgpu_buffer *sums = &prims->scan_sums[level];
+   if (! ensure_buffer (sums, num_blocks * sizeof (uint32_t)))
+      return false;
+
+   struct gpgpu_kernel *kernel = &prims->scan;
+   gpgpu_kernel_set_uint (kernel, "n", n);
+   gpgpu_kernel_bind_buffer (kernel, 0, in);
+   gpgpu_kernel_bind_buffer (kernel, 1, out);
+   gpgpu_kernel_bind_buffer (kernel, 2, sums);
+   if (! gpgpu_kernel_dispatch (kernel,
+                                num_blocks * prims->work_group_size,
+                                1,
+                                1)) {
+      return false;
+   }
+
+   if (num_blocks == 1)
+      return true;
+
+   if (! scan_level (prims, sums, sums, num_blocks, level + 1))
+      return false;
+
+   kernel = &prims->scan_add;
+   gpgpu_kernel_bind_buffer (kernel, 0, out);
+   gpgpu_kernel_bind_buffer (kernel, 1, sums);
+
+   return gpgpu_kernel_dispatch (kernel, n, 1, 1);
+}
+
+/* public API */
+
+bool
+gpgpu_primitives_init (struct gpgpu_primitives *prims,
+                       struct gpgpu_context *ctx)
+{
+   assert (prims != NULL);
+   assert (ctx != NULL);
+
+   memset (prims, 0x00, sizeof (struct gpgpu_primitives));
+
+   prims->ctx = ctx;
+   prims->work_group_size = choose_work_group_size (ctx);
+   if (prims->work_group_size < RADIX) {
+      printf ("Work groups of %u invocations are too small\n",
+              prims->work_group_size);
+      return false;
+   }
+
+   bool ok = init_kernel (prims, &prims->scan, SCAN_SRC, "")
+      && init_kernel (prims, &prims->scan_add, SCAN_ADD_SRC, "")
+      && init_kernel (prims,
+                      &prims->reduce[GPGPU_REDUCE_SUM],
+                      REDUCE_SRC,
+                      "#define OP_SUM 1\n")
+      && init_kernel (prims,
+                      &prims->reduce[GPGPU_REDUCE_MIN],
+                      REDUCE_SRC,
+                      "#define OP_MIN 1\n")
+      && init_kernel (prims,
+                      &prims->reduce[GPGPU_REDUCE_MAX],
+                      REDUCE_SRC,
+                      "#define OP_MAX 1\n")
+      && init_kernel (prims,
+                      &prims->radix_count[0],
+                      RADIX_COUNT_SRC,
+                      "#define WITH_VALUES 0\n")
+      && init_kernel (prims,
+                      &prims->radix_count[1],
+                      RADIX_COUNT_SRC,
+                      "#define WITH_VALUES 1\n")
+      && init_kernel (prims,
+                      &prims->radix_scatter[0],
+                      RADIX_SCATTER_SRC,
+                      "#define WITH_VALUES 0\n")
+      && init_kernel (prims,
+                      &prims->radix_scatter[1],
+                      RADIX_SCATTER_SRC,
+                      "#define WITH_VALUES 1\n")
+      && init_kernel (prims, &prims->pack_pairs, PACK_PAIRS_SRC, "")
+      && init_kernel (prims, &prims->unpack_pairs, UNPACK_PAIRS_SRC, "");
+
+   if (! ok) {
+      gpgpu_primitives_finish (prims);
+      return false;
+   }
+
+   return true;
+}
+
+void
+gpgpu_primitives_finish (struct gpgpu_primitives *prims)
+{
+   assert (prims != NULL);
+
+   gpgpu_kernel_finish (&prims->scan);
+   gpgpu_kernel_finish (&prims->scan_add);
+   for (uint32_t i = 0; i < GPGPU_REDUCE_NUM_OPS; i++)
+      gpgpu_kernel_finish (&prims->reduce[i]);
+   for (uint32_t i = 0; i < 2; i++) {
+      gpgpu_kernel_finish (&prims->radix_count[i]);
+      gpgpu_kernel_finish (&prims->radix_scatter[i]);
+   }
+   gpgpu_kernel_finish (&prims->pack_pairs);
+   gpgpu_kernel_finish (&prims->unpack_pairs);
+
+   for (uint32_t i = 0; i < GPGPU_SCAN_MAX_LEVELS; i++)
+      gpgpu_buffer_finish (&prims->scan_sums[i]);
+   for (uint32_t i = 0; i < 2; i++) {
+      gpgpu_buffer_finish (&prims->reduce_partials[i]);
+      gpgpu_buffer_finish (&prims->sort_elements[i]);
+   }
+   gpgpu_buffer_finish (&prims->sort_histogram);
+}
+
+bool
+gpgpu_scan (struct gpgpu_primitives *prims,
+            struct gpgpu_buffer *in,
+            struct gpgpu_buffer *out,
+            uint32_t n)
+{
+   assert (prims != NULL);
+   assert (in != NULL && in->size >= n * sizeof (uint32_t));
+   assert (out != NULL && out->size >= n * sizeof (uint32_t));
+
+   if (n == 0)
+      return true;
+
+   return scan_level (prims, in, out, n, 0);
+}
+
+bool
+gpgpu_reduce (struct gpgpu_primitives *prims,
+              enum gpgpu_reduce_op op,
+              struct gpgpu_buffer *in,
+              uint32_t n,
+              uint32_t *result)
+{
+   assert (prims != NULL);
+   assert (op < GPGPU_REDUCE_NUM_OPS);
+   assert (in != NULL && in->size >= n * sizeof (uint32_t));
+   assert (n > 0);
+   assert (result != NULL);
+
+   uint32_t block_size = 2 * prims->work_group_size;
+   uint32_t num_blocks = div_round_up (n, block_size);
+   size_t size = num_blocks * sizeof (uint32_t);
+
+   if (! ensure_buffer (&prims->reduce_partials[0], size)
+       || ! ensure_buffer (&prims->reduce_partials[1], size)) {
+      return false;
+   }
+
+   struct gpgpu_kernel *kernel = &prims->reduce[op];
+   struct gpgpu_buffer *src = in;
+   uint32_t pass = 0;
+
+   do {
+      struct gpgpu_buffer *dst = &prims->reduce_partials[pass % 2];
+      num_blocks = div_round_up (n, block_size);
+
+      gpgpu_kernel_set_uint (kernel, "n", n);
+      gpgpu_kernel_bind_buffer (kernel, 0, src);
+      gpgpu_kernel_bind_buffer (kernel, 1, dst);
+      if (! gpgpu_kernel_dispatch (kernel,
+                                   num_blocks * prims->work_group_size,
+                                   1,
+                                   1)) {
+         return false;
+      }
+
+      src = dst;
+      n = num_blocks;
+      pass++;
+   } while (n > 1);
+
+   return gpgpu_buffer_download (src, result, 0, sizeof (uint32_t));
+}
+
+bool
+gpgpu_sort (struct gpgpu_primitives *prims,
+            struct gpgpu_buffer *keys,
+            struct gpgpu_buffer *values,
+            uint32_t n)
+{
+   assert (prims != NULL);
+   assert (keys != NULL && keys->size >= n * sizeof (uint32_t));
+   assert (values == NULL || values->size >= n * sizeof (uint32_t));
+
+   if (n <= 1)
+      return true;
+
+   const uint32_t with_values = values != NULL ? 1 : 0;
+   const size_t element_size = (1 + with_values) * sizeof (uint32_t);
+   uint32_t num_blocks = div_round_up (n, prims->work_group_size);
+   uint32_t histogram_len = num_blocks * RADIX;
+
+   if (! ensure_buffer (&prims->sort_histogram,
+                        histogram_len * sizeof (uint32_t))
+       || ! ensure_buffer (&prims->sort_elements[0], n * element_size)
+       || ! ensure_buffer (&prims->sort_elements[1], n * element_size)) {
+      return false;
+   }
+
+   /* Keys alone are sorted back and forth between 'keys' and scratch; with
+    * an even number of passes they end up in 'keys'.
+    */
+   struct gpgpu_buffer *buffers[2] = { keys, &prims->sort_elements[0] };
+
+   if (with_values) {
+      gpgpu_kernel_bind_buffer (&prims->pack_pairs, 0, keys);
+      gpgpu_kernel_bind_buffer (&prims->pack_pairs, 1, values);
+      gpgpu_kernel_bind_buffer (&prims->pack_pairs,
+                                2,
+                                &prims->sort_elements[0]);
+      if (! gpgpu_kernel_dispatch (&prims->pack_pairs, n, 1, 1))
+         return false;
+
+      buffers[0] = &prims->sort_elements[0];
+      buffers[1] = &prims->sort_elements[1];
+   }
+
+   struct gpgpu_kernel *count = &prims->radix_count[with_values];
+   struct gpgpu_kernel *scatter = &prims->radix_scatter[with_values];
+
+   gpgpu_kernel_set_uint (count, "n", n);
+   gpgpu_kernel_set_uint (count, "num_blocks", num_blocks);
+   gpgpu_kernel_set_uint (scatter, "n", n);
+   gpgpu_kernel_set_uint (scatter, "num_blocks", num_blocks);
+
+   for (uint32_t pass = 0; pass < RADIX_PASSES; pass++) {
+      struct gpgpu_buffer *src = buffers[pass % 2];
+      struct gpgpu_buffer *dst = buffers[(pass + 1) % 2];
+      uint32_t shift = pass * RADIX_BITS;
+
+      gpgpu_kernel_set_uint (count, "shift", shift);
+      gpgpu_kernel_bind_buffer (count, 0, src);
+      gpgpu_kernel_bind_buffer (count, 1, &prims->sort_histogram);
+      if (! gpgpu_kernel_dispatch (count, n, 1, 1))
+         return false;
+
+      if (! gpgpu_scan (prims,
+                        &prims->sort_histogram,
+                        &prims->sort_histogram,
+                        histogram_len)) {
+         return false;
+      }
+
+      gpgpu_kernel_set_uint (scatter, "shift", shift);
+      gpgpu_kernel_bind_buffer (scatter, 0, src);
+      gpgpu_kernel_bind_buffer (scatter, 1, dst);
+      gpgpu_kernel_bind_buffer (scatter, 2, &prims->sort_histogram);
+      if (! gpgpu_kernel_dispatch (scatter, n, 1, 1))
+         return false;
+   }
+
+   if (with_values) {
+      gpgpu_kernel_bind_buffer (&prims->unpack_pairs, 0, buffers[0]);
+      gpgpu_kernel_bind_buffer (&prims->unpack_pairs, 1, keys);
+      gpgpu_kernel_bind_buffer (&prims->unpack_pairs, 2, values);
+      if (! gpgpu_kernel_dispatch (&prims->unpack_pairs, n, 1, 1))
+         return false;
+   }
+
+   return true;
+}
@@ -0,0 +1,106 @@
+/*
+ * GPGPU: parallel primitives
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gpgpu.h"
+
+/* Prefix sum, reduction and radix sort of 32-bit unsigned integers, on
+ * buffers of a gpgpu context.
+ *
+ * Each work group works on a block of the input in shared memory. The work
+ * group size is the largest power of two that the device's
+ * GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS and the block's footprint in
+ * GL_MAX_COMPUTE_SHARED_MEMORY_SIZE allow (up to
+ * GPGPU_PRIMITIVES_MAX_WORK_GROUP_SIZE):
+ *
+ * - Scan is Blelloch's work-efficient up-sweep/down-sweep over blocks of
+ *   two elements per invocation, the sums of the blocks being scanned
+ *   recursively and added back.
+ *
+ * - Reduce combines two elements per invocation and then halves the block
+ *   in shared memory, once per pass until one element is left.
+ *
+ * - Sort is an LSD radix sort, 4 bits per pass. Each pass counts the
+ *   digits of each block, scans the counts into global offsets, and
+ *   scatters each element to its digit's offset plus its rank among the
+ *   elements of the same digit before it in the block, which keeps the
+ *   sort stable.
+ *
+ * Scratch buffers are kept across calls and grown as needed.
+ */
+
+#define GPGPU_PRIMITIVES_MAX_WORK_GROUP_SIZE 1024
+#define GPGPU_SCAN_MAX_LEVELS 8
+
+enum gpgpu_reduce_op {
+   GPGPU_REDUCE_SUM,
+   GPGPU_REDUCE_MIN,
+   GPGPU_REDUCE_MAX,
+
+   GPGPU_REDUCE_NUM_OPS,
+};
+
+struct gpgpu_primitives {
+   struct gpgpu_context *ctx;
+   uint32_t work_group_size;
+
+   struct gpgpu_kernel scan;
+   struct gpgpu_kernel scan_add;
+   struct gpgpu_kernel reduce[GPGPU_REDUCE_NUM_OPS];
+
+   /* [0] for keys, [1] for key-value pairs */
+   struct gpgpu_kernel radix_count[2];
+   struct gpgpu_kernel radix_scatter[2];
+   struct gpgpu_kernel pack_pairs;
+   struct gpgpu_kernel unpack_pairs;
+
+   /* scratch */
+   struct gpgpu_buffer scan_sums[GPGPU_SCAN_MAX_LEVELS];
+   struct gpgpu_buffer reduce_partials[2];
+   struct gpgpu_buffer sort_histogram;
+   struct gpgpu_buffer sort_elements[2];
+};
+
+bool     gpgpu_primitives_init   (struct gpgpu_primitives *prims,
+                                  struct gpgpu_context *ctx);
+
+void     gpgpu_primitives_finish (struct gpgpu_primitives *prims);
+
+/* Exclusive prefix sum of the first 'n' elements of 'in' into 'out', which
+ * can be the same buffer. Sums wrap around at 2^32.
+ */
+bool     gpgpu_scan              (struct gpgpu_primitives *prims,
+                                  struct gpgpu_buffer *in,
+                                  struct gpgpu_buffer *out,
+                                  uint32_t n);
+
+/* Reduces the first 'n' elements of 'in' with 'op', and reads the result
+ * back to 'result'. Sums wrap around at 2^32.
+ */
+bool     gpgpu_reduce            (struct gpgpu_primitives *prims,
+                                  enum gpgpu_reduce_op op,
+                                  struct gpgpu_buffer *in,
+                                  uint32_t n,
+                                  uint32_t *result);
+
+/* Sorts the first 'n' elements of 'keys' in ascending order, in place.
+ * If 'values' is not NULL, its first 'n' elements are moved along with
+ * their keys. The sort is stable.
+ */
+bool     gpgpu_sort              (struct gpgpu_primitives *prims,
+                                  struct gpgpu_buffer *keys,
+                                  struct gpgpu_buffer *values,
+                                  uint32_t n);
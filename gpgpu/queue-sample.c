@@ -0,0 +1,253 @@
+/*
+ * Example:
+ *
+ * GPGPU queue: streams batches through a kernel with several jobs in
+ *              flight, so that filling the input of a batch and reading
+ *              the output of another overlap with the kernel computing a
+ *              third, and compares the throughput at different depths.
+ *
+ * Usage: gpgpu-queue [-n elements per batch] [-b batches]
+ *                    [-f jobs in flight]
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpgpu.h"
+#include "queue.h"
+
+/* a polynomial evaluated by Horner's rule, enough work per element for the
+ * kernel to take about as long as the copies
+ */
+static const char *POLY_SRC =
+   "#version 310 es\n"
+   "layout (local_size_x = 64) in;\n"
+   "layout (std430, binding = 0) readonly buffer In { uint x[]; };\n"
+   "layout (std430, binding = 1) writeonly buffer Out { uint y[]; };\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "void main (void) {\n"
+   "   uint i = gl_GlobalInvocationID.x;\n"
+   "   if (i >= gpgpu_global_size.x)\n"
+   "      return;\n"
+   "   uint v = x[i];\n"
+   "   uint r = 0u;\n"
+   "   for (uint k = 0u; k < 32u; k++)\n"
+   "      r = r * v + k;\n"
+   "   y[i] = r;\n"
+   "}\n";
+
+#define JOB_TIMEOUT_NS (1000ull * 1000 * 1000)
+
+static struct gpgpu_kernel kernel;
+
+struct batch {
+   uint32_t index;
+   uint32_t n;
+   bool ok;
+};
+
+static uint32_t
+input_value (uint32_t batch, uint32_t i)
+{
+   return batch * 2654435761u + i;
+}
+
+static uint32_t
+poly (uint32_t v)
+{
+   uint32_t r = 0;
+   for (uint32_t k = 0; k < 32; k++)
+      r = r * v + k;
+   return r;
+}
+
+static void
+batch_fill (void *input, void *data)
+{
+   struct batch *batch = data;
+   uint32_t *x = input;
+
+   for (uint32_t i = 0; i < batch->n; i++)
+      x[i] = input_value (batch->index, i);
+}
+
+static bool
+batch_dispatch (struct gpgpu_buffer *input,
+                struct gpgpu_buffer *output,
+                void *data)
+{
+   struct batch *batch = data;
+
+   gpgpu_kernel_bind_buffer (&kernel, 0, input);
+   gpgpu_kernel_bind_buffer (&kernel, 1, output);
+
+   return gpgpu_kernel_dispatch (&kernel, batch->n, 1, 1);
+}
+
+static void
+batch_complete (const void *output, void *data)
+{
+   struct batch *batch = data;
+   const uint32_t *y = output;
+
+   batch->ok = true;
+   for (uint32_t i = 0; i < batch->n && batch->ok; i++) {
+      if (y[i] != poly (input_value (batch->index, i))) {
+         printf ("Batch %u: y[%u] = %u, expected %u\n",
+                 batch->index,
+                 i,
+                 y[i],
+                 poly (input_value (batch->index, i)));
+         batch->ok = false;
+      }
+   }
+}
+
+/* Runs all batches with up to 'max_in_flight' jobs in flight, and returns
+ * the time it took, or a negative value on failure.
+ */
+static double
+run (struct gpgpu_context *ctx,
+     struct batch *batches,
+     uint32_t num_batches,
+     uint32_t max_in_flight,
+     bool print_stats)
+{
+   struct gpgpu_queue queue;
+   gpgpu_queue_init (&queue, ctx, max_in_flight, JOB_TIMEOUT_NS);
+
+   double start = gpgpu_now_ms ();
+   bool ok = true;
+
+   for (uint32_t i = 0; i < num_batches && ok; i++) {
+      batches[i].ok = false;
+
+      struct gpgpu_queue_job job = {
+         .input_size = batches[i].n * sizeof (uint32_t),
+         .output_size = batches[i].n * sizeof (uint32_t),
+         .fill = batch_fill,
+         .dispatch = batch_dispatch,
+         .complete = batch_complete,
+         .data = &batches[i],
+      };
+      ok = gpgpu_queue_submit (&queue, &job);
+   }
+   gpgpu_queue_wait_all (&queue);
+
+   double elapsed = gpgpu_now_ms () - start;
+
+   for (uint32_t i = 0; i < num_batches && ok; i++)
+      ok = batches[i].ok;
+
+   if (print_stats)
+      gpgpu_queue_print_stats (&queue);
+   gpgpu_queue_finish (&queue);
+
+   return ok ? elapsed : -1.0;
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   uint32_t n = 1 << 18;
+   uint32_t num_batches = 64;
+   uint32_t max_in_flight = 0;
+
+   for (int32_t i = 1; i < argc; i++) {
+      if (strcmp (argv[i], "-n") == 0 && i + 1 < argc) {
+         n = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-b") == 0 && i + 1 < argc) {
+         num_batches = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-f") == 0 && i + 1 < argc) {
+         max_in_flight = strtoul (argv[++i], NULL, 10);
+      } else {
+         printf ("Usage: %s [-n elements per batch] [-b batches] "
+                 "[-f jobs in flight]\n",
+                 argv[0]);
+         return -1;
+      }
+   }
+
+   if (n == 0 || num_batches == 0
+       || max_in_flight > GPGPU_QUEUE_MAX_IN_FLIGHT) {
+      printf ("Invalid arguments\n");
+      return -1;
+   }
+
+   struct gpgpu_context ctx;
+   if (! gpgpu_context_init (&ctx, NULL))
+      return -1;
+
+   gpgpu_context_print_info (&ctx);
+   printf ("\n");
+
+   if (! gpgpu_kernel_init (&kernel, &ctx, POLY_SRC))
+      return -1;
+
+   struct batch *batches = calloc (num_batches, sizeof (struct batch));
+   if (batches == NULL)
+      return -1;
+   for (uint32_t i = 0; i < num_batches; i++) {
+      batches[i].index = i;
+      batches[i].n = n;
+   }
+
+   /* not to count the driver's first-use costs against the first depth */
+   run (&ctx, batches, num_batches < 4 ? num_batches : 4, 4, false);
+
+   static const uint32_t depths[] = { 1, 2, 3, 4, 8 };
+   uint32_t num_depths = sizeof (depths) / sizeof (depths[0]);
+
+   printf ("%u batches of %u elements\n", num_batches, n);
+   printf ("%-10s %12s %14s %10s\n",
+           "in flight", "time (ms)", "Melem/s", "speedup");
+
+   bool ok = true;
+   double serial_ms = 0;
+   for (uint32_t d = 0; d < num_depths && ok; d++) {
+      uint32_t depth = max_in_flight > 0 ? max_in_flight : depths[d];
+      double ms = run (&ctx, batches, num_batches, depth, false);
+      if (ms < 0) {
+         ok = false;
+         break;
+      }
+      if (d == 0)
+         serial_ms = ms;
+
+      printf ("%-10u %12.2f %14.1f %9.2fx\n",
+              depth,
+              ms,
+              (double) num_batches * n / (ms * 1000.0),
+              serial_ms / ms);
+
+      if (max_in_flight > 0)
+         break;
+   }
+
+   if (ok) {
+      run (&ctx,
+           batches,
+           num_batches,
+           max_in_flight > 0 ? max_in_flight : 4,
+           true);
+   }
+
+   printf ("Results: %s\n", ok ? "OK" : "FAILED");
+
+   free (batches);
+   gpgpu_kernel_finish (&kernel);
+   gpgpu_context_finish (&ctx);
+
+   return ok ? 0 : -1;
+}
@@ -0,0 +1,240 @@
+/*
+ * GPGPU: asynchronous jobs with several in flight
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include "queue.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "common/gl-debug.h"
+
+/* Makes 'buf' at least 'size' bytes. Its contents are not preserved. */
+static bool
+reserve_buffer (struct gpgpu_buffer *buf, size_t size, GLenum usage)
+{
+   if (buf->size >= size)
+      return true;
+
+   gpgpu_buffer_finish (buf);
+
+   return gpgpu_buffer_init (buf, size, usage);
+}
+
+/* Completes the oldest job if it's done within 'timeout_ns'. */
+static bool
+complete_oldest (struct gpgpu_queue *queue, uint64_t timeout_ns)
+{
+   if (queue->in_flight == 0)
+      return false;
+
+   struct gpgpu_queue_slot *slot = &queue->slots[queue->first];
+
+   /* no fence means the job was waited for on submission */
+   if (slot->fence.sync != NULL) {
+      double start = gpgpu_now_ms ();
+      bool done = gpgpu_fence_wait (&slot->fence, timeout_ns);
+      queue->wait_ms += gpgpu_now_ms () - start;
+      if (! done)
+         return false;
+   }
+
+   gpgpu_fence_finish (&slot->fence);
+
+   if (slot->job.complete != NULL && slot->job.output_size > 0) {
+      const void *output = gpgpu_buffer_map (&slot->readback,
+                                             0,
+                                             slot->job.output_size,
+                                             GL_MAP_READ_BIT);
+      if (output != NULL) {
+         slot->job.complete (output, slot->job.data);
+         gpgpu_buffer_unmap (&slot->readback);
+      }
+   } else if (slot->job.complete != NULL) {
+      slot->job.complete (NULL, slot->job.data);
+   }
+
+   queue->first = (queue->first + 1) % GPGPU_QUEUE_MAX_IN_FLIGHT;
+   queue->in_flight--;
+   queue->completed++;
+
+   return true;
+}
+
+/* Waits for the oldest job, reporting each timeout that expires. Returns
+ * false if it was late.
+ */
+static bool
+wait_oldest (struct gpgpu_queue *queue)
+{
+   bool on_time = true;
+
+   while (! complete_oldest (queue, queue->timeout_ns)) {
+      queue->timeouts++;
+      on_time = false;
+      printf ("Job %llu still running after %.1f ms\n",
+              (unsigned long long) queue->completed,
+              queue->timeout_ns / 1000000.0);
+   }
+
+   return on_time;
+}
+
+/* public API */
+
+bool
+gpgpu_queue_init (struct gpgpu_queue *queue,
+                  struct gpgpu_context *ctx,
+                  uint32_t max_in_flight,
+                  uint64_t timeout_ns)
+{
+   assert (queue != NULL);
+   assert (ctx != NULL);
+   assert (max_in_flight > 0 && max_in_flight <= GPGPU_QUEUE_MAX_IN_FLIGHT);
+   assert (timeout_ns > 0);
+
+   memset (queue, 0x00, sizeof (struct gpgpu_queue));
+   queue->ctx = ctx;
+   queue->max_in_flight = max_in_flight;
+   queue->timeout_ns = timeout_ns;
+
+   return true;
+}
+
+void
+gpgpu_queue_finish (struct gpgpu_queue *queue)
+{
+   assert (queue != NULL);
+
+   gpgpu_queue_wait_all (queue);
+
+   for (uint32_t i = 0; i < GPGPU_QUEUE_MAX_IN_FLIGHT; i++) {
+      gpgpu_buffer_finish (&queue->slots[i].readback);
+      gpgpu_buffer_finish (&queue->slots[i].output);
+      gpgpu_buffer_finish (&queue->slots[i].input);
+   }
+}
+
+bool
+gpgpu_queue_submit (struct gpgpu_queue *queue,
+                    const struct gpgpu_queue_job *job)
+{
+   assert (queue != NULL);
+   assert (job != NULL && job->dispatch != NULL);
+
+   /* reap what's done, so that the free slot isn't found by waiting */
+   gpgpu_queue_poll (queue, 0);
+
+   if (queue->in_flight >= queue->max_in_flight)
+      wait_oldest (queue);
+
+   struct gpgpu_queue_slot *slot =
+      &queue->slots[(queue->first + queue->in_flight)
+                    % GPGPU_QUEUE_MAX_IN_FLIGHT];
+   slot->job = *job;
+
+   if ((job->input_size > 0
+        && ! reserve_buffer (&slot->input, job->input_size, GL_STREAM_DRAW))
+       || (job->output_size > 0
+           && (! reserve_buffer (&slot->output,
+                                 job->output_size,
+                                 GL_DYNAMIC_COPY)
+               || ! reserve_buffer (&slot->readback,
+                                    job->output_size,
+                                    GL_STREAM_READ)))) {
+      printf ("Out of memory for the buffers of a job\n");
+      return false;
+   }
+
+   /* The slot's last job completed, so nothing on the GPU uses the input
+    * anymore: there is nothing for the driver to synchronize with.
+    */
+   if (job->fill != NULL && job->input_size > 0) {
+      void *input = gpgpu_buffer_map (&slot->input,
+                                      0,
+                                      job->input_size,
+                                      GL_MAP_WRITE_BIT
+                                      | GL_MAP_INVALIDATE_BUFFER_BIT
+                                      | GL_MAP_UNSYNCHRONIZED_BIT);
+      if (input == NULL)
+         return false;
+
+      job->fill (input, job->data);
+      gpgpu_buffer_unmap (&slot->input);
+   }
+
+   if (! job->dispatch (job->input_size > 0 ? &slot->input : NULL,
+                        job->output_size > 0 ? &slot->output : NULL,
+                        job->data)) {
+      return false;
+   }
+
+   if (job->output_size > 0) {
+      gpgpu_buffer_copy (&slot->readback,
+                         0,
+                         &slot->output,
+                         0,
+                         job->output_size);
+   }
+
+   /* without a fence, the job must be done before returning */
+   if (! gpgpu_fence_init (&slot->fence))
+      glFinish ();
+
+   queue->in_flight++;
+   queue->submitted++;
+
+   return true;
+}
+
+uint32_t
+gpgpu_queue_poll (struct gpgpu_queue *queue, uint64_t timeout_ns)
+{
+   assert (queue != NULL);
+
+   if (! complete_oldest (queue, timeout_ns))
+      return 0;
+
+   uint32_t completed = 1;
+   while (complete_oldest (queue, 0))
+      completed++;
+
+   return completed;
+}
+
+bool
+gpgpu_queue_wait_all (struct gpgpu_queue *queue)
+{
+   assert (queue != NULL);
+
+   bool on_time = true;
+
+   while (queue->in_flight > 0)
+      on_time = wait_oldest (queue) && on_time;
+
+   return on_time;
+}
+
+void
+gpgpu_queue_print_stats (struct gpgpu_queue *queue)
+{
+   assert (queue != NULL);
+
+   printf ("Queue: %llu jobs submitted, %llu completed, up to %u in flight, "
+           "%.1f ms waiting, %llu timeouts\n",
+           (unsigned long long) queue->submitted,
+           (unsigned long long) queue->completed,
+           queue->max_in_flight,
+           queue->wait_ms,
+           (unsigned long long) queue->timeouts);
+}
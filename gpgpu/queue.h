@@ -0,0 +1,108 @@
+/*
+ * GPGPU: asynchronous jobs with several in flight
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gpgpu.h"
+
+/* Keeps up to 'max_in_flight' jobs of one context queued on the GPU, so
+ * that while it computes job N, the CPU fills the input of job N+1 and
+ * reads the output of job N-1.
+ *
+ * Each slot of the queue owns the buffers of its job: the input, the
+ * output kernels write, and a readback buffer the output is copied to
+ * before the job's fence. A slot is only reused once its fence signaled,
+ * so its input is mapped unsynchronized and its readback buffer mapped
+ * without a stall: the CPU never waits on the GPU but for a free slot.
+ */
+
+#define GPGPU_QUEUE_MAX_IN_FLIGHT 16
+
+struct gpgpu_queue_job {
+   size_t input_size;
+   size_t output_size;
+
+   /* Writes the job's input to 'input', mapped. Can be NULL. */
+   void (*fill) (void *input, void *data);
+
+   /* Binds 'input' and 'output' and dispatches the kernels of the job.
+    * Returns false on failure.
+    */
+   bool (*dispatch) (struct gpgpu_buffer *input,
+                     struct gpgpu_buffer *output,
+                     void *data);
+
+   /* Reads the job's output, mapped, once the job completed. Can be NULL. */
+   void (*complete) (const void *output, void *data);
+
+   void *data;
+};
+
+struct gpgpu_queue_slot {
+   struct gpgpu_queue_job job;
+   struct gpgpu_fence fence;
+
+   struct gpgpu_buffer input;
+   struct gpgpu_buffer output;
+   struct gpgpu_buffer readback;
+};
+
+struct gpgpu_queue {
+   struct gpgpu_context *ctx;
+
+   /* ring of jobs in flight, oldest first */
+   struct gpgpu_queue_slot slots[GPGPU_QUEUE_MAX_IN_FLIGHT];
+   uint32_t max_in_flight;
+   uint32_t first;
+   uint32_t in_flight;
+
+   /* how long a wait for a job lasts before it's reported as late */
+   uint64_t timeout_ns;
+
+   /* statistics */
+   uint64_t submitted;
+   uint64_t completed;
+   uint64_t timeouts;
+   double wait_ms;
+};
+
+bool     gpgpu_queue_init        (struct gpgpu_queue *queue,
+                                  struct gpgpu_context *ctx,
+                                  uint32_t max_in_flight,
+                                  uint64_t timeout_ns);
+
+/* Waits for all jobs, and frees the buffers of the slots. */
+void     gpgpu_queue_finish      (struct gpgpu_queue *queue);
+
+/* Fills, dispatches and fences 'job' in a free slot, first waiting for the
+ * oldest job if all 'max_in_flight' slots are taken.
+ */
+bool     gpgpu_queue_submit      (struct gpgpu_queue *queue,
+                                  const struct gpgpu_queue_job *job);
+
+/* Completes the jobs that are done, in submission order, and returns how
+ * many. Waits up to 'timeout_ns' nanoseconds for the oldest one if none
+ * is (0 to only poll).
+ */
+uint32_t gpgpu_queue_poll        (struct gpgpu_queue *queue,
+                                  uint64_t timeout_ns);
+
+/* Completes all jobs. Returns false if one of them was late, i.e. didn't
+ * complete within the queue's timeout.
+ */
+bool     gpgpu_queue_wait_all    (struct gpgpu_queue *queue);
+
+void     gpgpu_queue_print_stats (struct gpgpu_queue *queue);
@@ -0,0 +1,224 @@
+/*
+ * Example:
+ *
+ * GPGPU samples: saxpy and an image invert, run through the gpgpu library on
+ *                a render node (or llvmpipe), and checked against the CPU.
+ *
+ * Usage: gpgpu-samples [-d /dev/dri/renderDN] [-n elements]
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpgpu.h"
+
+/* y = a * x + y */
+static const char *SAXPY_SRC =
+   "#version 310 es\n"
+   "layout (local_size_x = 64) in;\n"
+   "layout (std430, binding = 0) readonly buffer X { float x[]; };\n"
+   "layout (std430, binding = 1) buffer Y { float y[]; };\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "uniform float a;\n"
+   "void main (void) {\n"
+   "   uint i = gl_GlobalInvocationID.x;\n"
+   "   if (i >= gpgpu_global_size.x)\n"
+   "      return;\n"
+   "   y[i] = a * x[i] + y[i];\n"
+   "}\n";
+
+/* inverts the color of RGBA8 pixels, keeping alpha */
+static const char *INVERT_SRC =
+   "#version 310 es\n"
+   "layout (local_size_x = 8, local_size_y = 8) in;\n"
+   "layout (std430, binding = 0) buffer Pixels { uint pixels[]; };\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "void main (void) {\n"
+   "   uvec2 pos = gl_GlobalInvocationID.xy;\n"
+   "   if (any (greaterThanEqual (pos, gpgpu_global_size.xy)))\n"
+   "      return;\n"
+   "   uint i = pos.y * gpgpu_global_size.x + pos.x;\n"
+   "   pixels[i] ^= 0x00ffffffu;\n"
+   "}\n";
+
+static bool
+run_saxpy (struct gpgpu_context *ctx, uint32_t n)
+{
+   const float a = 2.5f;
+   size_t size = n * sizeof (float);
+
+   float *x = malloc (size);
+   float *y = malloc (size);
+   float *result = malloc (size);
+   assert (x != NULL && y != NULL && result != NULL);
+
+   for (uint32_t i = 0; i < n; i++) {
+      x[i] = (float) i;
+      y[i] = (float) (n - i);
+   }
+
+   struct gpgpu_kernel kernel;
+   struct gpgpu_buffer x_buf;
+   struct gpgpu_buffer y_buf;
+   bool ok = gpgpu_kernel_init (&kernel, ctx, SAXPY_SRC)
+      && gpgpu_buffer_init (&x_buf, size, GL_STATIC_DRAW)
+      && gpgpu_buffer_init (&y_buf, size, GL_DYNAMIC_COPY);
+   assert (ok);
+
+   double start = gpgpu_now_ms ();
+
+   ok = gpgpu_buffer_upload (&x_buf, x, 0, size)
+      && gpgpu_buffer_upload (&y_buf, y, 0, size);
+
+   gpgpu_kernel_set_float (&kernel, "a", a);
+   gpgpu_kernel_bind_buffer (&kernel, 0, &x_buf);
+   gpgpu_kernel_bind_buffer (&kernel, 1, &y_buf);
+   ok = ok && gpgpu_kernel_dispatch (&kernel, n, 1, 1);
+
+   struct gpgpu_fence fence;
+   ok = ok && gpgpu_fence_init (&fence);
+   if (ok) {
+      gpgpu_fence_wait (&fence, GL_TIMEOUT_IGNORED);
+      gpgpu_fence_finish (&fence);
+   }
+
+   ok = ok && gpgpu_buffer_download (&y_buf, result, 0, size);
+
+   double elapsed = gpgpu_now_ms () - start;
+
+   uint32_t errors = 0;
+   for (uint32_t i = 0; ok && i < n; i++) {
+      float expected = a * x[i] + y[i];
+      if (fabsf (result[i] - expected) > 1e-5f * fabsf (expected)) {
+         if (errors++ == 0)
+            printf ("saxpy: y[%u] = %f, expected %f\n", i, result[i], expected);
+      }
+   }
+   ok = ok && errors == 0;
+
+   printf ("saxpy: %u elements in %.3f ms: %s\n",
+           n,
+           elapsed,
+           ok ? "OK" : "FAILED");
+
+   gpgpu_buffer_finish (&y_buf);
+   gpgpu_buffer_finish (&x_buf);
+   gpgpu_kernel_finish (&kernel);
+   free (result);
+   free (y);
+   free (x);
+
+   return ok;
+}
+
+static bool
+run_invert (struct gpgpu_context *ctx, uint32_t width, uint32_t height)
+{
+   size_t size = (size_t) width * height * 4;
+
+   uint32_t *pixels = malloc (size);
+   uint32_t *result = malloc (size);
+   assert (pixels != NULL && result != NULL);
+
+   for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width; x++) {
+         uint32_t r = x & 0xff;
+         uint32_t g = y & 0xff;
+         uint32_t b = (x ^ y) & 0xff;
+         pixels[y * width + x] = r | (g << 8) | (b << 16) | (0x80u << 24);
+      }
+   }
+
+   struct gpgpu_kernel kernel;
+   struct gpgpu_buffer buf;
+   bool ok = gpgpu_kernel_init (&kernel, ctx, INVERT_SRC)
+      && gpgpu_buffer_init (&buf, size, GL_DYNAMIC_COPY);
+   assert (ok);
+
+   double start = gpgpu_now_ms ();
+
+   ok = gpgpu_buffer_upload (&buf, pixels, 0, size);
+
+   gpgpu_kernel_bind_buffer (&kernel, 0, &buf);
+   ok = ok && gpgpu_kernel_dispatch (&kernel, width, height, 1);
+
+   /* mapping for reading waits for the kernel, no fence needed */
+   ok = ok && gpgpu_buffer_download (&buf, result, 0, size);
+
+   double elapsed = gpgpu_now_ms () - start;
+
+   for (uint32_t i = 0; ok && i < width * height; i++) {
+      uint32_t expected = pixels[i] ^ 0x00ffffffu;
+      if (result[i] != expected) {
+         printf ("invert: pixel %u = 0x%08x, expected 0x%08x\n",
+                 i,
+                 result[i],
+                 expected);
+         ok = false;
+      }
+   }
+
+   printf ("invert: %ux%u RGBA8 in %.3f ms: %s\n",
+           width,
+           height,
+           elapsed,
+           ok ? "OK" : "FAILED");
+
+   gpgpu_buffer_finish (&buf);
+   gpgpu_kernel_finish (&kernel);
+   free (result);
+   free (pixels);
+
+   return ok;
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   const char *device = NULL;
+   uint32_t n = 1000000;
+
+   for (int32_t i = 1; i < argc; i++) {
+      if (strcmp (argv[i], "-d") == 0 && i + 1 < argc) {
+         device = argv[++i];
+      } else if (strcmp (argv[i], "-n") == 0 && i + 1 < argc) {
+         n = strtoul (argv[++i], NULL, 10);
+      } else {
+         printf ("Usage: %s [-d /dev/dri/renderDN] [-n elements]\n",
+                 argv[0]);
+         return -1;
+      }
+   }
+
+   if (n == 0)
+      n = 1;
+
+   struct gpgpu_context ctx;
+   if (! gpgpu_context_init (&ctx, device))
+      return -1;
+
+   gpgpu_context_print_info (&ctx);
+
+   /* odd sizes, so that the last work groups are partial */
+   bool ok = run_saxpy (&ctx, n);
+   ok = run_invert (&ctx, 1021, 767) && ok;
+
+   gl_program_cache_print_stats (&ctx.program_cache);
+
+   gpgpu_context_finish (&ctx);
+
+   return ok ? 0 : -1;
+}
@@ -0,0 +1,215 @@
+/*
+ * Example:
+ *
+ * GPGPU scheduler: lists the compute devices of the machine with their
+ *                  capabilities, and spreads a batch of saxpy jobs across
+ *                  all of them, checking the results against the CPU.
+ *
+ * Usage: gpgpu-scheduler [-n elements] [-j elements per job]
+ *                        [-f jobs in flight per device]
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "devices.h"
+#include "gpgpu.h"
+#include "scheduler.h"
+
+static const char *SAXPY_SRC =
+   "#version 310 es\n"
+   "layout (local_size_x = 64) in;\n"
+   "layout (std430, binding = 0) readonly buffer X { float x[]; };\n"
+   "layout (std430, binding = 1) buffer Y { float y[]; };\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "uniform float a;\n"
+   "void main (void) {\n"
+   "   uint i = gl_GlobalInvocationID.x;\n"
+   "   if (i >= gpgpu_global_size.x)\n"
+   "      return;\n"
+   "   y[i] = a * x[i] + y[i];\n"
+   "}\n";
+
+#define SAXPY_A 2.5f
+
+/* one kernel per device, programs aren't shared across devices */
+static struct gpgpu_kernel kernels[GPGPU_MAX_DEVICES];
+
+struct saxpy_job {
+   const float *x;
+   float *y;
+   uint32_t n;
+
+   struct gpgpu_buffer x_buf;
+   struct gpgpu_buffer y_buf;
+   bool ok;
+};
+
+static bool
+saxpy_submit (struct gpgpu_context *ctx, uint32_t device, void *data)
+{
+   struct saxpy_job *job = data;
+   size_t size = job->n * sizeof (float);
+
+   if (! gpgpu_buffer_init (&job->x_buf, size, GL_STREAM_DRAW))
+      return false;
+   if (! gpgpu_buffer_init (&job->y_buf, size, GL_STREAM_COPY)) {
+      gpgpu_buffer_finish (&job->x_buf);
+      return false;
+   }
+
+   struct gpgpu_kernel *kernel = &kernels[device];
+   gpgpu_kernel_bind_buffer (kernel, 0, &job->x_buf);
+   gpgpu_kernel_bind_buffer (kernel, 1, &job->y_buf);
+
+   job->ok = gpgpu_buffer_upload (&job->x_buf, job->x, 0, size)
+      && gpgpu_buffer_upload (&job->y_buf, job->y, 0, size)
+      && gpgpu_kernel_dispatch (kernel, job->n, 1, 1);
+
+   return true;
+}
+
+static void
+saxpy_complete (struct gpgpu_context *ctx, uint32_t device, void *data)
+{
+   struct saxpy_job *job = data;
+
+   job->ok = job->ok
+      && gpgpu_buffer_download (&job->y_buf,
+                                job->y,
+                                0,
+                                job->n * sizeof (float));
+
+   gpgpu_buffer_finish (&job->y_buf);
+   gpgpu_buffer_finish (&job->x_buf);
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   uint32_t n = 1 << 22;
+   uint32_t job_size = 1 << 16;
+   uint32_t max_in_flight = 4;
+
+   for (int32_t i = 1; i < argc; i++) {
+      if (strcmp (argv[i], "-n") == 0 && i + 1 < argc) {
+         n = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-j") == 0 && i + 1 < argc) {
+         job_size = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-f") == 0 && i + 1 < argc) {
+         max_in_flight = strtoul (argv[++i], NULL, 10);
+      } else {
+         printf ("Usage: %s [-n elements] [-j elements per job] "
+                 "[-f jobs in flight per device]\n",
+                 argv[0]);
+         return -1;
+      }
+   }
+
+   if (n == 0 || job_size == 0
+       || max_in_flight == 0 || max_in_flight > GPGPU_SCHEDULER_MAX_IN_FLIGHT) {
+      printf ("Invalid arguments\n");
+      return -1;
+   }
+
+   /* discovery */
+   struct gpgpu_device devices[GPGPU_MAX_DEVICES];
+   uint32_t num_devices = gpgpu_devices_enumerate (devices,
+                                                   GPGPU_MAX_DEVICES);
+
+   struct gpgpu_device usable[GPGPU_MAX_DEVICES];
+   uint32_t num_usable = 0;
+
+   printf ("%u device(s):\n", num_devices);
+   for (uint32_t i = 0; i < num_devices; i++) {
+      struct gpgpu_device_info info;
+      if (gpgpu_device_probe (&devices[i], &info))
+         usable[num_usable++] = devices[i];
+      gpgpu_device_print_info (&info);
+   }
+   printf ("\n");
+
+   /* scheduling */
+   struct gpgpu_scheduler sched;
+   if (! gpgpu_scheduler_init (&sched, usable, num_usable, max_in_flight))
+      return -1;
+
+   for (uint32_t i = 0; i < sched.num_devices; i++) {
+      struct gpgpu_context *ctx = gpgpu_scheduler_make_current (&sched, i);
+      if (! gpgpu_kernel_init (&kernels[i], ctx, SAXPY_SRC))
+         return -1;
+      gpgpu_kernel_set_float (&kernels[i], "a", SAXPY_A);
+   }
+
+   float *x = malloc (n * sizeof (float));
+   float *y = malloc (n * sizeof (float));
+   assert (x != NULL && y != NULL);
+   for (uint32_t i = 0; i < n; i++) {
+      x[i] = (float) (i % 1000);
+      y[i] = (float) (i % 77);
+   }
+
+   uint32_t num_jobs = (n + job_size - 1) / job_size;
+   struct saxpy_job *jobs = calloc (num_jobs, sizeof (struct saxpy_job));
+   assert (jobs != NULL);
+
+   for (uint32_t i = 0; i < num_jobs; i++) {
+      struct saxpy_job *job = &jobs[i];
+      uint32_t offset = i * job_size;
+
+      job->x = x + offset;
+      job->y = y + offset;
+      job->n = n - offset < job_size ? n - offset : job_size;
+
+      struct gpgpu_job sched_job = {
+         .submit = saxpy_submit,
+         .complete = saxpy_complete,
+         .data = job,
+      };
+      if (gpgpu_scheduler_submit (&sched, &sched_job) < 0)
+         job->ok = false;
+   }
+
+   gpgpu_scheduler_wait_all (&sched);
+   gpgpu_scheduler_print_stats (&sched);
+
+   bool ok = true;
+   for (uint32_t i = 0; i < num_jobs; i++)
+      ok = ok && jobs[i].ok;
+
+   for (uint32_t i = 0; ok && i < n; i++) {
+      float expected = SAXPY_A * (float) (i % 1000) + (float) (i % 77);
+      if (fabsf (y[i] - expected) > 1e-3f) {
+         printf ("y[%u] = %f, expected %f\n", i, y[i], expected);
+         ok = false;
+      }
+   }
+
+   printf ("%u jobs of up to %u elements: %s\n",
+           num_jobs,
+           job_size,
+           ok ? "OK" : "FAILED");
+
+   for (uint32_t i = 0; i < sched.num_devices; i++) {
+      gpgpu_scheduler_make_current (&sched, i);
+      gpgpu_kernel_finish (&kernels[i]);
+   }
+   gpgpu_scheduler_finish (&sched);
+
+   free (jobs);
+   free (y);
+   free (x);
+
+   return ok ? 0 : -1;
+}
@@ -0,0 +1,259 @@
+/*
+ * GPGPU: multi-device job scheduling
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include "scheduler.h"
+#include <stdio.h>
+#include <string.h>
+
+/* weight of the latest job in the moving average of job times */
+#define JOB_TIME_WEIGHT 0.2
+
+static struct gpgpu_scheduler_device *
+make_current (struct gpgpu_scheduler *sched, uint32_t index)
+{
+   struct gpgpu_scheduler_device *dev = &sched->devices[index];
+
+   if (sched->current != (int32_t) index) {
+      if (! gpgpu_context_make_current (&dev->ctx))
+         printf ("Failed to make the context of %s current\n",
+                 dev->ctx.device.name);
+      sched->current = index;
+   }
+
+   return dev;
+}
+
+/* Completes the oldest job of device 'index' if it is done, or once it is
+ * if 'wait'. Returns false if there is none, or it's not done.
+ */
+static bool
+complete_oldest (struct gpgpu_scheduler *sched, uint32_t index, bool wait)
+{
+   struct gpgpu_scheduler_device *dev = &sched->devices[index];
+   if (dev->in_flight == 0)
+      return false;
+
+   struct gpgpu_scheduler_slot *slot = &dev->slots[dev->first];
+
+   make_current (sched, index);
+   if (! gpgpu_fence_wait (&slot->fence, wait ? GL_TIMEOUT_IGNORED : 0))
+      return false;
+
+   double now = gpgpu_now_ms ();
+
+   /* Jobs of a device run in order, so a job started running when the one
+    * before it completed, unless it was submitted later.
+    */
+   double start = slot->submit_ms > dev->last_complete_ms
+      ? slot->submit_ms
+      : dev->last_complete_ms;
+   double job_ms = now - start;
+
+   if (dev->job_ms == 0)
+      dev->job_ms = job_ms;
+   else
+      dev->job_ms += (job_ms - dev->job_ms) * JOB_TIME_WEIGHT;
+   dev->last_complete_ms = now;
+   dev->busy_ms += job_ms;
+   dev->jobs++;
+
+   gpgpu_fence_finish (&slot->fence);
+   if (slot->job.complete != NULL)
+      slot->job.complete (&dev->ctx, index, slot->job.data);
+
+   dev->first = (dev->first + 1) % GPGPU_SCHEDULER_MAX_IN_FLIGHT;
+   dev->in_flight--;
+
+   return true;
+}
+
+/* The device expected to complete one more job the soonest. */
+static uint32_t
+choose_device (struct gpgpu_scheduler *sched)
+{
+   uint32_t best = 0;
+   double best_ms = 0;
+
+   for (uint32_t i = 0; i < sched->num_devices; i++) {
+      struct gpgpu_scheduler_device *dev = &sched->devices[i];
+      double ms = (dev->in_flight + 1) * dev->job_ms;
+
+      if (i == 0
+          || ms < best_ms
+          || (ms == best_ms
+              && dev->in_flight < sched->devices[best].in_flight)) {
+         best = i;
+         best_ms = ms;
+      }
+   }
+
+   return best;
+}
+
+/* public API */
+
+bool
+gpgpu_scheduler_init (struct gpgpu_scheduler *sched,
+                      const struct gpgpu_device *devices,
+                      uint32_t num_devices,
+                      uint32_t max_in_flight)
+{
+   assert (sched != NULL);
+   assert (devices != NULL || num_devices == 0);
+   assert (max_in_flight > 0
+           && max_in_flight <= GPGPU_SCHEDULER_MAX_IN_FLIGHT);
+
+   memset (sched, 0x00, sizeof (struct gpgpu_scheduler));
+   sched->max_in_flight = max_in_flight;
+   sched->current = -1;
+
+   for (uint32_t i = 0; i < num_devices; i++) {
+      if (sched->num_devices >= GPGPU_MAX_DEVICES)
+         break;
+
+      struct gpgpu_scheduler_device *dev =
+         &sched->devices[sched->num_devices];
+      if (! gpgpu_context_init_device (&dev->ctx, &devices[i])) {
+         printf ("Skipping device %s\n", devices[i].name);
+         sched->current = -1;
+         continue;
+      }
+
+      sched->current = sched->num_devices;
+      sched->num_devices++;
+   }
+
+   sched->start_ms = gpgpu_now_ms ();
+
+   return sched->num_devices > 0;
+}
+
+void
+gpgpu_scheduler_finish (struct gpgpu_scheduler *sched)
+{
+   assert (sched != NULL);
+
+   gpgpu_scheduler_wait_all (sched);
+
+   for (uint32_t i = 0; i < sched->num_devices; i++)
+      gpgpu_context_finish (&sched->devices[i].ctx);
+
+   sched->num_devices = 0;
+   sched->current = -1;
+}
+
+struct gpgpu_context *
+gpgpu_scheduler_make_current (struct gpgpu_scheduler *sched, uint32_t device)
+{
+   assert (sched != NULL);
+   assert (device < sched->num_devices);
+
+   return &make_current (sched, device)->ctx;
+}
+
+int32_t
+gpgpu_scheduler_submit (struct gpgpu_scheduler *sched,
+                        const struct gpgpu_job *job)
+{
+   assert (sched != NULL);
+   assert (job != NULL && job->submit != NULL);
+
+   /* completions lower the estimates of the devices */
+   gpgpu_scheduler_poll (sched);
+
+   uint32_t index = choose_device (sched);
+   struct gpgpu_scheduler_device *dev = &sched->devices[index];
+
+   if (dev->in_flight >= sched->max_in_flight)
+      complete_oldest (sched, index, true);
+
+   make_current (sched, index);
+
+   struct gpgpu_scheduler_slot *slot =
+      &dev->slots[(dev->first + dev->in_flight)
+                  % GPGPU_SCHEDULER_MAX_IN_FLIGHT];
+   slot->job = *job;
+   slot->submit_ms = gpgpu_now_ms ();
+
+   if (! job->submit (&dev->ctx, index, job->data))
+      return -1;
+
+   /* without a fence, waiting for the job is all that's left */
+   if (! gpgpu_fence_init (&slot->fence)) {
+      gpgpu_context_wait_idle (&dev->ctx);
+      if (job->complete != NULL)
+         job->complete (&dev->ctx, index, job->data);
+      dev->jobs++;
+      return index;
+   }
+
+   dev->in_flight++;
+
+   return index;
+}
+
+uint32_t
+gpgpu_scheduler_poll (struct gpgpu_scheduler *sched)
+{
+   assert (sched != NULL);
+
+   uint32_t completed = 0;
+
+   for (uint32_t i = 0; i < sched->num_devices; i++) {
+      while (complete_oldest (sched, i, false))
+         completed++;
+   }
+
+   return completed;
+}
+
+void
+gpgpu_scheduler_wait_all (struct gpgpu_scheduler *sched)
+{
+   assert (sched != NULL);
+
+   for (uint32_t i = 0; i < sched->num_devices; i++) {
+      while (complete_oldest (sched, i, true))
+         ;
+   }
+}
+
+void
+gpgpu_scheduler_print_stats (struct gpgpu_scheduler *sched)
+{
+   assert (sched != NULL);
+
+   double elapsed = gpgpu_now_ms () - sched->start_ms;
+   uint64_t total = 0;
+   for (uint32_t i = 0; i < sched->num_devices; i++)
+      total += sched->devices[i].jobs;
+
+   printf ("Scheduler: %llu jobs in %.1f ms on %u device(s)\n",
+           (unsigned long long) total,
+           elapsed,
+           sched->num_devices);
+
+   for (uint32_t i = 0; i < sched->num_devices; i++) {
+      struct gpgpu_scheduler_device *dev = &sched->devices[i];
+
+      printf ("  %-20s %6llu jobs (%5.1f%%), %.3f ms per job, "
+              "busy %5.1f%%\n",
+              dev->ctx.device.name,
+              (unsigned long long) dev->jobs,
+              total > 0 ? 100.0 * dev->jobs / total : 0.0,
+              dev->job_ms,
+              elapsed > 0 ? 100.0 * dev->busy_ms / elapsed : 0.0);
+   }
+}
@@ -0,0 +1,109 @@
+/*
+ * GPGPU: multi-device job scheduling
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "devices.h"
+#include "gpgpu.h"
+
+/* Spreads jobs across the contexts of several devices, from one thread.
+ *
+ * Each job goes to the device expected to finish it first: the one with
+ * the fewest jobs in flight, weighted by how long its recent jobs took.
+ * Devices nothing is known about yet get jobs first, so every device gets
+ * measured. A fence after each job tells when it completed; up to
+ * 'max_in_flight' jobs are queued per device before submitting waits.
+ */
+
+#define GPGPU_SCHEDULER_MAX_IN_FLIGHT 16
+
+struct gpgpu_job {
+   /* Records the job's GL commands (uploads, dispatches), with the context
+    * of device number 'device' current. Returns false on failure.
+    */
+   bool (*submit) (struct gpgpu_context *ctx, uint32_t device, void *data);
+
+   /* Called once the commands of submit() have completed, with the same
+    * context current, e.g. to read results back. Can be NULL.
+    */
+   void (*complete) (struct gpgpu_context *ctx, uint32_t device, void *data);
+
+   void *data;
+};
+
+struct gpgpu_scheduler_slot {
+   struct gpgpu_job job;
+   struct gpgpu_fence fence;
+   double submit_ms;
+};
+
+struct gpgpu_scheduler_device {
+   struct gpgpu_context ctx;
+
+   /* ring of jobs in flight, oldest first */
+   struct gpgpu_scheduler_slot slots[GPGPU_SCHEDULER_MAX_IN_FLIGHT];
+   uint32_t first;
+   uint32_t in_flight;
+
+   /* moving average of the time a job takes, 0 until one completed */
+   double job_ms;
+   double last_complete_ms;
+
+   /* statistics */
+   uint64_t jobs;
+   double busy_ms;
+};
+
+struct gpgpu_scheduler {
+   struct gpgpu_scheduler_device devices[GPGPU_MAX_DEVICES];
+   uint32_t num_devices;
+   uint32_t max_in_flight;
+
+   /* the device whose context is current, -1 if none */
+   int32_t current;
+   double start_ms;
+};
+
+/* Creates a context on each of the 'num_devices' devices, skipping those
+ * that fail. Returns false if none could be used.
+ */
+bool     gpgpu_scheduler_init         (struct gpgpu_scheduler *sched,
+                                       const struct gpgpu_device *devices,
+                                       uint32_t num_devices,
+                                       uint32_t max_in_flight);
+
+/* Waits for all jobs, and destroys the contexts. */
+void     gpgpu_scheduler_finish       (struct gpgpu_scheduler *sched);
+
+/* Makes the context of device number 'device' current and returns it, e.g.
+ * to build the kernels its jobs use.
+ */
+struct gpgpu_context *
+         gpgpu_scheduler_make_current (struct gpgpu_scheduler *sched,
+                                       uint32_t device);
+
+/* Submits 'job' to a device; waits for a job to complete first if all the
+ * device's slots are taken. Returns the device number, or -1 if the job's
+ * submit() failed.
+ */
+int32_t  gpgpu_scheduler_submit       (struct gpgpu_scheduler *sched,
+                                       const struct gpgpu_job *job);
+
+/* Completes the jobs that are done without waiting, and returns how many. */
+uint32_t gpgpu_scheduler_poll         (struct gpgpu_scheduler *sched);
+
+void     gpgpu_scheduler_wait_all     (struct gpgpu_scheduler *sched);
+
+void     gpgpu_scheduler_print_stats  (struct gpgpu_scheduler *sched);
@@ -0,0 +1,231 @@
+/*
+ * Example:
+ *
+ * GPGPU image statistics: histograms, minimum, maximum, mean and average
+ *                         log-luminance of an image uploaded to a texture,
+ *                         as for display, computed on the GPU and checked
+ *                         against the CPU.
+ *
+ * Usage: gpgpu-stats [-w width] [-h height] [-i iterations]
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpgpu.h"
+#include "image.h"
+#include "stats.h"
+
+/* A gradient with noise, leaving some bins of each channel empty. */
+static void
+fill_pixels (uint8_t *pixels, uint32_t width, uint32_t height)
+{
+   srand (42);
+   for (uint32_t y = 0; y < height; y++) {
+      for (uint32_t x = 0; x < width; x++) {
+         uint8_t *p = pixels + ((size_t) y * width + x) * 4;
+         p[0] = 16 + (uint32_t) x * 200 / width + (rand () & 15);
+         p[1] = 32 + (uint32_t) y * 160 / height + (rand () & 31);
+         p[2] = rand () & 0xff;
+         p[3] = 255 - (rand () & 3);
+      }
+   }
+}
+
+static float
+to_linear (float c)
+{
+   return c > 0.04045f ? powf ((c + 0.055f) / 1.055f, 2.4f) : c / 12.92f;
+}
+
+static void
+cpu_stats (const uint8_t *pixels,
+           uint32_t width,
+           uint32_t height,
+           struct gpgpu_image_stats *stats)
+{
+   uint64_t sums[4] = { 0 };
+   double log_sum = 0.0;
+   size_t n = (size_t) width * height;
+
+   memset (stats, 0x00, sizeof (struct gpgpu_image_stats));
+   for (uint32_t c = 0; c < 4; c++)
+      stats->min[c] = 255;
+
+   for (size_t i = 0; i < n; i++) {
+      const uint8_t *p = pixels + i * 4;
+
+      for (uint32_t c = 0; c < 4; c++) {
+         stats->histogram[c][p[c]]++;
+         stats->min[c] = p[c] < stats->min[c] ? p[c] : stats->min[c];
+         stats->max[c] = p[c] > stats->max[c] ? p[c] : stats->max[c];
+         sums[c] += p[c];
+      }
+
+      float y = 0.2126f * to_linear (p[0] / 255.0f)
+         + 0.7152f * to_linear (p[1] / 255.0f)
+         + 0.0722f * to_linear (p[2] / 255.0f);
+      log_sum += log (0.0001 + y);
+   }
+
+   for (uint32_t c = 0; c < 4; c++)
+      stats->mean[c] = (double) sums[c] / n;
+   stats->log_luminance = exp (log_sum / n);
+}
+
+/* Histograms, minimums and maximums are exact, means and log-luminances
+ * are sums of floats on the GPU.
+ */
+static bool
+compare (const struct gpgpu_image_stats *a,
+         const struct gpgpu_image_stats *b)
+{
+   bool ok = true;
+
+   for (uint32_t c = 0; c < 4; c++) {
+      for (uint32_t i = 0; i < GPGPU_STATS_BINS; i++) {
+         if (a->histogram[c][i] != b->histogram[c][i]) {
+            printf ("channel %u, bin %u: %u, expected %u\n",
+                    c, i, a->histogram[c][i], b->histogram[c][i]);
+            ok = false;
+            break;
+         }
+      }
+      if (a->min[c] != b->min[c] || a->max[c] != b->max[c]) {
+         printf ("channel %u: min %u max %u, expected min %u max %u\n",
+                 c, a->min[c], a->max[c], b->min[c], b->max[c]);
+         ok = false;
+      }
+      if (fabsf (a->mean[c] - b->mean[c]) > 0.01f) {
+         printf ("channel %u: mean %f, expected %f\n",
+                 c, a->mean[c], b->mean[c]);
+         ok = false;
+      }
+   }
+
+   if (fabsf (a->log_luminance - b->log_luminance)
+       > 0.001f * b->log_luminance) {
+      printf ("log-luminance %f, expected %f\n",
+              a->log_luminance, b->log_luminance);
+      ok = false;
+   }
+
+   return ok;
+}
+
+static void
+print_stats (const struct gpgpu_image_stats *stats)
+{
+   static const char *channels = "RGBA";
+
+   printf ("%-8s %6s %6s %8s   %s\n",
+           "channel", "min", "max", "mean", "most frequent bin");
+   for (uint32_t c = 0; c < 4; c++) {
+      uint32_t mode = 0;
+      for (uint32_t i = 1; i < GPGPU_STATS_BINS; i++) {
+         if (stats->histogram[c][i] > stats->histogram[c][mode])
+            mode = i;
+      }
+      printf ("%-8c %6u %6u %8.2f   %u (%u texels)\n",
+              channels[c],
+              stats->min[c],
+              stats->max[c],
+              stats->mean[c],
+              mode,
+              stats->histogram[c][mode]);
+   }
+   printf ("average log-luminance: %.4f\n", stats->log_luminance);
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   uint32_t width = 1920;
+   uint32_t height = 1080;
+   uint32_t iterations = 10;
+
+   for (int32_t i = 1; i < argc; i++) {
+      if (strcmp (argv[i], "-w") == 0 && i + 1 < argc) {
+         width = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-h") == 0 && i + 1 < argc) {
+         height = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-i") == 0 && i + 1 < argc) {
+         iterations = strtoul (argv[++i], NULL, 10);
+      } else {
+         printf ("Usage: %s [-w width] [-h height] [-i iterations]\n",
+                 argv[0]);
+         return -1;
+      }
+   }
+
+   if (width == 0 || height == 0 || iterations == 0) {
+      printf ("Invalid arguments\n");
+      return -1;
+   }
+
+   struct gpgpu_context ctx;
+   if (! gpgpu_context_init (&ctx, NULL))
+      return -1;
+
+   gpgpu_context_print_info (&ctx);
+   printf ("\n");
+
+   uint8_t *pixels = malloc ((size_t) width * height * 4);
+   assert (pixels != NULL);
+   fill_pixels (pixels, width, height);
+
+   /* what the display path would have done already */
+   struct gpgpu_image image;
+   struct gpgpu_stats stats;
+   if (! gpgpu_image_init (&image, &ctx, width, height)
+       || ! gpgpu_image_upload (&image, pixels, width * 4)
+       || ! gpgpu_stats_init (&stats, &ctx)) {
+      return -1;
+   }
+
+   struct gpgpu_image_stats expected;
+   double start = gpgpu_now_ms ();
+   cpu_stats (pixels, width, height, &expected);
+   double cpu_ms = gpgpu_now_ms () - start;
+
+   struct gpgpu_image_stats result;
+   bool ok = gpgpu_stats_compute (&stats,
+                                  image.texture,
+                                  width,
+                                  height,
+                                  &result)
+      && compare (&result, &expected);
+
+   double gpu_ms = 0.0;
+   if (ok) {
+      start = gpgpu_now_ms ();
+      for (uint32_t i = 0; i < iterations; i++)
+         gpgpu_stats_compute (&stats, image.texture, width, height, &result);
+      gpu_ms = (gpgpu_now_ms () - start) / iterations;
+   }
+
+   print_stats (&result);
+   printf ("\n%ux%u: GPU %.3f ms, CPU %.3f ms, %zu bytes read back\n",
+           width, height, gpu_ms, cpu_ms, sizeof (result));
+   printf ("\nResults: %s\n", ok ? "OK" : "FAILED");
+
+   gpgpu_stats_finish (&stats);
+   gpgpu_image_finish (&image);
+   free (pixels);
+   gpgpu_context_finish (&ctx);
+
+   return ok ? 0 : -1;
+}
@@ -0,0 +1,274 @@
+/*
+ * GPGPU: image statistics
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#include <assert.h>
+#include "stats.h"
+#include <stdio.h>
+#include <string.h>
+
+/* 128 invocations, the least GLES 3.1 guarantees, each reading TILE^2 / 128
+ * texels of the work group's tile
+ */
+#define WG_X 16
+#define WG_Y 8
+#define TILE 64
+
+/* One per tile. std430 rounds the struct up to 64 bytes. */
+#define PARTIAL_SIZE 64
+
+/* Shared by both kernels. The Result block is struct gpgpu_image_stats. */
+#define KERNEL_HEADER                                                   \
+   "#version 310 es\n"                                                  \
+   "#define BINS 256u\n"                                                \
+   "#define SYNC() memoryBarrierShared (); barrier ()\n"                \
+   "struct Partial {\n"                                                 \
+   "   uvec4 min_value;\n"                                              \
+   "   uvec4 max_value;\n"                                              \
+   "   uvec4 sum;\n"                                                    \
+   "   float log_sum;\n"                                                \
+   "};\n"                                                               \
+   "layout (std430, binding = 1) buffer Result {\n"                     \
+   "   uint histogram[4u * BINS];\n"                                    \
+   "   uvec4 min_value;\n"                                              \
+   "   uvec4 max_value;\n"                                              \
+   "   vec4 mean;\n"                                                    \
+   "   float log_luminance;\n"                                          \
+   "};\n"
+
+static const char *TILES_SRC =
+   KERNEL_HEADER
+   "layout (local_size_x = 16, local_size_y = 8) in;\n"
+   "#define WG 128u\n"
+   "#define TILE 64\n"
+   /* log (0) is -inf: the usual offset of Reinhard's operator */
+   "#define DELTA 0.0001\n"
+   "layout (std430, binding = 0) writeonly buffer Partials {\n"
+   "   Partial partials[];\n"
+   "};\n"
+   "layout (binding = 0) uniform highp sampler2D image;\n"
+   "uniform uint width;\n"
+   "uniform uint height;\n"
+   "shared uint s_bins[4u * BINS];\n"
+   "shared uint s_min[4];\n"
+   "shared uint s_max[4];\n"
+   "shared uint s_sum[4];\n"
+   "shared float s_log[WG];\n"
+   "float luminance (vec3 c) {\n"
+   "   bvec3 high = greaterThan (c, vec3 (0.04045));\n"
+   "   c = mix (c / 12.92, pow ((c + 0.055) / 1.055, vec3 (2.4)), high);\n"
+   "   return dot (c, vec3 (0.2126, 0.7152, 0.0722));\n"
+   "}\n"
+   "void main (void) {\n"
+   "   uint lid = gl_LocalInvocationIndex;\n"
+   "   for (uint i = lid; i < 4u * BINS; i += WG)\n"
+   "      s_bins[i] = 0u;\n"
+   "   if (lid < 4u) {\n"
+   "      s_min[lid] = 255u;\n"
+   "      s_max[lid] = 0u;\n"
+   "      s_sum[lid] = 0u;\n"
+   "   }\n"
+   "   SYNC ();\n"
+   "\n"
+   "   ivec2 origin = ivec2 (gl_WorkGroupID.xy) * TILE;\n"
+   "   ivec2 size = ivec2 (width, height);\n"
+   "   uvec4 lo = uvec4 (255u);\n"
+   "   uvec4 hi = uvec4 (0u);\n"
+   "   uvec4 sum = uvec4 (0u);\n"
+   "   float log_sum = 0.0;\n"
+   "   for (int y = int (gl_LocalInvocationID.y); y < TILE; y += 8) {\n"
+   "      for (int x = int (gl_LocalInvocationID.x); x < TILE; x += 16) {\n"
+   "         ivec2 p = origin + ivec2 (x, y);\n"
+   "         if (any (greaterThanEqual (p, size)))\n"
+   "            continue;\n"
+   "         vec4 texel = clamp (texelFetch (image, p, 0), 0.0, 1.0);\n"
+   "         uvec4 v = uvec4 (round (texel * 255.0));\n"
+   "         atomicAdd (s_bins[v.r], 1u);\n"
+   "         atomicAdd (s_bins[BINS + v.g], 1u);\n"
+   "         atomicAdd (s_bins[2u * BINS + v.b], 1u);\n"
+   "         atomicAdd (s_bins[3u * BINS + v.a], 1u);\n"
+   "         lo = min (lo, v);\n"
+   "         hi = max (hi, v);\n"
+   "         sum += v;\n"
+   "         log_sum += log (DELTA + luminance (texel.rgb));\n"
+   "      }\n"
+   "   }\n"
+   "   for (int c = 0; c < 4; c++) {\n"
+   "      atomicMin (s_min[c], lo[c]);\n"
+   "      atomicMax (s_max[c], hi[c]);\n"
+   "      atomicAdd (s_sum[c], sum[c]);\n"
+   "   }\n"
+   "   s_log[lid] = log_sum;\n"
+   "   for (uint s = WG >> 1; s > 0u; s >>= 1) {\n"
+   "      SYNC ();\n"
+   "      if (lid < s)\n"
+   "         s_log[lid] += s_log[lid + s];\n"
+   "   }\n"
+   "   SYNC ();\n"
+   "\n"
+   /* most bins of a tile are empty, or the same for most tiles */
+   "   for (uint i = lid; i < 4u * BINS; i += WG) {\n"
+   "      if (s_bins[i] != 0u)\n"
+   "         atomicAdd (histogram[i], s_bins[i]);\n"
+   "   }\n"
+   "   if (lid == 0u) {\n"
+   "      uint g = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;\n"
+   "      partials[g].min_value = uvec4 (s_min[0], s_min[1], s_min[2],\n"
+   "                                     s_min[3]);\n"
+   "      partials[g].max_value = uvec4 (s_max[0], s_max[1], s_max[2],\n"
+   "                                     s_max[3]);\n"
+   "      partials[g].sum = uvec4 (s_sum[0], s_sum[1], s_sum[2], s_sum[3]);\n"
+   "      partials[g].log_sum = s_log[0];\n"
+   "   }\n"
+   "}\n";
+
+/* A single work group: the partials are few, one per 4096 texels */
+static const char *REDUCE_SRC =
+   KERNEL_HEADER
+   "layout (local_size_x = 128) in;\n"
+   "#define WG 128u\n"
+   "layout (std430, binding = 0) readonly buffer Partials {\n"
+   "   Partial partials[];\n"
+   "};\n"
+   "uniform uint num_partials;\n"
+   "uniform uint num_texels;\n"
+   "shared uvec4 s_min[WG];\n"
+   "shared uvec4 s_max[WG];\n"
+   "shared vec4 s_sum[WG];\n"
+   "shared float s_log[WG];\n"
+   "void main (void) {\n"
+   "   uint lid = gl_LocalInvocationID.x;\n"
+   "   uvec4 lo = uvec4 (255u);\n"
+   "   uvec4 hi = uvec4 (0u);\n"
+   "   vec4 sum = vec4 (0.0);\n"
+   "   float log_sum = 0.0;\n"
+   "   for (uint i = lid; i < num_partials; i += WG) {\n"
+   "      lo = min (lo, partials[i].min_value);\n"
+   "      hi = max (hi, partials[i].max_value);\n"
+   "      sum += vec4 (partials[i].sum);\n"
+   "      log_sum += partials[i].log_sum;\n"
+   "   }\n"
+   "   s_min[lid] = lo;\n"
+   "   s_max[lid] = hi;\n"
+   "   s_sum[lid] = sum;\n"
+   "   s_log[lid] = log_sum;\n"
+   "   for (uint s = WG >> 1; s > 0u; s >>= 1) {\n"
+   "      SYNC ();\n"
+   "      if (lid < s) {\n"
+   "         s_min[lid] = min (s_min[lid], s_min[lid + s]);\n"
+   "         s_max[lid] = max (s_max[lid], s_max[lid + s]);\n"
+   "         s_sum[lid] += s_sum[lid + s];\n"
+   "         s_log[lid] += s_log[lid + s];\n"
+   "      }\n"
+   "   }\n"
+   "   SYNC ();\n"
+   "   if (lid == 0u) {\n"
+   "      float n = float (num_texels);\n"
+   "      min_value = s_min[0];\n"
+   "      max_value = s_max[0];\n"
+   "      mean = s_sum[0] / n;\n"
+   "      log_luminance = exp (s_log[0] / n);\n"
+   "   }\n"
+   "}\n";
+
+static const uint32_t zero_histogram[4 * GPGPU_STATS_BINS];
+
+static uint32_t
+div_round_up (uint32_t a, uint32_t b)
+{
+   return (uint32_t) (((uint64_t) a + b - 1) / b);
+}
+
+/* public API */
+
+bool
+gpgpu_stats_init (struct gpgpu_stats *stats, struct gpgpu_context *ctx)
+{
+   assert (stats != NULL);
+   assert (ctx != NULL);
+
+   memset (stats, 0x00, sizeof (struct gpgpu_stats));
+   stats->ctx = ctx;
+
+   bool ok = gpgpu_kernel_init (&stats->tiles, ctx, TILES_SRC)
+      && gpgpu_kernel_init (&stats->reduce, ctx, REDUCE_SRC)
+      && gpgpu_buffer_init (&stats->result,
+                            sizeof (struct gpgpu_image_stats),
+                            GL_DYNAMIC_READ);
+   if (! ok) {
+      gpgpu_stats_finish (stats);
+      return false;
+   }
+
+   return true;
+}
+
+void
+gpgpu_stats_finish (struct gpgpu_stats *stats)
+{
+   assert (stats != NULL);
+
+   gpgpu_kernel_finish (&stats->tiles);
+   gpgpu_kernel_finish (&stats->reduce);
+   gpgpu_buffer_finish (&stats->partials);
+   gpgpu_buffer_finish (&stats->result);
+}
+
+bool
+gpgpu_stats_compute (struct gpgpu_stats *stats,
+                     GLuint texture,
+                     uint32_t width,
+                     uint32_t height,
+                     struct gpgpu_image_stats *result)
+{
+   assert (stats != NULL);
+   assert (texture != 0);
+   assert (width > 0 && height > 0);
+   assert (result != NULL);
+
+   uint32_t tiles_x = div_round_up (width, TILE);
+   uint32_t tiles_y = div_round_up (height, TILE);
+   uint32_t num_partials = tiles_x * tiles_y;
+   size_t size = (size_t) num_partials * PARTIAL_SIZE;
+
+   if (stats->partials.size < size) {
+      gpgpu_buffer_finish (&stats->partials);
+      if (! gpgpu_buffer_init (&stats->partials, size, GL_DYNAMIC_COPY))
+         return false;
+   }
+
+   if (! gpgpu_buffer_upload (&stats->result,
+                              zero_histogram,
+                              0,
+                              sizeof (zero_histogram))) {
+      return false;
+   }
+
+   struct gpgpu_kernel *kernel = &stats->tiles;
+   gpgpu_kernel_set_uint (kernel, "width", width);
+   gpgpu_kernel_set_uint (kernel, "height", height);
+   gpgpu_kernel_bind_texture (kernel, 0, texture);
+   gpgpu_kernel_bind_buffer (kernel, 0, &stats->partials);
+   gpgpu_kernel_bind_buffer (kernel, 1, &stats->result);
+   if (! gpgpu_kernel_dispatch (kernel, tiles_x * WG_X, tiles_y * WG_Y, 1))
+      return false;
+
+   kernel = &stats->reduce;
+   gpgpu_kernel_set_uint (kernel, "num_partials", num_partials);
+   gpgpu_kernel_set_uint (kernel, "num_texels", width * height);
+   if (! gpgpu_kernel_dispatch (kernel, 1, 1, 1))
+      return false;
+
+   return gpgpu_buffer_download (&stats->result,
+                                 result,
+                                 0,
+                                 sizeof (struct gpgpu_image_stats));
+}
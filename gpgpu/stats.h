@@ -0,0 +1,73 @@
+/*
+ * GPGPU: image statistics
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gpgpu.h"
+
+/* Per-channel histograms, minimum, maximum and mean, and the average
+ * log-luminance of a texture, e.g. the one an image was uploaded to for
+ * display, or that of a gpgpu_image.
+ *
+ * A first kernel reads each texel once: each work group counts a tile of
+ * the texture in shared-memory bins, which it then adds to the global
+ * histograms with atomics, and writes its minimum, maximum and sums as a
+ * partial. A second kernel, of a single work group, reduces the partials.
+ * Only the statistics are read back, not the pixels.
+ */
+
+#define GPGPU_STATS_BINS 256
+
+/* As the kernels write them, see the 'Result' block of stats.c. Channels
+ * are R, G, B and A, values 0 to 255.
+ */
+struct gpgpu_image_stats {
+   uint32_t histogram[4][GPGPU_STATS_BINS];
+   uint32_t min[4];
+   uint32_t max[4];
+   float mean[4];
+
+   /* exp (mean (log (delta + Y))) of the linear luminances Y (0 to 1) of
+    * the sRGB-encoded texels, the key of the image for tone mapping
+    */
+   float log_luminance;
+   uint32_t padding[3];
+};
+
+struct gpgpu_stats {
+   struct gpgpu_context *ctx;
+
+   struct gpgpu_kernel tiles;
+   struct gpgpu_kernel reduce;
+
+   struct gpgpu_buffer partials;
+   struct gpgpu_buffer result;
+};
+
+bool     gpgpu_stats_init    (struct gpgpu_stats *stats,
+                              struct gpgpu_context *ctx);
+
+void     gpgpu_stats_finish  (struct gpgpu_stats *stats);
+
+/* Computes the statistics of level 0 of 2D texture 'texture' of 'ctx',
+ * 'width' x 'height' texels, into 'result'. The texture must be complete,
+ * e.g. immutable or without mipmap filtering, and normalized: texels are
+ * read with texelFetch() and rounded to 0 to 255.
+ */
+bool     gpgpu_stats_compute (struct gpgpu_stats *stats,
+                              GLuint texture,
+                              uint32_t width,
+                              uint32_t height,
+                              struct gpgpu_image_stats *result);
@@ -0,0 +1,255 @@
+/*
+ * Example:
+ *
+ * GPGPU tuner: picks the local size of a 1D and a 2D kernel by timing
+ *              them, and compares the result with fixed sizes. The second
+ *              run finds the sizes in the tuning file, and skips the
+ *              search.
+ *
+ * Usage: gpgpu-tuner [-f tuning file] [-n elements]
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpgpu.h"
+#include "tuner.h"
+
+static const char *SAXPY_SRC =
+   "#version 310 es\n"
+   "layout (local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y) in;\n"
+   "layout (std430, binding = 0) readonly buffer X { float x[]; };\n"
+   "layout (std430, binding = 1) buffer Y { float y[]; };\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "uniform float a;\n"
+   "void main (void) {\n"
+   "   uint i = gl_GlobalInvocationID.x;\n"
+   "   if (i >= gpgpu_global_size.x)\n"
+   "      return;\n"
+   "   y[i] = a * x[i] + y[i];\n"
+   "}\n";
+
+/* out = in transposed, 'width' x 'height' floats */
+static const char *TRANSPOSE_SRC =
+   "#version 310 es\n"
+   "layout (local_size_x = LOCAL_SIZE_X, local_size_y = LOCAL_SIZE_Y) in;\n"
+   "layout (std430, binding = 0) readonly buffer In { float src[]; };\n"
+   "layout (std430, binding = 1) writeonly buffer Out { float dst[]; };\n"
+   "uniform uvec3 gpgpu_global_size;\n"
+   "void main (void) {\n"
+   "   uvec2 p = gl_GlobalInvocationID.xy;\n"
+   "   uvec2 size = gpgpu_global_size.xy;\n"
+   "   if (any (greaterThanEqual (p, size)))\n"
+   "      return;\n"
+   "   dst[p.x * size.y + p.y] = src[p.y * size.x + p.x];\n"
+   "}\n";
+
+struct problem {
+   struct gpgpu_buffer in;
+   struct gpgpu_buffer out;
+   uint32_t width;
+   uint32_t height;
+};
+
+static bool
+run_saxpy (struct gpgpu_kernel *kernel, void *data)
+{
+   struct problem *problem = data;
+
+   gpgpu_kernel_set_float (kernel, "a", 2.0f);
+   gpgpu_kernel_bind_buffer (kernel, 0, &problem->in);
+   gpgpu_kernel_bind_buffer (kernel, 1, &problem->out);
+
+   return gpgpu_kernel_dispatch (kernel, problem->width, 1, 1);
+}
+
+static bool
+run_transpose (struct gpgpu_kernel *kernel, void *data)
+{
+   struct problem *problem = data;
+
+   gpgpu_kernel_bind_buffer (kernel, 0, &problem->in);
+   gpgpu_kernel_bind_buffer (kernel, 1, &problem->out);
+
+   return gpgpu_kernel_dispatch (kernel, problem->width, problem->height, 1);
+}
+
+/* Returns the average time of a run, or a negative value if the kernel
+ * can't run, e.g. takes too many work groups.
+ */
+static double
+time_kernel (struct gpgpu_context *ctx,
+             struct gpgpu_kernel *kernel,
+             GpgpuTunerRunFunc run,
+             struct problem *problem)
+{
+   const uint32_t runs = 5;
+
+   if (! run (kernel, problem))
+      return -1.0;
+   gpgpu_context_wait_idle (ctx);
+
+   double start = gpgpu_now_ms ();
+   for (uint32_t i = 0; i < runs; i++)
+      run (kernel, problem);
+   gpgpu_context_wait_idle (ctx);
+
+   return (gpgpu_now_ms () - start) / runs;
+}
+
+/* Times the kernel with a fixed local size, as a reference. */
+static void
+print_fixed (struct gpgpu_context *ctx,
+             const char *source,
+             uint32_t x,
+             uint32_t y,
+             GpgpuTunerRunFunc run,
+             struct problem *problem)
+{
+   /* e.g. 1 x 1 groups on drivers limited to 65535 of them */
+   if ((problem->width + x - 1) / x > (uint32_t) ctx->max_work_group_count[0]
+       || (problem->height + y - 1) / y
+          > (uint32_t) ctx->max_work_group_count[1]) {
+      printf ("  %4u x %-4u %13s\n", x, y, "too many groups");
+      return;
+   }
+
+   char defines[64];
+   snprintf (defines, sizeof (defines),
+             "#define LOCAL_SIZE_X %u\n#define LOCAL_SIZE_Y %u\n", x, y);
+
+   struct gpgpu_kernel kernel;
+   if (! gpgpu_kernel_init_with_defines (&kernel, ctx, source, defines))
+      return;
+
+   double ms = time_kernel (ctx, &kernel, run, problem);
+   if (ms < 0)
+      printf ("  %4u x %-4u %13s\n", x, y, "can't run");
+   else
+      printf ("  %4u x %-4u %10.3f ms\n", x, y, ms);
+   gpgpu_kernel_finish (&kernel);
+}
+
+static void
+print_tuned (struct gpgpu_context *ctx,
+             struct gpgpu_kernel *kernel,
+             GpgpuTunerRunFunc run,
+             struct problem *problem)
+{
+   printf ("  %4d x %-4d %10.3f ms (tuned)\n",
+           kernel->local_size[0],
+           kernel->local_size[1],
+           time_kernel (ctx, kernel, run, problem));
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   const char *filename = NULL;
+   uint32_t n = 1 << 22;
+
+   for (int32_t i = 1; i < argc; i++) {
+      if (strcmp (argv[i], "-f") == 0 && i + 1 < argc) {
+         filename = argv[++i];
+      } else if (strcmp (argv[i], "-n") == 0 && i + 1 < argc) {
+         n = strtoul (argv[++i], NULL, 10);
+      } else {
+         printf ("Usage: %s [-f tuning file] [-n elements]\n", argv[0]);
+         return -1;
+      }
+   }
+
+   if (n == 0) {
+      printf ("Invalid arguments\n");
+      return -1;
+   }
+
+   struct gpgpu_context ctx;
+   if (! gpgpu_context_init (&ctx, NULL))
+      return -1;
+
+   gpgpu_context_print_info (&ctx);
+   printf ("\n");
+
+   struct gpgpu_tuner tuner;
+   gpgpu_tuner_init (&tuner, &ctx, filename);
+
+   /* a square-ish matrix for the transpose */
+   uint32_t side = (uint32_t) sqrt ((double) n);
+   struct problem problem = {
+      .width = n,
+      .height = 1,
+   };
+   if (! gpgpu_buffer_init (&problem.in, n * sizeof (float), GL_STATIC_DRAW)
+       || ! gpgpu_buffer_init (&problem.out,
+                               n * sizeof (float),
+                               GL_DYNAMIC_COPY)) {
+      return -1;
+   }
+
+   struct gpgpu_kernel saxpy;
+   struct gpgpu_kernel transpose;
+   bool ok = gpgpu_tuner_build_kernel (&tuner,
+                                       &saxpy,
+                                       "saxpy",
+                                       SAXPY_SRC,
+                                       NULL,
+                                       1,
+                                       n,
+                                       1,
+                                       run_saxpy,
+                                       &problem);
+
+   problem.width = side;
+   problem.height = side;
+   ok = ok && gpgpu_tuner_build_kernel (&tuner,
+                                        &transpose,
+                                        "transpose",
+                                        TRANSPOSE_SRC,
+                                        NULL,
+                                        2,
+                                        side,
+                                        side,
+                                        run_transpose,
+                                        &problem);
+   if (! ok)
+      return -1;
+
+   printf ("\nsaxpy, %u elements:\n", n);
+   problem.width = n;
+   problem.height = 1;
+   print_fixed (&ctx, SAXPY_SRC, 1, 1, run_saxpy, &problem);
+   print_fixed (&ctx, SAXPY_SRC, 64, 1, run_saxpy, &problem);
+   print_tuned (&ctx, &saxpy, run_saxpy, &problem);
+
+   printf ("\ntranspose, %u x %u:\n", side, side);
+   problem.width = side;
+   problem.height = side;
+   print_fixed (&ctx, TRANSPOSE_SRC, 1, 1, run_transpose, &problem);
+   print_fixed (&ctx, TRANSPOSE_SRC, 8, 8, run_transpose, &problem);
+   print_tuned (&ctx, &transpose, run_transpose, &problem);
+
+   printf ("\n");
+   gpgpu_tuner_print_stats (&tuner);
+
+   gpgpu_kernel_finish (&transpose);
+   gpgpu_kernel_finish (&saxpy);
+   gpgpu_buffer_finish (&problem.out);
+   gpgpu_buffer_finish (&problem.in);
+   gpgpu_tuner_finish (&tuner);
+   gpgpu_context_finish (&ctx);
+
+   return 0;
+}
@@ -0,0 +1,478 @@
+/*
+ * GPGPU: work group size autotuning
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "tuner.h"
+#include <unistd.h>
+
+#define TUNING_DIR_NAME "gpgpu"
+#define TUNING_FILE_NAME "tuning"
+#define TUNING_FILE_HEADER "# gpgpu work group sizes: key x y ms\n"
+
+/* timed runs of each variant, after one untimed to warm it up */
+#define MIN_RUNS 3
+#define MIN_RUN_MS 20.0
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+/* FNV-1a, including the terminating NUL, like the program cache's */
+static uint64_t
+hash_string (uint64_t hash, const char *str)
+{
+   if (str == NULL)
+      str = "";
+
+   do {
+      hash ^= (uint8_t) *str;
+      hash *= FNV_PRIME;
+   } while (*str++ != '\0');
+
+   return hash;
+}
+
+static char *
+default_filename (void)
+{
+   const char *base = getenv ("XDG_CACHE_HOME");
+   const char *suffix = "";
+
+   if (base == NULL || base[0] == '\0') {
+      base = getenv ("HOME");
+      suffix = "/.cache";
+   }
+   if (base == NULL || base[0] == '\0')
+      return NULL;
+
+   size_t len = strlen (base) + strlen (suffix) + strlen (TUNING_DIR_NAME)
+      + strlen (TUNING_FILE_NAME) + 3;
+   char *filename = malloc (len);
+   assert (filename != NULL);
+
+   /* the directories, one level at a time */
+   snprintf (filename, len, "%s%s", base, suffix);
+   if (mkdir (filename, 0755) != 0 && errno != EEXIST) {
+      free (filename);
+      return NULL;
+   }
+   snprintf (filename, len, "%s%s/%s", base, suffix, TUNING_DIR_NAME);
+   if (mkdir (filename, 0755) != 0 && errno != EEXIST) {
+      free (filename);
+      return NULL;
+   }
+
+   snprintf (filename, len, "%s%s/%s/%s",
+             base, suffix, TUNING_DIR_NAME, TUNING_FILE_NAME);
+
+   return filename;
+}
+
+static struct gpgpu_tuning *
+find_tuning (struct gpgpu_tuner *tuner, uint64_t key)
+{
+   for (uint32_t i = 0; i < tuner->num_tunings; i++) {
+      if (tuner->tunings[i].key == key)
+         return &tuner->tunings[i];
+   }
+
+   return NULL;
+}
+
+static void
+add_tuning (struct gpgpu_tuner *tuner, const struct gpgpu_tuning *tuning)
+{
+   struct gpgpu_tuning *existing = find_tuning (tuner, tuning->key);
+   if (existing != NULL) {
+      *existing = *tuning;
+      return;
+   }
+
+   tuner->tunings = realloc (tuner->tunings,
+                             (tuner->num_tunings + 1)
+                             * sizeof (struct gpgpu_tuning));
+   assert (tuner->tunings != NULL);
+   tuner->tunings[tuner->num_tunings++] = *tuning;
+}
+
+/* Adds the tunings of the file, returns false if it exists but can't be
+ * read.
+ */
+static bool
+load_tunings (struct gpgpu_tuner *tuner)
+{
+   FILE *file_obj = fopen (tuner->filename, "r");
+   if (file_obj == NULL)
+      return errno == ENOENT;
+
+   char line[256];
+   while (fgets (line, sizeof (line), file_obj) != NULL) {
+      struct gpgpu_tuning tuning;
+      unsigned long long key;
+
+      if (line[0] == '#')
+         continue;
+
+      /* skip what a newer or broken version wrote */
+      if (sscanf (line, "%llx %u %u %lf",
+                  &key,
+                  &tuning.local_size[0],
+                  &tuning.local_size[1],
+                  &tuning.ms) != 4
+          || tuning.local_size[0] == 0
+          || tuning.local_size[1] == 0) {
+         continue;
+      }
+
+      tuning.key = key;
+      add_tuning (tuner, &tuning);
+   }
+
+   fclose (file_obj);
+
+   return true;
+}
+
+/* Rewrites the whole file, merged with what other runs added meanwhile. */
+static void
+store_tunings (struct gpgpu_tuner *tuner)
+{
+   if (tuner->filename == NULL)
+      return;
+
+   /* ours win over theirs, both are the same kernel on the same driver */
+   struct gpgpu_tuning *ours = tuner->tunings;
+   uint32_t num_ours = tuner->num_tunings;
+   tuner->tunings = NULL;
+   tuner->num_tunings = 0;
+   load_tunings (tuner);
+   for (uint32_t i = 0; i < num_ours; i++)
+      add_tuning (tuner, &ours[i]);
+   free (ours);
+
+   /* Write to a temporary file first, so that concurrent runs never see a
+    * partial file.
+    */
+   size_t tmp_len = strlen (tuner->filename) + 16;
+   char *tmp_filename = malloc (tmp_len);
+   assert (tmp_filename != NULL);
+   snprintf (tmp_filename, tmp_len, "%s.%d",
+             tuner->filename, (int) getpid ());
+
+   FILE *file_obj = fopen (tmp_filename, "w");
+   if (file_obj != NULL) {
+      bool ok = fputs (TUNING_FILE_HEADER, file_obj) >= 0;
+      for (uint32_t i = 0; i < tuner->num_tunings && ok; i++) {
+         ok = fprintf (file_obj, "%016llx %u %u %.6f\n",
+                       (unsigned long long) tuner->tunings[i].key,
+                       tuner->tunings[i].local_size[0],
+                       tuner->tunings[i].local_size[1],
+                       tuner->tunings[i].ms) > 0;
+      }
+      ok = fclose (file_obj) == 0 && ok;
+
+      if (! ok || rename (tmp_filename, tuner->filename) != 0) {
+         printf ("Failed to store tunings in %s\n", tuner->filename);
+         unlink (tmp_filename);
+      }
+   }
+
+   free (tmp_filename);
+}
+
+static bool
+build_variant (struct gpgpu_tuner *tuner,
+               struct gpgpu_kernel *kernel,
+               const char *source,
+               const char *defines,
+               const uint32_t local_size[2])
+{
+   char *all_defines = NULL;
+   size_t len = (defines != NULL ? strlen (defines) : 0) + 64;
+
+   all_defines = malloc (len);
+   assert (all_defines != NULL);
+   snprintf (all_defines, len,
+             "#define LOCAL_SIZE_X %u\n#define LOCAL_SIZE_Y %u\n%s",
+             local_size[0],
+             local_size[1],
+             defines != NULL ? defines : "");
+
+   bool ok = gpgpu_kernel_init_with_defines (kernel,
+                                             tuner->ctx,
+                                             source,
+                                             all_defines);
+   free (all_defines);
+
+   return ok;
+}
+
+/* Returns the best time of a few runs of 'kernel', or a negative value if
+ * it failed to run.
+ */
+static double
+time_variant (struct gpgpu_tuner *tuner,
+              struct gpgpu_kernel *kernel,
+              GpgpuTunerRunFunc run,
+              void *data)
+{
+   /* the first run may compile the shader for real, or page in buffers */
+   if (! run (kernel, data))
+      return -1.0;
+   gpgpu_context_wait_idle (tuner->ctx);
+
+   double best_ms = -1.0;
+   double total_ms = 0;
+
+   for (uint32_t i = 0; i < MIN_RUNS || total_ms < MIN_RUN_MS; i++) {
+      double start = gpgpu_now_ms ();
+      if (! run (kernel, data))
+         return -1.0;
+      gpgpu_context_wait_idle (tuner->ctx);
+      double ms = gpgpu_now_ms () - start;
+
+      if (best_ms < 0 || ms < best_ms)
+         best_ms = ms;
+      total_ms += ms;
+   }
+
+   return best_ms;
+}
+
+/* Whether a dispatch of 'size' invocations along 'axis' takes no more
+ * work groups of 'local' invocations than the context allows.
+ */
+static bool
+group_count_fits (struct gpgpu_context *ctx,
+                  uint32_t axis,
+                  uint32_t size,
+                  uint32_t local)
+{
+   uint64_t count = ((uint64_t) size + local - 1) / local;
+
+   return count <= (uint64_t) ctx->max_work_group_count[axis];
+}
+
+/* Returns the number of candidates, written to 'sizes'. Those that would
+ * take too many work groups to dispatch 'size_x' by 'size_y' invocations
+ * are left out.
+ */
+static uint32_t
+candidate_sizes (struct gpgpu_tuner *tuner,
+                 uint32_t dimensions,
+                 uint32_t size_x,
+                 uint32_t size_y,
+                 uint32_t sizes[][2],
+                 uint32_t max_sizes)
+{
+   struct gpgpu_context *ctx = tuner->ctx;
+   uint32_t count = 0;
+   uint32_t max_y = dimensions > 1 ? ctx->max_work_group_size[1] : 1;
+
+   for (uint32_t y = 1; y <= max_y; y *= 2) {
+      for (uint32_t x = 1; x <= (uint32_t) ctx->max_work_group_size[0];
+           x *= 2) {
+         uint32_t invocations = x * y;
+         if (invocations < GPGPU_TUNER_MIN_INVOCATIONS)
+            continue;
+         if (invocations > (uint32_t) ctx->max_work_group_invocations)
+            break;
+         if (! group_count_fits (ctx, 0, size_x, x)
+             || ! group_count_fits (ctx, 1, size_y, y)) {
+            continue;
+         }
+
+         if (count < max_sizes) {
+            sizes[count][0] = x;
+            sizes[count][1] = y;
+            count++;
+         }
+      }
+   }
+
+   return count;
+}
+
+/* Times all candidates, and returns the fastest in 'best'. */
+static bool
+search (struct gpgpu_tuner *tuner,
+        const char *name,
+        const char *source,
+        const char *defines,
+        uint32_t dimensions,
+        uint32_t size_x,
+        uint32_t size_y,
+        GpgpuTunerRunFunc run,
+        void *data,
+        struct gpgpu_tuning *best)
+{
+   uint32_t sizes[256][2];
+   uint32_t num_sizes = candidate_sizes (tuner,
+                                         dimensions,
+                                         size_x,
+                                         size_y,
+                                         sizes,
+                                         256);
+   double start = gpgpu_now_ms ();
+
+   best->ms = -1.0;
+
+   printf ("Tuning %s:", name);
+   for (uint32_t i = 0; i < num_sizes; i++) {
+      struct gpgpu_kernel variant;
+
+      /* e.g. the shared memory of the bigger ones may exceed the limit */
+      if (! build_variant (tuner, &variant, source, defines, sizes[i]))
+         continue;
+
+      double ms = time_variant (tuner, &variant, run, data);
+      gpgpu_kernel_finish (&variant);
+      tuner->variants++;
+
+      if (ms < 0)
+         continue;
+
+      if (dimensions > 1)
+         printf (" %ux%u %.3f", sizes[i][0], sizes[i][1], ms);
+      else
+         printf (" %u %.3f", sizes[i][0], ms);
+      fflush (stdout);
+
+      if (best->ms < 0 || ms < best->ms) {
+         best->local_size[0] = sizes[i][0];
+         best->local_size[1] = sizes[i][1];
+         best->ms = ms;
+      }
+   }
+   printf ("\n");
+
+   tuner->tuning_ms += gpgpu_now_ms () - start;
+
+   if (best->ms < 0) {
+      printf ("No variant of %s could run\n", name);
+      return false;
+   }
+
+   return true;
+}
+
+/* public API */
+
+bool
+gpgpu_tuner_init (struct gpgpu_tuner *tuner,
+                  struct gpgpu_context *ctx,
+                  const char *filename)
+{
+   assert (tuner != NULL);
+   assert (ctx != NULL);
+
+   memset (tuner, 0x00, sizeof (struct gpgpu_tuner));
+   tuner->ctx = ctx;
+
+   tuner->filename = filename != NULL ? strdup (filename) : default_filename ();
+   if (tuner->filename == NULL || ! load_tunings (tuner)) {
+      printf ("Tuning file not usable, tunings won't be kept\n");
+      free (tuner->filename);
+      tuner->filename = NULL;
+      return false;
+   }
+
+   return true;
+}
+
+void
+gpgpu_tuner_finish (struct gpgpu_tuner *tuner)
+{
+   assert (tuner != NULL);
+
+   free (tuner->tunings);
+   tuner->tunings = NULL;
+   tuner->num_tunings = 0;
+
+   free (tuner->filename);
+   tuner->filename = NULL;
+}
+
+bool
+gpgpu_tuner_build_kernel (struct gpgpu_tuner *tuner,
+                          struct gpgpu_kernel *kernel,
+                          const char *name,
+                          const char *source,
+                          const char *defines,
+                          uint32_t dimensions,
+                          uint32_t size_x,
+                          uint32_t size_y,
+                          GpgpuTunerRunFunc run,
+                          void *data)
+{
+   assert (tuner != NULL);
+   assert (kernel != NULL);
+   assert (name != NULL && source != NULL);
+   assert (dimensions == 1 || dimensions == 2);
+   assert (dimensions > 1 || size_y == 1);
+   assert (run != NULL);
+
+   /* the program cache's driver hash covers vendor, renderer and version */
+   uint64_t key = tuner->ctx->program_cache.driver_hash;
+   key = hash_string (key, tuner->ctx->device.name);
+   key = hash_string (key, source);
+   key = hash_string (key, defines);
+   key = hash_string (key, dimensions > 1 ? "2d" : "1d");
+
+   struct gpgpu_tuning *tuning = find_tuning (tuner, key);
+   if (tuning != NULL
+       && build_variant (tuner, kernel, source, defines, tuning->local_size)) {
+      tuner->hits++;
+      return true;
+   }
+
+   /* no tuning yet, or one the limits of the driver don't allow anymore */
+   tuner->misses++;
+
+   struct gpgpu_tuning best = { .key = key };
+   if (! search (tuner,
+                 name,
+                 source,
+                 defines,
+                 dimensions,
+                 size_x,
+                 size_y,
+                 run,
+                 data,
+                 &best)) {
+      return false;
+   }
+
+   add_tuning (tuner, &best);
+   store_tunings (tuner);
+
+   return build_variant (tuner, kernel, source, defines, best.local_size);
+}
+
+void
+gpgpu_tuner_print_stats (struct gpgpu_tuner *tuner)
+{
+   assert (tuner != NULL);
+
+   printf ("Tuner: %u hits, %u misses, %u variants timed in %.1f ms (%s)\n",
+           tuner->hits,
+           tuner->misses,
+           tuner->variants,
+           tuner->tuning_ms,
+           tuner->filename != NULL ? tuner->filename : "not kept");
+}
@@ -0,0 +1,90 @@
+/*
+ * GPGPU: work group size autotuning
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "gpgpu.h"
+
+/* Picks the local size of kernels by timing them.
+ *
+ * Kernels declare 'layout (local_size_x = LOCAL_SIZE_X, local_size_y =
+ * LOCAL_SIZE_Y) in;', and the tuner builds variants with those defined to
+ * each candidate size within the limits of the context: powers of two, of
+ * at least GPGPU_TUNER_MIN_INVOCATIONS invocations. Each variant runs a
+ * few times on representative input, and the fastest one wins.
+ *
+ * Results are kept in a tuning file, keyed by a hash of the kernel source,
+ * its defines, the device and the GL vendor, renderer and version, so
+ * that later runs skip the search, and a driver update searches again.
+ */
+
+#define GPGPU_TUNER_MIN_INVOCATIONS 4
+
+struct gpgpu_tuning {
+   uint64_t key;
+   uint32_t local_size[2];
+   double ms;
+};
+
+/* Runs 'kernel' once on representative input: binds its buffers and
+ * dispatches it. Returns false on failure.
+ */
+typedef bool (* GpgpuTunerRunFunc) (struct gpgpu_kernel *kernel, void *data);
+
+struct gpgpu_tuner {
+   struct gpgpu_context *ctx;
+
+   /* NULL if results are not kept across runs */
+   char *filename;
+
+   struct gpgpu_tuning *tunings;
+   uint32_t num_tunings;
+
+   /* statistics */
+   uint32_t hits;
+   uint32_t misses;
+   uint32_t variants;
+   double tuning_ms;
+};
+
+/* 'filename' of NULL uses $XDG_CACHE_HOME/gpgpu/tuning, or
+ * ~/.cache/gpgpu/tuning. Returns false if the file can't be used, in which
+ * case the tuner still works but searches on every run.
+ */
+bool     gpgpu_tuner_init         (struct gpgpu_tuner *tuner,
+                                   struct gpgpu_context *ctx,
+                                   const char *filename);
+
+void     gpgpu_tuner_finish       (struct gpgpu_tuner *tuner);
+
+/* Builds 'kernel' from 'source' (and 'defines', as for
+ * gpgpu_kernel_init_with_defines(); can be NULL) with the fastest local
+ * size, in 'dimensions' 1 (LOCAL_SIZE_Y is 1) or 2. 'run' is only called
+ * when there is no tuning for the kernel yet, and dispatches 'size_x' by
+ * 'size_y' invocations: local sizes that would take more work groups than
+ * the context allows for that are not tried. 'name' is for messages.
+ */
+bool     gpgpu_tuner_build_kernel (struct gpgpu_tuner *tuner,
+                                   struct gpgpu_kernel *kernel,
+                                   const char *name,
+                                   const char *source,
+                                   const char *defines,
+                                   uint32_t dimensions,
+                                   uint32_t size_x,
+                                   uint32_t size_y,
+                                   GpgpuTunerRunFunc run,
+                                   void *data);
+
+void     gpgpu_tuner_print_stats  (struct gpgpu_tuner *tuner);
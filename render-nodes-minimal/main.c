@@ -37,6 +37,9 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "common/gl-debug.h"
+#include "common/gl-program-cache.h"
+
 /* a dummy compute shader that does nothing */
 #define COMPUTE_SHADER_SRC "          \
 #version 310 es\n                                                       \
@@ -85,6 +88,9 @@ main (int32_t argc, char* argv[])
 
    static const EGLint attribs[] = {
       EGL_CONTEXT_CLIENT_VERSION, 3,
+#ifndef NDEBUG
+      EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR,
+#endif
       EGL_NONE
    };
    EGLContext core_ctx = eglCreateContext (egl_dpy,
@@ -96,6 +102,10 @@ main (int32_t argc, char* argv[])
    res = eglMakeCurrent (egl_dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, core_ctx);
    assert (res);
 
+   /* report GL errors through KHR_debug in debug builds */
+   struct gl_debug gl_debug;
+   gl_debug_init (&gl_debug, (GlGetProcAddress) eglGetProcAddress);
+
    /* print some compute limits (not strictly necessary) */
    GLint work_group_count[3] = {0};
    for (unsigned i = 0; i < 3; i++)
@@ -123,34 +133,48 @@ main (int32_t argc, char* argv[])
    glGetIntegerv (GL_MAX_COMPUTE_SHARED_MEMORY_SIZE, &mem_size);
    printf ("GL_MAX_COMPUTE_SHARED_MEMORY_SIZE: %d\n", mem_size);
 
-   /* setup a compute shader */
-   GLuint compute_shader = glCreateShader (GL_COMPUTE_SHADER);
+   /* setup a compute shader, reusing the program binary from an earlier run
+    * if there is one (see common/gl-program-cache.h)
+    */
+   struct gl_program_cache program_cache;
+   gl_program_cache_init (&program_cache,
+                          NULL,
+                          (GlGetProcAddress) eglGetProcAddress);
 
-   assert (glGetError () == GL_NO_ERROR);
    const char *shader_source = COMPUTE_SHADER_SRC;
-
-   glShaderSource (compute_shader, 1, &shader_source, NULL);
-   assert (glGetError () == GL_NO_ERROR);
-
-   glCompileShader (compute_shader);
-   assert (glGetError () == GL_NO_ERROR);
-
-   GLuint shader_program = glCreateProgram ();
-
-   glAttachShader (shader_program, compute_shader);
-   assert (glGetError () == GL_NO_ERROR);
-
-   glLinkProgram (shader_program);
-   assert (glGetError () == GL_NO_ERROR);
-
-   glDeleteShader (compute_shader);
+   const GLenum shader_type = GL_COMPUTE_SHADER;
+   GLuint shader_program = gl_program_cache_get_program (&program_cache,
+                                                         &shader_source,
+                                                         &shader_type,
+                                                         1,
+                                                         NULL,
+                                                         0);
+   assert (shader_program != 0);
+   GL_CHECK ();
+
+   gl_program_cache_print_stats (&program_cache);
+   gl_program_cache_finish (&program_cache);
 
    glUseProgram (shader_program);
-   assert (glGetError () == GL_NO_ERROR);
+   GL_CHECK ();
 
    /* dispatch computation */
    glDispatchCompute (1, 1, 1);
-   assert (glGetError () == GL_NO_ERROR);
+   GL_CHECK ();
+
+   /* the dispatch only got queued, a fence tells when it completed */
+   GLsync fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+   assert (fence != NULL);
+
+   GLenum status = glClientWaitSync (fence,
+                                     GL_SYNC_FLUSH_COMMANDS_BIT,
+                                     GL_TIMEOUT_IGNORED);
+   glDeleteSync (fence);
+   GL_CHECK ();
+   if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      printf ("Error: waiting for the compute shader failed\n");
+      return -1;
+   }
 
    printf ("Compute shader dispatched and finished successfully\n");
 
@@ -0,0 +1,813 @@
+/*
+ * Example:
+ *
+ * Vulkan compute: a headless saxpy (y = a * x + y), with no window system
+ *                 at all. It picks a queue family with compute support,
+ *                 places the storage buffers in host-visible memory, builds
+ *                 a compute pipeline from SPIR-V, dispatches it, waits on a
+ *                 fence and reads the result back, then checks it against
+ *                 the CPU. Inputs are the ones of gpgpu-samples' saxpy, so
+ *                 that both runs compare the Vulkan and GLES compute paths
+ *                 of a driver (e.g. lavapipe and llvmpipe).
+ *
+ * Usage: vulkan-compute [-d device index] [-n elements] [-i iterations]
+ *
+ * This code is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 3, or (at your option) any later version as published by
+ * the Free Software Foundation.
+ *
+ * THIS CODE IS PROVIDED AS-IS, WITHOUT WARRANTY OF ANY KIND, OR POSSIBLE
+ * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+#include "common/now.h"
+#include "common/vk-allocator.h"
+#include "common/vk-api.h"
+#include "common/vk-memory.h"
+#include "common/vk-pipeline-cache.h"
+
+/* local_size_x of shader.comp */
+#define WORKGROUP_SIZE 64
+
+#define SAXPY_A 2.5f
+
+#define MAX_PHYSICAL_DEVICES 8
+#define MAX_QUEUE_FAMILIES 16
+
+static struct vk_api vk = { NULL, };
+static const VkAllocationCallbacks* allocator = VK_NULL_HANDLE;
+static struct vk_allocator host_allocator;
+
+/* must match the push constant block of shader.comp */
+struct saxpy_params {
+   uint32_t n;
+   float a;
+};
+
+struct vk_buffer {
+   VkBuffer buffer;
+   struct vk_memory_allocation memory;
+   VkDeviceSize size;
+   void* data;
+};
+
+struct vk_objects {
+   VkInstance instance;
+   VkPhysicalDevice physical_device;
+   VkPhysicalDeviceProperties props;
+   VkDevice device;
+
+   uint32_t queue_family_index;
+   VkQueue queue;
+   VkCommandPool cmd_pool;
+   VkCommandBuffer cmd_buffer;
+   VkFence fence;
+   struct vk_pipeline_cache pipeline_cache;
+
+   /* buffers are sub-allocated from a few blocks */
+   struct vk_memory memory;
+   struct vk_buffer x;
+   struct vk_buffer y;
+
+   VkShaderModule shader_module;
+   VkDescriptorSetLayout set_layout;
+   VkDescriptorPool descriptor_pool;
+   VkDescriptorSet descriptor_set;
+   VkPipelineLayout pipeline_layout;
+   VkPipeline pipeline;
+};
+
+static struct vk_objects objs = {VK_NULL_HANDLE,};
+
+static uint32_t*
+load_file (const char* filename, size_t* file_size)
+{
+   char *data = NULL;
+   size_t size = 0;
+   ssize_t read_size = 0;
+   int fd = open (filename, O_RDONLY);
+   uint8_t buf[1024];
+
+   if (fd < 0)
+      return NULL;
+
+   while ((read_size = read (fd, buf, 1024)) > 0) {
+      data = realloc (data, size + read_size);
+      assert (data != NULL);
+
+      memcpy (data + size, buf, read_size);
+      size += read_size;
+   }
+   close (fd);
+
+   if (read_size < 0) {
+      free (data);
+      return NULL;
+   }
+
+   if (file_size)
+      *file_size = size;
+
+   return (uint32_t*) data;
+}
+
+/* Prefers a family with compute but no graphics support, which often maps
+ * to a dedicated (asynchronous) compute engine, to any family with compute
+ * support. Returns false if the device has no compute queue at all.
+ */
+static bool
+choose_queue_family (VkPhysicalDevice physical_device, uint32_t* index)
+{
+   uint32_t num_queue_families = 0;
+   VkQueueFamilyProperties queue_families[MAX_QUEUE_FAMILIES];
+
+   vk.GetPhysicalDeviceQueueFamilyProperties (physical_device,
+                                              &num_queue_families,
+                                              NULL);
+   if (num_queue_families > MAX_QUEUE_FAMILIES)
+      num_queue_families = MAX_QUEUE_FAMILIES;
+   vk.GetPhysicalDeviceQueueFamilyProperties (physical_device,
+                                              &num_queue_families,
+                                              queue_families);
+
+   int32_t any = -1;
+   int32_t dedicated = -1;
+   for (uint32_t i = 0; i < num_queue_families; i++) {
+      VkQueueFlags flags = queue_families[i].queueFlags;
+
+      printf ("Queue family index: %u, flags: %u, count: %u\n",
+              i,
+              flags,
+              queue_families[i].queueCount);
+
+      if (! (flags & VK_QUEUE_COMPUTE_BIT) || queue_families[i].queueCount == 0)
+         continue;
+
+      if (any < 0)
+         any = i;
+      if (dedicated < 0 && ! (flags & VK_QUEUE_GRAPHICS_BIT))
+         dedicated = i;
+   }
+
+   if (any < 0)
+      return false;
+
+   *index = dedicated >= 0 ? dedicated : any;
+
+   return true;
+}
+
+static bool
+create_buffer (struct vk_objects* objs,
+               struct vk_buffer* buffer,
+               VkDeviceSize size)
+{
+   VkBufferCreateInfo buffer_info = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+      .size = size,
+      .usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+   };
+   if (vk.CreateBuffer (objs->device,
+                        &buffer_info,
+                        allocator,
+                        &buffer->buffer) != VK_SUCCESS) {
+      printf ("Error: Failed to create a buffer\n");
+      return false;
+   }
+   buffer->size = size;
+
+   /* host-visible, preferably coherent (no flushes nor invalidations) and
+    * cached (fast reads)
+    */
+   if (! vk_memory_alloc_buffer (&objs->memory,
+                                 buffer->buffer,
+                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                                 | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+                                 &buffer->memory)) {
+      printf ("Error: No host-visible memory for storage buffers\n");
+      return false;
+   }
+
+   /* its block stays mapped for the life of the buffer */
+   buffer->data = buffer->memory.mapped;
+   if (buffer->data == NULL) {
+      printf ("Error: Failed to map the memory of a buffer\n");
+      return false;
+   }
+
+   return true;
+}
+
+static void
+destroy_buffer (struct vk_objects* objs, struct vk_buffer* buffer)
+{
+   vk.DestroyBuffer (objs->device, buffer->buffer, allocator);
+   vk_memory_free (&objs->memory, &buffer->memory);
+   memset (buffer, 0x00, sizeof (struct vk_buffer));
+}
+
+/* Makes what the host wrote visible to the device. */
+static void
+flush_buffer (struct vk_objects* objs, struct vk_buffer* buffer)
+{
+   vk_memory_flush (&objs->memory, &buffer->memory);
+}
+
+/* Makes what the device wrote visible to the host. */
+static void
+invalidate_buffer (struct vk_objects* objs, struct vk_buffer* buffer)
+{
+   vk_memory_invalidate (&objs->memory, &buffer->memory);
+}
+
+static bool
+create_pipeline (struct vk_objects* objs)
+{
+   assert (objs->device != VK_NULL_HANDLE);
+
+   size_t shader_code_size;
+   uint32_t* shader_code = load_file (CURRENT_DIR "/comp.spv",
+                                      &shader_code_size);
+   if (shader_code == NULL) {
+      printf ("Error: Failed to load compute shader code from 'comp.spv'\n");
+      return false;
+   }
+
+   VkShaderModuleCreateInfo shader_info = {
+      .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+      .codeSize = shader_code_size,
+      .pCode = shader_code,
+   };
+   VkResult result = vk.CreateShaderModule (objs->device,
+                                            &shader_info,
+                                            allocator,
+                                            &objs->shader_module);
+   free (shader_code);
+   if (result != VK_SUCCESS) {
+      printf ("Error: Failed to create compute shader module\n");
+      return false;
+   }
+   printf ("Compute shader created\n");
+
+   /* x and y */
+   VkDescriptorSetLayoutBinding bindings[2] = {
+      {
+         .binding = 0,
+         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .descriptorCount = 1,
+         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      },
+      {
+         .binding = 1,
+         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .descriptorCount = 1,
+         .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      },
+   };
+   VkDescriptorSetLayoutCreateInfo set_layout_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+      .bindingCount = 2,
+      .pBindings = bindings,
+   };
+   if (vk.CreateDescriptorSetLayout (objs->device,
+                                     &set_layout_info,
+                                     allocator,
+                                     &objs->set_layout) != VK_SUCCESS) {
+      printf ("Error: Failed to create a descriptor set layout\n");
+      return false;
+   }
+
+   VkPushConstantRange push_constant_range = {
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = sizeof (struct saxpy_params),
+   };
+   VkPipelineLayoutCreateInfo pipeline_layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .setLayoutCount = 1,
+      .pSetLayouts = &objs->set_layout,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &push_constant_range,
+   };
+   if (vk.CreatePipelineLayout (objs->device,
+                                &pipeline_layout_info,
+                                allocator,
+                                &objs->pipeline_layout) != VK_SUCCESS) {
+      printf ("Error: Failed to create a pipeline layout\n");
+      return false;
+   }
+   printf ("Pipeline layout created\n");
+
+   VkComputePipelineCreateInfo pipeline_info = {
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .stage = {
+         .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+         .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+         .module = objs->shader_module,
+         .pName = "main",
+      },
+      .layout = objs->pipeline_layout,
+      .basePipelineHandle = VK_NULL_HANDLE,
+      .basePipelineIndex = -1,
+   };
+   if (vk_pipeline_cache_create_compute (&objs->pipeline_cache,
+                                         1,
+                                         &pipeline_info,
+                                         &objs->pipeline) != VK_SUCCESS) {
+      printf ("Error: Failed to create the compute pipeline\n");
+      return false;
+   }
+   printf ("Compute pipeline created\n");
+
+   return true;
+}
+
+static bool
+create_descriptor_set (struct vk_objects* objs)
+{
+   assert (objs->set_layout != VK_NULL_HANDLE);
+
+   VkDescriptorPoolSize pool_size = {
+      .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 2,
+   };
+   VkDescriptorPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+      .maxSets = 1,
+      .poolSizeCount = 1,
+      .pPoolSizes = &pool_size,
+   };
+   if (vk.CreateDescriptorPool (objs->device,
+                                &pool_info,
+                                allocator,
+                                &objs->descriptor_pool) != VK_SUCCESS) {
+      printf ("Error: Failed to create a descriptor pool\n");
+      return false;
+   }
+
+   VkDescriptorSetAllocateInfo set_alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+      .descriptorPool = objs->descriptor_pool,
+      .descriptorSetCount = 1,
+      .pSetLayouts = &objs->set_layout,
+   };
+   if (vk.AllocateDescriptorSets (objs->device,
+                                  &set_alloc_info,
+                                  &objs->descriptor_set) != VK_SUCCESS) {
+      printf ("Error: Failed to allocate a descriptor set\n");
+      return false;
+   }
+
+   VkDescriptorBufferInfo buffer_infos[2] = {
+      { .buffer = objs->x.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+      { .buffer = objs->y.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+   };
+   VkWriteDescriptorSet writes[2];
+   for (uint32_t i = 0; i < 2; i++) {
+      writes[i] = (VkWriteDescriptorSet) {
+         .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+         .dstSet = objs->descriptor_set,
+         .dstBinding = i,
+         .dstArrayElement = 0,
+         .descriptorCount = 1,
+         .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .pBufferInfo = &buffer_infos[i],
+      };
+   }
+   vk.UpdateDescriptorSets (objs->device, 2, writes, 0, NULL);
+   printf ("Descriptor set created\n");
+
+   return true;
+}
+
+/* Records the dispatch once: every run submits the same command buffer. */
+static bool
+record_command_buffer (struct vk_objects* objs, uint32_t n)
+{
+   VkCommandBufferAllocateInfo cmd_buffer_alloc_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+      .commandBufferCount = 1,
+      .commandPool = objs->cmd_pool
+   };
+   if (vk.AllocateCommandBuffers (objs->device,
+                                  &cmd_buffer_alloc_info,
+                                  &objs->cmd_buffer) != VK_SUCCESS) {
+      printf ("Error: Failed to allocate a command buffer\n");
+      return false;
+   }
+
+   VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = 0,
+   };
+   if (vk.BeginCommandBuffer (objs->cmd_buffer, &begin_info) != VK_SUCCESS) {
+      printf ("Error: Failed to begin recording of command buffer\n");
+      return false;
+   }
+
+   struct saxpy_params params = {
+      .n = n,
+      .a = SAXPY_A,
+   };
+
+   vk.CmdBindPipeline (objs->cmd_buffer,
+                       VK_PIPELINE_BIND_POINT_COMPUTE,
+                       objs->pipeline);
+   vk.CmdBindDescriptorSets (objs->cmd_buffer,
+                             VK_PIPELINE_BIND_POINT_COMPUTE,
+                             objs->pipeline_layout,
+                             0,
+                             1,
+                             &objs->descriptor_set,
+                             0,
+                             NULL);
+   vk.CmdPushConstants (objs->cmd_buffer,
+                        objs->pipeline_layout,
+                        VK_SHADER_STAGE_COMPUTE_BIT,
+                        0,
+                        sizeof (params),
+                        &params);
+   vk.CmdDispatch (objs->cmd_buffer,
+                   (n + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+                   1,
+                   1);
+
+   /* the fence alone does not make the shader's writes visible to the
+    * host: a barrier to the host stage does
+    */
+   VkBufferMemoryBarrier barrier = {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .buffer = objs->y.buffer,
+      .offset = 0,
+      .size = VK_WHOLE_SIZE,
+   };
+   vk.CmdPipelineBarrier (objs->cmd_buffer,
+                          VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                          VK_PIPELINE_STAGE_HOST_BIT,
+                          0,
+                          0,
+                          NULL,
+                          1,
+                          &barrier,
+                          0,
+                          NULL);
+
+   if (vk.EndCommandBuffer (objs->cmd_buffer) != VK_SUCCESS) {
+      printf ("Error: Failed to record the command buffer\n");
+      return false;
+   }
+   printf ("Dispatch recorded in command buffer\n");
+
+   return true;
+}
+
+/* Submits the dispatch and waits for it on the fence. */
+static bool
+run_dispatch (struct vk_objects* objs)
+{
+   VkSubmitInfo submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &objs->cmd_buffer,
+   };
+
+   vk.ResetFences (objs->device, 1, &objs->fence);
+   if (vk.QueueSubmit (objs->queue,
+                       1,
+                       &submit_info,
+                       objs->fence) != VK_SUCCESS) {
+      printf ("Error: Failed to submit queue\n");
+      return false;
+   }
+
+   if (vk.WaitForFences (objs->device,
+                         1,
+                         &objs->fence,
+                         VK_TRUE,
+                         UINT64_MAX) != VK_SUCCESS) {
+      printf ("Error: Failed to wait for the fence\n");
+      return false;
+   }
+
+   /* a dispatch is the frame of this sample */
+   vk_allocator_end_frame (&host_allocator);
+
+   return true;
+}
+
+static bool
+run_saxpy (struct vk_objects* objs, uint32_t n, uint32_t iterations)
+{
+   float* x = objs->x.data;
+   float* y = objs->y.data;
+
+   double start = now_ms ();
+
+   /* no upload: the host writes straight to the buffers' memory */
+   for (uint32_t i = 0; i < n; i++) {
+      x[i] = (float) i;
+      y[i] = (float) (n - i);
+   }
+   flush_buffer (objs, &objs->x);
+   flush_buffer (objs, &objs->y);
+
+   bool ok = run_dispatch (objs);
+   if (ok)
+      invalidate_buffer (objs, &objs->y);
+
+   double elapsed = now_ms () - start;
+
+   uint32_t errors = 0;
+   for (uint32_t i = 0; ok && i < n; i++) {
+      float expected = SAXPY_A * (float) i + (float) (n - i);
+      if (fabsf (y[i] - expected) > 1e-5f * fabsf (expected)) {
+         if (errors++ == 0)
+            printf ("saxpy: y[%u] = %f, expected %f\n", i, y[i], expected);
+      }
+   }
+   ok = ok && errors == 0;
+
+   printf ("saxpy: %u elements in %.3f ms: %s\n",
+           n,
+           elapsed,
+           ok ? "OK" : "FAILED");
+
+   /* y keeps accumulating, only the first run is checked */
+   if (ok && iterations > 0) {
+      start = now_ms ();
+      for (uint32_t i = 0; ok && i < iterations; i++)
+         ok = run_dispatch (objs);
+      elapsed = (now_ms () - start) / iterations;
+
+      /* x and y read, y written */
+      double bytes = 3.0 * n * sizeof (float);
+      printf ("saxpy: %.3f ms per dispatch over %u, %.2f GB/s\n",
+              elapsed,
+              iterations,
+              bytes / (elapsed * 1000000.0));
+   }
+
+   return ok;
+}
+
+static void
+destroy_objects (struct vk_objects* objs)
+{
+   /* free all allocated objects, in the right order */
+   if (objs->device != VK_NULL_HANDLE) {
+      vk.DeviceWaitIdle (objs->device);
+
+      /* command buffers are implicitly freed when the command pool is
+       * destroyed, descriptor sets when the descriptor pool is
+       */
+      vk.DestroyPipeline (objs->device, objs->pipeline, allocator);
+      vk_pipeline_cache_finish (&objs->pipeline_cache);
+      vk.DestroyPipelineLayout (objs->device,
+                                objs->pipeline_layout,
+                                allocator);
+      vk.DestroyDescriptorPool (objs->device,
+                                objs->descriptor_pool,
+                                allocator);
+      vk.DestroyDescriptorSetLayout (objs->device,
+                                     objs->set_layout,
+                                     allocator);
+      vk.DestroyShaderModule (objs->device, objs->shader_module, allocator);
+      destroy_buffer (objs, &objs->y);
+      destroy_buffer (objs, &objs->x);
+      vk_memory_finish (&objs->memory);
+      vk.DestroyFence (objs->device, objs->fence, allocator);
+      vk.DestroyCommandPool (objs->device, objs->cmd_pool, allocator);
+      vk.DestroyDevice (objs->device, allocator);
+   }
+
+   if (objs->instance != VK_NULL_HANDLE)
+      vk.DestroyInstance (objs->instance, allocator);
+}
+
+int32_t
+main (int32_t argc, char* argv[])
+{
+   uint32_t device_index = 0;
+   uint32_t n = 1000000;
+   uint32_t iterations = 100;
+   bool ok = false;
+
+   for (int32_t i = 1; i < argc; i++) {
+      if (strcmp (argv[i], "-d") == 0 && i + 1 < argc) {
+         device_index = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-n") == 0 && i + 1 < argc) {
+         n = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-i") == 0 && i + 1 < argc) {
+         iterations = strtoul (argv[++i], NULL, 10);
+      } else {
+         printf ("Usage: %s [-d device index] [-n elements] "
+                 "[-i iterations]\n",
+                 argv[0]);
+         return -1;
+      }
+   }
+
+   if (n == 0)
+      n = 1;
+
+   /* load API entry points from ICD */
+   vk_api_load_from_icd (&vk);
+
+   /* the memory allocation callbacks, counting what the driver allocates
+    * per scope
+    */
+   if (! vk_allocator_init (&host_allocator, 0))
+      return -1;
+   allocator = &host_allocator.callbacks;
+
+   /* no extensions: nothing is presented */
+   VkApplicationInfo app_info = {
+      .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+      .pApplicationName = "Vulkan compute example",
+      .applicationVersion = 0,
+      .apiVersion = VK_API_VERSION_1_0
+   };
+   VkInstanceCreateInfo instance_info = {
+      .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+      .pApplicationInfo = &app_info,
+   };
+   if (vk.CreateInstance (&instance_info,
+                          allocator,
+                          &objs.instance) != VK_SUCCESS) {
+      printf ("Error: Failed to create Vulkan instance\n");
+      vk_allocator_finish (&host_allocator);
+      return -1;
+   }
+   printf ("Vulkan instance created\n");
+
+   /* load instance-dependent API entry points */
+   vk_api_load_from_instance (&vk, &objs.instance);
+
+   /* query physical devices */
+   uint32_t num_devices = MAX_PHYSICAL_DEVICES;
+   VkPhysicalDevice devices[MAX_PHYSICAL_DEVICES] = {0};
+   VkResult result = vk.EnumeratePhysicalDevices (objs.instance,
+                                                  &num_devices,
+                                                  devices);
+   if (result != VK_SUCCESS && result != VK_INCOMPLETE) {
+      printf ("Error: Failed to enummerate Vulkan physical devices\n");
+      goto free_stuff;
+   }
+   printf ("Found %u physical devices\n", num_devices);
+   for (uint32_t i = 0; i < num_devices; i++) {
+      VkPhysicalDeviceProperties props;
+      vk.GetPhysicalDeviceProperties (devices[i], &props);
+      printf ("   %u: %s\n", i, props.deviceName);
+   }
+   if (device_index >= num_devices) {
+      printf ("Error: No physical device %u\n", device_index);
+      goto free_stuff;
+   }
+   objs.physical_device = devices[device_index];
+   vk.GetPhysicalDeviceProperties (objs.physical_device, &objs.props);
+   printf ("Physical device: %s\n", objs.props.deviceName);
+
+   uint32_t num_groups = (n + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE;
+   if (num_groups > objs.props.limits.maxComputeWorkGroupCount[0]) {
+      printf ("Error: %u elements need %u work groups, the device can "
+              "dispatch %u\n",
+              n,
+              num_groups,
+              objs.props.limits.maxComputeWorkGroupCount[0]);
+      goto free_stuff;
+   }
+
+   if (! choose_queue_family (objs.physical_device,
+                              &objs.queue_family_index)) {
+      printf ("Error: No queue family supports compute\n");
+      goto free_stuff;
+   }
+   printf ("Queue family %u chosen\n", objs.queue_family_index);
+
+   /* create logical device */
+   const float queue_priorities = 1.0;
+   VkDeviceQueueCreateInfo queue_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .flags = 0,
+      .queueCount = 1,
+      .pQueuePriorities = &queue_priorities,
+      .queueFamilyIndex = objs.queue_family_index
+   };
+   VkDeviceCreateInfo device_info = {
+      .sType =  VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+      .pQueueCreateInfos = &queue_info,
+      .queueCreateInfoCount = 1,
+   };
+   if (vk.CreateDevice (objs.physical_device,
+                        &device_info,
+                        allocator,
+                        &objs.device) != VK_SUCCESS) {
+      printf ("Error: Failed to create Vulkan device\n");
+      goto free_stuff;
+   }
+   printf ("Logical device created\n");
+
+   /* load device-dependent API entry points */
+   vk_api_load_from_device (&vk, &objs.device);
+
+   vk.GetDeviceQueue (objs.device, objs.queue_family_index, 0, &objs.queue);
+   if (objs.queue == VK_NULL_HANDLE) {
+      printf ("Error: Failed to get a device queue\n");
+      goto free_stuff;
+   }
+
+   if (! vk_pipeline_cache_init (&objs.pipeline_cache,
+                                 &vk,
+                                 objs.physical_device,
+                                 objs.device,
+                                 allocator,
+                                 NULL)) {
+      goto free_stuff;
+   }
+
+   if (! vk_memory_init (&objs.memory,
+                         &vk,
+                         objs.physical_device,
+                         objs.device,
+                         allocator,
+                         0)) {
+      goto free_stuff;
+   }
+
+   VkCommandPoolCreateInfo cmd_pool_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = 0,
+      .queueFamilyIndex = objs.queue_family_index,
+   };
+   if (vk.CreateCommandPool (objs.device,
+                             &cmd_pool_info,
+                             allocator,
+                             &objs.cmd_pool) != VK_SUCCESS) {
+      printf ("Error: Failed to create a command pool\n");
+      goto free_stuff;
+   }
+
+   VkFenceCreateInfo fence_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+      .flags = 0,
+   };
+   if (vk.CreateFence (objs.device,
+                       &fence_info,
+                       allocator,
+                       &objs.fence) != VK_SUCCESS) {
+      printf ("Error: Failed to create a fence\n");
+      goto free_stuff;
+   }
+
+   VkDeviceSize size = (VkDeviceSize) n * sizeof (float);
+   if (! create_buffer (&objs, &objs.x, size)
+       || ! create_buffer (&objs, &objs.y, size)) {
+      goto free_stuff;
+   }
+   printf ("Storage buffers created in memory type %u (%s)\n",
+           objs.x.memory.type_index,
+           vk_memory_is_coherent (&objs.memory, &objs.x.memory) ?
+           "coherent" : "not coherent");
+
+   if (! create_pipeline (&objs)
+       || ! create_descriptor_set (&objs)
+       || ! record_command_buffer (&objs, n)) {
+      goto free_stuff;
+   }
+
+   vk_pipeline_cache_print_stats (&objs.pipeline_cache);
+   vk_memory_print_stats (&objs.memory);
+
+   printf ("\n");
+   ok = run_saxpy (&objs, n, iterations);
+
+ free_stuff:
+   destroy_objects (&objs);
+
+   printf ("\n");
+   vk_allocator_print_stats (&host_allocator);
+   vk_allocator_finish (&host_allocator);
+
+   return ok ? 0 : -1;
+}
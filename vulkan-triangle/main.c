@@ -6,6 +6,22 @@
  * This example shows a triangle rendered by Vulkan API on an X11 window. It
  * supports resizing the window, and toggling fullscreen mode (F-key).
  *
+ * Frames are recorded and submitted through a ring of 'frames in flight'
+ * (2 by default): the CPU records a frame while the GPU still renders the
+ * previous ones.
+ *
+ * The present mode follows a policy (-p): 'low-latency' (MAILBOX, else
+ * IMMEDIATE, which tears), 'vsync' (FIFO, the default) or 'adaptive'
+ * (FIFO_RELAXED, which tears only when a frame is late), falling back to
+ * FIFO, which is always supported. The number of swapchain images is
+ * chosen to match. On exit, the time from acquiring an image to presenting
+ * it, and from a key press to presenting the next frame, is reported for
+ * the mode in use; -c renders continuously rather than on changes only,
+ * so that the present mode paces the frames.
+ *
+ * Usage: vulkan-triangle [-f frames in flight]
+ *                        [-p low-latency|vsync|adaptive] [-c]
+ *
  * Tested on Linux 4.7, Mesa 12.0, Intel Haswell (gen7+).
  *
  * Authors:
@@ -20,6 +36,8 @@
  * LIABILITY TO THE AUTHORS FOR ANY CLAIM OR DAMAGE.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
 #include "common/wsi.h"
 #include <fcntl.h>
@@ -33,13 +51,33 @@
 
 /* 'VK_USE_PLATFORM_X_KHR' currently defined as flag in Makefile */
 #include <vulkan/vulkan.h>
+#include "common/now.h"
+#include "common/vk-allocator.h"
 #include "common/vk-api.h"
+#include "common/vk-pipeline-cache.h"
 
 #define WIDTH  640
 #define HEIGHT 480
 
+#define MAX_FRAMES_IN_FLIGHT 8
+#define DEFAULT_FRAMES_IN_FLIGHT 2
+
 static struct vk_api vk = { NULL, };
 static const VkAllocationCallbacks* allocator = VK_NULL_HANDLE;
+static struct vk_allocator host_allocator;
+
+/* What the CPU needs to record and submit a frame. The GPU owns them until
+ * the frame's fence is signaled, so they are reused 'num_frames' frames
+ * later, once that fence was waited for.
+ */
+struct vk_frame {
+   VkCommandBuffer cmd_buffer;
+   VkSemaphore image_available_semaphore;
+   VkFence fence;
+
+   /* the frame last submitted with these objects, counting from 1 */
+   uint64_t number;
+};
 
 struct vk_objects {
    VkPhysicalDevice physical_device;
@@ -49,32 +87,67 @@ struct vk_objects {
    VkQueue graphics_queue;
    VkCommandPool cmd_pool;
    VkPipelineShaderStageCreateInfo shader_stages[2];
+   struct vk_pipeline_cache pipeline_cache;
 
-   VkSemaphore image_available_semaphore;
-   VkSemaphore render_finished_semaphore;
+   uint32_t num_frames;
+   struct vk_frame frames[MAX_FRAMES_IN_FLIGHT];
+};
+
+enum present_policy {
+   PRESENT_POLICY_LOW_LATENCY,
+   PRESENT_POLICY_VSYNC,
+   PRESENT_POLICY_ADAPTIVE,
 };
 
 struct vk_config {
+   enum present_policy present_policy;
    VkSurfaceCapabilitiesKHR surface_caps;
    VkSurfaceFormatKHR surface_format;
    VkPresentModeKHR present_mode;
 };
 
 #define MAX_SWAPCHAIN_IMAGES 8
+#define MAX_RETIRED_SWAPCHAINS 4
 
-struct vk_state {
-   VkExtent2D surface_extent;
-
+/* A swapchain and the objects created for each of its images */
+struct vk_swapchain {
    VkSwapchainKHR swapchain;
-   VkSwapchainKHR previous_swapchain;
-   uint32_t swapchain_images_count;
+   uint32_t images_count;
    VkImageView image_views[MAX_SWAPCHAIN_IMAGES];
    VkFramebuffer framebuffers[MAX_SWAPCHAIN_IMAGES];
 
+   /* Per image rather than per frame: the presentation engine waits on
+    * them, and only re-acquiring the image tells that it is done with it.
+    */
+   VkSemaphore render_finished_semaphores[MAX_SWAPCHAIN_IMAGES];
+
+   /* once replaced, the number of frames submitted by then: the swapchain
+    * is destroyed when they all completed
+    */
+   uint64_t retired_frame;
+};
+
+struct vk_state {
+   VkExtent2D surface_extent;
+   /* the format the render pass and pipeline were created for */
+   VkFormat format;
+   /* acquire or present asked for a new swapchain */
+   bool out_of_date;
+
+   struct vk_swapchain swapchain;
+   struct vk_swapchain retired[MAX_RETIRED_SWAPCHAINS];
+   uint32_t retired_count;
+
+   /* the fence of the last frame rendered to each image, if any */
+   VkFence image_fences[MAX_SWAPCHAIN_IMAGES];
+
    VkRenderPass renderpass;
    VkPipelineLayout pipeline_layout;
    VkPipeline pipeline;
-   VkCommandBuffer cmd_buffers[MAX_SWAPCHAIN_IMAGES];
+
+   uint32_t frame_index;
+   uint64_t frames_submitted;
+   uint64_t frames_completed;
 };
 
 static struct vk_objects objs = {VK_NULL_HANDLE,};
@@ -84,6 +157,28 @@ static struct vk_state state = {0,};
 static bool running = false;
 static bool damaged = false;
 static bool expose = false;
+static bool continuous = false;
+
+struct latency_stats {
+   uint64_t count;
+   double total_ms;
+   double min_ms;
+   double max_ms;
+};
+
+/* Measured on the CPU: presenting only queues the image, when it's shown
+ * depends on the present mode and the compositor.
+ */
+static struct {
+   struct latency_stats acquire_to_present;
+   struct latency_stats input_to_present;
+
+   /* when the oldest key press not drawn yet happened, or 0 */
+   double input_ms;
+
+   double first_present_ms;
+   double last_present_ms;
+} latency = {{0,},};
 
 static bool
 recreate_swapchain (struct vk_objects* objs,
@@ -121,6 +216,212 @@ load_file (const char* filename, size_t* file_size)
    }
 }
 
+static void
+latency_stats_add (struct latency_stats* stats, double ms)
+{
+   if (stats->count == 0 || ms < stats->min_ms)
+      stats->min_ms = ms;
+   if (stats->count == 0 || ms > stats->max_ms)
+      stats->max_ms = ms;
+   stats->total_ms += ms;
+   stats->count++;
+}
+
+static void
+latency_stats_print (const char* name, const struct latency_stats* stats)
+{
+   if (stats->count == 0) {
+      printf ("   %-20s none measured\n", name);
+      return;
+   }
+
+   printf ("   %-20s %8.2f ms avg, %8.2f min, %8.2f max (%llu)\n",
+           name,
+           stats->total_ms / stats->count,
+           stats->min_ms,
+           stats->max_ms,
+           (unsigned long long) stats->count);
+}
+
+static const char*
+present_mode_name (VkPresentModeKHR mode)
+{
+   switch (mode) {
+   case VK_PRESENT_MODE_IMMEDIATE_KHR:
+      return "IMMEDIATE";
+   case VK_PRESENT_MODE_MAILBOX_KHR:
+      return "MAILBOX";
+   case VK_PRESENT_MODE_FIFO_KHR:
+      return "FIFO";
+   case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+      return "FIFO_RELAXED";
+   default:
+      return "unknown";
+   }
+}
+
+static const char*
+present_policy_name (enum present_policy policy)
+{
+   switch (policy) {
+   case PRESENT_POLICY_LOW_LATENCY:
+      return "low-latency";
+   case PRESENT_POLICY_ADAPTIVE:
+      return "adaptive";
+   case PRESENT_POLICY_VSYNC:
+   default:
+      return "vsync";
+   }
+}
+
+static bool
+choose_present_mode (VkPhysicalDevice physical_device,
+                     VkSurfaceKHR surface,
+                     enum present_policy policy,
+                     VkPresentModeKHR* present_mode)
+{
+   VkPresentModeKHR modes[16];
+   uint32_t modes_count = 16;
+   VkResult result =
+      vk.GetPhysicalDeviceSurfacePresentModesKHR (physical_device,
+                                                  surface,
+                                                  &modes_count,
+                                                  modes);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE)
+       || modes_count == 0) {
+      printf ("Error: No suitable present modes found\n");
+      return false;
+   }
+   printf ("Found %u present mode(s)\n", modes_count);
+
+   /* in order of preference */
+   VkPresentModeKHR wanted[2];
+   uint32_t wanted_count = 0;
+   switch (policy) {
+   case PRESENT_POLICY_LOW_LATENCY:
+      /* mailbox never tears, immediate does */
+      wanted[wanted_count++] = VK_PRESENT_MODE_MAILBOX_KHR;
+      wanted[wanted_count++] = VK_PRESENT_MODE_IMMEDIATE_KHR;
+      break;
+   case PRESENT_POLICY_ADAPTIVE:
+      wanted[wanted_count++] = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+      break;
+   case PRESENT_POLICY_VSYNC:
+      wanted[wanted_count++] = VK_PRESENT_MODE_FIFO_KHR;
+      break;
+   }
+
+   for (uint32_t i = 0; i < wanted_count; i++) {
+      for (uint32_t j = 0; j < modes_count; j++) {
+         if (modes[j] == wanted[i]) {
+            *present_mode = wanted[i];
+            printf ("Present mode: %s (%s)\n",
+                    present_mode_name (*present_mode),
+                    present_policy_name (policy));
+            return true;
+         }
+      }
+   }
+
+   /* the only mode every implementation must support */
+   *present_mode = VK_PRESENT_MODE_FIFO_KHR;
+   printf ("Present mode: FIFO, none for policy '%s' supported\n",
+           present_policy_name (policy));
+
+   return true;
+}
+
+/* Prefers 8-bit UNORM formats, which take the colors the fragment shader
+ * writes as they are.
+ */
+static bool
+choose_surface_format (VkPhysicalDevice physical_device,
+                       VkSurfaceKHR surface,
+                       VkSurfaceFormatKHR* surface_format)
+{
+   VkSurfaceFormatKHR formats[32];
+   uint32_t formats_count = 32;
+   VkResult result =
+      vk.GetPhysicalDeviceSurfaceFormatsKHR (physical_device,
+                                             surface,
+                                             &formats_count,
+                                             formats);
+   if ((result != VK_SUCCESS && result != VK_INCOMPLETE)
+       || formats_count == 0) {
+      printf ("Error: No suitable surface format found\n");
+      return false;
+   }
+   printf ("Found %u surface format(s)\n", formats_count);
+
+   /* a single undefined format means any */
+   if (formats_count == 1 && formats[0].format == VK_FORMAT_UNDEFINED) {
+      surface_format->format = VK_FORMAT_B8G8R8A8_UNORM;
+      surface_format->colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+      return true;
+   }
+
+   const VkFormat wanted[] = {
+      VK_FORMAT_B8G8R8A8_UNORM,
+      VK_FORMAT_R8G8B8A8_UNORM,
+   };
+   for (uint32_t i = 0; i < sizeof (wanted) / sizeof (wanted[0]); i++) {
+      for (uint32_t j = 0; j < formats_count; j++) {
+         if (formats[j].format == wanted[i]
+             && formats[j].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+            *surface_format = formats[j];
+            return true;
+         }
+      }
+   }
+
+   *surface_format = formats[0];
+
+   return true;
+}
+
+/* Mailbox needs an image displayed, one queued and one rendered to, so
+ * that rendering never waits. The other modes get as few images as
+ * possible, as every image queued for FIFO is a frame of latency.
+ */
+static uint32_t
+choose_image_count (const struct vk_config* config)
+{
+   const VkSurfaceCapabilitiesKHR* caps = &config->surface_caps;
+   uint32_t count = 2;
+
+   if (config->present_mode == VK_PRESENT_MODE_MAILBOX_KHR)
+      count = 3;
+   if (count < caps->minImageCount)
+      count = caps->minImageCount;
+   if (caps->maxImageCount > 0 && count > caps->maxImageCount)
+      count = caps->maxImageCount;
+   if (count > MAX_SWAPCHAIN_IMAGES)
+      count = MAX_SWAPCHAIN_IMAGES;
+
+   return count;
+}
+
+static void
+print_latency (const struct vk_config* config, const struct vk_state* state)
+{
+   printf ("\nPresent mode %s (%s), %u swapchain images, "
+           "%u frame(s) in flight:\n",
+           present_mode_name (config->present_mode),
+           present_policy_name (config->present_policy),
+           state->swapchain.images_count,
+           objs.num_frames);
+   latency_stats_print ("acquire-to-present", &latency.acquire_to_present);
+   latency_stats_print ("input-to-present", &latency.input_to_present);
+
+   uint64_t frames = latency.acquire_to_present.count;
+   double ms = latency.last_present_ms - latency.first_present_ms;
+   if (continuous && frames > 1 && ms > 0) {
+      printf ("   %-20s %8.2f\n",
+              "frames per second",
+              (frames - 1) * 1000.0 / ms);
+   }
+}
+
 static void
 ctrl_c_handler (int32_t dummy)
 {
@@ -219,28 +520,25 @@ create_pipeline (struct vk_objects* objs,
       .primitiveRestartEnable = VK_FALSE,
    };
 
-   /* viewport and scissors */
-   VkViewport viewport = {
-      .x = 0.0f,
-      .y = 0.0f,
-      .width = (float) state->surface_extent.width,
-      .height = (float) state->surface_extent.height,
-      .minDepth = 0.0f,
-      .maxDepth = 1.0f
-   };
-
-   VkRect2D scissor = {
-      .offset.x = 0,
-      .offset.y = 0,
-      .extent = state->surface_extent
-   };
-
+   /* viewport and scissors, set when recording, so that the pipeline
+    * survives resizes
+    */
    VkPipelineViewportStateCreateInfo viewport_state_info = {
       .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
       .viewportCount = 1,
-      .pViewports = &viewport,
+      .pViewports = NULL,
       .scissorCount = 1,
-      .pScissors = &scissor
+      .pScissors = NULL
+   };
+
+   VkDynamicState dynamic_states[] = {
+      VK_DYNAMIC_STATE_VIEWPORT,
+      VK_DYNAMIC_STATE_SCISSOR
+   };
+   VkPipelineDynamicStateCreateInfo dynamic_state_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+      .dynamicStateCount = 2,
+      .pDynamicStates = dynamic_states
    };
 
    /* configure rasterizer */
@@ -312,7 +610,7 @@ create_pipeline (struct vk_objects* objs,
    };
    if (vk.CreatePipelineLayout (objs->device,
                                 &pipeline_layout_info,
-                                NULL,
+                                allocator,
                                 &pipeline_layout) != VK_SUCCESS) {
       printf ("Error: Failed to create a pipeline layout\n");
       return false;
@@ -333,19 +631,17 @@ create_pipeline (struct vk_objects* objs,
       .pMultisampleState = &multisampling,
       .pDepthStencilState = NULL,
       .pColorBlendState = &color_blending_info,
-      .pDynamicState = NULL,
+      .pDynamicState = &dynamic_state_info,
       .layout = pipeline_layout,
       .renderPass = state->renderpass,
       .subpass = 0,
       .basePipelineHandle = VK_NULL_HANDLE,
       .basePipelineIndex = -1
    };
-   if (vk.CreateGraphicsPipelines (objs->device,
-                                   VK_NULL_HANDLE,
-                                   1,
-                                   &pipeline_info,
-                                   allocator,
-                                   &pipeline) != VK_SUCCESS) {
+   if (vk_pipeline_cache_create_graphics (&objs->pipeline_cache,
+                                          1,
+                                          &pipeline_info,
+                                          &pipeline) != VK_SUCCESS) {
       printf ("Error: Failed to create the graphics pipeline\n");
       return false;
    }
@@ -356,158 +652,221 @@ create_pipeline (struct vk_objects* objs,
 }
 
 static bool
-create_command_buffers (struct vk_objects* objs,
-                        struct vk_config* config,
-                        struct vk_state* state)
+create_frames (struct vk_objects* objs)
 {
    assert (objs->device != VK_NULL_HANDLE);
    assert (objs->cmd_pool != VK_NULL_HANDLE);
-   assert (state->renderpass != VK_NULL_HANDLE);
+   assert (objs->num_frames > 0 && objs->num_frames <= MAX_FRAMES_IN_FLIGHT);
 
-   /* create command buffers */
+   /* create command buffers, one per frame */
+   VkCommandBuffer cmd_buffers[MAX_FRAMES_IN_FLIGHT];
    VkCommandBufferAllocateInfo cmd_buffer_alloc_info = {
       .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
       .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-      .commandBufferCount = state->swapchain_images_count,
+      .commandBufferCount = objs->num_frames,
       .commandPool = objs->cmd_pool
    };
    if (vk.AllocateCommandBuffers (objs->device,
                                   &cmd_buffer_alloc_info,
-                                  state->cmd_buffers) != VK_SUCCESS) {
+                                  cmd_buffers) != VK_SUCCESS) {
       printf ("Error: Failed to allocate command buffers\n");
       return false;
    }
    printf ("Command buffers allocated\n");
 
-   /* start recording to command buffers */
-   for (uint32_t i = 0; i < state->swapchain_images_count; i++) {
-      assert (state->framebuffers[i] != VK_NULL_HANDLE);
+   VkSemaphoreCreateInfo semaphore_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
+   };
 
-      VkCommandBufferBeginInfo begin_info = {
-         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-         .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
-         .pInheritanceInfo = NULL
-      };
+   /* signaled, as no frame was submitted yet */
+   VkFenceCreateInfo fence_info = {
+      .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+      .flags = VK_FENCE_CREATE_SIGNALED_BIT
+   };
+
+   for (uint32_t i = 0; i < objs->num_frames; i++) {
+      struct vk_frame* frame = &objs->frames[i];
 
-      if (vk.BeginCommandBuffer (state->cmd_buffers[i],
-                                 &begin_info) != VK_SUCCESS) {
-         printf ("Error: Failed to begin recording of command buffer\n");
+      frame->cmd_buffer = cmd_buffers[i];
+      if (vk.CreateSemaphore (objs->device,
+                              &semaphore_info,
+                              allocator,
+                              &frame->image_available_semaphore) != VK_SUCCESS
+          || vk.CreateFence (objs->device,
+                             &fence_info,
+                             allocator,
+                             &frame->fence) != VK_SUCCESS) {
+         printf ("Error: Failed to create the semaphores and fences\n");
          return false;
       }
+   }
+   printf ("%u frames in flight created\n", objs->num_frames);
 
-      /* start a render pass */
-      VkClearValue clear_color = {{{0.01f, 0.01f, 0.01f, 1.0f}}};
-      VkOffset2D swapchain_offset = {0, 0};
-      VkRenderPassBeginInfo renderpass_begin_info = {
-         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-         .renderPass = state->renderpass,
-         .framebuffer = state->framebuffers[i],
-         .renderArea.offset = swapchain_offset,
-         .renderArea.extent = state->surface_extent,
-         .clearValueCount = 1,
-         .pClearValues = &clear_color
-      };
-      vk.CmdBeginRenderPass (state->cmd_buffers[i],
-                             &renderpass_begin_info,
-                             VK_SUBPASS_CONTENTS_INLINE);
+   return true;
+}
 
-      vk.CmdBindPipeline (state->cmd_buffers[i],
-                          VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          state->pipeline);
+static bool
+record_command_buffer (struct vk_state* state,
+                       VkCommandBuffer cmd_buffer,
+                       uint32_t image_index)
+{
+   assert (state->renderpass != VK_NULL_HANDLE);
+   assert (state->swapchain.framebuffers[image_index] != VK_NULL_HANDLE);
 
-      vk.CmdDraw (state->cmd_buffers[i], 3, 1, 0, 0);
+   VkCommandBufferBeginInfo begin_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+      .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+      .pInheritanceInfo = NULL
+   };
 
-      vk.CmdEndRenderPass (state->cmd_buffers[i]);
+   if (vk.BeginCommandBuffer (cmd_buffer, &begin_info) != VK_SUCCESS) {
+      printf ("Error: Failed to begin recording of command buffer\n");
+      return false;
+   }
 
-      vk.EndCommandBuffer (state->cmd_buffers[i]);
+   /* start a render pass */
+   VkClearValue clear_color = {{{0.01f, 0.01f, 0.01f, 1.0f}}};
+   VkOffset2D swapchain_offset = {0, 0};
+   VkRenderPassBeginInfo renderpass_begin_info = {
+      .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+      .renderPass = state->renderpass,
+      .framebuffer = state->swapchain.framebuffers[image_index],
+      .renderArea.offset = swapchain_offset,
+      .renderArea.extent = state->surface_extent,
+      .clearValueCount = 1,
+      .pClearValues = &clear_color
+   };
+   vk.CmdBeginRenderPass (cmd_buffer,
+                          &renderpass_begin_info,
+                          VK_SUBPASS_CONTENTS_INLINE);
+
+   vk.CmdBindPipeline (cmd_buffer,
+                       VK_PIPELINE_BIND_POINT_GRAPHICS,
+                       state->pipeline);
+
+   VkViewport viewport = {
+      .x = 0.0f,
+      .y = 0.0f,
+      .width = (float) state->surface_extent.width,
+      .height = (float) state->surface_extent.height,
+      .minDepth = 0.0f,
+      .maxDepth = 1.0f
+   };
+   vk.CmdSetViewport (cmd_buffer, 0, 1, &viewport);
+
+   VkRect2D scissor = {
+      .offset.x = 0,
+      .offset.y = 0,
+      .extent = state->surface_extent
+   };
+   vk.CmdSetScissor (cmd_buffer, 0, 1, &scissor);
+
+   vk.CmdDraw (cmd_buffer, 3, 1, 0, 0);
+
+   vk.CmdEndRenderPass (cmd_buffer);
+
+   if (vk.EndCommandBuffer (cmd_buffer) != VK_SUCCESS) {
+      printf ("Error: Failed to record the command buffer\n");
+      return false;
    }
-   printf ("Render pass commands recorded in buffer\n");
 
    return true;
 }
 
-static bool
-recreate_swapchain (struct vk_objects* objs,
-                    struct vk_config* config,
-                    struct vk_state* state)
+/* Takes note of the frames whose fence is signaled, without waiting. Fences
+ * signal in submission order, so all the frames up to the last one with a
+ * signaled fence completed.
+ */
+static void
+update_completed_frames (struct vk_objects* objs, struct vk_state* state)
 {
-   uint32_t width, height;
+   for (uint32_t i = 0; i < objs->num_frames; i++) {
+      struct vk_frame* frame = &objs->frames[i];
 
-   assert (objs->physical_device != VK_NULL_HANDLE);
-   assert (objs->device != VK_NULL_HANDLE);
-   assert (objs->surface != VK_NULL_HANDLE);
-
-   /* wait for all async ops on device */
-   vk.DeviceWaitIdle (objs->device);
+      if (frame->number > state->frames_completed
+          && vk.GetFenceStatus (objs->device, frame->fence) == VK_SUCCESS) {
+         state->frames_completed = frame->number;
+      }
+   }
+}
 
-   /* resolve swap image size */
-   VkSurfaceCapabilitiesKHR surface_caps;
-   vk.GetPhysicalDeviceSurfaceCapabilitiesKHR (objs->physical_device,
-                                               objs->surface,
-                                               &surface_caps);
-   config->surface_caps = surface_caps;
-   printf ("Surface's image count (min, max): (%u, %u)\n",
-           surface_caps.minImageCount,
-           surface_caps.maxImageCount);
-   printf ("Surface's current extent (width, height): (%u, %u)\n",
-           surface_caps.currentExtent.width,
-           surface_caps.currentExtent.height);
+static void
+destroy_swapchain (struct vk_objects* objs, struct vk_swapchain* swapchain)
+{
+   for (uint32_t i = 0; i < swapchain->images_count; i++) {
+      vk.DestroyFramebuffer (objs->device,
+                             swapchain->framebuffers[i],
+                             allocator);
+      vk.DestroyImageView (objs->device,
+                           swapchain->image_views[i],
+                           allocator);
+      vk.DestroySemaphore (objs->device,
+                           swapchain->render_finished_semaphores[i],
+                           allocator);
+   }
+   vk.DestroySwapchainKHR (objs->device, swapchain->swapchain, allocator);
 
-   width = surface_caps.currentExtent.width;
-   height = surface_caps.currentExtent.height;
+   memset (swapchain, 0x00, sizeof (struct vk_swapchain));
+}
 
-   state->surface_extent.width = width;
-   state->surface_extent.height = height;
+/* Destroys the retired swapchains no frame in flight renders to anymore. */
+static void
+release_retired_swapchains (struct vk_objects* objs, struct vk_state* state)
+{
+   uint32_t kept = 0;
 
-   /* destroy previous swapchain */
-   if (state->swapchain != VK_NULL_HANDLE) {
-      /* keep record of the previous swapchain to link it to the new one */
-      if (state->previous_swapchain != VK_NULL_HANDLE)
-         vk.DestroySwapchainKHR (objs->device,
-                                 state->previous_swapchain,
-                                 allocator);
-      state->previous_swapchain = state->swapchain;
+   update_completed_frames (objs, state);
 
-      state->swapchain = VK_NULL_HANDLE;
+   for (uint32_t i = 0; i < state->retired_count; i++) {
+      if (state->retired[i].retired_frame <= state->frames_completed) {
+         destroy_swapchain (objs, &state->retired[i]);
+         printf ("Retired swap chain destroyed\n");
+      } else {
+         state->retired[kept++] = state->retired[i];
+      }
    }
+   state->retired_count = kept;
+}
 
-   /* create a swapchain */
-   VkSwapchainKHR swapchain = VK_NULL_HANDLE;
-   VkExtent2D swapchain_extent = {width, height};
-
-   VkSwapchainCreateInfoKHR swapchain_info = {
-      .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-      .surface = objs->surface,
-      .minImageCount = config->surface_caps.minImageCount,
-      .imageFormat = config->surface_format.format,
-      .imageColorSpace = config->surface_format.colorSpace,
-      .imageExtent = swapchain_extent,
-      .imageArrayLayers = 1,
-      .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-      .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
-      .queueFamilyIndexCount = 0,
-      .pQueueFamilyIndices = NULL,
-      .preTransform = config->surface_caps.currentTransform,
-      .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-      .presentMode = config->present_mode,
-      .clipped = VK_TRUE,
-      .oldSwapchain = state->previous_swapchain
-   };
-
-   if (vk.CreateSwapchainKHR (objs->device,
-                              &swapchain_info,
-                              allocator,
-                              &swapchain) != VK_SUCCESS) {
-      printf ("Error: Failed to create a swap chain\n");
-      return false;
+/* Hands the current swapchain over to the retired ones, to be destroyed
+ * once the frames submitted so far completed, instead of waiting for them.
+ */
+static void
+retire_swapchain (struct vk_objects* objs, struct vk_state* state)
+{
+   release_retired_swapchains (objs, state);
+
+   /* resizing faster than frames complete: wait for them this once */
+   if (state->retired_count == MAX_RETIRED_SWAPCHAINS) {
+      for (uint32_t i = 0; i < objs->num_frames; i++) {
+         vk.WaitForFences (objs->device,
+                           1,
+                           &objs->frames[i].fence,
+                           VK_TRUE,
+                           UINT64_MAX);
+      }
+      release_retired_swapchains (objs, state);
+      assert (state->retired_count < MAX_RETIRED_SWAPCHAINS);
    }
-   state->swapchain = swapchain;
-   printf ("Swap chain created\n");
 
+   state->swapchain.retired_frame = state->frames_submitted;
+   state->retired[state->retired_count++] = state->swapchain;
+   memset (&state->swapchain, 0x00, sizeof (struct vk_swapchain));
+}
+
+/* Creates the image views, framebuffers and semaphores of the images of
+ * 'swapchain'.
+ */
+static bool
+create_swapchain_images (struct vk_objects* objs,
+                         struct vk_config* config,
+                         struct vk_state* state,
+                         struct vk_swapchain* swapchain)
+{
    /* get the images from the swap chain */
    uint32_t swapchain_images_count = 0;
    if (vk.GetSwapchainImagesKHR (objs->device,
-                                 state->swapchain,
+                                 swapchain->swapchain,
                                  &swapchain_images_count,
                                  NULL) != VK_SUCCESS) {
       printf ("Error: Failed to get the images from the swap chain\n");
@@ -518,29 +877,23 @@ recreate_swapchain (struct vk_objects* objs,
               swapchain_images_count);
       return false;
    }
-   uint32_t old_swapchain_images_count = state->swapchain_images_count;
-   state->swapchain_images_count = swapchain_images_count;
    printf ("%u images in the swap chain\n", swapchain_images_count);
 
    VkImage swapchain_images[MAX_SWAPCHAIN_IMAGES] = {VK_NULL_HANDLE,};
    vk.GetSwapchainImagesKHR (objs->device,
-                             state->swapchain,
+                             swapchain->swapchain,
                              &swapchain_images_count,
                              swapchain_images);
 
-   /* destroy previous image views */
-   for (uint32_t i = 0; i < old_swapchain_images_count; i++) {
-      if (state->image_views[i] != VK_NULL_HANDLE) {
-         vk.DestroyImageView (objs->device,
-                              state->image_views[i],
-                              allocator);
-         state->image_views[i] = VK_NULL_HANDLE;
-      }
-   }
+   /* set first, so that whatever was created is destroyed on failure */
+   swapchain->images_count = swapchain_images_count;
+
+   VkSemaphoreCreateInfo semaphore_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
+   };
 
-   /* create an image view for each swapchain image */
-   VkImageView image_views[8] = {VK_NULL_HANDLE,};
    for (uint32_t i = 0; i < swapchain_images_count; i++) {
+      /* create an image view for each swapchain image */
       VkImageViewCreateInfo image_view_info = {
          .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
          .image = swapchain_images[i],
@@ -557,39 +910,17 @@ recreate_swapchain (struct vk_objects* objs,
          .subresourceRange.layerCount = 1,
       };
 
-      image_views[i] = VK_NULL_HANDLE;
       if (vk.CreateImageView (objs->device,
                               &image_view_info,
                               allocator,
-                              &image_views[i]) != VK_SUCCESS) {
+                              &swapchain->image_views[i]) != VK_SUCCESS) {
          printf ("Error: Failed to create image view\n");
          return false;
       }
-      state->image_views[i] = image_views[i];
-   }
-   printf ("Image views created\n");
-
-   /* create a new renderpass */
-   if (state->renderpass != VK_NULL_HANDLE)
-      vk.DestroyRenderPass (objs->device, state->renderpass, allocator);
-   if (! create_renderpass (objs, config, state))
-      return false;
 
-   /* destroy any previous framebuffers */
-   for (uint32_t i = 0; i < old_swapchain_images_count; i++) {
-      if (state->framebuffers[i] != VK_NULL_HANDLE) {
-         vk.DestroyFramebuffer (objs->device,
-                                state->framebuffers[i],
-                                allocator);
-         state->framebuffers[i] = VK_NULL_HANDLE;
-      }
-   }
-
-   /* create framebuffers for each image view */
-   VkFramebuffer framebuffers[MAX_SWAPCHAIN_IMAGES] = {VK_NULL_HANDLE,};
-   for (uint32_t i = 0; i < swapchain_images_count; i++) {
+      /* and a framebuffer for each image view */
       VkImageView attachments[] = {
-         state->image_views[i]
+         swapchain->image_views[i]
       };
 
       VkFramebufferCreateInfo framebuffer_info = {
@@ -597,68 +928,210 @@ recreate_swapchain (struct vk_objects* objs,
          .renderPass = state->renderpass,
          .attachmentCount = 1,
          .pAttachments = attachments,
-         .width = swapchain_extent.width,
-         .height = swapchain_extent.height,
+         .width = state->surface_extent.width,
+         .height = state->surface_extent.height,
          .layers = 1
       };
 
       if (vk.CreateFramebuffer (objs->device,
                                 &framebuffer_info,
                                 allocator,
-                                &framebuffers[i]) != VK_SUCCESS) {
+                                &swapchain->framebuffers[i]) != VK_SUCCESS) {
          printf ("Error: Failed to create a framebuffer\n");
          return false;
       }
 
-      state->framebuffers[i] = framebuffers[i];
+      if (vk.CreateSemaphore (objs->device,
+                              &semaphore_info,
+                              allocator,
+                              &swapchain->render_finished_semaphores[i])
+          != VK_SUCCESS) {
+         printf ("Error: Failed to create semaphores\n");
+         return false;
+      }
+   }
+   printf ("Image views and framebuffers created\n");
+
+   /* no frame rendered to the new images yet */
+   for (uint32_t i = 0; i < MAX_SWAPCHAIN_IMAGES; i++)
+      state->image_fences[i] = VK_NULL_HANDLE;
+
+   return true;
+}
+
+/* Called on every expose event: does nothing unless the surface's extent
+ * or format changed, or acquire or present reported the swapchain out of
+ * date. The render pass and pipeline only depend on the format, as the
+ * viewport and scissor are dynamic state, so they survive resizes.
+ */
+static bool
+recreate_swapchain (struct vk_objects* objs,
+                    struct vk_config* config,
+                    struct vk_state* state)
+{
+   assert (objs->physical_device != VK_NULL_HANDLE);
+   assert (objs->device != VK_NULL_HANDLE);
+   assert (objs->surface != VK_NULL_HANDLE);
+
+   /* resolve swap image size */
+   VkSurfaceCapabilitiesKHR surface_caps;
+   vk.GetPhysicalDeviceSurfaceCapabilitiesKHR (objs->physical_device,
+                                               objs->surface,
+                                               &surface_caps);
+   config->surface_caps = surface_caps;
+
+   VkExtent2D extent = surface_caps.currentExtent;
+   bool format_changed = state->format != config->surface_format.format;
+
+   if (state->swapchain.swapchain != VK_NULL_HANDLE
+       && ! state->out_of_date
+       && ! format_changed
+       && extent.width == state->surface_extent.width
+       && extent.height == state->surface_extent.height) {
+      return true;
    }
-   printf ("Framebuffers created\n");
 
-   /* destroy any previous pipeline */
-   if (state->pipeline != VK_NULL_HANDLE)
+   printf ("Surface's image count (min, max): (%u, %u)\n",
+           surface_caps.minImageCount,
+           surface_caps.maxImageCount);
+   printf ("Surface's current extent (width, height): (%u, %u)\n",
+           extent.width,
+           extent.height);
+
+   state->surface_extent = extent;
+   state->out_of_date = false;
+
+   /* a new render pass and pipeline, only for a new format: the old ones
+    * must not be in use anymore, which is worth an idle device this once
+    */
+   if (format_changed) {
+      vk.DeviceWaitIdle (objs->device);
+
       vk.DestroyPipeline (objs->device, state->pipeline, allocator);
+      state->pipeline = VK_NULL_HANDLE;
+      vk.DestroyRenderPass (objs->device, state->renderpass, allocator);
+      state->renderpass = VK_NULL_HANDLE;
 
-   /* create a new pipeline */
-   if (! create_pipeline (objs, config, state))
-      return false;
+      if (! create_renderpass (objs, config, state)
+          || ! create_pipeline (objs, config, state)) {
+         return false;
+      }
+      state->format = config->surface_format.format;
+   }
+
+   /* replace the current swapchain, if any, which frames in flight may
+    * still render to
+    */
+   VkSwapchainKHR old_swapchain = state->swapchain.swapchain;
+   if (old_swapchain != VK_NULL_HANDLE)
+      retire_swapchain (objs, state);
 
-   /* free any previous command buffers */
-   vk.FreeCommandBuffers (objs->device,
-                          objs->cmd_pool,
-                          old_swapchain_images_count,
-                          state->cmd_buffers);
+   VkSwapchainCreateInfoKHR swapchain_info = {
+      .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+      .surface = objs->surface,
+      .minImageCount = choose_image_count (config),
+      .imageFormat = config->surface_format.format,
+      .imageColorSpace = config->surface_format.colorSpace,
+      .imageExtent = extent,
+      .imageArrayLayers = 1,
+      .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+      .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .queueFamilyIndexCount = 0,
+      .pQueueFamilyIndices = NULL,
+      .preTransform = config->surface_caps.currentTransform,
+      .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+      .presentMode = config->present_mode,
+      .clipped = VK_TRUE,
+      .oldSwapchain = old_swapchain
+   };
 
-   /* create new command buffers */
-   if (! create_command_buffers (objs, config, state))
+   if (vk.CreateSwapchainKHR (objs->device,
+                              &swapchain_info,
+                              allocator,
+                              &state->swapchain.swapchain) != VK_SUCCESS) {
+      printf ("Error: Failed to create a swap chain\n");
       return false;
+   }
+   printf ("Swap chain created\n");
 
-   return true;
+   return create_swapchain_images (objs, config, state, &state->swapchain);
 }
 
 static bool
 draw_frame (struct vk_objects* objs, struct vk_state* state)
 {
    VkResult result;
+   struct vk_frame* frame = &objs->frames[state->frame_index];
+
+   /* wait for the GPU to be done with the frame submitted 'num_frames'
+    * frames ago, which used the same command buffer, semaphore and fence
+    */
+   if (vk.WaitForFences (objs->device,
+                         1,
+                         &frame->fence,
+                         VK_TRUE,
+                         UINT64_MAX) != VK_SUCCESS) {
+      printf ("Error: Failed to wait for a frame's fence\n");
+      return false;
+   }
+   if (frame->number > state->frames_completed)
+      state->frames_completed = frame->number;
+
+   /* the swapchains replaced since may be done with */
+   if (state->retired_count > 0)
+      release_retired_swapchains (objs, state);
 
    /* acquire swapchain's next image */
+   double acquire_ms = now_ms ();
    uint32_t image_index;
    result = vk.AcquireNextImageKHR (objs->device,
-                                    state->swapchain,
-                                    1000000,
-                                    objs->image_available_semaphore,
+                                    state->swapchain.swapchain,
+                                    UINT64_MAX,
+                                    frame->image_available_semaphore,
                                     VK_NULL_HANDLE,
                                     &image_index);
-   if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+   if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+      state->out_of_date = true;
       expose = true;
       return true;
+   } else if (result == VK_SUBOPTIMAL_KHR) {
+      /* the image is acquired and the semaphore will be signaled anyway, so
+       * the frame goes on
+       */
+      state->out_of_date = true;
+      expose = true;
    } else if (result != VK_SUCCESS) {
       printf ("Error: Failed to acquire next image from swap chain\n");
       return false;
    }
 
+   /* the key presses so far are drawn by this frame */
+   double input_ms = latency.input_ms;
+   latency.input_ms = 0;
+
+   /* the image may still be rendered to by an older frame, when there are
+    * more frames in flight than images, or images are acquired out of order
+    */
+   VkFence image_fence = state->image_fences[image_index];
+   if (image_fence != VK_NULL_HANDLE && image_fence != frame->fence) {
+      vk.WaitForFences (objs->device,
+                        1,
+                        &image_fence,
+                        VK_TRUE,
+                        UINT64_MAX);
+   }
+   state->image_fences[image_index] = frame->fence;
+
+   /* record the frame, while the GPU may still render the previous ones */
+   vk.ResetCommandBuffer (frame->cmd_buffer, 0);
+   if (! record_command_buffer (state, frame->cmd_buffer, image_index))
+      return false;
+
    /* submit graphics queue */
-   VkSemaphore wait_semaphores[] = {objs->image_available_semaphore};
-   VkSemaphore signal_semaphores[] = {objs->render_finished_semaphore};
+   VkSemaphore wait_semaphores[] = {frame->image_available_semaphore};
+   VkSemaphore signal_semaphores[] = {
+      state->swapchain.render_finished_semaphores[image_index]
+   };
 
    VkPipelineStageFlags wait_stages[] =
       {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
@@ -669,21 +1142,26 @@ draw_frame (struct vk_objects* objs, struct vk_state* state)
       .pWaitSemaphores = wait_semaphores,
       .pWaitDstStageMask = wait_stages,
       .commandBufferCount = 1,
-      .pCommandBuffers = &state->cmd_buffers[image_index],
+      .pCommandBuffers = &frame->cmd_buffer,
       .signalSemaphoreCount = 1,
       .pSignalSemaphores = signal_semaphores
    };
 
+   /* reset only now that the frame is sure to be submitted */
+   vk.ResetFences (objs->device, 1, &frame->fence);
    if (vk.QueueSubmit (objs->graphics_queue,
                        1,
                        &submit_info,
-                       VK_NULL_HANDLE) != VK_SUCCESS) {
+                       frame->fence) != VK_SUCCESS) {
       printf ("Error: Failed to submit queue\n");
       return false;
    }
+   frame->number = ++state->frames_submitted;
+
+   state->frame_index = (state->frame_index + 1) % objs->num_frames;
 
    /* present the frame */
-   VkSwapchainKHR swapchains[] = {state->swapchain};
+   VkSwapchainKHR swapchains[] = {state->swapchain.swapchain};
    VkPresentInfoKHR present_info = {
       .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
       .waitSemaphoreCount = 1,
@@ -695,7 +1173,23 @@ draw_frame (struct vk_objects* objs, struct vk_state* state)
    };
 
    result =  vk.QueuePresentKHR (objs->graphics_queue, &present_info);
+
+   double present_ms = now_ms ();
+   if (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) {
+      latency_stats_add (&latency.acquire_to_present,
+                         present_ms - acquire_ms);
+      if (input_ms > 0) {
+         latency_stats_add (&latency.input_to_present,
+                            present_ms - input_ms);
+      }
+
+      if (latency.first_present_ms == 0)
+         latency.first_present_ms = present_ms;
+      latency.last_present_ms = present_ms;
+   }
+
    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+      state->out_of_date = true;
       expose = true;
       return true;
    } else if (result != VK_SUCCESS) {
@@ -703,7 +1197,8 @@ draw_frame (struct vk_objects* objs, struct vk_state* state)
       return false;
    }
 
-   printf ("Frame!\n");
+   if (! continuous)
+      printf ("Frame!\n");
 
    return true;
 }
@@ -715,12 +1210,57 @@ wsi_on_expose (void)
    damaged = true;
 }
 
+static void
+wsi_on_input (void)
+{
+   if (latency.input_ms == 0)
+      latency.input_ms = now_ms ();
+   damaged = true;
+}
+
 int32_t
 main (int32_t argc, char* argv[])
 {
+   objs.num_frames = DEFAULT_FRAMES_IN_FLIGHT;
+   config.present_policy = PRESENT_POLICY_VSYNC;
+
+   bool usage = false;
+   for (int32_t i = 1; i < argc && ! usage; i++) {
+      if (strcmp (argv[i], "-f") == 0 && i + 1 < argc) {
+         objs.num_frames = strtoul (argv[++i], NULL, 10);
+      } else if (strcmp (argv[i], "-p") == 0 && i + 1 < argc) {
+         const char* policy = argv[++i];
+         if (strcmp (policy, "low-latency") == 0)
+            config.present_policy = PRESENT_POLICY_LOW_LATENCY;
+         else if (strcmp (policy, "vsync") == 0)
+            config.present_policy = PRESENT_POLICY_VSYNC;
+         else if (strcmp (policy, "adaptive") == 0)
+            config.present_policy = PRESENT_POLICY_ADAPTIVE;
+         else
+            usage = true;
+      } else if (strcmp (argv[i], "-c") == 0) {
+         continuous = true;
+      } else {
+         usage = true;
+      }
+   }
+   if (usage) {
+      printf ("Usage: %s [-f frames in flight] "
+              "[-p low-latency|vsync|adaptive] [-c]\n",
+              argv[0]);
+      return -1;
+   }
+
+   if (objs.num_frames == 0 || objs.num_frames > MAX_FRAMES_IN_FLIGHT) {
+      printf ("Error: Frames in flight must be 1 to %u\n",
+              MAX_FRAMES_IN_FLIGHT);
+      return -1;
+   }
+
    /* XCB setup */
    /* ======================================================================= */
    wsi_init (NULL, WIDTH, HEIGHT, wsi_on_expose);
+   wsi_set_input_event (wsi_on_input);
 
    /* Vulkan setup */
    /* ======================================================================= */
@@ -754,8 +1294,12 @@ main (int32_t argc, char* argv[])
               ext_props[i].extensionName,
               ext_props[i].specVersion);
 
-   /* the memory allocation callbacks (default by now) */
-   allocator = VK_NULL_HANDLE;
+   /* the memory allocation callbacks, counting what the driver allocates
+    * per scope
+    */
+   if (! vk_allocator_init (&host_allocator, 0))
+      return -1;
+   allocator = &host_allocator.callbacks;
 
    /* Vulkan application info */
    VkApplicationInfo app_info = {
@@ -913,46 +1457,33 @@ main (int32_t argc, char* argv[])
    printf ("Logical device created\n");
 
    /* choose a surface format */
-   uint32_t surface_formats_count = 0;
-   vk.GetPhysicalDeviceSurfaceFormatsKHR (physical_device,
-                                          surface,
-                                          &surface_formats_count,
-                                          NULL);
-   printf ("Found %u surface format(s). Choosing first.\n", surface_formats_count);
-   if (surface_formats_count == 0) {
-      printf ("Error: No suitable surface format found\n");
+   if (! choose_surface_format (physical_device,
+                                surface,
+                                &config.surface_format)) {
       goto free_stuff;
    }
-   surface_formats_count = 1;
-   VkSurfaceFormatKHR surface_format;
-   vk.GetPhysicalDeviceSurfaceFormatsKHR (physical_device,
-                                          surface,
-                                          &surface_formats_count,
-                                          &surface_format);
-   config.surface_format = surface_format;
 
    /* choose a present mode */
-   uint32_t present_mode_count = 0;
-   vk.GetPhysicalDeviceSurfacePresentModesKHR (physical_device,
-                                               surface,
-                                               &present_mode_count,
-                                               NULL);
-   printf ("Found %u present mode(s). Choosing first.\n", present_mode_count);
-   if (present_mode_count == 0) {
-      printf ("Error: No suitable present modes found\n");
+   if (! choose_present_mode (physical_device,
+                              surface,
+                              config.present_policy,
+                              &config.present_mode)) {
       goto free_stuff;
    }
-   present_mode_count = 1;
-   VkPresentModeKHR present_mode;
-   vk.GetPhysicalDeviceSurfacePresentModesKHR (physical_device,
-                                               surface,
-                                               &present_mode_count,
-                                               &present_mode);
-   config.present_mode = present_mode;
 
    /* load device-dependent API entry points */
    vk_api_load_from_device (&vk, &device);
 
+   /* pipelines are built through a cache kept on disk across runs */
+   if (! vk_pipeline_cache_init (&objs.pipeline_cache,
+                                 &vk,
+                                 physical_device,
+                                 device,
+                                 allocator,
+                                 NULL)) {
+      goto free_stuff;
+   }
+
    /* create the vertex shader module */
    size_t shader_code_size;
    uint32_t* shader_code = load_file (CURRENT_DIR "/vert.spv",
@@ -1031,7 +1562,8 @@ main (int32_t argc, char* argv[])
    VkCommandPool cmd_pool = VK_NULL_HANDLE;;
    VkCommandPoolCreateInfo cmd_pool_info = {
       .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-      .flags = 0,
+      /* each frame re-records its command buffer */
+      .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
       .queueFamilyIndex = queue_family_index,
    };
    if (vk.CreateCommandPool (device,
@@ -1044,27 +1576,9 @@ main (int32_t argc, char* argv[])
    objs.cmd_pool = cmd_pool;
    printf ("Command pool created\n");
 
-   /* create semaphores */
-   VkSemaphore image_available_semaphore = VK_NULL_HANDLE;
-   VkSemaphore render_finished_semaphore = VK_NULL_HANDLE;
-
-   VkSemaphoreCreateInfo semaphore_info = {
-      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO  \
-   };
-   if (vk.CreateSemaphore (device,
-                           &semaphore_info,
-                           allocator,
-                           &image_available_semaphore) != VK_SUCCESS ||
-       vk.CreateSemaphore (device,
-                           &semaphore_info,
-                           allocator,
-                           &render_finished_semaphore) != VK_SUCCESS) {
-      printf ("Error: Failed to create semaphores\n");
+   /* create the frames in flight */
+   if (! create_frames (&objs))
       goto free_stuff;
-   }
-   objs.image_available_semaphore = image_available_semaphore;
-   objs.image_available_semaphore = image_available_semaphore;
-   printf ("Semaphores create\n");
 
    /* create the first swapchain */
    if (! recreate_swapchain (&objs, &config, &state)) {
@@ -1083,7 +1597,11 @@ main (int32_t argc, char* argv[])
    wsi_window_show ();
 
    while (running) {
-      if (! damaged && ! expose) {
+      if (continuous) {
+         if (! wsi_poll_for_events ())
+            break;
+         damaged = true;
+      } else if (! damaged && ! expose) {
          if (! wsi_wait_for_events ())
             break;
       }
@@ -1101,10 +1619,13 @@ main (int32_t argc, char* argv[])
          if (! draw_frame (&objs, &state))
             break;
          damaged = false;
+         vk_allocator_end_frame (&host_allocator);
       }
    }
    printf ("Main-loop ended\n");
 
+   print_latency (&config, &state);
+
  free_stuff:
    /* free all allocated objects, in the right order */
 
@@ -1121,19 +1642,25 @@ main (int32_t argc, char* argv[])
    vk.DestroyPipeline (device, state.pipeline, allocator);
    vk.DestroyPipelineLayout (device, state.pipeline_layout, allocator);
 
-   for (uint32_t i = 0; i < state.swapchain_images_count; i++)
-      vk.DestroyFramebuffer (device, state.framebuffers[i], allocator);
-
-   for (uint32_t i = 0; i < state.swapchain_images_count; i++)
-      vk.DestroyImageView (device, state.image_views[i], allocator);
+   /* the retired swapchains before the one that replaced them */
+   for (uint32_t i = 0; i < state.retired_count; i++)
+      destroy_swapchain (&objs, &state.retired[i]);
+   destroy_swapchain (&objs, &state.swapchain);
 
    vk.DestroyRenderPass (device, state.renderpass, allocator);
-   vk.DestroySwapchainKHR (device, state.previous_swapchain, allocator);
-   vk.DestroySwapchainKHR (device, state.swapchain, allocator);
+
+   if (objs.pipeline_cache.cache != VK_NULL_HANDLE) {
+      vk_pipeline_cache_print_stats (&objs.pipeline_cache);
+      vk_pipeline_cache_finish (&objs.pipeline_cache);
+   }
 
    /* destroy immutable objects */
-   vk.DestroySemaphore (device, image_available_semaphore, allocator);
-   vk.DestroySemaphore (device, render_finished_semaphore, allocator);
+   for (uint32_t i = 0; i < objs.num_frames; i++) {
+      vk.DestroySemaphore (device,
+                           objs.frames[i].image_available_semaphore,
+                           allocator);
+      vk.DestroyFence (device, objs.frames[i].fence, allocator);
+   }
    vk.DestroyCommandPool (device, cmd_pool, allocator);
    vk.DestroyShaderModule (device, vert_shader_module, allocator);
    vk.DestroyShaderModule (device, frag_shader_module, allocator);
@@ -1141,6 +1668,9 @@ main (int32_t argc, char* argv[])
    vk.DestroySurfaceKHR (instance, surface, allocator);
    vk.DestroyInstance (instance, allocator);
 
+   vk_allocator_print_stats (&host_allocator);
+   vk_allocator_finish (&host_allocator);
+
    /* teardown WSI */
    wsi_finish ();
 